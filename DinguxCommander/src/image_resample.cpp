@@ -0,0 +1,362 @@
+#include "image_resample.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// Largest block the equal block path averages, so sums fit 16 bits.
+constexpr std::uint32_t kMaxRunBlockPixels = 256;
+
+// Rounded division by multiplying by the reciprocal, exact for values under
+// 2^16 and counts up to 256.
+constexpr std::uint32_t kReciprocalShift = 24;
+
+std::uint32_t reciprocal(std::uint32_t count) {
+    return ((1u << kReciprocalShift) + count - 1) / count;
+}
+
+// Kernels over rows of 8 bit, 4 channel pixels.
+
+// Adds the sum of each run of runWidth pixels to sums, which stay within 16 bits.
+void sumPixelRunsScalar(const std::uint8_t *row, std::uint32_t runWidth, std::uint32_t numRuns, std::uint16_t *sums)
+{
+    for (std::uint32_t r = 0; r < numRuns; ++r) {
+        std::uint16_t *sum = sums + r * 4;
+        for (std::uint32_t i = 0; i < runWidth; ++i, row += 4)
+            for (int c = 0; c < 4; ++c) sum[c] += row[c];
+    }
+}
+
+void divideSumsScalar(const std::uint16_t *sums, std::uint32_t numValues, std::uint32_t count, std::uint8_t *out)
+{
+    const std::uint64_t recip = reciprocal(count);
+    for (std::uint32_t i = 0; i < numValues; ++i)
+        out[i] = ((sums[i] + count / 2) * recip) >> kReciprocalShift;
+}
+
+// Pixel x of out interpolates pixels x0[x] and x0[x] + 1 of row by
+// weight[x] / 256, scaled by 256.
+void interpolateRowScalar(const std::uint8_t *row, std::uint32_t rowWidth, const std::uint32_t *x0, const std::uint8_t *weight, std::uint32_t outWidth, std::uint16_t *out)
+{
+    for (std::uint32_t x = 0; x < outWidth; ++x, out += 4) {
+        const std::uint8_t *p0 = row + x0[x] * 4;
+        const std::uint8_t *p1 = x0[x] + 1 < rowWidth ? p0 + 4 : p0;
+        const std::uint32_t w1 = weight[x];
+        const std::uint32_t w0 = 256 - w1;
+        for (int c = 0; c < 4; ++c) out[c] = p0[c] * w0 + p1[c] * w1;
+    }
+}
+
+void blendRowsScalar(const std::uint16_t *top, const std::uint16_t *bottom, std::uint32_t numValues, std::uint8_t weight, std::uint8_t *out)
+{
+    const std::uint32_t w1 = weight;
+    const std::uint32_t w0 = 256 - w1;
+    for (std::uint32_t i = 0; i < numValues; ++i)
+        out[i] = (top[i] * w0 + bottom[i] * w1 + (1u << 15)) >> 16;
+}
+
+#ifdef __ARM_NEON
+
+inline uint8x8_t loadPixel(const std::uint8_t *p) {
+    std::uint32_t pixel;
+    std::memcpy(&pixel, p, sizeof(pixel));
+    return vreinterpret_u8_u32(vdup_n_u32(pixel));
+}
+
+// Adds the sum of each block of pixels, blockWidths[i] wide, to sums[i * 4 + channel].
+void sumPixelBlocks(const std::uint8_t *row, const std::uint32_t *blockWidths, std::uint32_t numBlocks, std::uint32_t *sums)
+{
+    for (std::uint32_t b = 0; b < numBlocks; ++b) {
+        uint32x4_t sum = vld1q_u32(sums + b * 4);
+        std::uint32_t remaining = blockWidths[b];
+        while (remaining >= 2) {
+            // Pixels are added in pairs, up to 256 to a 16 bit lane before spilling.
+            const std::uint32_t pairs = std::min(remaining / 2, 256u);
+            uint16x8_t pairSums = vdupq_n_u16(0);
+            for (std::uint32_t i = 0; i < pairs; ++i, row += 8)
+                pairSums = vaddw_u8(pairSums, vld1_u8(row));
+            sum = vaddw_u16(sum, vget_low_u16(pairSums));
+            sum = vaddw_u16(sum, vget_high_u16(pairSums));
+            remaining -= pairs * 2;
+        }
+        if (remaining) {
+            sum = vaddw_u16(sum, vget_low_u16(vmovl_u8(loadPixel(row))));
+            row += 4;
+        }
+        vst1q_u32(sums + b * 4, sum);
+    }
+}
+
+// Rows of 32 bit pixels are 4 byte aligned, so they're loaded as such to
+// deinterleave pixels.
+void sumPixelRuns(const std::uint8_t *row, std::uint32_t runWidth, std::uint32_t numRuns, std::uint16_t *sums)
+{
+    std::uint32_t r = 0;
+    if (runWidth == 1) {
+        for (; r + 4 <= numRuns; r += 4, row += 16) {
+            uint8x16_t pixels = vld1q_u8(row);
+            vst1q_u16(sums + r * 4, vaddw_u8(vld1q_u16(sums + r * 4), vget_low_u8(pixels)));
+            vst1q_u16(sums + r * 4 + 8, vaddw_u8(vld1q_u16(sums + r * 4 + 8), vget_high_u8(pixels)));
+        }
+    } else if (runWidth == 2) {
+        for (; r + 4 <= numRuns; r += 4, row += 32) {
+            uint32x4x2_t pixels = vld2q_u32(reinterpret_cast<const std::uint32_t *>(row));
+            uint8x16_t even = vreinterpretq_u8_u32(pixels.val[0]);
+            uint8x16_t odd = vreinterpretq_u8_u32(pixels.val[1]);
+            vst1q_u16(sums + r * 4, vaddq_u16(vld1q_u16(sums + r * 4), vaddl_u8(vget_low_u8(even), vget_low_u8(odd))));
+            vst1q_u16(sums + r * 4 + 8, vaddq_u16(vld1q_u16(sums + r * 4 + 8), vaddl_u8(vget_high_u8(even), vget_high_u8(odd))));
+        }
+    } else if (runWidth == 4) {
+        for (; r + 4 <= numRuns; r += 4, row += 64) {
+            uint32x4x4_t pixels = vld4q_u32(reinterpret_cast<const std::uint32_t *>(row));
+            uint8x16_t p0 = vreinterpretq_u8_u32(pixels.val[0]);
+            uint8x16_t p1 = vreinterpretq_u8_u32(pixels.val[1]);
+            uint8x16_t p2 = vreinterpretq_u8_u32(pixels.val[2]);
+            uint8x16_t p3 = vreinterpretq_u8_u32(pixels.val[3]);
+            uint16x8_t low = vaddq_u16(vaddl_u8(vget_low_u8(p0), vget_low_u8(p1)), vaddl_u8(vget_low_u8(p2), vget_low_u8(p3)));
+            uint16x8_t high = vaddq_u16(vaddl_u8(vget_high_u8(p0), vget_high_u8(p1)), vaddl_u8(vget_high_u8(p2), vget_high_u8(p3)));
+            vst1q_u16(sums + r * 4, vaddq_u16(vld1q_u16(sums + r * 4), low));
+            vst1q_u16(sums + r * 4 + 8, vaddq_u16(vld1q_u16(sums + r * 4 + 8), high));
+        }
+    } else {
+        // Pairs of pixels, folded together once the run is summed.
+        for (; r < numRuns; ++r) {
+            uint16x8_t pairSums = vdupq_n_u16(0);
+            std::uint32_t i = 0;
+            for (; i + 2 <= runWidth; i += 2, row += 8)
+                pairSums = vaddw_u8(pairSums, vld1_u8(row));
+            if (i < runWidth) {
+                pairSums = vaddw_u8(pairSums, vreinterpret_u8_u64(vshl_n_u64(vreinterpret_u64_u8(loadPixel(row)), 32)));
+                row += 4;
+            }
+            uint16x4_t runSum = vadd_u16(vget_low_u16(pairSums), vget_high_u16(pairSums));
+            vst1_u16(sums + r * 4, vadd_u16(vld1_u16(sums + r * 4), runSum));
+        }
+    }
+    sumPixelRunsScalar(row, runWidth, numRuns - r, sums + r * 4);
+}
+
+void divideSums(const std::uint16_t *sums, std::uint32_t numValues, std::uint32_t count, std::uint8_t *out)
+{
+    const uint32x2_t recip = vdup_n_u32(reciprocal(count));
+    const uint32x4_t half = vdupq_n_u32(count / 2);
+    std::uint32_t i = 0;
+    for (; i + 8 <= numValues; i += 8) {
+        uint16x8_t values = vld1q_u16(sums + i);
+        uint32x4_t low = vaddw_u16(half, vget_low_u16(values));
+        uint32x4_t high = vaddw_u16(half, vget_high_u16(values));
+        uint32x4_t lowQuotient = vcombine_u32(
+            vshrn_n_u64(vmull_u32(vget_low_u32(low), recip), kReciprocalShift),
+            vshrn_n_u64(vmull_u32(vget_high_u32(low), recip), kReciprocalShift));
+        uint32x4_t highQuotient = vcombine_u32(
+            vshrn_n_u64(vmull_u32(vget_low_u32(high), recip), kReciprocalShift),
+            vshrn_n_u64(vmull_u32(vget_high_u32(high), recip), kReciprocalShift));
+        vst1_u8(out + i, vmovn_u16(vcombine_u16(vmovn_u32(lowQuotient), vmovn_u32(highQuotient))));
+    }
+    divideSumsScalar(sums + i, numValues - i, count, out + i);
+}
+
+void interpolateRow(const std::uint8_t *row, std::uint32_t rowWidth, const std::uint32_t *x0, const std::uint8_t *weight, std::uint32_t outWidth, std::uint16_t *out)
+{
+    // Both pixels come from one load, and are weighted in one multiply.
+    std::uint32_t x = 0;
+    for (; x < outWidth && x0[x] + 1 < rowWidth; ++x) {
+        uint16x8_t pixels = vmovl_u8(vld1_u8(row + x0[x] * 4));
+        uint16x8_t weights = vcombine_u16(vdup_n_u16(256 - weight[x]), vdup_n_u16(weight[x]));
+        uint16x8_t weighted = vmulq_u16(pixels, weights);
+        vst1_u16(out + x * 4, vadd_u16(vget_low_u16(weighted), vget_high_u16(weighted)));
+    }
+    // Positions only increase, so the rest are at the last pixel.
+    interpolateRowScalar(row, rowWidth, x0 + x, weight + x, outWidth - x, out + x * 4);
+}
+
+void blendRows(const std::uint16_t *top, const std::uint16_t *bottom, std::uint32_t numValues, std::uint8_t weight, std::uint8_t *out)
+{
+    const uint16x4_t w0 = vdup_n_u16(256 - weight);
+    const uint16x4_t w1 = vdup_n_u16(weight);
+    std::uint32_t i = 0;
+    for (; i + 8 <= numValues; i += 8) {
+        uint16x8_t t = vld1q_u16(top + i);
+        uint16x8_t b = vld1q_u16(bottom + i);
+        uint32x4_t low = vmlal_u16(vmull_u16(vget_low_u16(t), w0), vget_low_u16(b), w1);
+        uint32x4_t high = vmlal_u16(vmull_u16(vget_high_u16(t), w0), vget_high_u16(b), w1);
+        vst1_u8(out + i, vmovn_u16(vcombine_u16(vrshrn_n_u32(low, 16), vrshrn_n_u32(high, 16))));
+    }
+    blendRowsScalar(top + i, bottom + i, numValues - i, weight, out + i);
+}
+
+#else
+
+void sumPixelBlocks(const std::uint8_t *row, const std::uint32_t *blockWidths, std::uint32_t numBlocks, std::uint32_t *sums)
+{
+    for (std::uint32_t b = 0; b < numBlocks; ++b) {
+        std::uint32_t *sum = sums + b * 4;
+        for (std::uint32_t i = 0; i < blockWidths[b]; ++i, row += 4)
+            for (int c = 0; c < 4; ++c) sum[c] += row[c];
+    }
+}
+
+void sumPixelRuns(const std::uint8_t *row, std::uint32_t runWidth, std::uint32_t numRuns, std::uint16_t *sums)
+{
+    sumPixelRunsScalar(row, runWidth, numRuns, sums);
+}
+
+void divideSums(const std::uint16_t *sums, std::uint32_t numValues, std::uint32_t count, std::uint8_t *out)
+{
+    divideSumsScalar(sums, numValues, count, out);
+}
+
+void interpolateRow(const std::uint8_t *row, std::uint32_t rowWidth, const std::uint32_t *x0, const std::uint8_t *weight, std::uint32_t outWidth, std::uint16_t *out)
+{
+    interpolateRowScalar(row, rowWidth, x0, weight, outWidth, out);
+}
+
+void blendRows(const std::uint16_t *top, const std::uint16_t *bottom, std::uint32_t numValues, std::uint8_t weight, std::uint8_t *out)
+{
+    blendRowsScalar(top, bottom, numValues, weight, out);
+}
+
+#endif
+
+const std::uint8_t *rowAt(const SDL_Surface *surface, std::uint32_t y) {
+    return static_cast<const std::uint8_t *>(surface->pixels) + y * surface->pitch;
+}
+
+std::uint8_t *rowAt(SDL_Surface *surface, std::uint32_t y) {
+    return static_cast<std::uint8_t *>(surface->pixels) + y * surface->pitch;
+}
+
+void resampleEqualBlocks(const SDL_Surface *src, std::uint32_t blockW, std::uint32_t blockH, SDL_Surface *dst)
+{
+    const std::uint32_t w = dst->w;
+    std::vector<std::uint16_t> sums(w * 4);
+    for (int y = 0; y < dst->h; ++y) {
+        std::fill(sums.begin(), sums.end(), 0);
+        for (std::uint32_t i = 0; i < blockH; ++i)
+            sumPixelRuns(rowAt(src, y * blockH + i), blockW, w, sums.data());
+        divideSums(sums.data(), w * 4, blockW * blockH, rowAt(dst, y));
+    }
+}
+
+// Each source pixel goes to the destination pixel it falls in, which
+// averages all of its pixels.
+void resampleArea(const SDL_Surface *src, SDL_Surface *dst)
+{
+    const std::uint32_t srcW = src->w, srcH = src->h, w = dst->w, h = dst->h;
+    std::vector<std::uint32_t> srcColumns(w);
+    for (std::uint32_t x = 0; x < srcW; ++x)
+        ++srcColumns[static_cast<std::uint64_t>(x) * w / srcW];
+
+    std::vector<std::uint32_t> sums(w * 4);
+    std::uint32_t srcY = 0;
+    for (std::uint32_t y = 0; y < h; ++y) {
+        std::fill(sums.begin(), sums.end(), 0);
+        std::uint32_t srcRows = 0;
+        for (; srcY < srcH && static_cast<std::uint64_t>(srcY) * h / srcH == y; ++srcY, ++srcRows)
+            sumPixelBlocks(rowAt(src, srcY), srcColumns.data(), w, sums.data());
+
+        std::uint8_t *out = rowAt(dst, y);
+        for (std::uint32_t x = 0; x < w; ++x) {
+            const std::uint32_t count = srcColumns[x] * srcRows;
+            for (int c = 0; c < 4; ++c)
+                out[x * 4 + c] = (sums[x * 4 + c] + count / 2) / count;
+        }
+    }
+}
+
+// Source pixel before the centre of each destination pixel, and how far
+// towards the next one it is, in 256ths.
+void mapPositions(std::uint32_t srcSize, std::uint32_t dstSize, std::vector<std::uint32_t> &first, std::vector<std::uint8_t> &weight)
+{
+    first.resize(dstSize);
+    weight.resize(dstSize);
+    const std::int64_t maxPos = static_cast<std::int64_t>(srcSize - 1) * 256;
+    for (std::uint32_t i = 0; i < dstSize; ++i) {
+        std::int64_t pos = (static_cast<std::int64_t>(2 * i + 1) * srcSize * 256) / (2 * dstSize) - 128;
+        pos = std::max<std::int64_t>(0, std::min(pos, maxPos));
+        first[i] = pos >> 8;
+        weight[i] = pos & 0xff;
+    }
+}
+
+void resampleBilinear(const SDL_Surface *src, SDL_Surface *dst)
+{
+    const std::uint32_t srcW = src->w, srcH = src->h, w = dst->w, h = dst->h;
+    std::vector<std::uint32_t> x0, y0;
+    std::vector<std::uint8_t> xWeight, yWeight;
+    mapPositions(srcW, w, x0, xWeight);
+    mapPositions(srcH, h, y0, yWeight);
+
+    // Consecutive source rows, interpolated across, go to alternate slots.
+    std::vector<std::uint16_t> rows[2] = { std::vector<std::uint16_t>(w * 4), std::vector<std::uint16_t>(w * 4) };
+    std::int64_t rowY[2] = { -1, -1 };
+    auto interpolatedRow = [&](std::uint32_t srcY) {
+        const std::uint32_t slot = srcY & 1;
+        if (rowY[slot] != srcY) {
+            interpolateRow(rowAt(src, srcY), srcW, x0.data(), xWeight.data(), w, rows[slot].data());
+            rowY[slot] = srcY;
+        }
+        return rows[slot].data();
+    };
+
+    for (std::uint32_t y = 0; y < h; ++y) {
+        const std::uint16_t *top = interpolatedRow(y0[y]);
+        const std::uint16_t *bottom = interpolatedRow(std::min(y0[y] + 1, srcH - 1));
+        blendRows(top, bottom, w * 4, yWeight[y], rowAt(dst, y));
+    }
+}
+
+SDL_Surface *createRGBASurface(int width, int height) {
+    return SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, 32,
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+        0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000
+#else
+        0xff000000, 0x00ff0000, 0x0000ff00, 0x000000ff
+#endif
+    );
+}
+
+} // namespace
+
+namespace SDL_utils {
+
+SDLSurfaceUniquePtr resampleSurface(SDL_Surface *src, int width, int height)
+{
+    if (width <= 0 || height <= 0 || src->w <= 0 || src->h <= 0) return nullptr;
+
+    // Other formats are converted to 32 bit first, as zoomSurface does.
+    SDLSurfaceUniquePtr converted;
+    if (src->format->BitsPerPixel != 32) {
+        converted.reset(createRGBASurface(src->w, src->h));
+        if (converted == nullptr) return nullptr;
+        SDL_BlitSurface(src, nullptr, converted.get(), nullptr);
+        src = converted.get();
+    }
+
+    SDLSurfaceUniquePtr dst { SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, 32,
+        src->format->Rmask, src->format->Gmask, src->format->Bmask, src->format->Amask) };
+    if (dst == nullptr) return nullptr;
+    if (SDL_MUSTLOCK(src) && SDL_LockSurface(src) != 0) return nullptr;
+
+    const std::uint32_t srcW = src->w, srcH = src->h, w = width, h = height;
+    const std::uint32_t blockW = srcW / w, blockH = srcH / h;
+    if (srcW % w == 0 && srcH % h == 0 && blockW * blockH <= kMaxRunBlockPixels) {
+        resampleEqualBlocks(src, blockW, blockH, dst.get());
+    } else if (w <= srcW && h <= srcH && (w * 2 <= srcW || h * 2 <= srcH)) {
+        resampleArea(src, dst.get());
+    } else {
+        resampleBilinear(src, dst.get());
+    }
+
+    if (SDL_MUSTLOCK(src)) SDL_UnlockSurface(src);
+    return dst;
+}
+
+} // namespace SDL_utils
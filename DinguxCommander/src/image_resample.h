@@ -0,0 +1,18 @@
+#ifndef IMAGE_RESAMPLE_H_
+#define IMAGE_RESAMPLE_H_
+
+#include <SDL.h>
+
+#include "sdl_ptrs.h"
+
+namespace SDL_utils
+{
+    // Scale a surface to width x height, using NEON where available.
+    // Exact reductions average equal blocks of pixels, other reductions of
+    // half or more average the block each pixel covers, and anything else is
+    // bilinear. The result is 32 bit RGBA, like zoomSurface's; other source
+    // formats are converted first.
+    SDLSurfaceUniquePtr resampleSurface(SDL_Surface *src, int width, int height);
+}
+
+#endif // IMAGE_RESAMPLE_H_
@@ -4,9 +4,9 @@
 #include <iostream>
 
 #include <SDL_image.h>
-#include "SDL_rotozoom.h"
 #include "def.h"
 #include "fileutils.h"
+#include "image_resample.h"
 #include "resourceManager.h"
 #include "screen.h"
 #include "sdl_ttf_multifont.h"
@@ -42,12 +42,14 @@ SDLSurfaceUniquePtr loadImageToFit(
         target_h = std::min(l_img->h, fit_h);
         target_w = target_h * aspect_ratio;
     }
-    target_w *= screen.ppu_x;
-    target_h *= screen.ppu_y;
-    SDLSurfaceUniquePtr l_img2 { zoomSurface(l_img,
-        static_cast<double>(target_w) / l_img->w,
-        static_cast<double>(target_h) / l_img->h, SMOOTHING_ON) };
+    target_w = std::max(1, static_cast<int>(target_w * screen.ppu_x));
+    target_h = std::max(1, static_cast<int>(target_h * screen.ppu_y));
+    SDLSurfaceUniquePtr l_img2 = resampleSurface(l_img, target_w, target_h);
     SDL_FreeSurface(l_img);
+    if (l_img2 == nullptr) {
+        std::cerr << "loadImageToFit: " << SDL_GetError() << std::endl;
+        return nullptr;
+    }
 
     const std::string ext = File_utils::getLowercaseFileExtension(p_filename);
     const bool supports_alpha = ext != "xcf" && ext != "jpg" && ext != "jpeg";
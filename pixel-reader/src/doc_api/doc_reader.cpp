@@ -14,12 +14,39 @@ public:
     void write(const std::string &, const std::string &, const std::string &) override
     {
     }
+
+    std::experimental::optional<std::string> read_blob(const std::string &, const std::string &) const override
+    {
+        return {};
+    }
+
+    void write_blob(const std::string &, const std::string &, const std::string &) override
+    {
+    }
+
+    std::vector<std::string> blob_keys(const std::string &) const override
+    {
+        return {};
+    }
+
+    void remove_blob(const std::string &, const std::string &) override
+    {
+    }
 };
 
 } // namespace
 
 bool DocReader::open()
 {
-    NullCache cache;
+    static NullCache cache;
     return open(cache);
 }
+
+uint64_t DocReader::cache_size_bytes() const
+{
+    return 0;
+}
+
+void DocReader::set_cache_budget(uint64_t)
+{
+}
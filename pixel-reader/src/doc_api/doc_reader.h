@@ -1,6 +1,7 @@
 #ifndef DOC_READER_H_
 #define DOC_READER_H_
 
+#include "./resource_buffer.h"
 #include "./token_iter.h"
 
 #include <experimental/filesystem>
@@ -21,12 +22,21 @@ struct TocPosition
     uint32_t progress_percent;
 };
 
-// Allow readers to cache arbitrary data
+// Allow readers to cache arbitrary data. Readers may keep writing to the
+// cache after open() (e.g. from background indexing threads), so the cache
+// must be thread safe and outlive the reader.
 class DocReaderCache
 {
 public:
     virtual std::experimental::optional<std::string> read(const std::string &book_id, const std::string &key) const = 0;
     virtual void write(const std::string &book_id, const std::string &key, const std::string &value) = 0;
+
+    // Large binary values, stored separately from the small values above so
+    // each is only loaded when asked for.
+    virtual std::experimental::optional<std::string> read_blob(const std::string &book_id, const std::string &key) const = 0;
+    virtual void write_blob(const std::string &book_id, const std::string &key, const std::string &value) = 0;
+    virtual std::vector<std::string> blob_keys(const std::string &book_id) const = 0;
+    virtual void remove_blob(const std::string &book_id, const std::string &key) = 0;
 };
 
 // Interface for interacting with a particular document format.
@@ -49,7 +59,12 @@ public:
 
     virtual std::shared_ptr<TokenIter> get_iter(DocAddr address = 0) const = 0;
 
-    virtual std::vector<char> load_resource(const std::experimental::filesystem::path &path) const = 0;
+    virtual ResourceBuffer load_resource(const std::experimental::filesystem::path &path) const = 0;
+
+    // Memory held by parsed content, and a budget to keep it within. Formats
+    // that hold nothing beyond what's open ignore the budget.
+    virtual uint64_t cache_size_bytes() const;
+    virtual void set_cache_budget(uint64_t size_bytes);
 };
 
 #endif
@@ -1,25 +1,30 @@
 #include "./doc_token.h"
 
-DocToken::DocToken(TokenType type, DocAddr address)
-    : type(type), address(address)
+DocToken::DocToken(TokenType type, DocAddr address, std::string_view text, int nest_level)
+    : type(type), address(address), text(text), nest_level(nest_level)
 {
 }
 
 bool DocToken::operator==(const DocToken &other) const
 {
-    return type == other.type && address == other.address;
+    return (
+        type == other.type &&
+        address == other.address &&
+        text == other.text &&
+        nest_level == other.nest_level
+    );
 }
 
-std::string DocToken::common_to_string(std::string data) const
+std::string DocToken::to_string() const
 {
     return (
         "[DocToken "
         "address=" + ::to_string(address) + ", "
         "type=" + ::to_string(type) +
         (
-            data.empty()
+            text.empty()
             ? ""
-            : ", data=\"" + data + "\""
+            : ", data=\"" + std::string(text) + "\""
         ) +
         "]"
     );
@@ -27,90 +32,24 @@ std::string DocToken::common_to_string(std::string data) const
 
 ////////////////////////
 
-HeaderDocToken::HeaderDocToken(DocAddr address, const std::string &text)
-    : DocToken(TokenType::Header, address), text(text)
-{
-}
-
-bool HeaderDocToken::operator==(const DocToken &other) const
-{
-    if (!DocToken::operator==(other))
-    {
-        return false;
-    }
-    const HeaderDocToken &other_header = static_cast<const HeaderDocToken &>(other);
-    return text == other_header.text;
-}
-
-std::string HeaderDocToken::to_string() const
-{
-    return common_to_string(text);
-}
-
-////////////////////////
-
-TextDocToken::TextDocToken(DocAddr address, const std::string &text)
-    : DocToken(TokenType::Text, address), text(text)
-{
-}
-
-bool TextDocToken::operator==(const DocToken &other) const
-{
-    if (!DocToken::operator==(other))
-    {
-        return false;
-    }
-    const TextDocToken &other_text = static_cast<const TextDocToken &>(other);
-    return text == other_text.text;
-}
-
-std::string TextDocToken::to_string() const
-{
-    return common_to_string(text);
-}
-
-////////////////////////
-
-ImageDocToken::ImageDocToken(DocAddr address, const std::experimental::filesystem::path &path)
-    : DocToken(TokenType::Image, address), path(path)
-{
-}
-
-bool ImageDocToken::operator==(const DocToken &other) const
-{
-    if (!DocToken::operator==(other))
-    {
-        return false;
-    }
-    const ImageDocToken &other_image = static_cast<const ImageDocToken &>(other);
-    return path == other_image.path;
-}
-
-std::string ImageDocToken::to_string() const
+TextDocToken::TextDocToken(DocAddr address, std::string_view text)
+    : DocToken(TokenType::Text, address, text)
 {
-    return common_to_string(path);
 }
 
-////////////////////////
-
-ListItemDocToken::ListItemDocToken(DocAddr address, const std::string &text, int nest_level)
-    : DocToken(TokenType::ListItem, address), text(text), nest_level(nest_level)
+HeaderDocToken::HeaderDocToken(DocAddr address, std::string_view text)
+    : DocToken(TokenType::Header, address, text)
 {
 }
 
-bool ListItemDocToken::operator==(const DocToken &other) const
+ImageDocToken::ImageDocToken(DocAddr address, std::string_view path)
+    : DocToken(TokenType::Image, address, path)
 {
-    if (!DocToken::operator==(other))
-    {
-        return false;
-    }
-    const ListItemDocToken &other_list_item = static_cast<const ListItemDocToken &>(other);
-    return text == other_list_item.text && nest_level == other_list_item.nest_level;
 }
 
-std::string ListItemDocToken::to_string() const
+ListItemDocToken::ListItemDocToken(DocAddr address, std::string_view text, int nest_level)
+    : DocToken(TokenType::ListItem, address, text, nest_level)
 {
-    return common_to_string(text);
 }
 
 ////////////////////////
@@ -3,10 +3,10 @@
 
 #include "./doc_addr.h"
 
-#include <experimental/filesystem>
 #include <string>
+#include <string_view>
 
-enum class TokenType
+enum class TokenType : uint8_t
 {
     Text,
     Header,
@@ -14,54 +14,42 @@ enum class TokenType
     ListItem,
 };
 
+// Lightweight view of a token. Text is owned by the token's storage (see
+// TokenTable), so a view is only valid while that storage holds it.
 struct DocToken
 {
     TokenType type;
     DocAddr address;
+    // Text of text, header and list item tokens, or path of image tokens
+    std::string_view text;
+    // List items only
+    int nest_level;
 
-    DocToken(TokenType type, DocAddr address);
-    virtual bool operator==(const DocToken &other) const;
-    virtual std::string to_string() const = 0;
-
-protected:
-    std::string common_to_string(std::string data) const;
+    DocToken(TokenType type = TokenType::Text, DocAddr address = 0, std::string_view text = {}, int nest_level = 0);
+    bool operator==(const DocToken &other) const;
+    std::string to_string() const;
 };
 
+// Convenience constructors for each token type
+
 struct TextDocToken : public DocToken
 {
-    std::string text;
-
-    TextDocToken(DocAddr address, const std::string &text);
-    bool operator==(const DocToken &other) const override;
-    std::string to_string() const override;
+    TextDocToken(DocAddr address, std::string_view text);
 };
 
 struct HeaderDocToken : public DocToken
 {
-    std::string text;
-
-    HeaderDocToken(DocAddr address, const std::string &text);
-    bool operator==(const DocToken &other) const override;
-    std::string to_string() const override;
+    HeaderDocToken(DocAddr address, std::string_view text);
 };
 
 struct ImageDocToken : public DocToken
 {
-    std::experimental::filesystem::path path;
-
-    ImageDocToken(DocAddr address, const std::experimental::filesystem::path &path);
-    bool operator==(const DocToken &other) const override;
-    std::string to_string() const override;
+    ImageDocToken(DocAddr address, std::string_view path);
 };
 
 struct ListItemDocToken : public DocToken
 {
-    std::string text;
-    int nest_level;
-
-    ListItemDocToken(DocAddr address, const std::string &text, int nest_level);
-    bool operator==(const DocToken &other) const override;
-    std::string to_string() const override;
+    ListItemDocToken(DocAddr address, std::string_view text, int nest_level);
 };
 
 std::string to_string(TokenType type);
@@ -0,0 +1,28 @@
+#include "./resource_buffer.h"
+
+ResourceBuffer::ResourceBuffer(std::vector<char> buffer)
+    : buffer(std::move(buffer))
+{
+    _data = this->buffer.data();
+    _size = this->buffer.size();
+}
+
+ResourceBuffer::ResourceBuffer(std::shared_ptr<const void> owner, const char *data, size_t size)
+    : owner(std::move(owner)), _data(data), _size(size)
+{
+}
+
+const char *ResourceBuffer::data() const
+{
+    return _data;
+}
+
+size_t ResourceBuffer::size() const
+{
+    return _size;
+}
+
+bool ResourceBuffer::empty() const
+{
+    return _size == 0;
+}
@@ -0,0 +1,33 @@
+#ifndef RESOURCE_BUFFER_H_
+#define RESOURCE_BUFFER_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Contents of a resource loaded by a DocReader. Either holds its own copy of
+// the data, or keeps alive whatever the data points into (e.g. a mapping of
+// the document file), so resources can be used without copying.
+class ResourceBuffer
+{
+    std::vector<char> buffer;
+    std::shared_ptr<const void> owner;
+    const char *_data = nullptr;
+    size_t _size = 0;
+
+public:
+    ResourceBuffer() = default;
+    ResourceBuffer(std::vector<char> buffer);
+    ResourceBuffer(std::shared_ptr<const void> owner, const char *data, size_t size);
+
+    ResourceBuffer(ResourceBuffer &&) = default;
+    ResourceBuffer &operator=(ResourceBuffer &&) = default;
+    ResourceBuffer(const ResourceBuffer &) = delete;
+    ResourceBuffer &operator=(const ResourceBuffer &) = delete;
+
+    const char *data() const;
+    size_t size() const;
+    bool empty() const;
+};
+
+#endif
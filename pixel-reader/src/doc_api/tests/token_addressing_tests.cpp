@@ -9,3 +9,15 @@ TEST(TOKEN_ADDRESSING, get_address_width)
     EXPECT_EQ(get_address_width("asdf"), 4);
     EXPECT_EQ(get_address_width("\tasdf λv\n\r"), 6);
 }
+
+TEST(TOKEN_ADDRESSING, get_address_width_view)
+{
+    EXPECT_EQ(get_address_width(std::string_view()), 0);
+    EXPECT_EQ(get_address_width(TextDocToken(0, {})), 0);
+    EXPECT_EQ(get_address_width(std::string_view("asdf", 2)), 2);
+    EXPECT_EQ(get_address_width(std::string_view("\tasdf λv\n\r")), 6);
+
+    // Bounded by the view, not a terminator
+    const char *str = "ab λcd";
+    EXPECT_EQ(get_address_width(std::string_view(str, 5)), 3);
+}
@@ -0,0 +1,123 @@
+#include "../token_table.h"
+
+#include <gtest/gtest.h>
+
+TEST(TOKEN_TABLE, push_back_and_read)
+{
+    TokenTable tokens;
+    EXPECT_TRUE(tokens.empty());
+
+    tokens.push_back(TokenType::Header, 0, "Title");
+    tokens.push_back(TextDocToken(5, ""));
+    tokens.push_back(ImageDocToken(5, "images/cover.png"));
+    tokens.push_back(ListItemDocToken(6, "item", 2));
+
+    ASSERT_EQ(tokens.size(), 4);
+    EXPECT_EQ(tokens[0], HeaderDocToken(0, "Title"));
+    EXPECT_EQ(tokens[1], TextDocToken(5, ""));
+    EXPECT_EQ(tokens[2], ImageDocToken(5, "images/cover.png"));
+    EXPECT_EQ(tokens[3], ListItemDocToken(6, "item", 2));
+    EXPECT_EQ(tokens.back(), tokens[3]);
+
+    EXPECT_EQ(tokens.type(2), TokenType::Image);
+    EXPECT_EQ(tokens.address(3), 6);
+}
+
+TEST(TOKEN_TABLE, append)
+{
+    TokenTable a;
+    a.push_back(TextDocToken(0, "a0"));
+
+    TokenTable b;
+    b.push_back(TextDocToken(2, "b0"));
+    b.push_back(TextDocToken(4, "b1"));
+    b.push_back(TextDocToken(6, "b2"));
+
+    a.append(b, 1);
+    ASSERT_EQ(a.size(), 3);
+    EXPECT_EQ(a[0], TextDocToken(0, "a0"));
+    EXPECT_EQ(a[1], TextDocToken(4, "b1"));
+    EXPECT_EQ(a[2], TextDocToken(6, "b2"));
+
+    // Past the end is a no-op
+    a.append(b, 3);
+    EXPECT_EQ(a.size(), 3);
+}
+
+TEST(TOKEN_TABLE, clear)
+{
+    TokenTable tokens;
+    tokens.push_back(TextDocToken(0, "text"));
+    tokens.clear();
+    EXPECT_TRUE(tokens.empty());
+
+    tokens.push_back(TextDocToken(1, "more"));
+    ASSERT_EQ(tokens.size(), 1);
+    EXPECT_EQ(tokens[0], TextDocToken(1, "more"));
+}
+
+TEST(TOKEN_TABLE, seek_index)
+{
+    TokenTable tokens;
+    EXPECT_EQ(tokens.seek_index(5), 0);
+
+    tokens.push_back(TextDocToken(2, "ab"));
+    tokens.push_back(TextDocToken(4, ""));
+    tokens.push_back(TextDocToken(4, ""));
+    tokens.push_back(TextDocToken(4, "cdef"));
+    tokens.push_back(TextDocToken(8, "g"));
+
+    // Before the first token
+    EXPECT_EQ(tokens.seek_index(0), 0);
+    // Exact match
+    EXPECT_EQ(tokens.seek_index(2), 0);
+    EXPECT_EQ(tokens.seek_index(8), 4);
+    // Within a token
+    EXPECT_EQ(tokens.seek_index(3), 0);
+    EXPECT_EQ(tokens.seek_index(6), 3);
+    // First match among duplicates
+    EXPECT_EQ(tokens.seek_index(4), 1);
+    // Past the end
+    EXPECT_EQ(tokens.seek_index(100), 4);
+}
+
+TEST(TOKEN_TABLE, text_stays_in_place)
+{
+    TokenTable tokens;
+    tokens.push_back(TextDocToken(0, "first"));
+    std::string_view first = tokens[0].text;
+
+    // Enough text to fill several chunks, with a token larger than any
+    const std::string large(100 * 1024, 'x');
+    for (uint32_t i = 1; i < 1000; ++i)
+    {
+        tokens.push_back(TextDocToken(i, i == 500 ? large : std::string(i % 200, 'a' + i % 26)));
+    }
+    tokens.shrink_to_fit();
+
+    EXPECT_EQ(tokens[0].text.data(), first.data());
+    EXPECT_EQ(first, "first");
+    for (uint32_t i = 1; i < 1000; ++i)
+    {
+        ASSERT_EQ(tokens[i].text, i == 500 ? large : std::string(i % 200, 'a' + i % 26));
+    }
+}
+
+TEST(TOKEN_TABLE, reserve_fits_text_in_one_chunk)
+{
+    TokenTable a;
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        a.push_back(TextDocToken(i, std::string(100, 'a')));
+    }
+
+    TokenTable b;
+    b.reserve(a.size(), a.text_bytes());
+    b.append(a);
+    EXPECT_EQ(b.text_bytes(), a.text_bytes());
+    EXPECT_LT(b.size_bytes(), a.size_bytes());
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        ASSERT_EQ(b[i], a[i]);
+    }
+}
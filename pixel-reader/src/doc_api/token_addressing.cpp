@@ -1,19 +1,14 @@
 #include "./token_addressing.h"
-#include "util/str_utils.h"
-#include "util/utf8.h"
+#include "util/text_scan.h"
 
-namespace {
+#include <cstring>
+#include <stdexcept>
 
-// Determine if the character is counted in document text addressing.
-// Note: for address backwards compatibility, this function cannot change.
+// Every utf-8 character that isn't whitespace has a width of one.
+// Note: for address backwards compatibility, this cannot change. Any change to
+// is_whitespace, utf8_step or count_non_whitespace_chars changes addresses.
 // Also need to ensure any changes to xhtml whitespace compaction and
 // text-wrapping whitespace breaking are not altering the address calculations.
-inline bool char_has_width(char c)
-{
-    return !is_whitespace(c);
-}
-
-} // namespace
 
 uint32_t get_address_width(const char *str)
 {
@@ -21,18 +16,20 @@ uint32_t get_address_width(const char *str)
     {
         return 0;
     }
+    return count_non_whitespace_chars(str, strlen(str));
+}
 
-    uint32_t count = 0;
-    char c;
-    while ((c = *str))
+uint32_t get_address_width(std::string_view str)
+{
+    if (str.empty())
     {
-        if (char_has_width(c))
-        {
-            ++count;
-        }
-        str = utf8_step(str);
+        return 0;
     }
-    return count;
+
+    // Stops at a null, as above
+    const char *null_char = static_cast<const char*>(memchr(str.data(), '\0', str.size()));
+    size_t len = null_char ? null_char - str.data() : str.size();
+    return count_non_whitespace_chars(str.data(), len);
 }
 
 uint32_t get_address_width(const std::string &str)
@@ -45,13 +42,11 @@ uint32_t get_address_width(const DocToken &token)
     switch (token.type)
     {
         case TokenType::Text:
-            return get_address_width(static_cast<const TextDocToken &>(token).text);
         case TokenType::Header:
-            return get_address_width(static_cast<const HeaderDocToken &>(token).text);
+        case TokenType::ListItem:
+            return get_address_width(token.text);
         case TokenType::Image:
             return 1;
-        case TokenType::ListItem:
-            return get_address_width(static_cast<const ListItemDocToken &>(token).text);
         default:
             throw std::runtime_error("Unknown token type");
     }
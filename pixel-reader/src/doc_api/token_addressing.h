@@ -3,8 +3,10 @@
 
 #include "./doc_token.h"
 #include <cstdint>
+#include <string_view>
 
 uint32_t get_address_width(const char *str);
+uint32_t get_address_width(std::string_view str);
 uint32_t get_address_width(const std::string &str);
 uint32_t get_address_width(const DocToken &token);
 
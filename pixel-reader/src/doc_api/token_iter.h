@@ -10,6 +10,8 @@
 class TokenIter
 {
 public:
+    // Token, text included, is valid until the next call on this iterator.
+    // Other iterators over the same document don't invalidate it.
     virtual const DocToken *read(int direction) = 0;
     virtual void seek(DocAddr address) = 0;
     virtual ~TokenIter() = default;
@@ -0,0 +1,174 @@
+#include "./token_table.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Chunks double in size up to the max, so small tables stay small. Past that,
+// a chunk leaves at most one token's worth unused when closed.
+#define TEXT_CHUNK_MIN_BYTES 4096
+#define TEXT_CHUNK_MAX_BYTES (16 * 1024)
+
+uint32_t TokenTable::size() const
+{
+    return types.size();
+}
+
+bool TokenTable::empty() const
+{
+    return types.empty();
+}
+
+DocToken TokenTable::operator[](uint32_t index) const
+{
+    uint32_t text_offset = text_offsets[index];
+    uint32_t text_size = text_offsets[index + 1] - text_offset;
+
+    std::string_view text;
+    if (text_size)
+    {
+        // Last chunk starting at or before the text
+        uint32_t chunk = std::upper_bound(chunk_offsets.begin(), chunk_offsets.end(), text_offset) - chunk_offsets.begin() - 1;
+        text = std::string_view(text_chunks[chunk].data.get() + text_offset - chunk_offsets[chunk], text_size);
+    }
+
+    return DocToken(types[index], addresses[index], text, nest_levels[index]);
+}
+
+DocToken TokenTable::back() const
+{
+    return (*this)[size() - 1];
+}
+
+TokenType TokenTable::type(uint32_t index) const
+{
+    return types[index];
+}
+
+DocAddr TokenTable::address(uint32_t index) const
+{
+    return addresses[index];
+}
+
+uint32_t TokenTable::seek_index(DocAddr address) const
+{
+    auto it = std::lower_bound(addresses.begin(), addresses.end(), address);
+    uint32_t index = it - addresses.begin();
+    if (it != addresses.end() && *it == address)
+    {
+        return index;
+    }
+    return index > 0 ? index - 1 : 0;
+}
+
+void TokenTable::push_back(TokenType type, DocAddr address, std::string_view text, int nest_level)
+{
+    types.push_back(type);
+    addresses.push_back(address);
+    nest_levels.push_back(nest_level);
+
+    uint32_t text_end = text_offsets.back();
+    if (!text.empty())
+    {
+        if (last_chunk_free() < text.size())
+        {
+            uint32_t capacity = text_chunks.empty() ? TEXT_CHUNK_MIN_BYTES : std::min<uint32_t>(text_chunks.back().capacity * 2, TEXT_CHUNK_MAX_BYTES);
+            add_text_chunk(std::max<uint32_t>(capacity, text.size()));
+        }
+        std::memcpy(text_chunks.back().data.get() + text_end - chunk_offsets.back(), text.data(), text.size());
+        text_end += text.size();
+    }
+    text_offsets.push_back(text_end);
+}
+
+void TokenTable::push_back(const DocToken &token)
+{
+    push_back(token.type, token.address, token.text, token.nest_level);
+}
+
+void TokenTable::append(const TokenTable &other, uint32_t first_index)
+{
+    if (first_index >= other.size())
+    {
+        return;
+    }
+
+    // Text is left to fill chunks as pushed, as streams append a little at a time
+    reserve(other.size() - first_index, 0);
+    for (uint32_t i = first_index; i < other.size(); ++i)
+    {
+        push_back(other[i]);
+    }
+}
+
+void TokenTable::reserve(uint32_t num_tokens, uint32_t text_bytes)
+{
+    types.reserve(types.size() + num_tokens);
+    addresses.reserve(addresses.size() + num_tokens);
+    nest_levels.reserve(nest_levels.size() + num_tokens);
+    text_offsets.reserve(text_offsets.size() + num_tokens);
+    if (last_chunk_free() < text_bytes)
+    {
+        add_text_chunk(text_bytes);
+    }
+}
+
+void TokenTable::shrink_to_fit()
+{
+    types.shrink_to_fit();
+    addresses.shrink_to_fit();
+    nest_levels.shrink_to_fit();
+    text_offsets.shrink_to_fit();
+    text_chunks.shrink_to_fit();
+    chunk_offsets.shrink_to_fit();
+}
+
+void TokenTable::clear()
+{
+    types.clear();
+    addresses.clear();
+    nest_levels.clear();
+    text_offsets.assign(1, 0);
+    text_chunks.clear();
+    chunk_offsets.clear();
+}
+
+uint32_t TokenTable::text_bytes() const
+{
+    return text_offsets.back();
+}
+
+uint32_t TokenTable::size_bytes() const
+{
+    uint32_t text_chunks_bytes = 0;
+    for (const auto &chunk : text_chunks)
+    {
+        text_chunks_bytes += chunk.capacity;
+    }
+
+    return (
+        text_chunks.capacity() * sizeof(TextChunk) +
+        chunk_offsets.capacity() * sizeof(uint32_t) +
+        types.capacity() * sizeof(TokenType) +
+        addresses.capacity() * sizeof(DocAddr) +
+        nest_levels.capacity() * sizeof(int32_t) +
+        text_offsets.capacity() * sizeof(uint32_t) +
+        text_chunks_bytes
+    );
+}
+
+uint32_t TokenTable::last_chunk_free() const
+{
+    if (text_chunks.empty())
+    {
+        return 0;
+    }
+    return text_chunks.back().capacity - (text_offsets.back() - chunk_offsets.back());
+}
+
+// Text that doesn't fit in the last chunk starts a new one, leaving the rest
+// of the last unused
+void TokenTable::add_text_chunk(uint32_t capacity)
+{
+    text_chunks.push_back({std::unique_ptr<char[]>(new char[capacity]), capacity});
+    chunk_offsets.push_back(text_offsets.back());
+}
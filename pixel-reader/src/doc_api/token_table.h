@@ -0,0 +1,70 @@
+#ifndef TOKEN_TABLE_H_
+#define TOKEN_TABLE_H_
+
+#include "./doc_token.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Compact storage for a sequence of tokens. Fields are held in parallel
+// arrays, and text in a few large chunks, so a table of any length takes a
+// handful of allocations. Tokens are read back as DocToken views. Chunks are
+// never moved or resized, so views stay valid while tokens are appended,
+// until the table is cleared or destroyed.
+class TokenTable
+{
+    struct TextChunk
+    {
+        std::unique_ptr<char[]> data;
+        uint32_t capacity;
+    };
+
+    std::vector<TokenType> types;
+    std::vector<DocAddr> addresses;
+    std::vector<int32_t> nest_levels;
+    // Text of token i spans [text_offsets[i], text_offsets[i + 1]) of the
+    // concatenated chunks. A token's text never straddles two chunks.
+    std::vector<uint32_t> text_offsets {0};
+    std::vector<TextChunk> text_chunks;
+    // Offset of the first text in each chunk
+    std::vector<uint32_t> chunk_offsets;
+
+    uint32_t last_chunk_free() const;
+    void add_text_chunk(uint32_t capacity);
+
+public:
+    uint32_t size() const;
+    bool empty() const;
+
+    DocToken operator[](uint32_t index) const;
+    DocToken back() const;
+
+    TokenType type(uint32_t index) const;
+    DocAddr address(uint32_t index) const;
+
+    // Index to read from when seeking to address: the first token at the
+    // address if there is one, otherwise the last token before it. 0 if none.
+    // Tokens must be sorted by address.
+    uint32_t seek_index(DocAddr address) const;
+
+    void push_back(TokenType type, DocAddr address, std::string_view text, int nest_level = 0);
+    void push_back(const DocToken &token);
+    // Append tokens of other, starting from first_index
+    void append(const TokenTable &other, uint32_t first_index = 0);
+
+    // Make room for this many more tokens and bytes of text
+    void reserve(uint32_t num_tokens, uint32_t text_bytes);
+    // Text is left as is, since views may point into it
+    void shrink_to_fit();
+    void clear();
+
+    // Text of all tokens
+    uint32_t text_bytes() const;
+    // Memory held by the table
+    uint32_t size_bytes() const;
+};
+
+#endif
@@ -1,59 +1,314 @@
 #include "./epub_doc_index.h"
 
 #include "./epub_doc_addr.h"
+#include "./epub_token_cache.h"
 #include "./xhtml_parser.h"
+#include "./zip_xhtml_source.h"
 #include "doc_api/token_addressing.h"
-#include "util/zip_utils.h"
 
 #include <iostream>
 
 #define DEBUG 0
 
-Document::Document() : cache_is_valid(true) {}
+// Rough ratio of address width to deflated xhtml size, used until some widths are known
+#define DEFAULT_WIDTH_PER_COMPRESSED_BYTE 1.5
 
-Document::Document(std::experimental::filesystem::path zip_path)
-    : zip_path(zip_path), cache_is_valid(false)
+// Rough memory held by an element id entry, assuming a short id
+#define ID_ENTRY_SIZE_BYTES (sizeof(std::pair<const std::string, DocAddr>) + 2 * sizeof(void *) + 16)
+
+Document::Document() : compressed_size(0), cache_is_valid(true) {}
+
+Document::Document(std::experimental::filesystem::path zip_path, uint64_t compressed_size)
+    : zip_path(zip_path), compressed_size(compressed_size), cache_is_valid(false)
 {}
 
-const std::vector<std::unique_ptr<DocToken>> &EpubDocIndex::ensure_cached(uint32_t spine_index) const
+uint32_t spine_address_width(const TokenTable &tokens, uint32_t spine_index)
 {
-    static const std::vector<std::unique_ptr<DocToken>> empty_tokens;
-
-    if (spine_index >= spine_entries.size())
+    if (tokens.empty())
     {
-        std::cerr << "Requested tokens in invalid spine index: " << spine_index << std::endl;
-        return empty_tokens;
+        return 0;
     }
 
+    auto last_token = tokens.back();
+    return last_token.address + get_address_width(last_token) - make_address(spine_index);
+}
+
+uint32_t spine_entry_size_bytes(const TokenTable &tokens, const std::unordered_map<std::string, DocAddr> &id_to_addr)
+{
+    return tokens.size_bytes() + id_to_addr.size() * ID_ENTRY_SIZE_BYTES;
+}
+
+bool EpubDocIndex::parse_more(uint32_t spine_index) const
+{
     auto &document = spine_entries[spine_index];
-    if (!document.cache_is_valid)
+    if (document.cache_is_valid)
+    {
+        return false;
+    }
+
+    if (!document.token_stream && prefetcher)
+    {
+        prefetcher->wait_for(spine_index);
+        adopt_prefetched(spine_index);
+        if (document.cache_is_valid)
+        {
+            return true;
+        }
+    }
+
+    if (!document.token_stream && load_cached_tokens(spine_index))
+    {
+        return true;
+    }
+
+    if (!document.token_stream)
     {
         #if DEBUG
         std::cerr << "Loading " << document.zip_path << std::endl;
         #endif
-        auto bytes = read_zip_file_str(zip, document.zip_path);
+        auto source = open_zip_xhtml_source(zip, document.zip_path);
 
-        if (bytes.empty())
+        if (!source)
         {
             std::cerr << "Unable to read item " << document.zip_path << std::endl;
-            return empty_tokens;
+            document.cache_is_valid = true;
+            return false;
         }
 
-        parse_xhtml_tokens(
-            bytes.data(),
+        document.token_stream = std::make_unique<XhtmlTokenStream>(
+            std::move(source),
             document.zip_path,
-            spine_index,
-            document.tokens_cache,
-            document.id_to_addr_cache
+            spine_index
         );
+    }
+
+    bool has_more = document.token_stream->read(document.tokens_cache, document.id_to_addr_cache);
+    if (!has_more)
+    {
+        document.tokens_cache.shrink_to_fit();
+    }
+    set_cached_size(spine_index, spine_entry_size_bytes(document.tokens_cache, document.id_to_addr_cache));
+
+    if (!has_more)
+    {
+        document.token_stream.reset();
+        document.cache_is_valid = true;
+
+        if (token_cache)
+        {
+            // Written on the prefetcher's thread where there is one, to keep
+            // storage off the reader's
+            auto encoded = encode_spine_tokens(spine_index, document.tokens_cache, document.id_to_addr_cache);
+            if (prefetcher)
+            {
+                prefetcher->store(spine_index, std::move(encoded));
+            }
+            else
+            {
+                token_cache->write_blob(book_id, spine_tokens_cache_key(spine_index), encoded);
+            }
+        }
+        return false;
+    }
+
+    return true;
+}
+
+bool EpubDocIndex::load_cached_tokens(uint32_t spine_index) const
+{
+    if (!token_cache)
+    {
+        return false;
+    }
+
+    auto encoded = token_cache->read_blob(book_id, spine_tokens_cache_key(spine_index));
+    auto &document = spine_entries[spine_index];
+    if (!encoded || !try_decode_spine_tokens(*encoded, spine_index, document.tokens_cache, document.id_to_addr_cache))
+    {
+        return false;
+    }
+
+    #if DEBUG
+    std::cerr << "Loaded cached tokens for " << document.zip_path << std::endl;
+    #endif
+
+    document.cache_is_valid = true;
+    set_cached_size(spine_index, spine_entry_size_bytes(document.tokens_cache, document.id_to_addr_cache));
+    return true;
+}
+
+void EpubDocIndex::set_cached_size(uint32_t spine_index, uint32_t size_bytes) const
+{
+    if (cached_entry_sizes.has(spine_index))
+    {
+        cached_bytes -= cached_entry_sizes[spine_index];
+    }
+    cached_entry_sizes.put(spine_index, size_bytes);
+    cached_bytes += size_bytes;
+
+    evict_to_budget(spine_index);
+}
+
+void EpubDocIndex::evict(uint32_t spine_index) const
+{
+    #if DEBUG
+    std::cerr << "Evicting " << spine_entries[spine_index].zip_path << std::endl;
+    #endif
+
+    auto &document = spine_entries[spine_index];
+    document.cache_is_valid = false;
+    document.tokens_cache = TokenTable();
+    std::unordered_map<std::string, DocAddr>().swap(document.id_to_addr_cache);
+    document.token_stream.reset();
+}
+
+void EpubDocIndex::evict_to_budget(uint32_t keep_spine_index) const
+{
+    // Entries in use are moved to the front, so each is skipped at most once
+    uint32_t num_skipped = 0;
+    while (cached_bytes > cache_budget_bytes && num_skipped < cached_entry_sizes.size())
+    {
+        uint32_t spine_index = cached_entry_sizes.back_key();
+        uint32_t size_bytes = cached_entry_sizes.back_value();
+
+        if (spine_index == keep_spine_index || pin_counts[spine_index])
+        {
+            cached_entry_sizes.put(spine_index, size_bytes);
+            ++num_skipped;
+            continue;
+        }
+
+        cached_entry_sizes.pop();
+        cached_bytes -= size_bytes;
+        evict(spine_index);
+    }
+}
+
+void EpubDocIndex::adopt_prefetched(uint32_t keep_spine_index) const
+{
+    if (!prefetcher || !prefetcher->has_results())
+    {
+        return;
+    }
+
+    for (auto &entry : prefetcher->take_results())
+    {
+        auto &document = spine_entries[entry.spine_index];
+        if (document.cache_is_valid || document.token_stream)
+        {
+            // Already parsed on demand
+            continue;
+        }
+
+        #if DEBUG
+        std::cerr << "Adopting prefetched " << document.zip_path << std::endl;
+        #endif
+
+        uint32_t size_bytes = spine_entry_size_bytes(entry.tokens, entry.id_to_addr);
+
+        document.tokens_cache = std::move(entry.tokens);
+        document.id_to_addr_cache = std::move(entry.id_to_addr);
         document.cache_is_valid = true;
+        {
+            std::lock_guard<std::mutex> lock(doc_widths_mutex);
+            doc_widths_cache[entry.spine_index] = spine_address_width(document.tokens_cache, entry.spine_index);
+        }
+
+        cached_entry_sizes.put(entry.spine_index, size_bytes);
+        cached_bytes += size_bytes;
     }
 
-    return document.tokens_cache;
+    evict_to_budget(keep_spine_index);
 }
 
-EpubDocIndex::EpubDocIndex(const PackageContents &package, zip_t *zip, std::vector<uint32_t> _doc_widths_cache)
-    : zip(zip), doc_widths_cache(package.spine_ids.size())
+void EpubDocIndex::use_entry(uint32_t spine_index) const
+{
+    adopt_prefetched(spine_index);
+    if (cached_entry_sizes.has(spine_index))
+    {
+        // Mark as recently used
+        cached_entry_sizes[spine_index];
+    }
+}
+
+void EpubDocIndex::prefetch_neighbours()
+{
+    if (!prefetcher)
+    {
+        return;
+    }
+
+    std::vector<EpubSpinePrefetcher::Job> jobs;
+    auto add_job = [&](uint32_t spine_index) {
+        if (spine_index >= spine_size() || pin_counts[spine_index])
+        {
+            return;
+        }
+        const auto &document = spine_entries[spine_index];
+        if (document.cache_is_valid || document.token_stream)
+        {
+            return;
+        }
+        for (const auto &job : jobs)
+        {
+            if (job.first == spine_index)
+            {
+                return;
+            }
+        }
+        jobs.emplace_back(spine_index, document.zip_path);
+    };
+
+    // Reading forward is more common, so next entries go first
+    for (uint32_t spine_index = 0; spine_index < spine_size(); ++spine_index)
+    {
+        if (pin_counts[spine_index])
+        {
+            add_job(spine_index + 1);
+        }
+    }
+    for (uint32_t spine_index = 1; spine_index < spine_size(); ++spine_index)
+    {
+        if (pin_counts[spine_index])
+        {
+            add_job(spine_index - 1);
+        }
+    }
+
+    prefetcher->prefetch(std::move(jobs));
+}
+
+const TokenTable &EpubDocIndex::ensure_cached(uint32_t spine_index) const
+{
+    static const TokenTable empty_tokens;
+
+    if (spine_index >= spine_entries.size())
+    {
+        std::cerr << "Requested tokens in invalid spine index: " << spine_index << std::endl;
+        return empty_tokens;
+    }
+
+    use_entry(spine_index);
+
+    while (parse_more(spine_index))
+    {
+    }
+
+    return spine_entries[spine_index].tokens_cache;
+}
+
+EpubDocIndex::EpubDocIndex(
+    const PackageContents &package,
+    const ZipArchive &zip,
+    const std::vector<std::experimental::optional<uint32_t>> &_doc_widths_cache,
+    std::experimental::filesystem::path epub_path,
+    DocReaderCache *token_cache,
+    std::string book_id
+) : zip(zip),
+    token_cache(token_cache),
+    book_id(std::move(book_id)),
+    pin_counts(package.spine_ids.size()),
+    doc_widths_cache(package.spine_ids.size())
 {
     uint32_t num_spine_entries = package.spine_ids.size();
     bool cache_is_valid = num_spine_entries == _doc_widths_cache.size();
@@ -64,19 +319,26 @@ EpubDocIndex::EpubDocIndex(const PackageContents &package, zip_t *zip, std::vect
         auto item_it = package.id_to_manifest_item.find(doc_id);
         if (item_it != package.id_to_manifest_item.end() && item_it->second.media_type == APPLICATION_XHTML_XML)
         {
-            spine_entries.emplace_back(item_it->second.href_absolute);
+            const auto &path = item_it->second.href_absolute;
+            spine_entries.emplace_back(path, zip.compressed_size(path));
         }
         else
         {
             std::cerr << "Skipping spine doc " << doc_id << " in manifest" << std::endl;
             spine_entries.emplace_back();
+            doc_widths_cache[spine_index] = 0;
         }
 
-        if (cache_is_valid)
+        if (cache_is_valid && _doc_widths_cache[spine_index])
         {
             doc_widths_cache[spine_index] = _doc_widths_cache[spine_index];
         }
     }
+
+    if (!epub_path.empty())
+    {
+        prefetcher = std::make_unique<EpubSpinePrefetcher>(std::move(epub_path), token_cache, this->book_id);
+    }
 }
 
 uint32_t EpubDocIndex::spine_size() const
@@ -93,35 +355,165 @@ uint32_t EpubDocIndex::token_count(uint32_t spine_index) const
     return 0;
 }
 
+std::experimental::optional<DocToken> EpubDocIndex::token(uint32_t spine_index, uint32_t token_index) const
+{
+    if (spine_index >= spine_size())
+    {
+        return std::experimental::nullopt;
+    }
+
+    use_entry(spine_index);
+
+    const auto &tokens = spine_entries[spine_index].tokens_cache;
+    while (token_index >= tokens.size() && parse_more(spine_index))
+    {
+    }
+
+    if (token_index < tokens.size())
+    {
+        return tokens[token_index];
+    }
+    return std::experimental::nullopt;
+}
+
+uint32_t EpubDocIndex::seek_token_index(uint32_t spine_index, DocAddr address) const
+{
+    if (spine_index >= spine_size())
+    {
+        return 0;
+    }
+
+    use_entry(spine_index);
+
+    // Parse until a token at or past the address is known
+    const auto &tokens = spine_entries[spine_index].tokens_cache;
+    while ((tokens.empty() || tokens.back().address < address) && parse_more(spine_index))
+    {
+    }
+
+    return tokens.seek_index(address);
+}
+
 bool EpubDocIndex::empty(uint32_t spine_index) const
 {
-    return token_count(spine_index) == 0;
+    return !token(spine_index, 0);
 }
 
 uint32_t EpubDocIndex::address_width(uint32_t spine_index) const
 {
-    uint32_t width = 0;
-    if (spine_index < spine_size())
+    if (spine_index >= spine_size())
     {
-        if (doc_widths_cache[spine_index])
-        {
-            width = *doc_widths_cache[spine_index];
-        }
-        else
+        return 0;
+    }
+
+    auto known_width = known_address_width(spine_index);
+    if (known_width)
+    {
+        return *known_width;
+    }
+
+    uint32_t width = spine_address_width(ensure_cached(spine_index), spine_index);
+    {
+        std::lock_guard<std::mutex> lock(doc_widths_mutex);
+        doc_widths_cache[spine_index] = width;
+    }
+    return width;
+}
+
+std::experimental::optional<uint32_t> EpubDocIndex::known_address_width(uint32_t spine_index) const
+{
+    std::lock_guard<std::mutex> lock(doc_widths_mutex);
+    if (spine_index < doc_widths_cache.size())
+    {
+        return doc_widths_cache[spine_index];
+    }
+    return std::experimental::nullopt;
+}
+
+std::vector<uint32_t> EpubDocIndex::estimated_address_widths() const
+{
+    std::lock_guard<std::mutex> lock(doc_widths_mutex);
+
+    // Estimate density of unknown entries from the entries indexed so far
+    double width_per_byte = DEFAULT_WIDTH_PER_COMPRESSED_BYTE;
+    {
+        uint64_t known_width = 0;
+        uint64_t known_bytes = 0;
+        for (uint32_t i = 0; i < doc_widths_cache.size(); ++i)
         {
-            const auto &_tokens = ensure_cached(spine_index);
-            if (_tokens.size())
+            if (doc_widths_cache[i] && spine_entries[i].compressed_size)
             {
-                const auto &last_token = _tokens[_tokens.size() - 1];
-                width = last_token->address + get_address_width(*last_token) - make_address(spine_index);
+                known_width += *doc_widths_cache[i];
+                known_bytes += spine_entries[i].compressed_size;
             }
-            doc_widths_cache[spine_index] = width;
+        }
+        if (known_bytes)
+        {
+            width_per_byte = static_cast<double>(known_width) / known_bytes;
         }
     }
-    return width;
+
+    std::vector<uint32_t> widths;
+    widths.reserve(doc_widths_cache.size());
+    for (uint32_t i = 0; i < doc_widths_cache.size(); ++i)
+    {
+        widths.push_back(
+            doc_widths_cache[i].value_or(
+                static_cast<uint32_t>(spine_entries[i].compressed_size * width_per_byte)
+            )
+        );
+    }
+    return widths;
+}
+
+void EpubDocIndex::set_address_width(uint32_t spine_index, uint32_t width)
+{
+    std::lock_guard<std::mutex> lock(doc_widths_mutex);
+    if (spine_index < doc_widths_cache.size())
+    {
+        doc_widths_cache[spine_index] = width;
+    }
+}
+
+std::vector<std::experimental::optional<uint32_t>> EpubDocIndex::known_address_widths() const
+{
+    std::lock_guard<std::mutex> lock(doc_widths_mutex);
+    return doc_widths_cache;
+}
+
+const std::experimental::filesystem::path &EpubDocIndex::spine_entry_path(uint32_t spine_index) const
+{
+    return spine_entries[spine_index].zip_path;
+}
+
+void EpubDocIndex::pin_spine_entry(uint32_t spine_index)
+{
+    if (spine_index < spine_size() && pin_counts[spine_index]++ == 0)
+    {
+        prefetch_neighbours();
+    }
+}
+
+void EpubDocIndex::unpin_spine_entry(uint32_t spine_index)
+{
+    if (spine_index < spine_size() && pin_counts[spine_index] > 0)
+    {
+        --pin_counts[spine_index];
+    }
+}
+
+void EpubDocIndex::set_cache_budget(uint64_t size_bytes)
+{
+    cache_budget_bytes = size_bytes;
+    evict_to_budget(spine_size());
+}
+
+uint64_t EpubDocIndex::cache_size_bytes() const
+{
+    return cached_bytes;
 }
 
-const std::vector<std::unique_ptr<DocToken>> &EpubDocIndex::tokens(uint32_t spine_index) const
+const TokenTable &EpubDocIndex::tokens(uint32_t spine_index) const
 {
     return ensure_cached(spine_index);
 }
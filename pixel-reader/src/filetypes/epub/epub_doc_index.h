@@ -2,54 +2,141 @@
 #define EPUB_DOC_INDEX_H_
 
 #include "./epub_metadata.h"
-#include "doc_api/doc_token.h"
-
-#include <zip.h>
+#include "./epub_spine_prefetcher.h"
+#include "./xhtml_parser.h"
+#include "doc_api/doc_reader.h"
+#include "doc_api/token_table.h"
+#include "util/lru_cache.h"
+#include "util/zip_archive.h"
 
 #include <experimental/filesystem>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <experimental/optional>
 #include <vector>
 
+// Default upper bound on memory held by parsed spine entries
+#define DEFAULT_SPINE_CACHE_BYTES (8 * 1024 * 1024)
+
 struct Document
 {
     std::experimental::filesystem::path zip_path;
+    uint64_t compressed_size;
 
+    // True once fully parsed. Until then, tokens_cache holds the tokens read from token_stream so far.
     bool cache_is_valid;
-    std::vector<std::unique_ptr<DocToken>> tokens_cache;
+    TokenTable tokens_cache;
     std::unordered_map<std::string, DocAddr> id_to_addr_cache;
+    std::unique_ptr<XhtmlTokenStream> token_stream;
 
     Document();
-    Document(std::experimental::filesystem::path zip_path);
+    Document(std::experimental::filesystem::path zip_path, uint64_t compressed_size);
 };
 
+// Address space consumed by the parsed tokens of a spine entry
+uint32_t spine_address_width(const TokenTable &tokens, uint32_t spine_index);
+
+// Rough memory held by a parsed spine entry
+uint32_t spine_entry_size_bytes(const TokenTable &tokens, const std::unordered_map<std::string, DocAddr> &id_to_addr);
+
 // Provide access to documents listed in the spine.
 // Documents are addressed by spine index. Lazy load from zip.
+// Parsed entries are evicted least recently used first once the cache
+// budget is exceeded, except for entries pinned by iterators.
 class EpubDocIndex
 {
-    zip_t *zip;
+    const ZipArchive &zip;
     mutable std::vector<Document> spine_entries;
+
+    // Parsed entries persisted across sessions, if set
+    DocReaderCache *token_cache;
+    const std::string book_id;
+
+    // Estimated bytes held by each parsed spine entry, in order of use
+    mutable LRUCache<uint32_t, uint32_t> cached_entry_sizes;
+    mutable uint64_t cached_bytes = 0;
+    uint64_t cache_budget_bytes = DEFAULT_SPINE_CACHE_BYTES;
+
+    // Number of iterators positioned in each spine entry
+    std::vector<uint32_t> pin_counts;
+
+    std::unique_ptr<EpubSpinePrefetcher> prefetcher;
+
+    // Widths may be filled in by background indexing threads
+    mutable std::mutex doc_widths_mutex;
     mutable std::vector<std::experimental::optional<uint32_t>> doc_widths_cache;
 
-    const std::vector<std::unique_ptr<DocToken>> &ensure_cached(uint32_t spine_index) const;
+    // Parse more of a spine entry. Returns false once the entry is fully parsed.
+    bool parse_more(uint32_t spine_index) const;
+    // Load fully parsed entry from token_cache. Returns false if not cached.
+    bool load_cached_tokens(uint32_t spine_index) const;
+    const TokenTable &ensure_cached(uint32_t spine_index) const;
+
+    // Account for memory held by a spine entry, evicting others as needed
+    void set_cached_size(uint32_t spine_index, uint32_t size_bytes) const;
+    void evict(uint32_t spine_index) const;
+    // Evict least recently used entries until within budget. Never evicts keep_spine_index.
+    void evict_to_budget(uint32_t keep_spine_index) const;
+
+    // Move entries parsed in the background into the cache
+    void adopt_prefetched(uint32_t keep_spine_index) const;
+    // Adopt prefetched entries and mark spine entry as recently used
+    void use_entry(uint32_t spine_index) const;
+    // Queue unparsed neighbours of pinned entries for prefetch
+    void prefetch_neighbours();
 
 public:
-    EpubDocIndex(const PackageContents &package, zip_t *zip, std::vector<uint32_t> doc_widths_cache);
+    // Spine entries are prefetched from epub_path if given, otherwise all
+    // parsing happens on demand. Parsed entries are persisted in token_cache
+    // under book_id if given.
+    EpubDocIndex(
+        const PackageContents &package,
+        const ZipArchive &zip,
+        const std::vector<std::experimental::optional<uint32_t>> &doc_widths_cache,
+        std::experimental::filesystem::path epub_path = {},
+        DocReaderCache *token_cache = nullptr,
+        std::string book_id = {}
+    );
     EpubDocIndex(const EpubDocIndex &) = delete;
     EpubDocIndex &operator=(const EpubDocIndex &) = delete;
 
     // Number of spine entries
     uint32_t spine_size() const;
 
-    // Number of tokens in spine entry
+    // Number of tokens in spine entry. Parses the whole entry.
     uint32_t token_count(uint32_t spine_index) const;
+    // Token in spine entry, or nullopt if past the end. Only parses as far as needed.
+    // The view is valid until the spine entry is parsed further or evicted.
+    std::experimental::optional<DocToken> token(uint32_t spine_index, uint32_t token_index) const;
+    // Index of the token to read from when seeking to address. Only parses as far as needed.
+    uint32_t seek_token_index(uint32_t spine_index, DocAddr address) const;
     // True if spine has no tokens
     bool empty(uint32_t spine_index) const;
 
-    // Address space consumed by spine entry
+    // Address space consumed by spine entry. Parses the entry if width is not yet known.
     uint32_t address_width(uint32_t spine_index) const;
+    // Width of spine entry, if already known. Never parses.
+    std::experimental::optional<uint32_t> known_address_width(uint32_t spine_index) const;
+    // Known widths, or widths estimated from compressed entry size. Never parses.
+    std::vector<uint32_t> estimated_address_widths() const;
+    // Record width computed elsewhere (e.g. by a background indexer). Thread safe.
+    void set_address_width(uint32_t spine_index, uint32_t width);
+    // Snapshot of known widths, for persisting to cache. Thread safe.
+    std::vector<std::experimental::optional<uint32_t>> known_address_widths() const;
+
+    const std::experimental::filesystem::path &spine_entry_path(uint32_t spine_index) const;
+
+    // Pinned spine entries are never evicted, and their neighbours are prefetched.
+    void pin_spine_entry(uint32_t spine_index);
+    void unpin_spine_entry(uint32_t spine_index);
+
+    // Upper bound on memory held by parsed entries. Pinned entries may exceed it.
+    void set_cache_budget(uint64_t size_bytes);
+    // Estimated memory held by parsed entries
+    uint64_t cache_size_bytes() const;
 
-    const std::vector<std::unique_ptr<DocToken>> &tokens(uint32_t spine_index) const;
+    const TokenTable &tokens(uint32_t spine_index) const;
     const std::unordered_map<std::string, DocAddr> &elem_id_to_address(uint32_t spine_index) const;
 };
 
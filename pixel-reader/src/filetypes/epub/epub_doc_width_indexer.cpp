@@ -0,0 +1,92 @@
+#include "./epub_doc_width_indexer.h"
+
+#include "./epub_doc_index.h"
+#include "./epub_token_cache.h"
+#include "./xhtml_parser.h"
+#include "./zip_xhtml_source.h"
+#include "util/zip_archive.h"
+
+#include <iostream>
+
+#define DEBUG 0
+
+EpubDocWidthIndexer::EpubDocWidthIndexer(
+    std::experimental::filesystem::path epub_path,
+    std::vector<Job> jobs,
+    WidthCallback on_width,
+    DoneCallback on_done,
+    uint32_t num_threads,
+    DocReaderCache *token_cache,
+    std::string book_id
+) : epub_path(std::move(epub_path)),
+    jobs(std::move(jobs)),
+    on_width(std::move(on_width)),
+    on_done(std::move(on_done)),
+    token_cache(token_cache),
+    book_id(std::move(book_id))
+{
+    num_threads = std::max(1u, std::min<uint32_t>(num_threads, this->jobs.size()));
+    running_workers = num_threads;
+    for (uint32_t i = 0; i < num_threads; ++i)
+    {
+        workers.emplace_back(&EpubDocWidthIndexer::run_worker, this);
+    }
+}
+
+EpubDocWidthIndexer::~EpubDocWidthIndexer()
+{
+    stop_requested = true;
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+uint32_t EpubDocWidthIndexer::default_num_threads()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void EpubDocWidthIndexer::run_worker()
+{
+    ZipArchive zip(epub_path);
+    if (!zip.open())
+    {
+        std::cerr << "Indexer failed to open " << epub_path << std::endl;
+    }
+
+    uint32_t job_index;
+    while (zip.is_open() && !stop_requested && (job_index = next_job++) < jobs.size())
+    {
+        uint32_t spine_index = jobs[job_index].first;
+        const auto &doc_path = jobs[job_index].second;
+
+        auto source = open_zip_xhtml_source(zip, doc_path);
+
+        TokenTable tokens;
+        std::unordered_map<std::string, DocAddr> id_to_addr;
+        if (source)
+        {
+            bool parsed = parse_xhtml_tokens(std::move(source), doc_path, spine_index, tokens, id_to_addr);
+            if (parsed && token_cache)
+            {
+                token_cache->write_blob(
+                    book_id,
+                    spine_tokens_cache_key(spine_index),
+                    encode_spine_tokens(spine_index, tokens, id_to_addr)
+                );
+            }
+        }
+
+        #if DEBUG
+        std::cerr << "Indexed " << doc_path << std::endl;
+        #endif
+
+        on_width(spine_index, spine_address_width(tokens, spine_index), id_to_addr);
+    }
+
+    if (--running_workers == 0 && !stop_requested)
+    {
+        on_done();
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef EPUB_DOC_WIDTH_INDEXER_H_
+#define EPUB_DOC_WIDTH_INDEXER_H_
+
+#include "doc_api/doc_addr.h"
+#include "doc_api/doc_reader.h"
+
+#include <atomic>
+#include <cstdint>
+#include <experimental/filesystem>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Compute address widths of spine entries on background threads. Each worker
+// opens its own handle to the epub, since libzip handles can't be shared
+// across threads. Parsed entries are also persisted in token_cache under
+// book_id if given, so the reader doesn't parse them again. xmlInitParser must
+// have been called.
+class EpubDocWidthIndexer
+{
+public:
+    // (spine index, path of document in zip)
+    using Job = std::pair<uint32_t, std::experimental::filesystem::path>;
+    // Called from worker threads as each width becomes known, along with the
+    // element ids found in the entry
+    using WidthCallback = std::function<void(uint32_t spine_index, uint32_t width, const std::unordered_map<std::string, DocAddr> &id_to_addr)>;
+    // Called once from the last worker to finish
+    using DoneCallback = std::function<void()>;
+
+private:
+    const std::experimental::filesystem::path epub_path;
+    const std::vector<Job> jobs;
+    const WidthCallback on_width;
+    const DoneCallback on_done;
+    DocReaderCache *token_cache;
+    const std::string book_id;
+
+    std::atomic<uint32_t> next_job {0};
+    std::atomic<uint32_t> running_workers {0};
+    std::atomic<bool> stop_requested {false};
+    std::vector<std::thread> workers;
+
+    void run_worker();
+
+public:
+    EpubDocWidthIndexer(
+        std::experimental::filesystem::path epub_path,
+        std::vector<Job> jobs,
+        WidthCallback on_width,
+        DoneCallback on_done,
+        uint32_t num_threads,
+        DocReaderCache *token_cache = nullptr,
+        std::string book_id = {}
+    );
+    EpubDocWidthIndexer(const EpubDocWidthIndexer &) = delete;
+    EpubDocWidthIndexer &operator=(const EpubDocWidthIndexer &) = delete;
+
+    // Stops after in-flight entries complete
+    virtual ~EpubDocWidthIndexer();
+
+    // Number of workers to use on this machine
+    static uint32_t default_num_threads();
+};
+
+#endif
@@ -1,20 +1,27 @@
 #include "./epub_reader.h"
 
 #include "./epub_doc_index.h"
+#include "./epub_doc_width_indexer.h"
 #include "./epub_metadata.h"
 #include "./epub_toc_index.h"
 #include "./epub_token_iter.h"
 #include "util/string_serialization.h"
-#include "util/zip_utils.h"
+#include "util/zip_archive.h"
 
 #include "extern/hash-library/md5.h"
 
 #include <algorithm>
+#include <chrono>
 #include <iostream>
-#include <zip.h>
+#include <mutex>
 
 #define DEBUG 0
 #define DOC_WIDTHS_CACHE_KEY "doc_widths"
+#define TOC_STARTS_CACHE_KEY "toc_starts"
+// Indexing results are written to cache after this many entries or this long,
+// whichever comes first, and once indexing ends
+#define INDEX_CHECKPOINT_ENTRIES 16
+#define INDEX_CHECKPOINT_MS 5000
 
 namespace
 {
@@ -44,7 +51,8 @@ uint32_t fraction_to_progress_percent( std::pair<uint32_t, uint32_t> fraction)
 struct EpubReaderState
 {
     std::experimental::filesystem::path path;
-    zip_t *zip = nullptr;
+    // Declared before the index, since parsers stream entries out of it
+    ZipArchive zip;
 
     std::string package_md5;
 
@@ -52,9 +60,108 @@ struct EpubReaderState
     std::unique_ptr<EpubTocIndex> toc_index;
     std::vector<TocItem> user_toc;
 
-    EpubReaderState(std::string path) : path(std::move(path)) {}
+    // Serialize cache writes from indexer threads
+    std::mutex index_checkpoint_mutex;
+    DocReaderCache *index_cache = nullptr;
+    // Entries indexed since results were last written to index_cache
+    uint32_t unsaved_index_entries = 0;
+    std::chrono::steady_clock::time_point last_index_checkpoint;
+    // Declared last so workers stop before the index is destroyed
+    std::unique_ptr<EpubDocWidthIndexer> doc_width_indexer;
+
+    EpubReaderState(std::string path) : path(std::move(path)), zip(this->path) {}
 };
 
+namespace
+{
+
+// Caller must hold index_checkpoint_mutex
+void write_indexes(EpubReaderState &state)
+{
+    state.index_cache->write(
+        state.package_md5,
+        DOC_WIDTHS_CACHE_KEY,
+        encode_optional_uint_vector(state.doc_index->known_address_widths())
+    );
+    state.index_cache->write(
+        state.package_md5,
+        TOC_STARTS_CACHE_KEY,
+        encode_optional_uint_vector(state.toc_index->known_start_offsets())
+    );
+    state.unsaved_index_entries = 0;
+    state.last_index_checkpoint = std::chrono::steady_clock::now();
+}
+
+// Each write encodes every entry, so batch them rather than writing per entry
+void checkpoint_indexes(EpubReaderState &state)
+{
+    std::lock_guard<std::mutex> lock(state.index_checkpoint_mutex);
+    ++state.unsaved_index_entries;
+    if (
+        state.unsaved_index_entries >= INDEX_CHECKPOINT_ENTRIES ||
+        std::chrono::steady_clock::now() - state.last_index_checkpoint >= std::chrono::milliseconds(INDEX_CHECKPOINT_MS)
+    )
+    {
+        write_indexes(state);
+    }
+}
+
+void flush_indexes(EpubReaderState &state)
+{
+    std::lock_guard<std::mutex> lock(state.index_checkpoint_mutex);
+    if (state.index_cache && state.unsaved_index_entries)
+    {
+        write_indexes(state);
+    }
+}
+
+// Index widths and toc start addresses of any spine entries not found in
+// cache, without blocking the caller. Partial results are checkpointed to the
+// cache as they arrive, so an interrupted session resumes close to where it
+// left off.
+void start_doc_width_indexing(EpubReaderState &state, DocReaderCache &cache)
+{
+    const auto &doc_index = *state.doc_index;
+    const auto &toc_index = *state.toc_index;
+
+    std::vector<EpubDocWidthIndexer::Job> jobs;
+    for (uint32_t i = 0; i < doc_index.spine_size(); ++i)
+    {
+        if (!doc_index.known_address_width(i) || toc_index.needs_spine_ids(i))
+        {
+            jobs.emplace_back(i, doc_index.spine_entry_path(i));
+        }
+    }
+
+    if (jobs.empty())
+    {
+        return;
+    }
+
+    state.index_cache = &cache;
+    state.last_index_checkpoint = std::chrono::steady_clock::now();
+    state.doc_width_indexer = std::make_unique<EpubDocWidthIndexer>(
+        state.path,
+        std::move(jobs),
+        [&state](uint32_t spine_index, uint32_t width, const std::unordered_map<std::string, DocAddr> &id_to_addr) {
+            state.doc_index->set_address_width(spine_index, width);
+            state.toc_index->resolve_spine_items(spine_index, id_to_addr);
+            checkpoint_indexes(state);
+        },
+        [&state]() {
+            #if DEBUG
+            std::cerr << "Finished indexing doc widths" << std::endl;
+            #endif
+            flush_indexes(state);
+        },
+        EpubDocWidthIndexer::default_num_threads(),
+        &cache,
+        state.package_md5
+    );
+}
+
+} // namespace
+
 EPubReader::EPubReader(std::experimental::filesystem::path path)
     : state(std::make_unique<EpubReaderState>(std::move(path)))
 {
@@ -62,36 +169,28 @@ EPubReader::EPubReader(std::experimental::filesystem::path path)
 
 EPubReader::~EPubReader()
 {
-    if (!state->zip)
-    {
-        zip_close(state->zip);
-    }
+    state->doc_width_indexer.reset();
+    // Keep what was indexed since the last checkpoint
+    flush_indexes(*state);
 }
 
 bool EPubReader::open(DocReaderCache &cache)
 {
-    if (state->zip)
+    if (state->zip.is_open())
     {
         return true;
     }
 
-    // open zip
+    if (!state->zip.open())
     {
-        int err = 0;
-        state->zip = zip_open(state->path.c_str(), ZIP_RDONLY, &err);
-        if (state->zip == nullptr)
-        {
-            std::cerr << "Failed to epub " << state->path
-                << " code: " << err
-                << std::endl;
-            return false;
-        }
+        std::cerr << "Failed to epub " << state->path << std::endl;
+        return false;
     }
 
     // read container.xml
     std::string rootfile_path;
     {
-        auto container_xml = read_zip_file_str(state->zip, EPUB_CONTAINER_PATH);
+        auto container_xml = state->zip.read(EPUB_CONTAINER_PATH);
         if (container_xml.empty())
         {
             std::cerr << "Failed to read epub container" << std::endl;
@@ -109,7 +208,7 @@ bool EPubReader::open(DocReaderCache &cache)
     // read package document
     PackageContents package;
     {
-        auto package_xml = read_zip_file_str(state->zip, rootfile_path);
+        auto package_xml = state->zip.read(rootfile_path);
         if (package_xml.empty())
         {
             std::cerr << "Failed to open " << rootfile_path << std::endl;
@@ -134,7 +233,7 @@ bool EPubReader::open(DocReaderCache &cache)
         if (item != package.id_to_manifest_item.end() && item->second.media_type == APPLICATION_X_DTBNCX_XML)
         {
             auto ncx_path = item->second.href_absolute;
-            auto ncx_xml = read_zip_file_str(state->zip, ncx_path);
+            auto ncx_xml = state->zip.read(ncx_path);
 
             epub_parse_ncx(ncx_path, ncx_xml.data(), navmap);
         }
@@ -157,7 +256,7 @@ bool EPubReader::open(DocReaderCache &cache)
         if (nav_item != package.id_to_manifest_item.end())
         {
             auto nav_path = nav_item->second.href_absolute;
-            auto nav_xml = read_zip_file_str(state->zip, nav_path);
+            auto nav_xml = state->zip.read(nav_path);
 
             epub_parse_nav(nav_path, nav_xml.data(), navmap);
         }
@@ -165,33 +264,33 @@ bool EPubReader::open(DocReaderCache &cache)
 
     // Construct index helpers
     {
-        std::vector<uint32_t> doc_widths_cache;
+        std::vector<std::experimental::optional<uint32_t>> doc_widths_cache;
 
         auto cache_opt = cache.read(state->package_md5, DOC_WIDTHS_CACHE_KEY);
-        bool cache_is_valid = (
-            cache_opt &&
-            try_decode_uint_vector(*cache_opt, doc_widths_cache) &&
-            doc_widths_cache.size()
-        );
-        if (!cache_is_valid)
+        if (!cache_opt || !try_decode_optional_uint_vector(*cache_opt, doc_widths_cache))
         {
             doc_widths_cache.clear();
         }
 
-        state->doc_index = std::make_unique<EpubDocIndex>(package, state->zip, doc_widths_cache);
-        state->toc_index = std::make_unique<EpubTocIndex>(package, navmap, *state->doc_index.get());
+        std::vector<std::experimental::optional<uint32_t>> toc_starts_cache;
 
-        if (!cache_is_valid)
+        cache_opt = cache.read(state->package_md5, TOC_STARTS_CACHE_KEY);
+        if (!cache_opt || !try_decode_optional_uint_vector(*cache_opt, toc_starts_cache))
         {
-            uint32_t num_spine_entries = state->doc_index->spine_size();
-            doc_widths_cache.reserve(num_spine_entries);
-            for (uint32_t i = 0; i < num_spine_entries; ++i)
-            {
-                doc_widths_cache.emplace_back(state->doc_index->address_width(i));
-            }
-
-            cache.write(state->package_md5, DOC_WIDTHS_CACHE_KEY, encode_uint_vector(doc_widths_cache));
+            toc_starts_cache.clear();
         }
+
+        state->doc_index = std::make_unique<EpubDocIndex>(
+            package,
+            state->zip,
+            doc_widths_cache,
+            state->path,
+            &cache,
+            state->package_md5
+        );
+        state->toc_index = std::make_unique<EpubTocIndex>(package, navmap, *state->doc_index.get(), toc_starts_cache);
+
+        start_doc_width_indexing(*state, cache);
     }
 
     // Compile user table of contents
@@ -209,7 +308,7 @@ bool EPubReader::open(DocReaderCache &cache)
 
 bool EPubReader::is_open() const
 {
-    return state->zip != nullptr;
+    return state->zip.is_open();
 }
 
 std::string EPubReader::get_id() const
@@ -254,7 +353,35 @@ std::shared_ptr<TokenIter> EPubReader::get_iter(DocAddr address) const
     );
 }
 
-std::vector<char> EPubReader::load_resource(const std::experimental::filesystem::path &path) const
+ResourceBuffer EPubReader::load_resource(const std::experimental::filesystem::path &path) const
 {
-    return read_zip_file_str(state->zip, path);
+    // Images are usually stored uncompressed, so can be used in place
+    std::shared_ptr<MappedZipEntry> mapped = state->zip.map_entry(path);
+    if (mapped)
+    {
+        const char *data = mapped->data();
+        uint64_t size = mapped->size();
+        return ResourceBuffer(std::move(mapped), data, size);
+    }
+
+    auto buffer = state->zip.read(path);
+    if (!buffer.empty())
+    {
+        // Drop null terminator
+        buffer.pop_back();
+    }
+    return ResourceBuffer(std::move(buffer));
+}
+
+uint64_t EPubReader::cache_size_bytes() const
+{
+    return state->doc_index ? state->doc_index->cache_size_bytes() : 0;
+}
+
+void EPubReader::set_cache_budget(uint64_t size_bytes)
+{
+    if (state->doc_index)
+    {
+        state->doc_index->set_cache_budget(size_bytes);
+    }
 }
@@ -31,7 +31,10 @@ public:
 
     std::shared_ptr<TokenIter> get_iter(DocAddr address = make_address()) const override;
 
-    std::vector<char> load_resource(const std::experimental::filesystem::path &path) const override;
+    ResourceBuffer load_resource(const std::experimental::filesystem::path &path) const override;
+
+    uint64_t cache_size_bytes() const override;
+    void set_cache_budget(uint64_t size_bytes) override;
 };
 
 #endif
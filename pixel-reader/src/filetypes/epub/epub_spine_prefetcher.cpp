@@ -0,0 +1,200 @@
+#include "./epub_spine_prefetcher.h"
+
+#include "./epub_token_cache.h"
+#include "./xhtml_parser.h"
+#include "./zip_xhtml_source.h"
+
+#include <algorithm>
+#include <iostream>
+
+#define DEBUG 0
+
+EpubSpinePrefetcher::EpubSpinePrefetcher(
+    std::experimental::filesystem::path epub_path,
+    DocReaderCache *token_cache,
+    std::string book_id
+) : epub_path(std::move(epub_path)),
+    token_cache(token_cache),
+    book_id(std::move(book_id))
+{
+    worker = std::thread(&EpubSpinePrefetcher::run_worker, this);
+}
+
+EpubSpinePrefetcher::~EpubSpinePrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop_requested = true;
+    }
+    job_cv.notify_all();
+    worker.join();
+}
+
+void EpubSpinePrefetcher::prefetch(std::vector<Job> jobs)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (active_spine_index)
+        {
+            auto still_wanted = std::any_of(jobs.begin(), jobs.end(), [&](const Job &job) {
+                return job.first == *active_spine_index;
+            });
+            if (still_wanted)
+            {
+                jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [&](const Job &job) {
+                    return job.first == *active_spine_index;
+                }), jobs.end());
+            }
+            else
+            {
+                active_job_cancelled = true;
+            }
+        }
+
+        // Worker takes jobs from the back
+        std::reverse(jobs.begin(), jobs.end());
+        queued_jobs = std::move(jobs);
+    }
+    job_cv.notify_all();
+}
+
+void EpubSpinePrefetcher::wait_for(uint32_t spine_index)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    queued_jobs.erase(std::remove_if(queued_jobs.begin(), queued_jobs.end(), [&](const Job &job) {
+        return job.first == spine_index;
+    }), queued_jobs.end());
+
+    done_cv.wait(lock, [&]() {
+        return active_spine_index != spine_index;
+    });
+}
+
+void EpubSpinePrefetcher::store(uint32_t spine_index, std::string encoded)
+{
+    if (!token_cache)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending_writes.emplace_back(spine_tokens_cache_key(spine_index), std::move(encoded));
+    }
+    job_cv.notify_all();
+}
+
+bool EpubSpinePrefetcher::has_results() const
+{
+    return results_ready;
+}
+
+std::vector<ParsedSpineEntry> EpubSpinePrefetcher::take_results()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    results_ready = false;
+
+    std::vector<ParsedSpineEntry> taken;
+    taken.swap(results);
+    return taken;
+}
+
+bool EpubSpinePrefetcher::parse_entry(const ZipArchive &zip, const Job &job, ParsedSpineEntry &entry)
+{
+    const std::string cache_key = spine_tokens_cache_key(job.first);
+    if (token_cache)
+    {
+        auto encoded = token_cache->read_blob(book_id, cache_key);
+        if (encoded && try_decode_spine_tokens(*encoded, job.first, entry.tokens, entry.id_to_addr))
+        {
+            return true;
+        }
+    }
+
+    auto source = open_zip_xhtml_source(zip, job.second);
+    if (!source)
+    {
+        return true;
+    }
+
+    XhtmlTokenStream stream(std::move(source), job.second, job.first);
+    while (stream.read(entry.tokens, entry.id_to_addr))
+    {
+        // Checked between chunks, so an unwanted entry doesn't hold up the queue
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stop_requested || active_job_cancelled)
+        {
+            return false;
+        }
+    }
+
+    if (token_cache)
+    {
+        token_cache->write_blob(book_id, cache_key, encode_spine_tokens(job.first, entry.tokens, entry.id_to_addr));
+    }
+    return true;
+}
+
+void EpubSpinePrefetcher::run_worker()
+{
+    ZipArchive zip(epub_path);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        job_cv.wait(lock, [&]() {
+            return stop_requested || !queued_jobs.empty() || !pending_writes.empty();
+        });
+
+        // Written ahead of parsing, and before stopping, so they aren't lost
+        if (!pending_writes.empty())
+        {
+            std::vector<std::pair<std::string, std::string>> writes;
+            writes.swap(pending_writes);
+            lock.unlock();
+            for (const auto &write : writes)
+            {
+                token_cache->write_blob(book_id, write.first, write.second);
+            }
+            lock.lock();
+            continue;
+        }
+        if (stop_requested)
+        {
+            break;
+        }
+
+        Job job = std::move(queued_jobs.back());
+        queued_jobs.pop_back();
+        active_spine_index = job.first;
+        active_job_cancelled = false;
+        lock.unlock();
+
+        if (!zip.is_open() && !zip.open())
+        {
+            std::cerr << "Prefetcher failed to open " << epub_path << std::endl;
+        }
+
+        ParsedSpineEntry entry {job.first, {}, {}};
+        bool cancelled = zip.is_open() && !parse_entry(zip, job, entry);
+
+        #if DEBUG
+        std::cerr << (cancelled ? "Abandoned prefetch of " : "Prefetched ") << job.second << std::endl;
+        #endif
+
+        lock.lock();
+        if (!zip.is_open())
+        {
+            // Leave queued entries for the caller to parse
+            queued_jobs.clear();
+        }
+        else if (!cancelled && !active_job_cancelled)
+        {
+            results.push_back(std::move(entry));
+            results_ready = true;
+        }
+        active_spine_index = std::experimental::nullopt;
+        done_cv.notify_all();
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef EPUB_SPINE_PREFETCHER_H_
+#define EPUB_SPINE_PREFETCHER_H_
+
+#include "doc_api/doc_reader.h"
+#include "doc_api/token_table.h"
+#include "util/zip_archive.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <experimental/filesystem>
+#include <experimental/optional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct ParsedSpineEntry
+{
+    uint32_t spine_index;
+    TokenTable tokens;
+    std::unordered_map<std::string, DocAddr> id_to_addr;
+};
+
+// Parse spine entries on a background thread, ahead of the reader reaching
+// them. The worker opens its own handle to the epub, since libzip handles
+// can't be shared across threads. Entries are loaded from and persisted to
+// token_cache when given. xmlInitParser must have been called.
+class EpubSpinePrefetcher
+{
+public:
+    // (spine index, path of document in zip)
+    using Job = std::pair<uint32_t, std::experimental::filesystem::path>;
+
+private:
+    const std::experimental::filesystem::path epub_path;
+    DocReaderCache *token_cache;
+    const std::string book_id;
+
+    std::mutex mutex;
+    std::condition_variable job_cv;
+    std::condition_variable done_cv;
+    std::vector<Job> queued_jobs;
+    std::experimental::optional<uint32_t> active_spine_index;
+    bool active_job_cancelled = false;
+    std::vector<ParsedSpineEntry> results;
+    // (cache key, encoded entry) to write to token_cache
+    std::vector<std::pair<std::string, std::string>> pending_writes;
+
+    std::atomic<bool> results_ready {false};
+    std::atomic<bool> stop_requested {false};
+    std::thread worker;
+
+    void run_worker();
+    // Returns false if abandoned
+    bool parse_entry(const ZipArchive &zip, const Job &job, ParsedSpineEntry &entry);
+
+public:
+    EpubSpinePrefetcher(
+        std::experimental::filesystem::path epub_path,
+        DocReaderCache *token_cache = nullptr,
+        std::string book_id = {}
+    );
+    EpubSpinePrefetcher(const EpubSpinePrefetcher &) = delete;
+    EpubSpinePrefetcher &operator=(const EpubSpinePrefetcher &) = delete;
+
+    // Abandons any entry being parsed
+    virtual ~EpubSpinePrefetcher();
+
+    // Replace queued jobs. An entry being parsed is abandoned if it is no longer wanted.
+    void prefetch(std::vector<Job> jobs);
+
+    // Wait for entry if it is being parsed right now, otherwise drop it from
+    // the queue so the caller can parse it without waiting.
+    void wait_for(uint32_t spine_index);
+
+    // Write an entry encoded with encode_spine_tokens to token_cache, on the
+    // worker thread. Pending writes are finished before the worker stops.
+    void store(uint32_t spine_index, std::string encoded);
+
+    // True if take_results would return anything. Cheap enough to poll.
+    bool has_results() const;
+    // Move out all entries parsed so far
+    std::vector<ParsedSpineEntry> take_results();
+};
+
+#endif
@@ -5,15 +5,18 @@
 
 #include "doc_api/token_addressing.h"
 
+#include <algorithm>
 #include <iostream>
+#include <mutex>
 
 #define DEBUG 0
 
 struct TocItemProgressLookup
 {
     uint32_t total_size = 0;                             // Total size of the toc item in units of address space
-    std::vector<DocAddr> spine_to_start_addr;            // Start address for the toc item within each spine entry
-    std::vector<uint32_t> spine_to_cumulative_size;      // Total size of the toc item at the start of each spine entry
+    uint32_t start_spine = 0;                            // First spine entry covered by the toc item
+    std::vector<DocAddr> spine_to_start_addr;            // Start address for the toc item within each covered spine entry
+    std::vector<uint32_t> spine_to_cumulative_size;      // Total size of the toc item at the start of each covered spine entry
 };
 
 struct TocItemCache
@@ -23,12 +26,12 @@ struct TocItemCache
     uint32_t spine_start_index;
     std::string token_id_link;
 
-    // caching
+    // caching, guarded by EpubTocIndexState::start_address_mutex
     mutable bool start_address_is_valid = false;
     mutable DocAddr start_address = 0;  // address of first token for this toc item
 
     mutable bool progress_is_valid = false;
-    mutable TocItemProgressLookup progress {0, {}, {}};
+    mutable TocItemProgressLookup progress {0, 0, {}, {}};
 };
 
 struct EpubTocIndexState
@@ -36,8 +39,13 @@ struct EpubTocIndexState
     EpubDocIndex &doc_index;
     std::vector<TocItemCache> toc;
 
-    std::vector<uint32_t> spine_to_offset;
-    uint32_t book_width = 0;
+    // Toc items are in spine order, so lookups can binary search
+    bool toc_is_ordered = true;
+    // Whether start addresses of the toc items in a spine entry are in order
+    mutable std::unordered_map<uint32_t, bool> spine_items_are_ordered;
+
+    // Start addresses may be resolved from indexer threads
+    mutable std::mutex start_address_mutex;
 
     mutable uint32_t cached_toc_index = 0;
     mutable DocAddr cached_toc_index_start_address = -1;
@@ -179,61 +187,95 @@ DocAddr document_upper_address(const EpubDocIndex &doc_index, uint32_t spine_ind
     return make_address(spine_index) + doc_index.address_width(spine_index);
 }
 
-DocAddr resolve_start_address(uint32_t item_index, const EpubDocIndex &doc_index, const std::vector<TocItemCache> &toc)
+std::experimental::optional<DocAddr> known_start_address(uint32_t item_index, const EpubTocIndexState &state)
 {
-    if (item_index >= toc.size())
-    {
-        std::cerr << "Requested start address for invalid toc item index: " << item_index << std::endl;
-        return make_address();
-    }
-
-    auto &toc_item = toc[item_index];
+    std::lock_guard<std::mutex> lock(state.start_address_mutex);
+    const auto &toc_item = state.toc[item_index];
     if (toc_item.start_address_is_valid)
     {
         return toc_item.start_address;
     }
+    return std::experimental::nullopt;
+}
 
-    toc_item.start_address = make_address(toc_item.spine_start_index);
+void set_start_address(uint32_t item_index, DocAddr address, const EpubTocIndexState &state)
+{
+    std::lock_guard<std::mutex> lock(state.start_address_mutex);
+    const auto &toc_item = state.toc[item_index];
+    toc_item.start_address = address;
+    toc_item.start_address_is_valid = true;
+}
+
+// Start address of the toc item given the ids of its spine entry
+DocAddr start_address_from_ids(const TocItemCache &toc_item, const std::unordered_map<std::string, DocAddr> &elem_id_to_addr)
+{
     if (!toc_item.token_id_link.empty())
     {
         // Need to match fragment
-        const auto &elem_id_to_addr = doc_index.elem_id_to_address(toc_item.spine_start_index);
         auto it = elem_id_to_addr.find(toc_item.token_id_link);
         if (it != elem_id_to_addr.end())
         {
-            toc_item.start_address = it->second;
-        }
-        else
-        {
-            #if DEBUG
-            std::cerr << "Failed to find id=" << toc_item.token_id_link << " in spine " << toc_item.spine_start_index << std::endl;
-            #endif
+            return it->second;
         }
+
+        #if DEBUG
+        std::cerr << "Failed to find id=" << toc_item.token_id_link << " in spine " << toc_item.spine_start_index << std::endl;
+        #endif
     }
 
-    toc_item.start_address_is_valid = true;
-    return toc_item.start_address;
+    return make_address(toc_item.spine_start_index);
 }
 
-DocAddr resolve_upper_address(uint32_t item_index, const EpubDocIndex &doc_index, const std::vector<TocItemCache> &toc)
+DocAddr resolve_start_address(uint32_t item_index, const EpubTocIndexState &state)
+{
+    const auto &toc = state.toc;
+    if (item_index >= toc.size())
+    {
+        std::cerr << "Requested start address for invalid toc item index: " << item_index << std::endl;
+        return make_address();
+    }
+
+    auto known_address = known_start_address(item_index, state);
+    if (known_address)
+    {
+        return *known_address;
+    }
+
+    const auto &toc_item = toc[item_index];
+    DocAddr start_address = make_address(toc_item.spine_start_index);
+    if (!toc_item.token_id_link.empty())
+    {
+        start_address = start_address_from_ids(
+            toc_item,
+            state.doc_index.elem_id_to_address(toc_item.spine_start_index)
+        );
+    }
+
+    set_start_address(item_index, start_address, state);
+    return start_address;
+}
+
+DocAddr resolve_upper_address(uint32_t item_index, const EpubTocIndexState &state)
 {
     static const DocAddr null_address = make_address();
 
-    if (item_index >= toc.size())
+    if (item_index >= state.toc.size())
     {
         std::cerr << "Requested end address for invalid toc item index: " << item_index << std::endl;
         return null_address;
     }
 
-    if (item_index + 1 < toc.size())
+    if (item_index + 1 < state.toc.size())
     {
-        return resolve_start_address(item_index + 1, doc_index, toc);
+        return resolve_start_address(item_index + 1, state);
     }
-    return spine_upper_address(doc_index);
+    return spine_upper_address(state.doc_index);
 }
 
-const TocItemProgressLookup &resolve_progress_lookup(uint32_t item_index, const EpubDocIndex &doc_index, const std::vector<TocItemCache> &toc)
+const TocItemProgressLookup &resolve_progress_lookup(uint32_t item_index, const EpubTocIndexState &state)
 {
+    const auto &toc = state.toc;
+    const auto &doc_index = state.doc_index;
     if (item_index >= toc.size())
     {
         throw std::runtime_error("Requested progress for invalid toc item index" + std::to_string(item_index));
@@ -247,15 +289,20 @@ const TocItemProgressLookup &resolve_progress_lookup(uint32_t item_index, const
     }
 
     // Compute size of the toc item + lookup table to compute progress for any address within the toc item.
+    // Only needs spine widths, which are usually known from the index cache, so this rarely parses.
     {
-        progress.spine_to_start_addr.resize(doc_index.spine_size());
-        progress.spine_to_cumulative_size.resize(doc_index.spine_size());
-
-        DocAddr start_address = resolve_start_address(item_index, doc_index, toc);
-        DocAddr upper_address = resolve_upper_address(item_index, doc_index, toc);
+        DocAddr start_address = resolve_start_address(item_index, state);
+        DocAddr upper_address = resolve_upper_address(item_index, state);
 
         uint32_t start_spine = get_chapter_number(start_address);
-        uint32_t end_spine = get_chapter_number(upper_address);
+        uint32_t end_spine = std::max(
+            start_spine,
+            std::min(get_chapter_number(upper_address), doc_index.spine_size())
+        );
+
+        progress.start_spine = start_spine;
+        progress.spine_to_start_addr.assign(end_spine - start_spine + 1, start_address);
+        progress.spine_to_cumulative_size.assign(end_spine - start_spine + 1, 0);
 
         uint32_t cumulative_size = 0;
         for (uint32_t i = start_spine; i <= end_spine; ++i)
@@ -274,8 +321,8 @@ const TocItemProgressLookup &resolve_progress_lookup(uint32_t item_index, const
                 document_upper_address(doc_index, i)
             );
 
-            progress.spine_to_start_addr[i] = local_start;
-            progress.spine_to_cumulative_size[i] = cumulative_size;
+            progress.spine_to_start_addr[i - start_spine] = local_start;
+            progress.spine_to_cumulative_size[i - start_spine] = cumulative_size;
             cumulative_size += get_text_number(local_end) - get_text_number(local_start);
         }
         progress.total_size = cumulative_size;
@@ -285,10 +332,67 @@ const TocItemProgressLookup &resolve_progress_lookup(uint32_t item_index, const
     return progress;
 }
 
+// True if start addresses of toc items [begin, end) are in order. Resolves them.
+bool items_are_ordered(uint32_t spine_index, uint32_t begin, uint32_t end, const EpubTocIndexState &state)
+{
+    auto it = state.spine_items_are_ordered.find(spine_index);
+    if (it != state.spine_items_are_ordered.end())
+    {
+        return it->second;
+    }
+
+    bool is_ordered = true;
+    for (uint32_t i = begin + 1; i < end; ++i)
+    {
+        if (resolve_start_address(i, state) < resolve_start_address(i - 1, state))
+        {
+            #if DEBUG
+            std::cerr << "Toc item " << state.toc[i].display_name << " starts before the previous item" << std::endl;
+            #endif
+            is_ordered = false;
+            break;
+        }
+    }
+
+    state.spine_items_are_ordered[spine_index] = is_ordered;
+    return is_ordered;
+}
+
+// Used when toc items are out of order, so can't be binary searched
+std::experimental::optional<uint32_t> find_toc_item_linear(const DocAddr &address, const EpubTocIndexState &state)
+{
+    const auto &toc = state.toc;
+    uint32_t spine_index = get_chapter_number(address);
+    for (uint32_t i = 0; i < toc.size() - 1; ++i)
+    {
+        uint32_t toc_item_spine_start = toc[i].spine_start_index;
+        uint32_t toc_item_spine_end = toc[i + 1].spine_start_index;
+        if (spine_index >= toc_item_spine_start && spine_index <= toc_item_spine_end)
+        {
+            // Next chapter may not start at the beginning of the doc. Need to check addresses.
+            if (address >= resolve_start_address(i, state) && address < resolve_upper_address(i, state))
+            {
+                return i;
+            }
+        }
+    }
+
+    uint32_t i = toc.size() - 1;
+    if (address >= resolve_start_address(i, state))
+    {
+        return i;
+    }
+    return std::experimental::nullopt;
+}
+
 } // namespace
 
-EpubTocIndex::EpubTocIndex(const PackageContents &package, const std::vector<NavPoint> &navmap, EpubDocIndex &doc_index)
-    : state(std::make_unique<EpubTocIndexState>(doc_index))
+EpubTocIndex::EpubTocIndex(
+    const PackageContents &package,
+    const std::vector<NavPoint> &navmap,
+    EpubDocIndex &doc_index,
+    const std::vector<std::experimental::optional<uint32_t>> &start_offsets_cache
+) : state(std::make_unique<EpubTocIndexState>(doc_index))
 {
     // Compile Toc
     auto &toc = state->toc;
@@ -301,17 +405,6 @@ EpubTocIndex::EpubTocIndex(const PackageContents &package, const std::vector<Nav
         fallback_convert_spine_to_toc(package, toc);
     }
 
-    // Compile global progress lookup
-    {
-        uint32_t offset = 0;
-        for (uint32_t i = 0; i < doc_index.spine_size(); ++i)
-        {
-            state->spine_to_offset.emplace_back(offset);
-            offset += doc_index.address_width(i);
-        }
-        state->book_width = offset;
-    }
-
     #if DEBUG
     {
         std::cerr << "TOC:" << std::endl;
@@ -333,10 +426,24 @@ EpubTocIndex::EpubTocIndex(const PackageContents &package, const std::vector<Nav
             if (toc_item.spine_start_index < last_spine_index)
             {
                 std::cerr << "Toc item " << toc_item.display_name << " is out of order" << std::endl;
+                state->toc_is_ordered = false;
             }
             last_spine_index = toc_item.spine_start_index;
         }
     }
+
+    // Restore start addresses resolved in a previous session
+    if (start_offsets_cache.size() == toc.size())
+    {
+        for (uint32_t i = 0; i < toc.size(); ++i)
+        {
+            if (start_offsets_cache[i])
+            {
+                toc[i].start_address = make_address(toc[i].spine_start_index, *start_offsets_cache[i]);
+                toc[i].start_address_is_valid = true;
+            }
+        }
+    }
 }
 
 EpubTocIndex::~EpubTocIndex()
@@ -370,7 +477,7 @@ uint32_t EpubTocIndex::toc_item_indent_level(uint32_t toc_item_index) const
 
 DocAddr EpubTocIndex::get_toc_item_address(uint32_t toc_item_index) const
 {
-    return resolve_start_address(toc_item_index, state->doc_index, state->toc);
+    return resolve_start_address(toc_item_index, *state);
 }
 
 std::experimental::optional<uint32_t> EpubTocIndex::get_toc_item_index(const DocAddr &address) const
@@ -390,38 +497,75 @@ std::experimental::optional<uint32_t> EpubTocIndex::get_toc_item_index(const Doc
         return cached_toc_index;
     }
 
+    auto find_linear = [&]() {
+        auto toc_index = find_toc_item_linear(address, *state);
+        if (toc_index && *toc_index + 1 < toc.size())
+        {
+            cached_toc_index = *toc_index;
+            cached_toc_index_start_address = resolve_start_address(*toc_index, *state);
+            cached_toc_index_upper_address = resolve_upper_address(*toc_index, *state);
+        }
+        return toc_index;
+    };
+
+    if (!state->toc_is_ordered)
+    {
+        return find_linear();
+    }
+
+    // Items starting in an earlier spine entry start before the address, and
+    // items starting in a later one after it. Only the start addresses of
+    // items in the address's own spine entry need resolving.
     uint32_t spine_index = get_chapter_number(address);
-    for (uint32_t i = 0; i < toc.size() - 1; ++i)
+    auto by_spine = [](const TocItemCache &toc_item, uint32_t spine_index) {
+        return toc_item.spine_start_index < spine_index;
+    };
+    uint32_t spine_begin = std::lower_bound(toc.begin(), toc.end(), spine_index, by_spine) - toc.begin();
+    uint32_t spine_end = std::lower_bound(toc.begin() + spine_begin, toc.end(), spine_index + 1, by_spine) - toc.begin();
+
+    if (!items_are_ordered(spine_index, spine_begin, spine_end, *state))
     {
-        auto &toc_item = toc[i];
-        auto &next_toc_item = toc[i + 1];
+        return find_linear();
+    }
 
-        uint32_t toc_item_spine_start = toc_item.spine_start_index;
-        uint32_t toc_item_spine_end = next_toc_item.spine_start_index;
-        if (spine_index >= toc_item_spine_start && spine_index <= toc_item_spine_end)
+    // Find the first item in the spine entry starting after the address
+    uint32_t lo = spine_begin;
+    uint32_t hi = spine_end;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (resolve_start_address(mid, *state) <= address)
         {
-            // Next chapter may not start at the beginning of the doc. Need to check addresses.
-            const auto &toc_item_start_addr = resolve_start_address(i, state->doc_index, state->toc);
-            const auto &toc_item_upper_addr = resolve_upper_address(i, state->doc_index, state->toc);
-            if (address >= toc_item_start_addr && address < toc_item_upper_addr)
-            {
-                cached_toc_index = i;
-                cached_toc_index_start_address = toc_item_start_addr;
-                cached_toc_index_upper_address = toc_item_upper_addr;
-                return i;
-            }
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
         }
     }
 
+    if (lo == 0)
     {
-        uint32_t i = toc.size() - 1;
-        if (address >= resolve_start_address(i, state->doc_index, state->toc))
-        {
-            return i;
-        }
+        return std::experimental::fundamentals_v1::nullopt;
     }
 
-	return std::experimental::fundamentals_v1::nullopt;
+    uint32_t i = lo - 1;
+    cached_toc_index = i;
+    cached_toc_index_start_address = resolve_start_address(i, *state);
+    if (lo == spine_end)
+    {
+        // Next item starts in a later spine entry, so at least at its start
+        cached_toc_index_upper_address = (
+            lo < toc.size()
+            ? make_address(toc[lo].spine_start_index)
+            : spine_upper_address(state->doc_index)
+        );
+    }
+    else
+    {
+        cached_toc_index_upper_address = resolve_start_address(lo, *state);
+    }
+    return i;
 }
 
 std::pair<uint32_t, uint32_t> EpubTocIndex::get_toc_item_progress(const DocAddr &address) const
@@ -432,16 +576,69 @@ std::pair<uint32_t, uint32_t> EpubTocIndex::get_toc_item_progress(const DocAddr
         return {0, 0};
     }
 
-    const auto &progress = resolve_progress_lookup(*toc_index, state->doc_index, state->toc);
+    const auto &progress = resolve_progress_lookup(*toc_index, *state);
     uint32_t spine_index = get_chapter_number(address);
+    if (spine_index < progress.start_spine || spine_index - progress.start_spine >= progress.spine_to_start_addr.size())
+    {
+        return {0, progress.total_size};
+    }
 
     uint32_t pos = (
-        progress.spine_to_cumulative_size[spine_index] +
-        static_cast<uint32_t>(address - progress.spine_to_start_addr[spine_index])
+        progress.spine_to_cumulative_size[spine_index - progress.start_spine] +
+        static_cast<uint32_t>(address - progress.spine_to_start_addr[spine_index - progress.start_spine])
     );
     return {pos, progress.total_size};
 }
 
+bool EpubTocIndex::needs_spine_ids(uint32_t spine_index) const
+{
+    for (uint32_t i = 0; i < state->toc.size(); ++i)
+    {
+        const auto &toc_item = state->toc[i];
+        if (
+            toc_item.spine_start_index == spine_index &&
+            !toc_item.token_id_link.empty() &&
+            !known_start_address(i, *state)
+        )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void EpubTocIndex::resolve_spine_items(uint32_t spine_index, const std::unordered_map<std::string, DocAddr> &elem_id_to_addr)
+{
+    for (uint32_t i = 0; i < state->toc.size(); ++i)
+    {
+        const auto &toc_item = state->toc[i];
+        if (toc_item.spine_start_index == spine_index && !known_start_address(i, *state))
+        {
+            set_start_address(i, start_address_from_ids(toc_item, elem_id_to_addr), *state);
+        }
+    }
+}
+
+std::vector<std::experimental::optional<uint32_t>> EpubTocIndex::known_start_offsets() const
+{
+    std::lock_guard<std::mutex> lock(state->start_address_mutex);
+
+    std::vector<std::experimental::optional<uint32_t>> offsets;
+    offsets.reserve(state->toc.size());
+    for (const auto &toc_item : state->toc)
+    {
+        if (toc_item.start_address_is_valid)
+        {
+            offsets.push_back(get_text_number(toc_item.start_address));
+        }
+        else
+        {
+            offsets.push_back(std::experimental::nullopt);
+        }
+    }
+    return offsets;
+}
+
 std::pair<uint32_t, uint32_t> EpubTocIndex::get_global_progress(const DocAddr &address) const
 {
     uint32_t cur_spine = get_chapter_number(address);
@@ -450,8 +647,22 @@ std::pair<uint32_t, uint32_t> EpubTocIndex::get_global_progress(const DocAddr &a
         return {0, 0};
     }
 
+    // Widths may still be estimates while the book is being indexed
+    auto spine_widths = state->doc_index.estimated_address_widths();
+
+    uint32_t offset = 0;
+    uint32_t book_width = 0;
+    for (uint32_t i = 0; i < spine_widths.size(); ++i)
+    {
+        if (i == cur_spine)
+        {
+            offset = book_width;
+        }
+        book_width += spine_widths[i];
+    }
+
     return {
-        state->spine_to_offset[cur_spine] + (address - make_address(cur_spine)),
-        state->book_width
+        offset + (address - make_address(cur_spine)),
+        book_width
     };
 }
@@ -7,6 +7,8 @@
 #include <cstdint>
 #include <memory>
 #include <experimental/optional>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 struct EpubTocIndexState;
@@ -20,7 +22,12 @@ class EpubTocIndex
     std::unique_ptr<EpubTocIndexState> state;
 
 public:
-    EpubTocIndex(const PackageContents &package, const std::vector<NavPoint> &navmap, EpubDocIndex &doc_index);
+    EpubTocIndex(
+        const PackageContents &package,
+        const std::vector<NavPoint> &navmap,
+        EpubDocIndex &doc_index,
+        const std::vector<std::experimental::optional<uint32_t>> &start_offsets_cache
+    );
     EpubTocIndex(const EpubTocIndex &) = delete;
     EpubTocIndex &operator=(const EpubTocIndex &) = delete;
     virtual ~EpubTocIndex();
@@ -36,6 +43,14 @@ public:
     std::pair<uint32_t, uint32_t> get_toc_item_progress(const DocAddr &address) const;
     // Return (pos inside, size of) the book in units of address space.
     std::pair<uint32_t, uint32_t> get_global_progress(const DocAddr &address) const;
+
+    // True if start addresses of toc items in the spine entry are still unknown,
+    // and need its element ids to resolve.
+    bool needs_spine_ids(uint32_t spine_index) const;
+    // Resolve start addresses of toc items in the spine entry. Thread safe.
+    void resolve_spine_items(uint32_t spine_index, const std::unordered_map<std::string, DocAddr> &elem_id_to_addr);
+    // Start address offsets within their spine entries, of the toc items resolved so far. Thread safe.
+    std::vector<std::experimental::optional<uint32_t>> known_start_offsets() const;
 };
 
 #endif
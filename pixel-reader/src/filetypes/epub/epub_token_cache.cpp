@@ -0,0 +1,254 @@
+#include "./epub_token_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Bump whenever the encoding, or the tokens produced by the xhtml parser, change
+#define TOKEN_CACHE_FORMAT_VERSION 2
+
+namespace
+{
+
+constexpr char TOKEN_CACHE_MAGIC[4] = {'P', 'R', 'T', 'K'};
+
+// magic, version, spine index, checksum
+constexpr uint32_t HEADER_SIZE = sizeof(TOKEN_CACHE_MAGIC) + 2 * sizeof(uint32_t) + sizeof(uint64_t);
+
+// FNV-1a
+uint64_t checksum(const char *data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+template <typename T>
+void write_value(std::string &out, T value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void write_str(std::string &out, std::string_view str)
+{
+    write_value<uint32_t>(out, str.size());
+    out.append(str);
+}
+
+class Reader
+{
+    const char *pos;
+    const char *end;
+
+public:
+    Reader(const char *data, size_t size) : pos(data), end(data + size) {}
+
+    template <typename T>
+    bool read_value(T &value)
+    {
+        if (static_cast<size_t>(end - pos) < sizeof(value))
+        {
+            return false;
+        }
+        std::memcpy(&value, pos, sizeof(value));
+        pos += sizeof(value);
+        return true;
+    }
+
+    bool read_str(std::string_view &str)
+    {
+        uint32_t size;
+        if (!read_value(size) || static_cast<size_t>(end - pos) < size)
+        {
+            return false;
+        }
+        str = std::string_view(pos, size);
+        pos += size;
+        return true;
+    }
+
+    bool at_end() const
+    {
+        return pos == end;
+    }
+};
+
+bool decode_token(Reader &reader, TokenTable &tokens_out)
+{
+    uint8_t type;
+    DocAddr address;
+    int32_t nest_level = 0;
+    std::string_view text;
+    if (!reader.read_value(type) || !reader.read_value(address))
+    {
+        return false;
+    }
+
+    switch (static_cast<TokenType>(type))
+    {
+        case TokenType::Text:
+        case TokenType::Header:
+        case TokenType::Image:
+            break;
+        case TokenType::ListItem:
+            if (!reader.read_value(nest_level))
+            {
+                return false;
+            }
+            break;
+        default:
+            return false;
+    }
+
+    if (!reader.read_str(text))
+    {
+        return false;
+    }
+
+    tokens_out.push_back(static_cast<TokenType>(type), address, text, nest_level);
+    return true;
+}
+
+} // namespace
+
+std::string spine_tokens_cache_key(uint32_t spine_index)
+{
+    return "spine_tokens_" + std::to_string(spine_index);
+}
+
+std::string encode_spine_tokens(
+    uint32_t spine_index,
+    const TokenTable &tokens,
+    const std::unordered_map<std::string, DocAddr> &id_to_addr)
+{
+    std::string out(HEADER_SIZE, '\0');
+
+    write_value<uint32_t>(out, tokens.size());
+    write_value<uint32_t>(out, tokens.text_bytes());
+    for (uint32_t i = 0; i < tokens.size(); ++i)
+    {
+        DocToken token = tokens[i];
+        write_value<uint8_t>(out, static_cast<uint8_t>(token.type));
+        write_value<DocAddr>(out, token.address);
+        if (token.type == TokenType::ListItem)
+        {
+            write_value<int32_t>(out, token.nest_level);
+        }
+        write_str(out, token.text);
+    }
+
+    write_value<uint32_t>(out, id_to_addr.size());
+    for (const auto &entry : id_to_addr)
+    {
+        write_str(out, entry.first);
+        write_value<DocAddr>(out, entry.second);
+    }
+
+    // Fill in header now that the body is known
+    char *header = &out[0];
+    std::memcpy(header, TOKEN_CACHE_MAGIC, sizeof(TOKEN_CACHE_MAGIC));
+    header += sizeof(TOKEN_CACHE_MAGIC);
+
+    uint32_t version = TOKEN_CACHE_FORMAT_VERSION;
+    std::memcpy(header, &version, sizeof(version));
+    header += sizeof(version);
+
+    std::memcpy(header, &spine_index, sizeof(spine_index));
+    header += sizeof(spine_index);
+
+    uint64_t body_checksum = checksum(out.data() + HEADER_SIZE, out.size() - HEADER_SIZE);
+    std::memcpy(header, &body_checksum, sizeof(body_checksum));
+
+    return out;
+}
+
+bool try_decode_spine_tokens(
+    const std::string &encoded,
+    uint32_t spine_index,
+    TokenTable &tokens_out,
+    std::unordered_map<std::string, DocAddr> &id_to_addr_out)
+{
+    Reader header(encoded.data(), encoded.size());
+
+    char magic[sizeof(TOKEN_CACHE_MAGIC)];
+    uint32_t version;
+    uint32_t encoded_spine_index;
+    uint64_t body_checksum;
+    if (!header.read_value(magic) ||
+        !header.read_value(version) ||
+        !header.read_value(encoded_spine_index) ||
+        !header.read_value(body_checksum))
+    {
+        return false;
+    }
+
+    if (std::memcmp(magic, TOKEN_CACHE_MAGIC, sizeof(magic)) != 0 ||
+        version != TOKEN_CACHE_FORMAT_VERSION ||
+        encoded_spine_index != spine_index)
+    {
+        return false;
+    }
+
+    if (checksum(encoded.data() + HEADER_SIZE, encoded.size() - HEADER_SIZE) != body_checksum)
+    {
+        std::cerr << "Token cache checksum mismatch for spine entry " << spine_index << std::endl;
+        return false;
+    }
+
+    Reader reader(encoded.data() + HEADER_SIZE, encoded.size() - HEADER_SIZE);
+    TokenTable tokens;
+    std::unordered_map<std::string, DocAddr> id_to_addr;
+
+    uint32_t token_count;
+    uint32_t text_bytes;
+    if (!reader.read_value(token_count) || !reader.read_value(text_bytes))
+    {
+        return false;
+    }
+    // Text goes in a single chunk of exactly its size
+    tokens.reserve(std::min<size_t>(token_count, encoded.size()), std::min<size_t>(text_bytes, encoded.size()));
+    for (uint32_t i = 0; i < token_count; ++i)
+    {
+        if (!decode_token(reader, tokens))
+        {
+            return false;
+        }
+    }
+
+    uint32_t id_count;
+    if (!reader.read_value(id_count))
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < id_count; ++i)
+    {
+        std::string_view id;
+        DocAddr address;
+        if (!reader.read_str(id) || !reader.read_value(address))
+        {
+            return false;
+        }
+        id_to_addr[std::string(id)] = address;
+    }
+
+    if (!reader.at_end())
+    {
+        return false;
+    }
+
+    tokens.shrink_to_fit();
+    if (tokens_out.empty())
+    {
+        tokens_out = std::move(tokens);
+    }
+    else
+    {
+        tokens_out.append(tokens);
+    }
+    id_to_addr_out.insert(id_to_addr.begin(), id_to_addr.end());
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef EPUB_TOKEN_CACHE_H_
+#define EPUB_TOKEN_CACHE_H_
+
+#include "doc_api/token_table.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Binary encoding of a parsed spine entry, for persisting in a DocReaderCache.
+// Entries are only valid on the machine that wrote them (native byte order),
+// and are rejected if written by a different format version or corrupted.
+
+// Cache key for the tokens of a spine entry
+std::string spine_tokens_cache_key(uint32_t spine_index);
+
+std::string encode_spine_tokens(
+    uint32_t spine_index,
+    const TokenTable &tokens,
+    const std::unordered_map<std::string, DocAddr> &id_to_addr
+);
+
+bool try_decode_spine_tokens(
+    const std::string &encoded,
+    uint32_t spine_index,
+    TokenTable &tokens_out,
+    std::unordered_map<std::string, DocAddr> &id_to_addr_out
+);
+
+#endif
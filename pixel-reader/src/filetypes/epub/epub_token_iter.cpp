@@ -6,7 +6,9 @@
 EPubTokenIter::EPubTokenIter(EpubDocIndex *index, DocAddr address)
     : index(index)
 {
-    seek(address);
+    // Pinned once positioned, so only that entry's neighbours are prefetched
+    locate(address, current_spine_idx, current_token_idx);
+    index->pin_spine_entry(current_spine_idx);
 }
 
 EPubTokenIter::EPubTokenIter(const EPubTokenIter &other)
@@ -14,18 +16,35 @@ EPubTokenIter::EPubTokenIter(const EPubTokenIter &other)
     , current_spine_idx(other.current_spine_idx)
     , current_token_idx(other.current_token_idx)
 {
+    index->pin_spine_entry(current_spine_idx);
+}
+
+EPubTokenIter::~EPubTokenIter()
+{
+    index->unpin_spine_entry(current_spine_idx);
+}
+
+void EPubTokenIter::set_spine_idx(uint32_t spine_idx)
+{
+    if (spine_idx != current_spine_idx)
+    {
+        // Unpinned first, so neighbours to prefetch are worked out from the new entry alone
+        index->unpin_spine_entry(current_spine_idx);
+        index->pin_spine_entry(spine_idx);
+        current_spine_idx = spine_idx;
+    }
 }
 
 bool EPubTokenIter::seek_to_first()
 {
     while (current_spine_idx < index->spine_size())
     {
-        if (current_token_idx < index->token_count(current_spine_idx))
+        if (index->token(current_spine_idx, current_token_idx))
         {
             return true;
         }
 
-        ++current_spine_idx;
+        set_spine_idx(current_spine_idx + 1);
         current_token_idx = 0;
     }
 
@@ -42,7 +61,8 @@ bool EPubTokenIter::seek_to_prev()
 
     while (current_spine_idx > 0)
     {
-        if (--current_spine_idx < index->spine_size())
+        set_spine_idx(current_spine_idx - 1);
+        if (current_spine_idx < index->spine_size())
         {
             uint32_t token_count = index->token_count(current_spine_idx);
             if (token_count)
@@ -58,52 +78,51 @@ bool EPubTokenIter::seek_to_prev()
 
 const DocToken *EPubTokenIter::read(int direction)
 {
-    const DocToken *token = nullptr;
+    std::experimental::optional<DocToken> token;
 
     if (direction < 0)
     {
         if (seek_to_prev())
         {
-            token = index->tokens(current_spine_idx)[current_token_idx].get();
+            token = index->token(current_spine_idx, current_token_idx);
         }
     }
     else
     {
         if (seek_to_first())
         {
-            token = index->tokens(current_spine_idx)[current_token_idx++].get();
+            token = index->token(current_spine_idx, current_token_idx++);
         }
     }
 
-    return token;
+    if (!token)
+    {
+        return nullptr;
+    }
+    current_token = *token;
+    return &current_token;
 }
 
-void EPubTokenIter::seek(DocAddr address)
+void EPubTokenIter::locate(DocAddr address, uint32_t &spine_idx, uint32_t &token_idx) const
 {
-    uint32_t new_spine_idx = std::min(
+    spine_idx = std::min(
         get_chapter_number(address),
         index->spine_size()
     );
-    uint32_t new_token_idx = 0;
-    if (new_spine_idx < index->spine_size())
+    token_idx = 0;
+    if (spine_idx < index->spine_size())
     {
-        const auto &tokens = index->tokens(new_spine_idx);
-        uint32_t token_idx = 0;
-        for (const auto &token: tokens)
-        {
-            if (token->address <= address)
-            {
-                new_token_idx = token_idx;
-            }
-            if (token->address >= address)
-            {
-                break;
-            }
-            ++token_idx;
-        }
+        token_idx = index->seek_token_index(spine_idx, address);
     }
+}
+
+void EPubTokenIter::seek(DocAddr address)
+{
+    uint32_t new_spine_idx;
+    uint32_t new_token_idx;
+    locate(address, new_spine_idx, new_token_idx);
 
-    current_spine_idx = new_spine_idx;
+    set_spine_idx(new_spine_idx);
     current_token_idx = new_token_idx;
 }
 
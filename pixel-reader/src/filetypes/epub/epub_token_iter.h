@@ -10,6 +10,14 @@ class EPubTokenIter: public TokenIter
     EpubDocIndex *index;
     uint32_t current_spine_idx = 0;
     uint32_t current_token_idx = 0;
+    // Text points into the index, which keeps it in place while the spine
+    // entry is pinned
+    DocToken current_token;
+
+    // Keeps the current spine entry pinned in the index
+    void set_spine_idx(uint32_t spine_idx);
+    // Spine entry and token to read from at address
+    void locate(DocAddr address, uint32_t &spine_idx, uint32_t &token_idx) const;
 
     bool seek_to_first();
     bool seek_to_prev();
@@ -17,6 +25,8 @@ class EPubTokenIter: public TokenIter
 public:
     EPubTokenIter(EpubDocIndex *index, DocAddr address);
     EPubTokenIter(const EPubTokenIter &);
+    EPubTokenIter &operator=(const EPubTokenIter &) = delete;
+    virtual ~EPubTokenIter();
 
     const DocToken *read(int direction) override;
     void seek(DocAddr address) override;
@@ -0,0 +1,87 @@
+#include "../epub_doc_addr.h"
+#include "../epub_token_cache.h"
+
+#include <gtest/gtest.h>
+
+static TokenTable make_tokens()
+{
+    TokenTable tokens;
+    tokens.push_back(HeaderDocToken(make_address(3, 0), "Chapter 3"));
+    tokens.push_back(TextDocToken(make_address(3, 8), "Some text \xe2\x80\x94 with utf8"));
+    tokens.push_back(TextDocToken(make_address(3, 30), ""));
+    tokens.push_back(ImageDocToken(make_address(3, 30), "OEBPS/images/cover.png"));
+    tokens.push_back(ListItemDocToken(make_address(3, 31), "item", 2));
+    return tokens;
+}
+
+static std::unordered_map<std::string, DocAddr> make_ids()
+{
+    return {
+        {"ch3", make_address(3, 0)},
+        {"note-1", make_address(3, 30)},
+    };
+}
+
+TEST(EPUB_TOKEN_CACHE, round_trip)
+{
+    auto tokens = make_tokens();
+    auto ids = make_ids();
+    auto encoded = encode_spine_tokens(3, tokens, ids);
+
+    TokenTable decoded_tokens;
+    std::unordered_map<std::string, DocAddr> decoded_ids;
+    ASSERT_TRUE(try_decode_spine_tokens(encoded, 3, decoded_tokens, decoded_ids));
+
+    ASSERT_EQ(decoded_tokens.size(), tokens.size());
+    for (uint32_t i = 0; i < tokens.size(); ++i)
+    {
+        EXPECT_EQ(decoded_tokens[i], tokens[i]) << i;
+    }
+    EXPECT_EQ(decoded_ids, ids);
+}
+
+TEST(EPUB_TOKEN_CACHE, empty_entry)
+{
+    TokenTable tokens;
+    std::unordered_map<std::string, DocAddr> ids;
+    auto encoded = encode_spine_tokens(0, tokens, ids);
+
+    ASSERT_TRUE(try_decode_spine_tokens(encoded, 0, tokens, ids));
+    EXPECT_TRUE(tokens.empty());
+    EXPECT_TRUE(ids.empty());
+}
+
+TEST(EPUB_TOKEN_CACHE, wrong_spine_index)
+{
+    auto encoded = encode_spine_tokens(3, make_tokens(), make_ids());
+
+    TokenTable tokens;
+    std::unordered_map<std::string, DocAddr> ids;
+    EXPECT_FALSE(try_decode_spine_tokens(encoded, 4, tokens, ids));
+    EXPECT_TRUE(tokens.empty());
+}
+
+TEST(EPUB_TOKEN_CACHE, corrupt)
+{
+    auto encoded = encode_spine_tokens(3, make_tokens(), make_ids());
+
+    TokenTable tokens;
+    std::unordered_map<std::string, DocAddr> ids;
+
+    // Any flipped byte is caught by the header or checksum
+    for (uint32_t i = 0; i < encoded.size(); ++i)
+    {
+        auto corrupted = encoded;
+        corrupted[i] ^= 0x20;
+        EXPECT_FALSE(try_decode_spine_tokens(corrupted, 3, tokens, ids)) << i;
+    }
+
+    // Truncated
+    for (uint32_t size = 0; size < encoded.size(); ++size)
+    {
+        EXPECT_FALSE(try_decode_spine_tokens(encoded.substr(0, size), 3, tokens, ids)) << size;
+    }
+
+    EXPECT_TRUE(tokens.empty());
+    EXPECT_TRUE(ids.empty());
+}
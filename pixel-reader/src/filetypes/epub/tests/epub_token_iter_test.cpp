@@ -0,0 +1,78 @@
+#include "../epub_doc_addr.h"
+#include "../epub_doc_index.h"
+#include "../epub_token_iter.h"
+#include "util/tests/test_files.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+
+namespace
+{
+
+std::string paragraph_text(uint32_t i)
+{
+    return "Paragraph " + std::to_string(i) + " of a chapter long enough to be parsed in several chunks.";
+}
+
+std::string make_chapter(uint32_t num_paragraphs)
+{
+    std::string xhtml = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\"><body>\n";
+    for (uint32_t i = 0; i < num_paragraphs; ++i)
+    {
+        xhtml += "<p>" + paragraph_text(i) + "</p>\n";
+    }
+    xhtml += "</body></html>\n";
+    return xhtml;
+}
+
+PackageContents make_package(const std::string &chapter_path)
+{
+    PackageContents package;
+    package.id_to_manifest_item["ch"] = {chapter_path, chapter_path, APPLICATION_XHTML_XML, ""};
+    package.spine_ids.push_back("ch");
+    return package;
+}
+
+} // namespace
+
+TEST(EPUB_TOKEN_ITER, token_survives_other_iter_parsing)
+{
+    const uint32_t num_paragraphs = 400;
+
+    TempDir dir("epub_token_iter");
+    auto zip_path = write_file(dir, "book.epub", make_stored_zip({{"ch.xhtml", make_chapter(num_paragraphs)}}));
+
+    ZipArchive zip(zip_path);
+    ASSERT_TRUE(zip.open());
+    EpubDocIndex index(make_package("ch.xhtml"), zip, {});
+
+    // Reading the first paragraph only parses the start of the chapter
+    EPubTokenIter first(&index, make_address(0, 0));
+    const DocToken *token = nullptr;
+    uint32_t first_index = 0;
+    for (; (token = first.read(1)) && token->text != paragraph_text(0); ++first_index)
+    {
+    }
+    ASSERT_TRUE(token);
+
+    // Parse the rest of the chapter through another iterator
+    EPubTokenIter second(&index, make_address(0, 0));
+    std::vector<std::string> texts;
+    while (const DocToken *other = second.read(1))
+    {
+        texts.emplace_back(other->text);
+    }
+    ASSERT_GE(texts.size(), num_paragraphs);
+    ASSERT_NE(texts.end(), std::find(texts.begin(), texts.end(), paragraph_text(num_paragraphs - 1)));
+
+    // Still readable, and reading carries on from it
+    ASSERT_EQ(paragraph_text(0), token->text);
+    for (uint32_t i = first_index + 1; i < texts.size(); ++i)
+    {
+        token = first.read(1);
+        ASSERT_TRUE(token);
+        ASSERT_EQ(texts[i], token->text);
+    }
+}
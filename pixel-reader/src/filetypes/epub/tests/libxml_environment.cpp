@@ -0,0 +1,25 @@
+#include <gtest/gtest.h>
+#include <libxml/parser.h>
+
+namespace
+{
+
+// Initialize parser globals once for all tests, as the reader does in main,
+// since parsing may happen on worker threads
+class LibxmlEnvironment : public ::testing::Environment
+{
+public:
+    void SetUp() override
+    {
+        xmlInitParser();
+    }
+
+    void TearDown() override
+    {
+        xmlCleanupParser();
+    }
+};
+
+const ::testing::Environment *libxml_environment = ::testing::AddGlobalTestEnvironment(new LibxmlEnvironment);
+
+} // namespace
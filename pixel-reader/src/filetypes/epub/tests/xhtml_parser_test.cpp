@@ -2,31 +2,27 @@
 
 #include <gtest/gtest.h>
 
-static void ASSERT_TOKENS_EQ(const std::vector<std::unique_ptr<DocToken>> &actual_tokens, const std::vector<std::unique_ptr<DocToken>> &expected_tokens)
+#include <algorithm>
+#include <cstring>
+
+static void ASSERT_TOKENS_EQ(const TokenTable &actual_tokens, const std::vector<DocToken> &expected_tokens)
 {
-    auto actual_it = actual_tokens.begin();
-    auto expected_it = expected_tokens.begin();
-    int i = 0;
-    while (actual_it != actual_tokens.end() && expected_it != expected_tokens.end())
+    for (uint32_t i = 0; i < actual_tokens.size() && i < expected_tokens.size(); ++i)
     {
-        const auto &actual = *actual_it;
-        const auto &expected = *expected_it;
-    
-        EXPECT_EQ(actual->type, expected->type) << i << ": Type didn't match";
-        EXPECT_EQ(actual->address, expected->address) << i << ": Address didn't match";
-        ASSERT_EQ(*actual.get(), *expected.get()) << i << ": Token didn't match";
+        DocToken actual = actual_tokens[i];
+        const DocToken &expected = expected_tokens[i];
     
-        ++actual_it;
-        ++expected_it;
-        ++i;
+        EXPECT_EQ(actual.type, expected.type) << i << ": Type didn't match";
+        EXPECT_EQ(actual.address, expected.address) << i << ": Address didn't match";
+        ASSERT_EQ(actual, expected) << i << ": Token didn't match";
     }
 
     ASSERT_EQ(actual_tokens.size(), expected_tokens.size());
 }
 
-static std::vector<std::unique_ptr<DocToken>> _parse_xhtml_tokens(const char *xml)
+static TokenTable _parse_xhtml_tokens(const char *xml)
 {
-    std::vector<std::unique_ptr<DocToken>> tokens;
+    TokenTable tokens;
     std::unordered_map<std::string, DocAddr> ids;
     parse_xhtml_tokens(xml, "/base/file.xhtml", 0, tokens, ids);
     return tokens;
@@ -47,8 +43,8 @@ TEST(XHTML_PARSER, basic_text_valid_xhtml)
         "</html>"
     );
   
-    std::vector<std::unique_ptr<DocToken>> expected_tokens;
-    expected_tokens.push_back(std::make_unique<TextDocToken>(0, "Text"));
+    std::vector<DocToken> expected_tokens;
+    expected_tokens.push_back(TextDocToken(0, "Text"));
   
     ASSERT_TOKENS_EQ(
         _parse_xhtml_tokens(xml),
@@ -64,8 +60,8 @@ TEST(XHTML_PARSER, whitespace_compaction)
         "</body></html>"
     );
   
-    std::vector<std::unique_ptr<DocToken>> expected_tokens;
-    expected_tokens.push_back(std::make_unique<TextDocToken>(0, "This has some extra white space"));
+    std::vector<DocToken> expected_tokens;
+    expected_tokens.push_back(TextDocToken(0, "This has some extra white space"));
   
     ASSERT_TOKENS_EQ(
         _parse_xhtml_tokens(xml),
@@ -82,9 +78,9 @@ TEST(XHTML_PARSER, line_break)
         "</body></html>"
     );
   
-    std::vector<std::unique_ptr<DocToken>> expected_tokens;
-    expected_tokens.push_back(std::make_unique<TextDocToken>(0, "Line 1"));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(5, "Line 2"));
+    std::vector<DocToken> expected_tokens;
+    expected_tokens.push_back(TextDocToken(0, "Line 1"));
+    expected_tokens.push_back(TextDocToken(5, "Line 2"));
   
     ASSERT_TOKENS_EQ(
         _parse_xhtml_tokens(xml),
@@ -109,12 +105,12 @@ TEST(XHTML_PARSER, section_compaction)
         "</body></html>"
     );
   
-    std::vector<std::unique_ptr<DocToken>> expected_tokens;
-    expected_tokens.push_back(std::make_unique<TextDocToken>(0,  ""          ));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(0,  "Some text."));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(9,  ""          ));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(9,  "Some more."));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(18, ""          ));
+    std::vector<DocToken> expected_tokens;
+    expected_tokens.push_back(TextDocToken(0,  ""          ));
+    expected_tokens.push_back(TextDocToken(0,  "Some text."));
+    expected_tokens.push_back(TextDocToken(9,  ""          ));
+    expected_tokens.push_back(TextDocToken(9,  "Some more."));
+    expected_tokens.push_back(TextDocToken(18, ""          ));
   
     ASSERT_TOKENS_EQ(
         _parse_xhtml_tokens(xml),
@@ -135,16 +131,16 @@ TEST(XHTML_PARSER, header_elems)
         "</body></html>"
     );
 
-    std::vector<std::unique_ptr<DocToken>> expected_tokens;
-    expected_tokens.push_back(std::make_unique<TextDocToken>(0, ""));
-    expected_tokens.push_back(std::make_unique<HeaderDocToken>(0, "heading 1"));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(8, ""));
-    expected_tokens.push_back(std::make_unique<HeaderDocToken>(8, "heading 2"));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(16, ""));
-    expected_tokens.push_back(std::make_unique<HeaderDocToken>(16, "heading 3"));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(24, ""));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(24, "Some text"));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(32, ""));
+    std::vector<DocToken> expected_tokens;
+    expected_tokens.push_back(TextDocToken(0, ""));
+    expected_tokens.push_back(HeaderDocToken(0, "heading 1"));
+    expected_tokens.push_back(TextDocToken(8, ""));
+    expected_tokens.push_back(HeaderDocToken(8, "heading 2"));
+    expected_tokens.push_back(TextDocToken(16, ""));
+    expected_tokens.push_back(HeaderDocToken(16, "heading 3"));
+    expected_tokens.push_back(TextDocToken(24, ""));
+    expected_tokens.push_back(TextDocToken(24, "Some text"));
+    expected_tokens.push_back(TextDocToken(32, ""));
 
     ASSERT_TOKENS_EQ(
         _parse_xhtml_tokens(xml),
@@ -168,14 +164,14 @@ TEST(XHTML_PARSER, pre_elems)
         "</body></html>"
     );
 
-    std::vector<std::unique_ptr<DocToken>> expected_tokens;
-    expected_tokens.push_back(std::make_unique<TextDocToken>(0, "start"              ));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(5, ""                   ));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(5, "line1\nline2\nline3"));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(20, ""                  ));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(20, "line4"             ));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(25, ""                  ));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(25, "end"               ));
+    std::vector<DocToken> expected_tokens;
+    expected_tokens.push_back(TextDocToken(0, "start"              ));
+    expected_tokens.push_back(TextDocToken(5, ""                   ));
+    expected_tokens.push_back(TextDocToken(5, "line1\nline2\nline3"));
+    expected_tokens.push_back(TextDocToken(20, ""                  ));
+    expected_tokens.push_back(TextDocToken(20, "line4"             ));
+    expected_tokens.push_back(TextDocToken(25, ""                  ));
+    expected_tokens.push_back(TextDocToken(25, "end"               ));
 
     ASSERT_TOKENS_EQ(
         _parse_xhtml_tokens(xml),
@@ -193,10 +189,10 @@ TEST(XHTML_PARSER, image_elems)
         "</body></html>"
     );
 
-    std::vector<std::unique_ptr<DocToken>> expected_tokens;
-    expected_tokens.push_back(std::make_unique<ImageDocToken>(0, "/base/foo.png"));
-    expected_tokens.push_back(std::make_unique<ImageDocToken>(1, "/bar.png"));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(2, "Line 2"));
+    std::vector<DocToken> expected_tokens;
+    expected_tokens.push_back(ImageDocToken(0, "/base/foo.png"));
+    expected_tokens.push_back(ImageDocToken(1, "/bar.png"));
+    expected_tokens.push_back(TextDocToken(2, "Line 2"));
 
     ASSERT_TOKENS_EQ(
         _parse_xhtml_tokens(xml),
@@ -218,9 +214,187 @@ TEST(XHTML_PARSER, capture_ids)
         {"id2", 5},
     };
   
-    std::vector<std::unique_ptr<DocToken>> tokens;
+    TokenTable tokens;
     std::unordered_map<std::string, DocAddr> ids;
     ASSERT_TRUE(parse_xhtml_tokens(xml, "", 0, tokens, ids));
 
     ASSERT_EQ(expected_ids, ids);
 }
+
+TEST(XHTML_PARSER, recover_from_errors)
+{
+    const char *xml = (
+        "<html><body>"
+        "<p>a</p>"
+        "x < y"
+        "<p>b</p>"
+        "</body></html>"
+    );
+
+    std::vector<DocToken> expected_tokens;
+    expected_tokens.push_back(TextDocToken(0, ""   ));
+    expected_tokens.push_back(TextDocToken(0, "a"  ));
+    expected_tokens.push_back(TextDocToken(1, ""   ));
+    expected_tokens.push_back(TextDocToken(1, "x y"));
+    expected_tokens.push_back(TextDocToken(3, ""   ));
+    expected_tokens.push_back(TextDocToken(3, "b"  ));
+    expected_tokens.push_back(TextDocToken(4, ""   ));
+
+    ASSERT_TOKENS_EQ(
+        _parse_xhtml_tokens(xml),
+        expected_tokens
+    );
+}
+
+TEST(XHTML_PARSER, truncated_document)
+{
+    const char *xml = (
+        "<html><body>"
+        "<p>a</p>"
+        "<p>b"
+    );
+
+    std::vector<DocToken> expected_tokens;
+    expected_tokens.push_back(TextDocToken(0, ""   ));
+    expected_tokens.push_back(TextDocToken(0, "a"  ));
+    expected_tokens.push_back(TextDocToken(1, ""   ));
+    expected_tokens.push_back(TextDocToken(1, "b"  ));
+    expected_tokens.push_back(TextDocToken(2, ""   ));
+
+    ASSERT_TOKENS_EQ(
+        _parse_xhtml_tokens(xml),
+        expected_tokens
+    );
+}
+
+static std::string make_long_xhtml(uint32_t num_paragraphs, const char *error = "")
+{
+    std::string xml = "<html><body>";
+    for (uint32_t i = 0; i < num_paragraphs; ++i)
+    {
+        xml += "<p id=\"p" + std::to_string(i) + "\">paragraph</p>";
+        if (i == num_paragraphs / 2)
+        {
+            xml += error;
+        }
+    }
+    xml += "</body></html>";
+    return xml;
+}
+
+static void ASSERT_STREAMS_PROGRESSIVELY(const std::string &xml, uint32_t num_paragraphs)
+{
+    TokenTable tokens;
+    std::unordered_map<std::string, DocAddr> ids;
+    XhtmlTokenStream stream(xml, "/base/file.xhtml", 0);
+
+    ASSERT_TRUE(stream.read(tokens, ids));
+    ASSERT_LT(tokens.size(), num_paragraphs);
+
+    while (stream.read(tokens, ids))
+    {
+    }
+    ASSERT_FALSE(stream.failed());
+
+    std::vector<DocToken> expected_tokens;
+    for (uint32_t i = 0; i < num_paragraphs; ++i)
+    {
+        expected_tokens.push_back(TextDocToken(i * 9, ""));
+        expected_tokens.push_back(TextDocToken(i * 9, "paragraph"));
+    }
+    expected_tokens.push_back(TextDocToken(num_paragraphs * 9, ""));
+    ASSERT_TOKENS_EQ(tokens, expected_tokens);
+
+    ASSERT_EQ(ids.size(), num_paragraphs);
+    ASSERT_EQ(ids["p0"], 0);
+    ASSERT_EQ(ids["p" + std::to_string(num_paragraphs - 1)], (num_paragraphs - 1) * 9);
+}
+
+TEST(XHTML_PARSER, stream_tokens)
+{
+    ASSERT_STREAMS_PROGRESSIVELY(make_long_xhtml(1000), 1000);
+}
+
+TEST(XHTML_PARSER, stream_tokens_with_error)
+{
+    // Raw '<' is dropped while recovering
+    ASSERT_STREAMS_PROGRESSIVELY(make_long_xhtml(1000, "<"), 1000);
+}
+
+// Hands out a few bytes at a time, as an inflating zip entry might
+class TrickleXhtmlSource : public XhtmlSource
+{
+    std::string xml;
+    uint32_t offset = 0;
+    uint32_t &max_offset;
+
+public:
+    TrickleXhtmlSource(std::string xml, uint32_t &max_offset) : xml(std::move(xml)), max_offset(max_offset) {}
+
+    int read(char *buf, int size) override
+    {
+        int read_size = std::min<uint32_t>({static_cast<uint32_t>(size), 7u, static_cast<uint32_t>(xml.size() - offset)});
+        memcpy(buf, xml.data() + offset, read_size);
+        offset += read_size;
+        max_offset = std::max(max_offset, offset);
+        return read_size;
+    }
+
+    bool rewind() override
+    {
+        offset = 0;
+        return true;
+    }
+};
+
+TEST(XHTML_PARSER, stream_from_source)
+{
+    // Error forces the source to be rewound and reparsed
+    for (const char *error : {"", "<"})
+    {
+        std::string xml = make_long_xhtml(1000, error);
+
+        uint32_t max_offset = 0;
+        TokenTable tokens;
+        std::unordered_map<std::string, DocAddr> ids;
+        XhtmlTokenStream stream(std::make_unique<TrickleXhtmlSource>(xml, max_offset), "/base/file.xhtml", 0);
+
+        ASSERT_TRUE(stream.read(tokens, ids));
+        ASSERT_LT(max_offset, xml.size());
+
+        while (stream.read(tokens, ids))
+        {
+        }
+        ASSERT_FALSE(stream.failed());
+
+        TokenTable expected_tokens;
+        std::unordered_map<std::string, DocAddr> expected_ids;
+        parse_xhtml_tokens(xml.c_str(), "/base/file.xhtml", 0, expected_tokens, expected_ids);
+
+        ASSERT_EQ(tokens.size(), expected_tokens.size());
+        for (uint32_t i = 0; i < tokens.size(); ++i)
+        {
+            ASSERT_EQ(tokens[i], expected_tokens[i]) << i;
+        }
+        ASSERT_EQ(ids, expected_ids);
+    }
+}
+
+TEST(XHTML_PARSER, stream_ends_at_null)
+{
+    std::string xml("<html><body><p>a</p>\0<p>b</p></body></html>", 43);
+
+    TokenTable tokens;
+    std::unordered_map<std::string, DocAddr> ids;
+    XhtmlTokenStream stream(xml, "/base/file.xhtml", 0);
+    while (stream.read(tokens, ids))
+    {
+    }
+
+    std::vector<DocToken> expected_tokens;
+    expected_tokens.push_back(TextDocToken(0, ""   ));
+    expected_tokens.push_back(TextDocToken(0, "a"  ));
+    expected_tokens.push_back(TextDocToken(1, ""   ));
+
+    ASSERT_TOKENS_EQ(tokens, expected_tokens);
+}
@@ -1,14 +1,16 @@
 #include "./xhtml_parser.h"
 
 #include "./epub_doc_addr.h"
-#include "./libxml_iter.h"
 #include "./xhtml_string_util.h"
 #include "./util/str_utils.h"
 
 #include "doc_api/token_addressing.h"
 
 #include <libxml/parser.h>
+#include <libxml/parserInternals.h>
+#include <libxml/SAX2.h>
 
+#include <algorithm>
 #include <cstring>
 #include <experimental/filesystem>
 #include <iostream>
@@ -120,7 +122,7 @@ struct Node
 
     Type type;
     DocAddr address;
-    xmlNodePtr node;
+    xmlNodePtr node;    // freed as parsing progresses, only valid while being emitted
     std::string text;
     int list_depth;
 
@@ -174,6 +176,168 @@ struct Node
     }
 };
 
+std::experimental::filesystem::path normalize_path(const std::experimental::filesystem::path& p) {
+    std::experimental::filesystem::path result;
+    for (const auto& component : p) {
+        if (component == ".") {
+            continue;  // Skip current directory
+        } else if (component == "..") {
+            result = result.parent_path();  // Go up one level
+        } else {
+            result /= component;
+        }
+    }
+    return result;
+}
+
+// Merge inline text types, emit DocTokens
+class TokenGenerator
+{
+    std::experimental::filesystem::path base_path;
+    TokenTable &tokens_out;
+
+    // Run of inline nodes sharing the same type
+    std::vector<Node> group;
+    bool separator_allowed = true;
+
+    void emit_group()
+    {
+        const Node &head = group.front();
+        DocAddr address = head.address;
+
+        switch (head.type)
+        {
+            case Node::Type::InlineText:
+            case Node::Type::InlineHeader:
+            case Node::Type::InlineList:
+                {
+                    std::vector<const char*> substrings;
+                    substrings.reserve(group.size());
+                    for (const auto &node : group)
+                    {
+                        substrings.push_back(node.text.c_str());
+                    }
+
+                    std::string text = compact_strings(substrings);
+                    if (text.size())
+                    {
+                        if (head.type == Node::Type::InlineText)
+                        {
+                            tokens_out.push_back(TokenType::Text, address, text);
+                        }
+                        else if (head.type == Node::Type::InlineHeader)
+                        {
+                            tokens_out.push_back(TokenType::Header, address, text);
+                        }
+                        else
+                        {
+                            tokens_out.push_back(TokenType::ListItem, address, text, head.list_depth);
+                        }
+
+                        separator_allowed = true;
+                    }
+                }
+                break;
+            case Node::Type::InlinePre:
+                {
+                    std::vector<const char *> substrings;
+                    substrings.reserve(group.size());
+                    for (const auto &node : group)
+                    {
+                        substrings.push_back(node.text.c_str());
+                    }
+
+                    std::string text = remove_carriage_returns(join_strings(substrings));
+                    if (text.size())
+                    {
+                        tokens_out.push_back(TokenType::Text, address, text);
+                        separator_allowed = true;
+                    }
+                }
+                break;
+            default:
+                throw std::runtime_error("Unknown inline node type");
+        }
+    }
+
+    void emit_single(const Node &head)
+    {
+        DocAddr address = head.address;
+
+        switch (head.type)
+        {
+            case Node::Type::Image:
+                {
+                    xmlNodePtr node = head.node;
+                    const xmlChar *img_path = xmlGetProp(node, BAD_CAST "href");
+                    if (!img_path) img_path = xmlGetProp(node, BAD_CAST "src");
+                    if (img_path)
+                    {
+                        tokens_out.push_back(
+                            TokenType::Image,
+                            address,
+                            normalize_path(base_path / (const char*)img_path).string()
+                        );
+                    }
+                    else
+                    {
+                        std::cerr << "Unable to get link from image" << std::endl;
+                    }
+
+                    separator_allowed = true;
+                }
+                break;
+            case Node::Type::SectionSeparator:
+                if (separator_allowed)
+                {
+                    tokens_out.push_back(TokenType::Text, address, "");
+
+                    separator_allowed = false;
+                }
+                break;
+            case Node::Type::InlineBreak:
+                break;
+            default:
+                throw std::runtime_error("Unknown node type");
+        }
+    }
+
+public:
+    TokenGenerator(
+        const std::experimental::filesystem::path &base_path,
+        TokenTable &tokens_out
+    ) : base_path(base_path), tokens_out(tokens_out)
+    {
+    }
+
+    void push(Node node)
+    {
+        if (!group.empty() && group.front().type != node.type)
+        {
+            flush();
+        }
+
+        if (node.is_inline())
+        {
+            group.push_back(std::move(node));
+        }
+        else
+        {
+            emit_single(node);
+        }
+    }
+
+    // Emit the pending inline group. Call at end of document.
+    void flush()
+    {
+        if (!group.empty())
+        {
+            emit_group();
+            group.clear();
+        }
+    }
+};
+
 class NodeProcessor
 {
     int list_depth = 0;     // depth inside ul/ol tags
@@ -183,7 +347,7 @@ class NodeProcessor
 
     DocAddr current_address;
 
-    std::vector<Node> nodes;
+    TokenGenerator &generator;
     std::set<std::string> unattached_ids;
     std::unordered_map<std::string, DocAddr> &id_to_addr;
 
@@ -199,15 +363,17 @@ class NodeProcessor
     void emit_node(int node_depth, Node::Type type, xmlNodePtr node, std::string text = "")
     {
         attach_pending_ids(current_address);
-        nodes.emplace_back(type, current_address, node, std::move(text), list_depth);
-        DEBUG_LOG("[node: " << nodes.back().to_string() << "]");
+        Node emitted(type, current_address, node, std::move(text), list_depth);
+        DEBUG_LOG("[node: " << emitted.to_string() << "]");
+        generator.push(std::move(emitted));
     }
 
 public:
     NodeProcessor(
         DocAddr current_address,
+        TokenGenerator &generator,
         std::unordered_map<std::string, DocAddr> &id_to_addr
-    ) : current_address(current_address), id_to_addr(id_to_addr)
+    ) : current_address(current_address), generator(generator), id_to_addr(id_to_addr)
     {
     }
 
@@ -360,10 +526,6 @@ public:
         }
     }
 
-    const std::vector<Node> &get_nodes() const
-    {
-        return nodes;
-    }
 };
 
 void visit_nodes(xmlNodePtr node, NodeProcessor &processor, int node_depth = 0)
@@ -393,182 +555,499 @@ void visit_nodes(xmlNodePtr node, NodeProcessor &processor, int node_depth = 0)
     }
 }
 
-std::experimental::filesystem::path normalize_path(const std::experimental::filesystem::path& p) {
-    std::experimental::filesystem::path result;
-    for (const auto& component : p) {
-        if (component == ".") {
-            continue;  // Skip current directory
-        } else if (component == "..") {
-            result = result.parent_path();  // Go up one level
-        } else {
-            result /= component;
-        }
+// Element opened by the parser, but not yet closed
+struct OpenElement
+{
+    xmlNodePtr node;
+    xmlNodePtr last_visited_child = nullptr;
+
+    OpenElement(xmlNodePtr node) : node(node) {}
+};
+
+// Document held in memory
+class StringXhtmlSource : public XhtmlSource
+{
+    std::string xml;
+    uint32_t offset = 0;
+
+public:
+    StringXhtmlSource(std::string xml) : xml(std::move(xml)) {}
+
+    int read(char *buf, int size) override
+    {
+        int read_size = std::min<uint32_t>(size, xml.size() - offset);
+        memcpy(buf, xml.data() + offset, read_size);
+        offset += read_size;
+        return read_size;
     }
-    return result;
-}
 
-// Merge inline text types, emit DocTokens
-void generate_doc_tokens(
-    const std::vector<Node> &nodes,
-    const std::experimental::filesystem::path &base_path,
-    std::vector<std::unique_ptr<DocToken>> &tokens_out
-)
+    bool rewind() override
+    {
+        offset = 0;
+        return true;
+    }
+};
+
+} // namespace
+
+// Rather than building the whole DOM, the default SAX2 tree builder is wrapped
+// and nodes are handed to NodeProcessor as soon as they are complete. Children
+// are freed once a following sibling is created, so only the open elements and
+// their most recent children stay in memory. The builder still owns text
+// merging and entity handling, keeping results identical to a DOM walk.
+//
+// Documents are read from the source and fed to a push parser a chunk at a
+// time. The push parser recovers from fewer errors than xmlReadMemory, so on
+// the first error the source is rewound and the document reparsed in one pass
+// by the pull parser. Tokens already read came from events before the error
+// and are skipped. As with a C string, a document ends at the first null.
+struct XhtmlTokenStreamState
 {
-    auto get_group_size = [&nodes](uint32_t i) -> uint32_t {
-        const auto &head = nodes[i];
-        if (head.is_inline())
+    std::unique_ptr<XhtmlSource> source;
+    std::experimental::filesystem::path file_path;
+    uint32_t chapter_number;
+
+    // Read from source, but not yet parsed
+    std::string pending;
+    bool source_ended = false;
+    xmlParserCtxtPtr ctxt = nullptr;
+
+    // Parsed, but not yet read
+    TokenTable tokens;
+    std::unordered_map<std::string, DocAddr> id_to_addr;
+    uint32_t tokens_read = 0;
+
+    std::unique_ptr<TokenGenerator> generator;
+    std::unique_ptr<NodeProcessor> processor;
+
+    std::vector<OpenElement> open_elements;
+    bool root_is_html = false;
+    int body_depth = -1;    // index of <body> in open_elements
+    bool body_seen = false;
+    bool parser_stopped = false;
+
+    bool finished = false;
+    bool failed = false;
+
+    XhtmlTokenStreamState(std::unique_ptr<XhtmlSource> source, std::experimental::filesystem::path file_path, uint32_t chapter_number)
+        : source(std::move(source))
+        , file_path(file_path)
+        , chapter_number(chapter_number)
+    {
+        reset_document_state();
+    }
+
+    ~XhtmlTokenStreamState()
+    {
+        free_parser();
+    }
+
+    void reset_document_state()
+    {
+        tokens.clear();
+        id_to_addr.clear();
+        generator = std::make_unique<TokenGenerator>(file_path.parent_path(), tokens);
+        processor = std::make_unique<NodeProcessor>(make_address(chapter_number), *generator, id_to_addr);
+
+        open_elements.clear();
+        root_is_html = false;
+        body_depth = -1;
+        body_seen = false;
+        parser_stopped = false;
+    }
+
+    bool in_body(uint32_t depth) const
+    {
+        return body_depth >= 0 && depth > static_cast<uint32_t>(body_depth);
+    }
+
+    // Process children of the element completed since the last visit
+    void visit_new_children(OpenElement &elem, uint32_t depth)
+    {
+        xmlNodePtr child = elem.last_visited_child ? elem.last_visited_child->next : elem.node->children;
+        for (; child; child = child->next)
+        {
+            if (in_body(depth + 1))
+            {
+                int node_depth = depth - body_depth;
+                if (child->type == XML_TEXT_NODE)
+                {
+                    processor->on_text_node(child, node_depth);
+                }
+                else if (child->type != XML_ELEMENT_NODE)
+                {
+                    // Elements are handled by their own start/end events
+                    visit_nodes(child->children, *processor, node_depth + 1);
+                }
+            }
+            elem.last_visited_child = child;
+        }
+    }
+
+    // Free children that precede the most recent child
+    void prune_children(OpenElement &elem)
+    {
+        xmlNodePtr child = elem.node->children;
+        while (child && child != elem.node->last)
         {
-            Node::Type head_type = head.type;
+            xmlNodePtr next = child->next;
+            xmlUnlinkNode(child);
+            xmlFreeNode(child);
+            child = next;
+        }
+    }
 
-            uint32_t size = 1;
-            while (++i < nodes.size() && nodes[i].type == head_type)
+    void close_element(OpenElement &elem, uint32_t depth)
+    {
+        visit_new_children(elem, depth);
+        if (in_body(depth))
+        {
+            processor->on_exit_element_node(elem.node, depth - body_depth - 1);
+        }
+    }
+
+    void pop_element()
+    {
+        uint32_t depth = open_elements.size() - 1;
+        close_element(open_elements.back(), depth);
+        open_elements.pop_back();
+
+        if (body_seen && static_cast<int>(depth) == body_depth)
+        {
+            body_depth = -1;
+
+            // Nothing after the body is used. Keep going after an error, so
+            // the push parser is replaced.
+            if (ctxt->wellFormed)
             {
-                ++size;
+                parser_stopped = true;
+                xmlStopParser(ctxt);
             }
-            return size;
         }
-        return 1;
-    };
+    }
 
-    uint32_t n = nodes.size();
-    tokens_out.reserve(n);
+    bool is_open(xmlNodePtr node) const
+    {
+        return std::find_if(
+            open_elements.begin(),
+            open_elements.end(),
+            [node](const OpenElement &elem) { return elem.node == node; }
+        ) != open_elements.end();
+    }
 
-    bool separator_allowed = true;
-    uint32_t i = 0;
-    while (i < n)
+    // While recovering from errors, the tree builder can drop elements
+    // without an end event. Close any elements opened after node.
+    void close_elements_after(xmlNodePtr node)
     {
-        uint32_t group_size = get_group_size(i);
-        const Node &head = nodes[i];
-        DocAddr address = head.address;
+        while (!open_elements.empty() && open_elements.back().node != node)
+        {
+            pop_element();
+        }
+    }
 
-        switch (head.type)
+    void on_start_element(xmlNodePtr parent, xmlNodePtr node)
+    {
+        if (parent && !is_open(parent))
         {
-            case Node::Type::InlineText:
-            case Node::Type::InlineHeader:
-            case Node::Type::InlineList:
-                {
-                    std::vector<const char*> substrings;
-                    substrings.reserve(group_size);
-                    for (uint32_t j = i; j < i + group_size; ++j)
-                    {
-                        substrings.push_back(nodes[j].text.c_str());
-                    }
+            // Entity content is parsed under a detached root. It is visited
+            // through the entity reference instead.
+            return;
+        }
+        close_elements_after(parent);
 
-                    std::string text = compact_strings(substrings);
-                    if (text.size())
-                    {
-                        if (head.type == Node::Type::InlineText)
-                        {
-                            tokens_out.push_back(std::make_unique<TextDocToken>(
-                                address,
-                                text
-                            ));
-                        }
-                        else if (head.type == Node::Type::InlineHeader)
-                        {
-                            tokens_out.push_back(std::make_unique<HeaderDocToken>(
-                                address,
-                                text
-                            ));
-                        }
-                        else
-                        {
-                            tokens_out.push_back(std::make_unique<ListItemDocToken>(
-                                address,
-                                text,
-                                head.list_depth
-                            ));
-                        }
+        uint32_t depth = open_elements.size();
+        if (depth == 0)
+        {
+            root_is_html = xmlStrEqual(node->name, BAD_CAST "html");
+        }
+        else
+        {
+            OpenElement &parent_elem = open_elements.back();
+            visit_new_children(parent_elem, depth - 1);
+            prune_children(parent_elem);
 
-                        separator_allowed = true;
-                    }
-                }
-                break;
-            case Node::Type::InlinePre:
-                {
-                    std::vector<const char *> substrings;
-                    substrings.reserve(group_size);
-                    for (uint32_t j = i; j < i + group_size; ++j)
-                    {
-                        substrings.push_back(nodes[j].text.c_str());
-                    }
+            if (depth == 1 && root_is_html && !body_seen && xmlStrEqual(node->name, BAD_CAST "body"))
+            {
+                body_depth = depth;
+                body_seen = true;
+            }
+        }
 
-                    std::string text = remove_carriage_returns(join_strings(substrings));
-                    if (text.size())
-                    {
-                        tokens_out.push_back(std::make_unique<TextDocToken>(
-                            address,
-                            text
-                        ));
-                        separator_allowed = true;
-                    }
-                }
-                break;
-            case Node::Type::Image:
-                {
-                    xmlNodePtr node = head.node;
-                    const xmlChar *img_path = xmlGetProp(node, BAD_CAST "href");
-                    if (!img_path) img_path = xmlGetProp(node, BAD_CAST "src");
-                    if (img_path)
-                    {
-                        tokens_out.push_back(std::make_unique<ImageDocToken>(
-                            address,
-                            normalize_path(base_path / (const char*)img_path)
-                        ));
-                    }
-                    else
-                    {
-                        std::cerr << "Unable to get link from image" << std::endl;
-                    }
+        open_elements.emplace_back(node);
 
-                    separator_allowed = true;
-                }
-                break;
-            case Node::Type::SectionSeparator:
-                if (separator_allowed)
-                {
-                    tokens_out.push_back(std::make_unique<TextDocToken>(
-                        address,
-                        ""
-                    ));
+        if (in_body(depth))
+        {
+            processor->on_enter_element_node(node, depth - body_depth - 1);
+        }
+    }
 
-                    separator_allowed = false;
-                }
-                break;
-            case Node::Type::InlineBreak:
-                break;
-            default:
-                throw std::runtime_error("Unknown node type");
+    void on_end_element(xmlNodePtr node)
+    {
+        if (node && is_open(node))
+        {
+            close_elements_after(node);
+            pop_element();
         }
-        i += group_size;
     }
+
+    bool init_parser(xmlParserCtxtPtr ctxt);
+    void free_parser();
+
+    // Read up to size bytes of the document. Returns 0 at the end.
+    int read_source(char *buf, int size);
+
+    void parse_chunk();
+    void reparse_document();
+    void finish();
+};
+
+namespace
+{
+
+#define PARSE_CHUNK_SIZE 4096
+#define PARSE_OPTIONS (XML_PARSE_NOERROR | XML_PARSE_NOWARNING | XML_PARSE_RECOVER)
+
+XhtmlTokenStreamState *get_stream_state(void *ctx)
+{
+    return static_cast<XhtmlTokenStreamState*>(static_cast<xmlParserCtxtPtr>(ctx)->_private);
+}
+
+void on_sax_start_element(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI, int nb_namespaces, const xmlChar **namespaces, int nb_attributes, int nb_defaulted, const xmlChar **attributes)
+{
+    xmlParserCtxtPtr ctxt = static_cast<xmlParserCtxtPtr>(ctx);
+    xmlNodePtr parent = ctxt->node;
+
+    xmlSAX2StartElementNs(ctx, localname, prefix, URI, nb_namespaces, namespaces, nb_attributes, nb_defaulted, attributes);
+
+    if (ctxt->node && ctxt->node != parent)
+    {
+        get_stream_state(ctx)->on_start_element(parent, ctxt->node);
+    }
+}
+
+void on_sax_end_element(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI)
+{
+    get_stream_state(ctx)->on_end_element(static_cast<xmlParserCtxtPtr>(ctx)->node);
+
+    xmlSAX2EndElementNs(ctx, localname, prefix, URI);
+}
+
+int on_io_read(void *context, char *buffer, int len)
+{
+    return static_cast<XhtmlTokenStreamState*>(context)->read_source(buffer, len);
+}
+
+int on_io_close(void *)
+{
+    return 0;
 }
 
 } // namespace
 
-bool parse_xhtml_tokens(const char *xml_str, std::experimental::filesystem::path file_path, uint32_t chapter_number, std::vector<std::unique_ptr<DocToken>> &tokens_out, std::unordered_map<std::string, DocAddr> &id_to_addr_out)
+bool XhtmlTokenStreamState::init_parser(xmlParserCtxtPtr new_ctxt)
 {
-    xmlDocPtr doc = xmlReadMemory(xml_str, strlen(xml_str), nullptr, nullptr, XML_PARSE_NOERROR | XML_PARSE_NOWARNING | XML_PARSE_RECOVER);
-    if (doc == nullptr)
+    ctxt = new_ctxt;
+    if (!ctxt)
     {
-        std::cerr << "Unable to parse " << file_path << " as xml" << std::endl;
         return false;
     }
 
-    xmlNodePtr node = xmlDocGetRootElement(doc);
+    xmlCtxtUseOptions(ctxt, PARSE_OPTIONS);
+    ctxt->sax->startElementNs = on_sax_start_element;
+    ctxt->sax->endElementNs = on_sax_end_element;
+    ctxt->_private = this;
+
+    return true;
+}
+
+void XhtmlTokenStreamState::free_parser()
+{
+    if (ctxt)
+    {
+        xmlFreeDoc(ctxt->myDoc);
+        ctxt->myDoc = nullptr;
+        xmlFreeParserCtxt(ctxt);
+        ctxt = nullptr;
+    }
+}
+
+int XhtmlTokenStreamState::read_source(char *buf, int size)
+{
+    if (source_ended)
+    {
+        return 0;
+    }
+
+    int read_size = 0;
+    while (read_size < size)
+    {
+        int chunk_size = source->read(buf + read_size, size - read_size);
+        if (chunk_size < 0)
+        {
+            std::cerr << "Error reading " << file_path << std::endl;
+        }
+        if (chunk_size <= 0)
+        {
+            source_ended = true;
+            break;
+        }
+
+        const char *null_char = static_cast<const char*>(memchr(buf + read_size, '\0', chunk_size));
+        if (null_char)
+        {
+            read_size = null_char - buf;
+            source_ended = true;
+            break;
+        }
+        read_size += chunk_size;
+    }
+
+    return read_size;
+}
+
+void XhtmlTokenStreamState::parse_chunk()
+{
+    if (!ctxt && !init_parser(xmlCreatePushParserCtxt(nullptr, nullptr, nullptr, 0, file_path.c_str())))
+    {
+        failed = true;
+        finish();
+        return;
+    }
+
+    // Read ahead past the chunk, so the last chunk can be flagged as such
+    if (!source_ended && pending.size() <= PARSE_CHUNK_SIZE)
+    {
+        uint32_t pending_size = pending.size();
+        pending.resize(pending_size + PARSE_CHUNK_SIZE);
+        pending.resize(pending_size + read_source(&pending[pending_size], PARSE_CHUNK_SIZE));
+    }
+
+    uint32_t chunk_size = std::min<uint32_t>(PARSE_CHUNK_SIZE, pending.size());
+    bool terminate = source_ended && chunk_size == pending.size();
+
+    xmlParseChunk(ctxt, pending.data(), chunk_size, terminate);
+    pending.erase(0, chunk_size);
+
+    if (parser_stopped)
+    {
+        finish();
+    }
+    else if (!ctxt->wellFormed)
+    {
+        reparse_document();
+    }
+    else if (terminate)
+    {
+        finish();
+    }
+}
+
+void XhtmlTokenStreamState::reparse_document()
+{
+    free_parser();
+    reset_document_state();
+
+    pending = std::string();
+    source_ended = false;
+    if (
+        !source->rewind() ||
+        !init_parser(xmlCreateIOParserCtxt(nullptr, nullptr, on_io_read, on_io_close, this, XML_CHAR_ENCODING_NONE))
+    )
+    {
+        failed = true;
+        finish();
+        return;
+    }
+
+    xmlParseDocument(ctxt);
+    finish();
+
+    TokenTable unread_tokens;
+    unread_tokens.append(tokens, tokens_read);
+    tokens = std::move(unread_tokens);
+}
+
+void XhtmlTokenStreamState::finish()
+{
+    // Elements left open by a truncated document are closed innermost first
+    while (!open_elements.empty())
+    {
+        close_element(open_elements.back(), open_elements.size() - 1);
+        open_elements.pop_back();
+    }
+    generator->flush();
+
+    if (ctxt && !ctxt->myDoc)
+    {
+        failed = true;
+    }
+    free_parser();
+
+    if (failed)
+    {
+        std::cerr << "Unable to parse " << file_path << " as xml" << std::endl;
+    }
+
+    source.reset();
+    pending = std::string();
+    finished = true;
+}
+
+XhtmlTokenStream::XhtmlTokenStream(std::string xml, std::experimental::filesystem::path file_path, uint32_t chapter_number)
+    : XhtmlTokenStream(std::make_unique<StringXhtmlSource>(std::move(xml)), file_path, chapter_number)
+{
+}
+
+XhtmlTokenStream::XhtmlTokenStream(std::unique_ptr<XhtmlSource> source, std::experimental::filesystem::path file_path, uint32_t chapter_number)
+    : state(std::make_unique<XhtmlTokenStreamState>(std::move(source), file_path, chapter_number))
+{
+}
 
-    node = elem_first_child(elem_first_by_name(node, BAD_CAST "html"));
-    node = elem_first_child(elem_first_by_name(node, BAD_CAST "body"));
+XhtmlTokenStream::~XhtmlTokenStream()
+{
+}
 
-    NodeProcessor processor(
-        make_address(chapter_number),
-        id_to_addr_out
-    );
-    visit_nodes(node, processor);
+bool XhtmlTokenStream::read(TokenTable &tokens_out, std::unordered_map<std::string, DocAddr> &id_to_addr_out)
+{
+    while (state->tokens.empty() && !state->finished)
+    {
+        state->parse_chunk();
+    }
 
-    generate_doc_tokens(processor.get_nodes(), file_path.parent_path(), tokens_out);
+    for (auto &id_addr : state->id_to_addr)
+    {
+        id_to_addr_out[id_addr.first] = id_addr.second;
+    }
+    state->id_to_addr.clear();
+
+    if (state->tokens.empty())
+    {
+        return false;
+    }
 
-    xmlFreeDoc(doc);
+    tokens_out.append(state->tokens);
+    state->tokens_read += state->tokens.size();
+    state->tokens.clear();
 
     return true;
 }
+
+bool XhtmlTokenStream::failed() const
+{
+    return state->failed;
+}
+
+bool parse_xhtml_tokens(const char *xml_str, std::experimental::filesystem::path file_path, uint32_t chapter_number, TokenTable &tokens_out, std::unordered_map<std::string, DocAddr> &id_to_addr_out)
+{
+    return parse_xhtml_tokens(std::make_unique<StringXhtmlSource>(xml_str), file_path, chapter_number, tokens_out, id_to_addr_out);
+}
+
+bool parse_xhtml_tokens(std::unique_ptr<XhtmlSource> source, std::experimental::filesystem::path file_path, uint32_t chapter_number, TokenTable &tokens_out, std::unordered_map<std::string, DocAddr> &id_to_addr_out)
+{
+    XhtmlTokenStream stream(std::move(source), file_path, chapter_number);
+    while (stream.read(tokens_out, id_to_addr_out))
+    {
+    }
+
+    return !stream.failed();
+}
@@ -1,13 +1,52 @@
 #ifndef XHTML_PARSER_H_
 #define XHTML_PARSER_H_
 
-#include "doc_api/doc_token.h"
+#include "doc_api/token_table.h"
 
 #include <experimental/filesystem>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
-bool parse_xhtml_tokens(const char *xml_str, std::experimental::filesystem::path file_path, uint32_t chapter_number, std::vector<std::unique_ptr<DocToken>> &tokens_out, std::unordered_map<std::string, DocAddr> &id_to_addr_out);
+struct XhtmlTokenStreamState;
+
+// Supplies the bytes of a document to XhtmlTokenStream
+class XhtmlSource
+{
+public:
+    virtual ~XhtmlSource() = default;
+
+    // Read up to size bytes. Returns bytes read, 0 at the end, or -1 on error.
+    virtual int read(char *buf, int size) = 0;
+    // Restart from the beginning of the document
+    virtual bool rewind() = 0;
+};
+
+// Incrementally tokenize an xhtml document. Tokens at the start of the
+// document are available before the rest of the document has been parsed.
+class XhtmlTokenStream
+{
+    std::unique_ptr<XhtmlTokenStreamState> state;
+
+public:
+    XhtmlTokenStream(std::string xml, std::experimental::filesystem::path file_path, uint32_t chapter_number);
+    // Read the document from source as parsing progresses, rather than holding all of it
+    XhtmlTokenStream(std::unique_ptr<XhtmlSource> source, std::experimental::filesystem::path file_path, uint32_t chapter_number);
+    XhtmlTokenStream(const XhtmlTokenStream &) = delete;
+    XhtmlTokenStream &operator=(const XhtmlTokenStream &) = delete;
+    ~XhtmlTokenStream();
+
+    // Parse until more tokens are available and append them to the output.
+    // Element ids resolved so far are also appended. Returns false once the
+    // document has been fully read.
+    bool read(TokenTable &tokens_out, std::unordered_map<std::string, DocAddr> &id_to_addr_out);
+
+    // True if the document could not be parsed as xml
+    bool failed() const;
+};
+
+bool parse_xhtml_tokens(const char *xml_str, std::experimental::filesystem::path file_path, uint32_t chapter_number, TokenTable &tokens_out, std::unordered_map<std::string, DocAddr> &id_to_addr_out);
+bool parse_xhtml_tokens(std::unique_ptr<XhtmlSource> source, std::experimental::filesystem::path file_path, uint32_t chapter_number, TokenTable &tokens_out, std::unordered_map<std::string, DocAddr> &id_to_addr_out);
 
 #endif
@@ -1,71 +1,47 @@
 #include "./xhtml_string_util.h"
 
-#include "util/str_utils.h"
+#include "util/text_scan.h"
 
 #include <cstring>
 
 std::string compact_whitespace(const char *str)
 {
-    std::string result;
-    result.reserve(strlen(str));
+    size_t len = strlen(str);
+    std::string result(len, '\0');
 
     bool last_was_whitespace = false;
-    char c;
-    for (; (c = *str); ++str)
-    {
-        if (is_whitespace(c))
-        {
-            if (last_was_whitespace)
-            {
-                continue;
-            }
-            last_was_whitespace = true;
-            result.push_back(' ');  // treat all whitespace as ' '
-        }
-        else
-        {
-            last_was_whitespace = false;
-            result.push_back(c);
-        }
-    }
+    result.resize(collapse_whitespace(str, len, &result[0], last_was_whitespace));
 
     return result;
 }
 
 std::string compact_strings(const std::vector<const char*> &strings)
 {
-    std::string result;
-    {
-        uint32_t upper_size = 0;
-        for (const char *str : strings)
-        {
-            upper_size += strlen(str);
-        }
-        result.reserve(upper_size);
-    }
-
+    std::vector<size_t> lengths;
+    lengths.reserve(strings.size());
+    size_t upper_size = 0;
     for (const char *str : strings)
     {
-        std::string substring = compact_whitespace(str);
-
-        if (result.empty())
-        {
-            substring = strip_whitespace_left(substring);
-        }
+        lengths.push_back(strlen(str));
+        upper_size += lengths.back();
+    }
 
-        bool space_left = result.empty() ? false : is_whitespace(result[result.size() - 1]);
-        bool space_right = substring.empty() ? false : is_whitespace(substring[0]);
-        if (space_left && space_right)
-        {
-            substring = strip_whitespace_left(substring);
-        }
+    std::string result(upper_size, '\0');
 
-        result.append(substring);
+    // Compacted as one string, so runs spanning strings collapse too. Starting
+    // as if after whitespace drops leading whitespace.
+    bool last_was_whitespace = true;
+    size_t size = 0;
+    for (uint32_t i = 0; i < strings.size(); ++i)
+    {
+        size += collapse_whitespace(strings[i], lengths[i], &result[size], last_was_whitespace);
     }
 
-    if (!result.empty() && is_whitespace(result[result.size() - 1]))
+    // Drop trailing whitespace, which is at most one char once collapsed
+    if (size && result[size - 1] == ' ')
     {
-        result = strip_whitespace_right(result);
+        --size;
     }
+    result.resize(size);
     return result;
 }
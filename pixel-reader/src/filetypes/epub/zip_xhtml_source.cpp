@@ -0,0 +1,34 @@
+#include "./zip_xhtml_source.h"
+
+namespace
+{
+
+class ZipXhtmlSource : public XhtmlSource
+{
+    std::unique_ptr<ZipEntryReader> reader;
+
+public:
+    ZipXhtmlSource(std::unique_ptr<ZipEntryReader> reader) : reader(std::move(reader)) {}
+
+    int read(char *buf, int size) override
+    {
+        return reader->read(buf, size);
+    }
+
+    bool rewind() override
+    {
+        return reader->rewind();
+    }
+};
+
+} // namespace
+
+std::unique_ptr<XhtmlSource> open_zip_xhtml_source(const ZipArchive &zip, const std::string &path)
+{
+    auto reader = zip.open_entry(path);
+    if (!reader)
+    {
+        return nullptr;
+    }
+    return std::make_unique<ZipXhtmlSource>(std::move(reader));
+}
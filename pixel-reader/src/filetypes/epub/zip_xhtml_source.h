@@ -0,0 +1,15 @@
+#ifndef ZIP_XHTML_SOURCE_H_
+#define ZIP_XHTML_SOURCE_H_
+
+#include "./xhtml_parser.h"
+#include "util/zip_archive.h"
+
+#include <memory>
+#include <string>
+
+// Stream an xhtml document out of the zip, inflating as it is parsed.
+// Returns nullptr if the entry can't be opened. The source must not outlive
+// the archive.
+std::unique_ptr<XhtmlSource> open_zip_xhtml_source(const ZipArchive &zip, const std::string &path);
+
+#endif
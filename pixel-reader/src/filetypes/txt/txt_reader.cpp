@@ -13,7 +13,7 @@ namespace
 
 constexpr uint32_t SPACES_PER_TAB = 4;
 
-bool tokenize_text_file(const std::experimental::filesystem::path &path, std::vector<std::unique_ptr<DocToken>> &tokens_out, std::string &md5_out)
+bool tokenize_text_file(const std::experimental::filesystem::path &path, TokenTable &tokens_out, std::string &md5_out)
 {
     std::ifstream file(path);
     if (!file.is_open())
@@ -37,11 +37,12 @@ bool tokenize_text_file(const std::experimental::filesystem::path &path, std::ve
             )
         );
 
-        tokens_out.emplace_back(std::make_unique<TextDocToken>(cur_address, line));
+        tokens_out.push_back(TokenType::Text, cur_address, line);
 
-        cur_address += get_address_width(*tokens_out.back().get());
+        cur_address += get_address_width(line);
     }
 
+    tokens_out.shrink_to_fit();
     md5_out = md5.getHash();
 
     return true;
@@ -53,7 +54,7 @@ struct TxtReaderState
 {
     std::experimental::filesystem::path path;
     std::vector<TocItem> toc;
-    std::vector<std::unique_ptr<DocToken>> tokens;
+    TokenTable tokens;
     std::string md5;
     bool is_open = false;
     uint32_t total_address_width = 0;
@@ -82,8 +83,8 @@ bool TxtReader::open(DocReaderCache &)
     state->is_open = tokenize_text_file(state->path, state->tokens, state->md5);
     if (state->is_open && state->tokens.size())
     {
-        const auto *last_token = state->tokens.back().get();
-        state->total_address_width = last_token->address + get_address_width(*last_token);
+        auto last_token = state->tokens.back();
+        state->total_address_width = last_token.address + get_address_width(last_token);
     }
 
     return state->is_open;
@@ -132,7 +133,7 @@ std::shared_ptr<TokenIter> TxtReader::get_iter(DocAddr address) const
     return std::make_shared<TxtTokenIter>(state->tokens, address);
 }
 
-std::vector<char> TxtReader::load_resource(const std::experimental::filesystem::path &) const
+ResourceBuffer TxtReader::load_resource(const std::experimental::filesystem::path &) const
 {
     throw std::runtime_error("Load resource is not supported for txt");
 }
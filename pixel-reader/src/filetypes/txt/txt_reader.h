@@ -32,7 +32,7 @@ public:
 
     std::shared_ptr<TokenIter> get_iter(DocAddr address = 0) const override;
 
-    std::vector<char> load_resource(const std::experimental::filesystem::path &path) const override;
+    ResourceBuffer load_resource(const std::experimental::filesystem::path &path) const override;
 };
 
 #endif
@@ -1,6 +1,6 @@
 #include "./txt_token_iter.h"
 
-TxtTokenIter::TxtTokenIter(const std::vector<std::unique_ptr<DocToken>> &tokens, DocAddr address)
+TxtTokenIter::TxtTokenIter(const TokenTable &tokens, DocAddr address)
     : tokens(tokens)
 {
     seek(address);
@@ -38,28 +38,13 @@ const DocToken *TxtTokenIter::read(int direction)
         return nullptr;
     }
 
-    return tokens[read_pos].get();
+    current_token = tokens[read_pos];
+    return &current_token;
 }
 
 void TxtTokenIter::seek(DocAddr address)
 {
-    for (uint32_t j = 0; j < tokens.size(); ++j)
-    {
-        DocAddr other_address = tokens[j]->address;
-        if (other_address <= address)
-        {
-            i = j;
-            // stop at first match in case of duplicates
-            if (other_address == address)
-            {
-                break;
-            }
-        }
-        else
-        {
-            break;
-        }
-    }
+    i = tokens.seek_index(address);
 }
 
 std::shared_ptr<TokenIter> TxtTokenIter::clone() const
@@ -2,16 +2,16 @@
 #define TXT_TOKEN_ITER_H_
 
 #include "doc_api/token_iter.h"
-
-#include <vector>
+#include "doc_api/token_table.h"
 
 class TxtTokenIter: public TokenIter
 {
     uint32_t i = 0;
-    const std::vector<std::unique_ptr<DocToken>> &tokens;
+    const TokenTable &tokens;
+    DocToken current_token;
 
 public:
-    TxtTokenIter(const std::vector<std::unique_ptr<DocToken>> &tokens, DocAddr address);
+    TxtTokenIter(const TokenTable &tokens, DocAddr address);
     TxtTokenIter(const TxtTokenIter &);
 
     const DocToken *read(int direction) override;
@@ -22,6 +22,20 @@
 #define CONFIG_FILE_PATH "reader.cfg"
 #define FALLBACK_STORE_PATH ".pixel_reader_store"
 
+// Scaled images kept across sessions, under the store path
+#define IMAGE_DISK_CACHE_DIR        "image_cache"
+#define IMAGE_DISK_CACHE_SIZE_BYTES (32 * 1024 * 1024)
+
+// Reader cache blobs (parsed chapters, line breaks) of all books in the store
+#define READER_CACHE_BLOB_SIZE_BYTES (32 * 1024 * 1024)
+
+// Shared by the in-memory caches, and cut when free memory drops below the
+// reserve. Overridden by memory_budget_mb in the config file.
+#define MEMORY_BUDGET_BYTES          (40 * 1024 * 1024)
+#define MEMORY_RESERVE_BYTES         (16 * 1024 * 1024)
+#define MEMORY_BUDGET_UPDATE_MS      2000
+#define BOOK_CACHE_MAX_BYTES         (8 * 1024 * 1024)
+
 #if PLATFORM_MIYOO_MINI
     #define DEFAULT_BROWSE_PATH "/mnt/SDCARD/Media/Books/"
     #define EXTRA_FONTS_LIST    {"/customer/app/wqy-microhei.ttc"}
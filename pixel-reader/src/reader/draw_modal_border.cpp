@@ -2,6 +2,7 @@
 
 #include "sys/screen.h"
 #include "util/sdl_pointer.h"
+#include "util/sdl_utils.h"
 #include "./config.h"
 
 void draw_modal_border(uint32_t w, uint32_t h, const ColorTheme &theme, SDL_Surface *dest_surface)
@@ -11,15 +12,8 @@ void draw_modal_border(uint32_t w, uint32_t h, const ColorTheme &theme, SDL_Surf
 
     // transparent background
     {
-        surface_unique_ptr mask = surface_unique_ptr {
-            SDL_CreateRGBSurface(
-                SDL_SWSURFACE,
-                SCREEN_WIDTH,
-                SCREEN_HEIGHT,
-                32,
-                0, 0, 0, 0
-            )
-        };
+        // Same format as dest, so the blend needs no conversion
+        surface_unique_ptr mask = create_surface_in_format(SDL_SWSURFACE, SCREEN_WIDTH, SCREEN_HEIGHT, dest_surface->format);
         SDL_SetAlpha(mask.get(), SDL_SRCALPHA, 128);
 
         SDL_Rect rect = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT };
@@ -2,6 +2,7 @@
 #include "./font_catalog.h"
 #include "./settings_store.h"
 #include "./shoulder_keymap.h"
+#include "./ss_doc_reader_cache.h"
 #include "./state_store.h"
 #include "./system_styling.h"
 #include "./color_theme_def.h"
@@ -15,9 +16,13 @@
 #include "sys/screen.h"
 #include "util/fps_limiter.h"
 #include "util/held_key_tracker.h"
+#include "util/image_disk_cache.h"
 #include "util/key_value_file.h"
 #include "util/math.h"
+#include "util/memory_budget.h"
 #include "util/sdl_font_cache.h"
+#include "util/sdl_utils.h"
+#include "util/string_serialization.h"
 #include "util/task_queue.h"
 #include "util/timer.h"
 
@@ -33,13 +38,16 @@ namespace
 void initialize_views(
     ViewStack &view_stack,
     StateStore &state_store,
+    DocReaderCache &reader_cache,
+    ImageDiskCache &image_disk_cache,
+    MemoryBudget &memory_budget,
     SystemStyling &sys_styling,
     TokenViewStyling &token_view_styling,
     TaskQueue &task_queue,
     std::experimental::optional<std::experimental::filesystem::path> requested_book_path
 )
 {
-    auto load_book = [&view_stack, &state_store, &sys_styling, &token_view_styling, &task_queue](std::experimental::filesystem::path path) {
+    auto load_book = [&view_stack, &state_store, &reader_cache, &image_disk_cache, &memory_budget, &sys_styling, &token_view_styling, &task_queue](std::experimental::filesystem::path path) {
         if (!std::experimental::filesystem::exists(path))
         {
             std::cerr << path << " does not exist" << std::endl;
@@ -58,7 +66,10 @@ void initialize_views(
                 token_view_styling,
                 view_stack,
                 state_store,
-                [&task_queue](task_func task){ task_queue.submit(task); }
+                reader_cache,
+                &image_disk_cache,
+                &memory_budget,
+                task_queue
             )
         );
     };
@@ -159,6 +170,55 @@ void signal_handler(int)
 }
 
 const char *CONFIG_KEY_STORE_PATH = "store_path";
+const char *CONFIG_KEY_MEMORY_BUDGET_MB = "memory_budget_mb";
+
+// Copy rendered areas to the display. All of it if dirty_rects is empty.
+void present(SDL_Surface *screen, SDL_Surface *video, std::vector<SDL_Rect> dirty_rects)
+{
+    if (screen == video)
+    {
+        // Rendered straight into the back buffer
+        SDL_Flip(video);
+        return;
+    }
+
+    if (dirty_rects.empty())
+    {
+        SDL_BlitSurface(screen, NULL, video, NULL);
+        SDL_Flip(video);
+        return;
+    }
+
+    for (const auto &rect : dirty_rects)
+    {
+        SDL_Rect src_rect = rect;
+        SDL_Rect dest_rect = rect;
+        SDL_BlitSurface(screen, &src_rect, video, &dest_rect);
+    }
+    SDL_UpdateRects(video, dirty_rects.size(), dirty_rects.data());
+}
+
+bool has_pending_events()
+{
+    SDL_Event event;
+    SDL_PumpEvents();
+    return SDL_PeepEvents(&event, 1, SDL_PEEKEVENT, SDL_ALLEVENTS) > 0;
+}
+
+uint64_t get_memory_budget_bytes(const std::unordered_map<std::string, std::string> &config)
+{
+    auto it = config.find(CONFIG_KEY_MEMORY_BUDGET_MB);
+    if (it != config.end())
+    {
+        auto budget_mb = try_decode_uint(it->second);
+        if (budget_mb)
+        {
+            return static_cast<uint64_t>(*budget_mb) * 1024 * 1024;
+        }
+        std::cerr << "Invalid " << CONFIG_KEY_MEMORY_BUDGET_MB << ": " << it->second << std::endl;
+    }
+    return MEMORY_BUDGET_BYTES;
+}
 
 std::unordered_map<std::string, std::string> load_config_with_defaults()
 {
@@ -186,20 +246,49 @@ int main(int argc, char **argv)
             SCREEN_HEIGHT = static_cast<unsigned int>(new_height);
     }
 
-    std::cout << "Screen Size: " << SCREEN_WIDTH << "x" << SCREEN_HEIGHT << std::endl;
+    int screen_bpp = 32;
+    if (char* env_screen_bpp = SDL_getenv("SCREEN_BPP")) {
+        int new_bpp = atoi(env_screen_bpp);
+        if (new_bpp == 16 || new_bpp == 32)
+            screen_bpp = new_bpp;
+    }
+
+    Uint32 video_flags = SDL_HWSURFACE;
+    if (SDL_getenv("SCREEN_DOUBLEBUF")) {
+        video_flags |= SDL_DOUBLEBUF;
+    }
+
+    std::cout << "Screen Size: " << SCREEN_WIDTH << "x" << SCREEN_HEIGHT << "x" << screen_bpp << std::endl;
 
     // SDL Init
     SDL_Init(SDL_INIT_VIDEO);
     SDL_ShowCursor(SDL_DISABLE);
     TTF_Init();
+    xmlInitParser();  // once, before libxml is used from other threads
 
     // Surfaces
-    SDL_Surface *video = SDL_SetVideoMode(SCREEN_WIDTH, SCREEN_HEIGHT, 32, SDL_HWSURFACE);
-    SDL_Surface *screen = SDL_CreateRGBSurface(SDL_HWSURFACE, SCREEN_WIDTH, SCREEN_HEIGHT, 32, 0, 0, 0, 0);
+    SDL_Surface *video = SDL_SetVideoMode(SCREEN_WIDTH, SCREEN_HEIGHT, screen_bpp, video_flags);
+
+    // Render into the back buffer if there is one. Otherwise render offscreen,
+    // in the display's format so presenting is a plain copy. Everything cached
+    // for drawing (glyphs, lines, images, pages) follows the render format.
+    const bool render_to_video = video->flags & SDL_DOUBLEBUF;
+    surface_unique_ptr offscreen;
+    if (!render_to_video)
+    {
+        offscreen = create_surface_in_format(SDL_HWSURFACE, SCREEN_WIDTH, SCREEN_HEIGHT, video->format);
+    }
+    SDL_Surface *screen = render_to_video ? video : offscreen.get();
     set_render_surface_format(screen->format);
 
     auto config = load_config_with_defaults();
-    StateStore state_store(config[CONFIG_KEY_STORE_PATH]);
+    StateStore state_store(config[CONFIG_KEY_STORE_PATH], READER_CACHE_BLOB_SIZE_BYTES);
+    SSDocReaderCache reader_cache(state_store);  // must outlive any open books
+    ImageDiskCache image_disk_cache(
+        std::experimental::filesystem::path(config[CONFIG_KEY_STORE_PATH]) / IMAGE_DISK_CACHE_DIR,
+        IMAGE_DISK_CACHE_SIZE_BYTES
+    );
+    MemoryBudget memory_budget(get_memory_budget_bytes(config), MEMORY_RESERVE_BYTES, read_mem_available);
 
     // Preload & check fonts
     auto init_font_name = get_valid_font_name(settings_get_font_name(state_store).value_or(DEFAULT_FONT_NAME));
@@ -212,6 +301,15 @@ int main(int argc, char **argv)
         std::cerr << "Failed to load one or more fonts" << std::endl;
         return 1;
     }
+    // Loaded fonts are held for the life of the program, so only count against the budget
+    auto font_cache_budget = memory_budget.add({
+        "fonts",
+        MemoryPriority::High,
+        0,
+        0,
+        cached_fonts_size_bytes,
+        {}
+    });
 
     // System styling
     SystemStyling sys_styling(
@@ -249,6 +347,9 @@ int main(int argc, char **argv)
     initialize_views(
         view_stack,
         state_store,
+        reader_cache,
+        image_disk_cache,
+        memory_budget,
         sys_styling,
         token_view_styling,
         task_queue,
@@ -283,13 +384,13 @@ int main(int argc, char **argv)
 
     // Timing
     Timer idle_timer;
+    Timer memory_budget_timer;
     FPSLimiter limit_fps(TARGET_FPS);
     const uint32_t avg_loop_time = 1000 / TARGET_FPS;
 
     // Initial render
     view_stack.render(screen, true);
-    SDL_BlitSurface(screen, NULL, video, NULL);
-    SDL_Flip(video);
+    present(screen, video, {});
 
     while (!quit)
     {
@@ -352,7 +453,8 @@ int main(int argc, char **argv)
 
         if (ran_user_code)
         {
-            bool force_render = view_stack.pop_completed_views();
+            // Back buffer doesn't hold the last frame, so can't be updated in part
+            bool force_render = view_stack.pop_completed_views() || render_to_video;
 
             if (view_stack.is_done())
             {
@@ -361,8 +463,14 @@ int main(int argc, char **argv)
 
             if (view_stack.render(screen, force_render))
             {
-                SDL_BlitSurface(screen, NULL, video, NULL);
-                SDL_Flip(video);
+                present(screen, video, view_stack.get_dirty_rects());
+            }
+        }
+        else if (!quit && !has_pending_events())
+        {
+            if (view_stack.on_idle() && view_stack.render(screen, render_to_video))
+            {
+                present(screen, video, view_stack.get_dirty_rects());
             }
         }
 
@@ -378,12 +486,20 @@ int main(int argc, char **argv)
             state_store.flush();
             idle_timer.reset();
         }
+
+        if (memory_budget_timer.elapsed_ms() >= MEMORY_BUDGET_UPDATE_MS)
+        {
+            memory_budget.update();
+            memory_budget_timer.reset();
+        }
     }
 
+    // Books may still be opening, which uses libxml and the state store
+    task_queue.shutdown();
     view_stack.shutdown();
     state_store.flush();
 
-    SDL_FreeSurface(screen);
+    offscreen.reset();
     SDL_Quit();
     xmlCleanupParser();
     
@@ -4,11 +4,12 @@
 
 #define PROGRESS_STR_CHAPTER_PERCENT "chapter"
 #define PROGRESS_STR_GLOBAL_PERCENT "global"
+#define PROGRESS_STR_PAGE_NUMBER "page"
 
 ProgressReporting get_next_progress_reporting(ProgressReporting progress_reporting)
 {
     return static_cast<ProgressReporting>(
-        (static_cast<int>(progress_reporting) + 1) % 2
+        (static_cast<int>(progress_reporting) + 1) % 3
     );
 }
 
@@ -22,6 +23,10 @@ std::experimental::optional<ProgressReporting> decode_progress_reporting(std::st
     {
         return ProgressReporting::GLOBAL_PERCENT;
     }
+    if (progress_reporting == PROGRESS_STR_PAGE_NUMBER)
+    {
+        return ProgressReporting::PAGE_NUMBER;
+    }
     return {};
 }
 
@@ -33,6 +38,23 @@ std::string encode_progress_reporting(ProgressReporting progress_reporting)
             return PROGRESS_STR_CHAPTER_PERCENT;
         case ProgressReporting::GLOBAL_PERCENT:
             return PROGRESS_STR_GLOBAL_PERCENT;
+        case ProgressReporting::PAGE_NUMBER:
+            return PROGRESS_STR_PAGE_NUMBER;
+        default:
+            throw std::runtime_error("Invalid progress value");
+    }
+}
+
+const char *get_progress_reporting_display_name(ProgressReporting progress_reporting)
+{
+    switch (progress_reporting)
+    {
+        case ProgressReporting::CHAPTER_PERCENT:
+            return "Chapter %";
+        case ProgressReporting::GLOBAL_PERCENT:
+            return "Book %";
+        case ProgressReporting::PAGE_NUMBER:
+            return "Page";
         default:
             throw std::runtime_error("Invalid progress value");
     }
@@ -6,7 +6,8 @@
 
 enum class ProgressReporting {
     CHAPTER_PERCENT,
-    GLOBAL_PERCENT
+    GLOBAL_PERCENT,
+    PAGE_NUMBER
 };
 
 ProgressReporting get_next_progress_reporting(ProgressReporting progress_reporting);
@@ -14,4 +15,6 @@ ProgressReporting get_next_progress_reporting(ProgressReporting progress_reporti
 std::experimental::optional<ProgressReporting> decode_progress_reporting(std::string progress_reporting);
 std::string encode_progress_reporting(ProgressReporting progress_reporting);
 
+const char *get_progress_reporting_display_name(ProgressReporting progress_reporting);
+
 #endif
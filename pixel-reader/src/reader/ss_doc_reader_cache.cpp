@@ -7,21 +7,30 @@ SSDocReaderCache::SSDocReaderCache(StateStore &store): store(store)
 
 std::experimental::optional<std::string> SSDocReaderCache::read(const std::string &book_id, const std::string &key) const
 {
-    const auto &kv = store.get_reader_cache(book_id);
-    const auto it = kv.find(key);
-    if (it == kv.end())
-    {
-        return {};
-    }
-    return it->second;
+    return store.get_reader_cache_value(book_id, key);
 }
 
 void SSDocReaderCache::write(const std::string &book_id, const std::string &key, const std::string &value)
 {
-    if (read(book_id, key) != value)
-    {
-        auto kv = store.get_reader_cache(book_id);
-        kv[key] = value;
-        store.set_reader_cache(book_id, kv);
-    }
+    store.set_reader_cache_value(book_id, key, value);
+}
+
+std::experimental::optional<std::string> SSDocReaderCache::read_blob(const std::string &book_id, const std::string &key) const
+{
+    return store.get_reader_cache_blob(book_id, key);
+}
+
+void SSDocReaderCache::write_blob(const std::string &book_id, const std::string &key, const std::string &value)
+{
+    store.set_reader_cache_blob(book_id, key, value);
+}
+
+std::vector<std::string> SSDocReaderCache::blob_keys(const std::string &book_id) const
+{
+    return store.get_reader_cache_blob_keys(book_id);
+}
+
+void SSDocReaderCache::remove_blob(const std::string &book_id, const std::string &key)
+{
+    store.remove_reader_cache_blob(book_id, key);
 }
@@ -9,11 +9,17 @@ struct StateStore;
 class SSDocReaderCache : public DocReaderCache
 {
     StateStore &store;
+
 public:
     SSDocReaderCache(StateStore &store);
 
     std::experimental::optional<std::string> read(const std::string &book_id, const std::string &key) const override;
     void write(const std::string &book_id, const std::string &key, const std::string &value) override;
+
+    std::experimental::optional<std::string> read_blob(const std::string &book_id, const std::string &key) const override;
+    void write_blob(const std::string &book_id, const std::string &key, const std::string &value) override;
+    std::vector<std::string> blob_keys(const std::string &book_id) const override;
+    void remove_blob(const std::string &book_id, const std::string &key) override;
 };
 
 #endif
@@ -1,8 +1,15 @@
 #include "./state_store.h"
+#include "extern/hash-library/md5.h"
 #include "util/key_value_file.h"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
 #include <fstream>
+#include <iostream>
 #include <unordered_map>
+#include <vector>
 
 namespace
 {
@@ -90,11 +97,36 @@ std::experimental::filesystem::path reader_cache_store_path_for_book(const std::
     return base_path / (book_id + ".cache");
 }
 
+std::experimental::filesystem::path reader_cache_blob_dir_for_book(const std::experimental::filesystem::path &base_path, const std::string &book_id)
+{
+    return base_path / (book_id + ".blobs");
+}
+
+std::experimental::filesystem::path reader_cache_blob_path_for_book(const std::experimental::filesystem::path &base_path, const std::string &book_id, const std::string &key)
+{
+    return reader_cache_blob_dir_for_book(base_path, book_id) / key;
+}
+
+// Last use is marked in both access and modify times, as FAT only keeps the
+// date of access
+time_t blob_last_used(const struct stat &st)
+{
+    return std::max(st.st_atime, st.st_mtime);
+}
+
+void mark_blob_used(const std::experimental::filesystem::path &path)
+{
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+}
+
 } // namespace
 
-StateStore::StateStore(std::experimental::filesystem::path base_dir)
+StateStore::StateStore(std::experimental::filesystem::path base_dir, uint64_t max_blob_bytes)
     : activity_store_path(base_dir / "activity"),
       book_data_root_path(base_dir / "books"),
+      max_blob_bytes(max_blob_bytes),
+      book_ids_store_path(base_dir / "book_ids"),
+      book_ids(load_key_value(book_ids_store_path)),
       settings_store_path(base_dir / "settings"),
       settings(load_key_value(settings_store_path))
 {
@@ -196,7 +228,14 @@ void StateStore::set_book_address(const std::string &book_id, DocAddr address)
     }
 }
 
-const string_unordered_map &StateStore::get_reader_cache(const std::string &book_id) const
+namespace
+{
+
+const string_unordered_map &load_reader_cache(
+    std::unordered_map<std::string, string_unordered_map> &book_reader_caches,
+    const std::experimental::filesystem::path &book_data_root_path,
+    const std::string &book_id
+)
 {
     auto it = book_reader_caches.find(book_id);
     if (it != book_reader_caches.end())
@@ -204,16 +243,23 @@ const string_unordered_map &StateStore::get_reader_cache(const std::string &book
         return it->second;
     }
 
-    book_reader_caches[book_id] = load_key_value(
+    return book_reader_caches[book_id] = load_key_value(
         reader_cache_store_path_for_book(book_data_root_path, book_id)
     );
+}
+
+} // namespace
 
-    return book_reader_caches[book_id];
+string_unordered_map StateStore::get_reader_cache(const std::string &book_id) const
+{
+    std::lock_guard<std::mutex> lock(reader_cache_mutex);
+    return load_reader_cache(book_reader_caches, book_data_root_path, book_id);
 }
 
 void StateStore::set_reader_cache(const std::string &book_id, const string_unordered_map &new_cache)
 {
-    const auto &cur_cache = get_reader_cache(book_id);
+    std::lock_guard<std::mutex> lock(reader_cache_mutex);
+    const auto &cur_cache = load_reader_cache(book_reader_caches, book_data_root_path, book_id);
 
     if (cur_cache != new_cache)
     {
@@ -222,6 +268,237 @@ void StateStore::set_reader_cache(const std::string &book_id, const string_unord
     }
 }
 
+std::experimental::optional<std::string> StateStore::get_reader_cache_value(const std::string &book_id, const std::string &key) const
+{
+    std::lock_guard<std::mutex> lock(reader_cache_mutex);
+    const auto &cache = load_reader_cache(book_reader_caches, book_data_root_path, book_id);
+
+    auto it = cache.find(key);
+    if (it == cache.end())
+    {
+        return std::experimental::nullopt;
+    }
+    return it->second;
+}
+
+void StateStore::set_reader_cache_value(const std::string &book_id, const std::string &key, const std::string &value)
+{
+    std::lock_guard<std::mutex> lock(reader_cache_mutex);
+    load_reader_cache(book_reader_caches, book_data_root_path, book_id);
+
+    auto &cur_value = book_reader_caches[book_id][key];
+    if (cur_value != value)
+    {
+        cur_value = value;
+        reader_cache_dirty.emplace(book_id);
+    }
+}
+
+std::experimental::optional<std::string> StateStore::get_reader_cache_blob(const std::string &book_id, const std::string &key) const
+{
+    const auto path = reader_cache_blob_path_for_book(book_data_root_path, book_id, key);
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+    {
+        return std::experimental::nullopt;
+    }
+
+    // Single read of the whole file
+    std::string value(in.tellg(), '\0');
+    in.seekg(0);
+    if (!in.read(&value[0], value.size()))
+    {
+        return std::experimental::nullopt;
+    }
+
+    mark_blob_used(path);
+    return value;
+}
+
+void StateStore::set_reader_cache_blob(const std::string &book_id, const std::string &key, const std::string &value)
+{
+    if (value.size() > max_blob_bytes)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(reader_cache_blob_mutex);
+
+    auto path = reader_cache_blob_path_for_book(book_data_root_path, book_id, key);
+    auto tmp_path = path;
+    tmp_path += ".tmp";
+
+    std::error_code ec;
+    std::experimental::filesystem::create_directories(path.parent_path(), ec);
+    uint64_t replaced_bytes = std::experimental::filesystem::file_size(path, ec);
+    if (ec)
+    {
+        replaced_bytes = 0;
+    }
+
+    // Write then rename, so readers never see a partial blob
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out.write(value.data(), value.size()))
+        {
+            std::cerr << "Unable to write " << tmp_path << std::endl;
+            return;
+        }
+    }
+    std::experimental::filesystem::rename(tmp_path, path, ec);
+    if (ec)
+    {
+        std::cerr << "Unable to write " << path << ": " << ec.message() << std::endl;
+        return;
+    }
+
+    if (total_blob_bytes)
+    {
+        *total_blob_bytes = *total_blob_bytes - std::min(*total_blob_bytes, replaced_bytes) + value.size();
+    }
+    if (!total_blob_bytes || *total_blob_bytes > max_blob_bytes)
+    {
+        evict_blobs(path);
+    }
+}
+
+std::vector<std::string> StateStore::get_reader_cache_blob_keys(const std::string &book_id) const
+{
+    std::vector<std::string> keys;
+
+    std::error_code ec;
+    for (const auto &entry : std::experimental::filesystem::directory_iterator(reader_cache_blob_dir_for_book(book_data_root_path, book_id), ec))
+    {
+        // Skip blobs still being written
+        if (entry.path().extension() != ".tmp")
+        {
+            keys.push_back(entry.path().filename().string());
+        }
+    }
+    return keys;
+}
+
+void StateStore::remove_reader_cache_blob(const std::string &book_id, const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(reader_cache_blob_mutex);
+
+    const auto path = reader_cache_blob_path_for_book(book_data_root_path, book_id, key);
+    std::error_code ec;
+    uint64_t removed_bytes = std::experimental::filesystem::file_size(path, ec);
+    if (!ec && std::experimental::filesystem::remove(path, ec) && total_blob_bytes)
+    {
+        *total_blob_bytes -= std::min(*total_blob_bytes, removed_bytes);
+    }
+}
+
+void StateStore::remove_reader_cache_blobs(const std::string &book_id)
+{
+    std::lock_guard<std::mutex> lock(reader_cache_blob_mutex);
+
+    std::error_code ec;
+    std::experimental::filesystem::remove_all(reader_cache_blob_dir_for_book(book_data_root_path, book_id), ec);
+    if (ec)
+    {
+        std::cerr << "Unable to remove blobs of " << book_id << ": " << ec.message() << std::endl;
+    }
+    // Recounted on the next write
+    total_blob_bytes = std::experimental::nullopt;
+}
+
+// Counts blobs of all books, then while over max_blob_bytes removes those
+// least recently used. Trims to three quarters of max_blob_bytes, so a full
+// store isn't scanned on every write. Called with reader_cache_blob_mutex held.
+void StateStore::evict_blobs(const std::experimental::filesystem::path &keep_path)
+{
+    struct Entry
+    {
+        time_t last_used;
+        uint64_t size;
+        std::experimental::filesystem::path path;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<std::experimental::filesystem::path> blob_dirs;
+    uint64_t total = 0;
+
+    std::error_code ec;
+    for (const auto &book_entry : std::experimental::filesystem::directory_iterator(book_data_root_path, ec))
+    {
+        if (book_entry.path().extension() != ".blobs")
+        {
+            continue;
+        }
+        blob_dirs.push_back(book_entry.path());
+
+        for (const auto &dir_entry : std::experimental::filesystem::directory_iterator(book_entry.path(), ec))
+        {
+            struct stat st;
+            if (stat(dir_entry.path().c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+            {
+                continue;
+            }
+            total += st.st_size;
+            if (dir_entry.path() != keep_path)
+            {
+                entries.push_back({blob_last_used(st), static_cast<uint64_t>(st.st_size), dir_entry.path()});
+            }
+        }
+    }
+
+    if (total > max_blob_bytes)
+    {
+        std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+            return a.last_used < b.last_used;
+        });
+
+        const uint64_t target_bytes = max_blob_bytes / 4 * 3;
+        for (const auto &entry : entries)
+        {
+            if (total <= target_bytes)
+            {
+                break;
+            }
+            if (std::experimental::filesystem::remove(entry.path, ec))
+            {
+                total -= entry.size;
+            }
+        }
+
+        // Only succeeds for books left without blobs
+        for (const auto &dir : blob_dirs)
+        {
+            std::experimental::filesystem::remove(dir, ec);
+        }
+    }
+
+    total_blob_bytes = total;
+}
+
+void StateStore::set_book_id(const std::experimental::filesystem::path &book_path, const std::string &book_id)
+{
+    // Keyed by md5, as paths may contain '='
+    auto &cur_id = book_ids[MD5()(book_path.string())];
+    if (cur_id == book_id)
+    {
+        return;
+    }
+
+    std::string old_id = cur_id;
+    cur_id = book_id;
+    book_ids_dirty = true;
+
+    // Keep blobs still used by a copy of the book elsewhere
+    bool old_id_used = old_id.empty() || std::any_of(
+        book_ids.begin(),
+        book_ids.end(),
+        [&old_id](const auto &entry) { return entry.second == old_id; }
+    );
+    if (!old_id_used)
+    {
+        remove_reader_cache_blobs(old_id);
+    }
+}
+
 std::experimental::optional<std::string> StateStore::get_setting(const std::string &name) const
 {
     auto it = settings.find(name);
@@ -266,6 +543,7 @@ void StateStore::flush() const
 
     // book cache
     {
+        std::lock_guard<std::mutex> lock(reader_cache_mutex);
         for (const auto &book_id : reader_cache_dirty)
         {
             const auto &cache = book_reader_caches[book_id];
@@ -277,6 +555,12 @@ void StateStore::flush() const
         reader_cache_dirty.clear();
     }
 
+    if (book_ids_dirty)
+    {
+        write_key_value(book_ids_store_path, book_ids);
+        book_ids_dirty = false;
+    }
+
     if (settings_dirty)
     {
         write_key_value(settings_store_path, settings);
@@ -5,8 +5,10 @@
 
 #include <experimental/filesystem>
 #include <experimental/optional>
+#include <mutex>
 #include <set>
 #include <unordered_map>
+#include <vector>
 
 using string_unordered_map = std::unordered_map<std::string, std::string>;
 
@@ -23,16 +25,28 @@ class StateStore {
     // book addresses
     std::experimental::filesystem::path book_data_root_path;
 
-    // reader cache
+    // reader cache (may be accessed from reader background threads)
+    mutable std::mutex reader_cache_mutex;
     mutable std::unordered_map<std::string, string_unordered_map> book_reader_caches;
     mutable std::set<std::string> reader_cache_dirty;
+    std::mutex reader_cache_blob_mutex;
+    // Blobs of all books, least recently used removed past this
+    const uint64_t max_blob_bytes;
+    // Size of all blobs, once counted. Guarded by reader_cache_blob_mutex.
+    std::experimental::optional<uint64_t> total_blob_bytes;
+    void evict_blobs(const std::experimental::filesystem::path &keep_path);
+
+    // md5 of book path -> id of the book last opened there
+    std::experimental::filesystem::path book_ids_store_path;
+    string_unordered_map book_ids;
+    mutable bool book_ids_dirty = false;
 
     // settings
     std::experimental::filesystem::path settings_store_path;
     string_unordered_map settings;
 
 public:
-    StateStore(std::experimental::filesystem::path base_dir);
+    StateStore(std::experimental::filesystem::path base_dir, uint64_t max_blob_bytes);
     virtual ~StateStore();
 
     // activity
@@ -48,9 +62,22 @@ public:
     std::experimental::optional<DocAddr> get_book_address(const std::string &book_id) const;
     void set_book_address(const std::string &book_id, DocAddr address);
 
-    // reader cache
-    const string_unordered_map &get_reader_cache(const std::string &book_id) const;
+    // reader cache (thread safe)
+    string_unordered_map get_reader_cache(const std::string &book_id) const;
     void set_reader_cache(const std::string &book_id, const string_unordered_map &cache);
+    // Single entries, without copying the book's whole cache
+    std::experimental::optional<std::string> get_reader_cache_value(const std::string &book_id, const std::string &key) const;
+    void set_reader_cache_value(const std::string &book_id, const std::string &key, const std::string &value);
+    // Blobs are written immediately rather than on flush
+    std::experimental::optional<std::string> get_reader_cache_blob(const std::string &book_id, const std::string &key) const;
+    void set_reader_cache_blob(const std::string &book_id, const std::string &key, const std::string &value);
+    std::vector<std::string> get_reader_cache_blob_keys(const std::string &book_id) const;
+    void remove_reader_cache_blob(const std::string &book_id, const std::string &key);
+    void remove_reader_cache_blobs(const std::string &book_id);
+
+    // Record the id of the book at book_path. If the file previously had
+    // another id, blobs stored under that id are removed.
+    void set_book_id(const std::experimental::filesystem::path &book_path, const std::string &book_id);
 
     // generic settings
     std::experimental::optional<std::string> get_setting(const std::string &name) const;
@@ -0,0 +1,297 @@
+#include "reader/views/token_view/line_break_index.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+
+static bool operator==(const LineBreakIndex::LineBreak &a, const LineBreakIndex::LineBreak &b)
+{
+    return a.offset == b.offset && a.length == b.length;
+}
+
+namespace
+{
+
+class MemoryDocReaderCache : public DocReaderCache
+{
+public:
+    std::map<std::pair<std::string, std::string>, std::string> blobs;
+
+    std::experimental::optional<std::string> read(const std::string &, const std::string &) const override
+    {
+        return std::experimental::nullopt;
+    }
+
+    void write(const std::string &, const std::string &, const std::string &) override
+    {
+    }
+
+    std::experimental::optional<std::string> read_blob(const std::string &book_id, const std::string &key) const override
+    {
+        auto it = blobs.find({book_id, key});
+        if (it == blobs.end())
+        {
+            return std::experimental::nullopt;
+        }
+        return it->second;
+    }
+
+    void write_blob(const std::string &book_id, const std::string &key, const std::string &value) override
+    {
+        blobs[{book_id, key}] = value;
+    }
+
+    std::vector<std::string> blob_keys(const std::string &book_id) const override
+    {
+        std::vector<std::string> keys;
+        for (const auto &entry : blobs)
+        {
+            if (entry.first.first == book_id)
+            {
+                keys.push_back(entry.first.second);
+            }
+        }
+        return keys;
+    }
+
+    void remove_blob(const std::string &book_id, const std::string &key) override
+    {
+        blobs.erase({book_id, key});
+    }
+};
+
+using LineBreaks = std::vector<LineBreakIndex::LineBreak>;
+
+// "abc def gh" wrapped as "abc def" / "gh"
+const LineBreaks TEXT_BREAKS = {{0, 7}, {8, 2}};
+
+// Adds tokens at addresses 0, 10, 20, ... each with 2 lines
+void add_tokens(LineBreakIndex &index, uint32_t first, uint32_t end)
+{
+    for (uint32_t i = first; i < end; ++i)
+    {
+        index.add_text(i * 10, i, TEXT_BREAKS);
+    }
+}
+
+} // namespace
+
+TEST(LINE_BREAK_INDEX, lookup)
+{
+    LineBreakIndex index(nullptr, "book", "layout");
+    index.add_text(0, 100, TEXT_BREAKS);
+    index.add_text(10, 101, {{0, 0}});
+    index.add_image(10, 102, 3);
+    index.add_text(20, 103, {{1, 4}});
+
+    EXPECT_EQ(index.num_tokens(), 4);
+    EXPECT_EQ(index.num_lines(), 7);
+    EXPECT_EQ(*index.last_address(), 20);
+
+    LineBreaks breaks;
+    ASSERT_TRUE(index.get_line_breaks(0, 100, 10, breaks));
+    EXPECT_EQ(breaks, TEXT_BREAKS);
+    ASSERT_TRUE(index.get_line_breaks(10, 101, 0, breaks));
+    EXPECT_EQ(breaks, (LineBreaks{{0, 0}}));
+    ASSERT_TRUE(index.get_line_breaks(20, 103, 5, breaks));
+    EXPECT_EQ(breaks, (LineBreaks{{1, 4}}));
+
+    // Images have no line breaks
+    EXPECT_FALSE(index.get_line_breaks(10, 102, 0, breaks));
+
+    EXPECT_EQ(*index.first_line(0, 100), 0);
+    EXPECT_EQ(*index.first_line(10, 101), 2);
+    EXPECT_EQ(*index.first_line(10, 102), 3);
+    EXPECT_EQ(*index.first_line(20, 103), 6);
+}
+
+TEST(LINE_BREAK_INDEX, mismatch)
+{
+    LineBreakIndex index(nullptr, "book", "layout");
+    index.add_text(0, 100, TEXT_BREAKS);
+
+    LineBreaks breaks;
+    EXPECT_FALSE(index.get_line_breaks(1, 100, 10, breaks));
+    EXPECT_FALSE(index.get_line_breaks(0, 99, 10, breaks));
+    EXPECT_FALSE(index.first_line(0, 99));
+
+    // Text no longer fits the breaks
+    EXPECT_FALSE(index.get_line_breaks(0, 100, 9, breaks));
+    EXPECT_FALSE(index.get_line_breaks(0, 100, 12, breaks));
+    EXPECT_TRUE(index.get_line_breaks(0, 100, 11, breaks));
+}
+
+TEST(LINE_BREAK_INDEX, tokens_at_last_address)
+{
+    LineBreakIndex index(nullptr, "book", "layout");
+    EXPECT_FALSE(index.last_address());
+    EXPECT_EQ(index.num_tokens_at_last_address(), 0);
+
+    index.add_text(0, 1, TEXT_BREAKS);
+    index.add_text(5, 2, TEXT_BREAKS);
+    index.add_image(5, 3, 1);
+    EXPECT_EQ(index.num_tokens_at_last_address(), 2);
+}
+
+TEST(LINE_BREAK_INDEX, persist_and_resume)
+{
+    MemoryDocReaderCache cache;
+    const uint32_t num_tokens = LINE_BREAK_CHUNK_TOKENS * 2 + 10;
+    {
+        LineBreakIndex index(&cache, "book", "layout");
+        index.load();
+        add_tokens(index, 0, LINE_BREAK_CHUNK_TOKENS + 5);
+    }
+    {
+        LineBreakIndex index(&cache, "book", "layout");
+        index.load();
+        EXPECT_FALSE(index.is_complete());
+        ASSERT_EQ(index.num_tokens(), LINE_BREAK_CHUNK_TOKENS + 5);
+
+        add_tokens(index, index.num_tokens(), num_tokens);
+        index.set_complete();
+    }
+
+    LineBreakIndex index(&cache, "book", "layout");
+
+    index.load();
+    EXPECT_TRUE(index.is_complete());
+    ASSERT_EQ(index.num_tokens(), num_tokens);
+    EXPECT_EQ(index.num_lines(), num_tokens * 2);
+
+    LineBreaks breaks;
+    for (uint32_t i = 0; i < num_tokens; ++i)
+    {
+        ASSERT_TRUE(index.get_line_breaks(i * 10, i, 10, breaks)) << i;
+        EXPECT_EQ(breaks, TEXT_BREAKS);
+        EXPECT_EQ(*index.first_line(i * 10, i), i * 2);
+    }
+
+    // Other layouts and books are separate
+    LineBreakIndex other_layout(&cache, "book", "other");
+    other_layout.load();
+    EXPECT_EQ(other_layout.num_tokens(), 0);
+
+    LineBreakIndex other_book(&cache, "other", "layout");
+    other_book.load();
+    EXPECT_EQ(other_book.num_tokens(), 0);
+}
+
+TEST(LINE_BREAK_INDEX, complete_on_chunk_boundary)
+{
+    MemoryDocReaderCache cache;
+    {
+        LineBreakIndex index(&cache, "book", "layout");
+        index.load();
+        add_tokens(index, 0, LINE_BREAK_CHUNK_TOKENS);
+        index.save();
+        index.set_complete();
+    }
+
+    LineBreakIndex index(&cache, "book", "layout");
+
+    index.load();
+    EXPECT_TRUE(index.is_complete());
+    EXPECT_EQ(index.num_tokens(), LINE_BREAK_CHUNK_TOKENS);
+}
+
+TEST(LINE_BREAK_INDEX, empty_book)
+{
+    MemoryDocReaderCache cache;
+    {
+        LineBreakIndex index(&cache, "book", "layout");
+        index.load();
+        index.set_complete();
+    }
+
+    LineBreakIndex index(&cache, "book", "layout");
+
+    index.load();
+    EXPECT_TRUE(index.is_complete());
+    EXPECT_EQ(index.num_tokens(), 0);
+    EXPECT_EQ(index.num_lines(), 0);
+}
+
+TEST(LINE_BREAK_INDEX, corrupt_chunk)
+{
+    MemoryDocReaderCache cache;
+    {
+        LineBreakIndex index(&cache, "book", "layout");
+        index.load();
+        add_tokens(index, 0, LINE_BREAK_CHUNK_TOKENS + 5);
+        index.set_complete();
+    }
+
+    // Resumes after the last good chunk
+    for (auto &blob : cache.blobs)
+    {
+        if (blob.first.second.back() == '1')
+        {
+            blob.second[blob.second.size() / 2] ^= 1;
+        }
+    }
+
+    LineBreakIndex index(&cache, "book", "layout");
+
+    index.load();
+    EXPECT_FALSE(index.is_complete());
+    EXPECT_EQ(index.num_tokens(), LINE_BREAK_CHUNK_TOKENS);
+    EXPECT_EQ(index.num_lines(), LINE_BREAK_CHUNK_TOKENS * 2);
+}
+
+TEST(LINE_BREAK_INDEX, loads_a_chunk_at_a_time)
+{
+    MemoryDocReaderCache cache;
+    {
+        LineBreakIndex index(&cache, "book", "layout");
+        index.load();
+        add_tokens(index, 0, LINE_BREAK_CHUNK_TOKENS * 2 + 5);
+    }
+
+    LineBreakIndex index(&cache, "book", "layout");
+    EXPECT_EQ(index.num_tokens(), 0);
+
+    uint32_t num_chunks = 0;
+    while (!index.is_loaded())
+    {
+        index.load_next_chunk();
+        ++num_chunks;
+    }
+    EXPECT_EQ(num_chunks, 3);
+    EXPECT_EQ(index.num_tokens(), LINE_BREAK_CHUNK_TOKENS * 2 + 5);
+
+    // Nothing to save until tokens are added
+    cache.blobs.clear();
+    index.save();
+    EXPECT_TRUE(cache.blobs.empty());
+}
+
+TEST(LINE_BREAK_INDEX, keeps_one_layout_per_book)
+{
+    MemoryDocReaderCache cache;
+    cache.write_blob("book", "other_key", "value");
+    {
+        LineBreakIndex index(&cache, "book", "layout_a");
+        index.load();
+        add_tokens(index, 0, LINE_BREAK_CHUNK_TOKENS + 5);
+    }
+    {
+        LineBreakIndex index(&cache, "other_book", "layout_b");
+        index.load();
+        add_tokens(index, 0, 5);
+    }
+    EXPECT_EQ(cache.blobs.size(), 4);
+
+    // Reopening the same layout keeps it
+    {
+        LineBreakIndex index(&cache, "book", "layout_a");
+        index.load();
+        EXPECT_EQ(index.num_tokens(), LINE_BREAK_CHUNK_TOKENS + 5);
+    }
+
+    LineBreakIndex index(&cache, "book", "layout_b");
+    index.load();
+    EXPECT_EQ(index.num_tokens(), 0);
+    EXPECT_EQ(cache.blob_keys("book"), std::vector<std::string>{"other_key"});
+    EXPECT_EQ(cache.blob_keys("other_book").size(), 1);
+}
@@ -0,0 +1,103 @@
+#include "../state_store.h"
+#include "util/tests/test_files.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <string>
+
+namespace
+{
+
+void set_used_time(const std::experimental::filesystem::path &path, time_t time)
+{
+    struct timespec times[2] = {{time, 0}, {time, 0}};
+    utimensat(AT_FDCWD, path.c_str(), times, 0);
+}
+
+std::experimental::filesystem::path blob_path(const TempDir &dir, const std::string &book_id, const std::string &key)
+{
+    return dir.path / "books" / (book_id + ".blobs") / key;
+}
+
+} // namespace
+
+TEST(STATE_STORE, blobs_evict_least_recently_used)
+{
+    TempDir dir("state_store");
+    ASSERT_FALSE(dir.path.empty());
+
+    // Room for two blobs, not three
+    StateStore store(dir.path, 3000);
+    const std::string blob(1100, 'x');
+
+    store.set_reader_cache_blob("book_a", "a", blob);
+    set_used_time(blob_path(dir, "book_a", "a"), 1000);
+    store.set_reader_cache_blob("book_b", "b", blob);
+    set_used_time(blob_path(dir, "book_b", "b"), 2000);
+
+    // Use a, leaving b least recently used
+    ASSERT_TRUE(store.get_reader_cache_blob("book_a", "a"));
+
+    store.set_reader_cache_blob("book_a", "c", blob);
+    EXPECT_TRUE(store.get_reader_cache_blob("book_a", "a"));
+    EXPECT_FALSE(store.get_reader_cache_blob("book_b", "b"));
+    EXPECT_TRUE(store.get_reader_cache_blob("book_a", "c"));
+    EXPECT_FALSE(std::experimental::filesystem::exists(dir.path / "books" / "book_b.blobs"));
+
+    // Too big to store at all
+    store.set_reader_cache_blob("book_a", "large", std::string(4000, 'x'));
+    EXPECT_FALSE(store.get_reader_cache_blob("book_a", "large"));
+    EXPECT_TRUE(store.get_reader_cache_blob("book_a", "a"));
+}
+
+TEST(STATE_STORE, changed_book_id_removes_blobs)
+{
+    TempDir dir("state_store");
+    ASSERT_FALSE(dir.path.empty());
+
+    StateStore store(dir.path, 1024 * 1024);
+    store.set_book_id("books/a.epub", "id_1");
+    store.set_book_id("copy/a.epub", "id_1");
+    store.set_reader_cache_blob("id_1", "key", "value");
+
+    // Still used by the copy
+    store.set_book_id("books/a.epub", "id_2");
+    EXPECT_TRUE(store.get_reader_cache_blob("id_1", "key"));
+
+    store.set_book_id("copy/a.epub", "id_2");
+    EXPECT_FALSE(store.get_reader_cache_blob("id_1", "key"));
+
+    // Kept across sessions
+    store.set_reader_cache_blob("id_2", "key", "value");
+    store.flush();
+    StateStore reopened(dir.path, 1024 * 1024);
+    reopened.set_book_id("books/a.epub", "id_3");
+    EXPECT_TRUE(reopened.get_reader_cache_blob("id_2", "key"));
+    reopened.set_book_id("copy/a.epub", "id_3");
+    EXPECT_FALSE(reopened.get_reader_cache_blob("id_2", "key"));
+}
+
+TEST(STATE_STORE, list_and_remove_blobs)
+{
+    TempDir dir("state_store");
+    ASSERT_FALSE(dir.path.empty());
+
+    StateStore store(dir.path, 1024 * 1024);
+    EXPECT_TRUE(store.get_reader_cache_blob_keys("book").empty());
+
+    store.set_reader_cache_blob("book", "a", "value");
+    store.set_reader_cache_blob("book", "b", "value");
+    store.set_reader_cache_blob("other_book", "c", "value");
+
+    auto keys = store.get_reader_cache_blob_keys("book");
+    std::sort(keys.begin(), keys.end());
+    EXPECT_EQ(keys, (std::vector<std::string>{"a", "b"}));
+
+    store.remove_reader_cache_blob("book", "a");
+    EXPECT_FALSE(store.get_reader_cache_blob("book", "a"));
+    EXPECT_EQ(store.get_reader_cache_blob_keys("book"), std::vector<std::string>{"b"});
+    EXPECT_TRUE(store.get_reader_cache_blob("other_book", "c"));
+}
@@ -132,3 +132,48 @@ TEST(TEXT_WRAP, limit_mac_char_len)
         (std::vector<std::string>{"123", "45", "789", "ABC", "D"})
     );
 }
+
+namespace {
+
+// Checks that lines are only extended between calls to start_line
+class IncrementalFitter : public LineFitter
+{
+public:
+    const char *line_start = nullptr;
+    uint32_t last_len = 0;
+    bool extended_only = true;
+
+    void start_line(const char *start) override
+    {
+        line_start = start;
+        last_len = 0;
+    }
+
+    bool fits(uint32_t len) override
+    {
+        extended_only = extended_only && line_start && len >= last_len;
+        last_len = len;
+        return len <= 12;
+    }
+};
+
+} // namespace
+
+TEST(TEXT_WRAP, line_fitter_extends_lines)
+{
+    IncrementalFitter line_fitter;
+    std::vector<std::string> lines;
+    wrap_lines(
+        "1234 6789 1234 6789ABCDEFGHIJ ΑΒΓΔΕΖΗΘΙΚΛΜΝΞΟΠ",
+        line_fitter,
+        [&lines](const char *str, uint32_t len) {
+            lines.emplace_back(str, len);
+        }
+    );
+
+    EXPECT_TRUE(line_fitter.extended_only);
+    EXPECT_EQ(
+        lines,
+        (std::vector<std::string>{"1234 6789", "1234", "6789ABCDEFGH", "IJ", "ΑΒΓΔΕΖ", "ΗΘΙΚΛΜ", "ΝΞΟΠ"})
+    );
+}
@@ -8,7 +8,28 @@
 
 namespace {
 
-using str_filter_func = std::function<bool(const char *, uint32_t)>;
+// Measures each candidate independently
+class FunctionLineFitter : public LineFitter
+{
+    std::function<bool(const char *, uint32_t)> fits_on_line;
+    const char *line_start = nullptr;
+
+public:
+    FunctionLineFitter(std::function<bool(const char *, uint32_t)> fits_on_line)
+        : fits_on_line(std::move(fits_on_line))
+    {
+    }
+
+    void start_line(const char *start) override
+    {
+        line_start = start;
+    }
+
+    bool fits(uint32_t len) override
+    {
+        return fits_on_line(line_start, len);
+    }
+};
 
 const char *find_first_break(const char *pos, int max_search)
 {
@@ -22,8 +43,10 @@ const char *find_first_break(const char *pos, int max_search)
     return pos;
 }
 
-const char *find_last_whitespace(const char *start_pos, str_filter_func &fits_on_line, uint32_t max_line_search_chars)
+const char *find_last_whitespace(const char *start_pos, LineFitter &line_fitter, uint32_t max_line_search_chars)
 {
+    line_fitter.start_line(start_pos);
+
     const char *best_candidate_pos = nullptr;
     const char *cur_pos = start_pos;
 
@@ -36,7 +59,7 @@ const char *find_last_whitespace(const char *start_pos, str_filter_func &fits_on
             break;
         }
 
-        if (!fits_on_line(start_pos, candidate_pos - start_pos))
+        if (!line_fitter.fits(candidate_pos - start_pos))
         {
             // overshot
             break;
@@ -55,13 +78,15 @@ const char *find_last_whitespace(const char *start_pos, str_filter_func &fits_on
     return best_candidate_pos;
 }
 
-const char *find_last_character(const char *start_pos, str_filter_func &fits_on_line, uint32_t max_line_search_chars)
+const char *find_last_character(const char *start_pos, LineFitter &line_fitter, uint32_t max_line_search_chars)
 {
+    line_fitter.start_line(start_pos);
+
     const char *cur_pos = start_pos;
     while (*cur_pos && max_line_search_chars-- > 0)
     {
         const char *candidate_pos = utf8_step(cur_pos);
-        if (!fits_on_line(start_pos, candidate_pos - start_pos))
+        if (!line_fitter.fits(candidate_pos - start_pos))
         {
             break;
         }
@@ -74,7 +99,7 @@ const char *find_last_character(const char *start_pos, str_filter_func &fits_on_
 
 void wrap_lines(
     const char *str,
-    std::function<bool(const char *, uint32_t)> fits_on_line,
+    LineFitter &line_fitter,
     std::function<void(const char *, uint32_t)> on_next_line,
     uint32_t max_line_search_chars
 )
@@ -91,12 +116,12 @@ void wrap_lines(
     while (cur_pos < string_end_pos)
     {
         const char *break_pos;
-        if ((break_pos = find_last_whitespace(cur_pos, fits_on_line, max_line_search_chars)))
+        if ((break_pos = find_last_whitespace(cur_pos, line_fitter, max_line_search_chars)))
         {
             on_next_line(cur_pos, break_pos - cur_pos);
             cur_pos = break_pos + 1;
         }
-        else if ((break_pos = find_last_character(cur_pos, fits_on_line, max_line_search_chars)))
+        else if ((break_pos = find_last_character(cur_pos, line_fitter, max_line_search_chars)))
         {
             on_next_line(cur_pos, break_pos - cur_pos);
             cur_pos = break_pos;
@@ -107,3 +132,14 @@ void wrap_lines(
         }
     }
 }
+
+void wrap_lines(
+    const char *str,
+    std::function<bool(const char *, uint32_t)> fits_on_line,
+    std::function<void(const char *, uint32_t)> on_next_line,
+    uint32_t max_line_search_chars
+)
+{
+    FunctionLineFitter line_fitter(std::move(fits_on_line));
+    wrap_lines(str, line_fitter, std::move(on_next_line), max_line_search_chars);
+}
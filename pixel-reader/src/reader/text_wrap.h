@@ -1,10 +1,33 @@
 #ifndef TEXT_WRAP_H_
 #define TEXT_WRAP_H_
 
+#include <cstdint>
 #include <functional>
 #include <string>
 #include <vector>
 
+// Decides whether a line fits. While searching for a break, a line is only
+// ever extended from the same start, so implementations can build on the
+// previous measurement instead of measuring each candidate from scratch.
+class LineFitter
+{
+public:
+    virtual ~LineFitter() = default;
+
+    // Following calls to fits measure from line_start
+    virtual void start_line(const char *line_start) = 0;
+    // True if the first len chars from the line start fit. len never
+    // decreases between calls to start_line.
+    virtual bool fits(uint32_t len) = 0;
+};
+
+void wrap_lines(
+    const char *str,
+    LineFitter &line_fitter,
+    std::function<void(const char *, uint32_t)> on_next_line,
+    unsigned int max_line_search_chars = 1024
+);
+
 void wrap_lines(
     const char *str,
     std::function<bool(const char *, uint32_t)> fits_on_line,
@@ -4,12 +4,18 @@
 #include <SDL/SDL_keysym.h>
 #include <SDL/SDL_video.h>
 
+#include <vector>
+
 class View
 {
 public:
     // Returns true if rendering was performed.
     virtual bool render(SDL_Surface *dest, bool force_render) = 0;
 
+    // Areas of dest changed by the last render. Empty if it may have changed
+    // anywhere.
+    virtual std::vector<SDL_Rect> get_dirty_rects() const { return {}; }
+
     // Return true if the view is no longer needed.
     virtual bool is_done() = 0;
 
@@ -22,6 +28,11 @@ public:
     // Pass key and held time in ms.
     virtual void on_keyheld(SDLKey, uint32_t) {}
 
+    // Nothing else to do while waiting for input. Use for a small step of
+    // speculative work, as input isn't handled until it returns. Return true
+    // if the view needs rendering, e.g. for work finished in the background.
+    virtual bool on_idle() { return false; }
+
     // This view has been popped from the stack (now defunct).
     virtual void on_pop() {}
 
@@ -12,6 +12,7 @@ ViewStack::~ViewStack()
 bool ViewStack::render(SDL_Surface *dest, bool force_render)
 {
     bool rendered = false;
+    dirty_rects.clear();
     if (!views.empty())
     {
         auto &top_view = views.back();
@@ -24,6 +25,10 @@ bool ViewStack::render(SDL_Surface *dest, bool force_render)
         if (!top_view->is_modal())
         {
             rendered = top_view->render(dest, force_render) || force_render;
+            if (!force_render)
+            {
+                dirty_rects = top_view->get_dirty_rects();
+            }
         }
         else
         {
@@ -46,6 +51,11 @@ bool ViewStack::render(SDL_Surface *dest, bool force_render)
     return rendered;
 }
 
+std::vector<SDL_Rect> ViewStack::get_dirty_rects() const
+{
+    return dirty_rects;
+}
+
 bool ViewStack::is_done()
 {
     return views.empty();
@@ -67,6 +77,15 @@ void ViewStack::on_keyheld(SDLKey key, uint32_t hold_time_ms)
     }
 }
 
+bool ViewStack::on_idle()
+{
+    if (!views.empty() && !views.back()->is_modal())
+    {
+        return views.back()->on_idle();
+    }
+    return false;
+}
+
 bool ViewStack::pop_completed_views()
 {
     bool changed_focus = false;
@@ -10,15 +10,18 @@ class ViewStack: public View
 {
     std::vector<std::shared_ptr<View>> views;
     std::weak_ptr<View> last_top_view;
+    std::vector<SDL_Rect> dirty_rects;
 public:
     void push(std::shared_ptr<View> view);
     virtual ~ViewStack();
 
     bool render(SDL_Surface *dest, bool force_render) override;
+    std::vector<SDL_Rect> get_dirty_rects() const override;
     bool is_done() override;
 
     void on_keypress(SDLKey key) override;
     void on_keyheld(SDLKey key, uint32_t hold_time_ms) override;
+    bool on_idle() override;
 
     // Pop views that report as done. Return true if focus changed.
     bool pop_completed_views();
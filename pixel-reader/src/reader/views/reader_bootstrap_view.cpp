@@ -4,11 +4,11 @@
 #include "./reader_view.h"
 #include "filetypes/open_doc.h"
 #include "reader/config.h"
-#include "reader/ss_doc_reader_cache.h"
 #include "reader/state_store.h"
 #include "reader/system_styling.h"
 #include "reader/view_stack.h"
 #include "sys/screen.h"
+#include "util/task_queue.h"
 
 #include <iostream>
 
@@ -19,6 +19,11 @@ struct ReaderBootstrapViewState
     TokenViewStyling &token_view_styling;
     ViewStack &view_stack;
     StateStore &state_store;
+    DocReaderCache &reader_cache;
+    ImageDiskCache *image_disk_cache;
+    MemoryBudget *memory_budget;
+
+    CancelToken open_token;
 
     bool is_done = false;
     bool needs_render = true;
@@ -28,18 +33,24 @@ struct ReaderBootstrapViewState
         SystemStyling &sys_styling,
         TokenViewStyling &token_view_styling,
         ViewStack &view_stack,
-        StateStore &state_store
+        StateStore &state_store,
+        DocReaderCache &reader_cache,
+        ImageDiskCache *image_disk_cache,
+        MemoryBudget *memory_budget
     ) :
         book_path(book_path),
         sys_styling(sys_styling),
         token_view_styling(token_view_styling),
         view_stack(view_stack),
-        state_store(state_store)
+        state_store(state_store),
+        reader_cache(reader_cache),
+        image_disk_cache(image_disk_cache),
+        memory_budget(memory_budget)
     {
     }
 };
 
-void ReaderBootstrapView::load_reader()
+void ReaderBootstrapView::show_reader(std::shared_ptr<DocReader> reader)
 {
     state->is_done = true;
 
@@ -49,9 +60,7 @@ void ReaderBootstrapView::load_reader()
     auto &view_stack = state->view_stack;
     auto &state_store = state->state_store;
 
-    std::shared_ptr<DocReader> reader = create_doc_reader(book_path);
-    SSDocReaderCache cache(state_store);
-    if (!reader || !reader->open(cache))
+    if (!reader)
     {
         std::cerr << "Failed to open " << book_path << std::endl;
         view_stack.push(std::make_shared<PopupView>("Error opening", SYSTEM_FONT, sys_styling));
@@ -61,13 +70,17 @@ void ReaderBootstrapView::load_reader()
     state_store.set_current_book_path(book_path);
 
     auto book_id = reader->get_id();
+    state_store.set_book_id(book_path, book_id);
     auto reader_view = std::make_shared<ReaderView>(
         book_path,
         reader,
         state_store.get_book_address(book_id).value_or(0),
         sys_styling,
         token_view_styling,
-        view_stack
+        view_stack,
+        &state->reader_cache,
+        state->image_disk_cache,
+        state->memory_budget
     );
 
     reader_view->set_on_change_address([&state_store, book_id](DocAddr addr) {
@@ -83,15 +96,30 @@ ReaderBootstrapView::ReaderBootstrapView(
     TokenViewStyling &token_view_styling,
     ViewStack &view_stack,
     StateStore &state_store,
-    std::function<void(std::function<void()>)> async
-) : state(std::make_unique<ReaderBootstrapViewState>(book_path, sys_styling, token_view_styling, view_stack, state_store))
+    DocReaderCache &reader_cache,
+    ImageDiskCache *image_disk_cache,
+    MemoryBudget *memory_budget,
+    TaskQueue &task_queue
+) : state(std::make_unique<ReaderBootstrapViewState>(book_path, sys_styling, token_view_styling, view_stack, state_store, reader_cache, image_disk_cache, memory_budget))
 {
-    // Perform asynchronously so that rendering can continue
-    async([this](){ load_reader(); });
+    // Open on a worker so that rendering can continue, and show on the main thread
+    auto opened = std::make_shared<std::shared_ptr<DocReader>>();
+    state->open_token = task_queue.submit(
+        [opened, book_path, &reader_cache](const CancelToken &) {
+            std::shared_ptr<DocReader> reader = create_doc_reader(book_path);
+            if (reader && reader->open(reader_cache))
+            {
+                *opened = reader;
+            }
+        },
+        [this, opened]() { show_reader(std::move(*opened)); },
+        TaskPriority::High
+    );
 }
 
 ReaderBootstrapView::~ReaderBootstrapView()
 {
+    state->open_token.cancel();
 }
 
 bool ReaderBootstrapView::render(SDL_Surface *dest_surface, bool force_render)
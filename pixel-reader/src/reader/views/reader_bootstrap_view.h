@@ -4,11 +4,16 @@
 #include "doc_api/doc_addr.h"
 #include "reader/view.h"
 
+struct DocReader;
+struct DocReaderCache;
+class ImageDiskCache;
+class MemoryBudget;
 struct ReaderBootstrapViewState;
 struct SystemStyling;
 struct TokenViewStyling;
 struct ViewStack;
 struct StateStore;
+class TaskQueue;
 
 #include <experimental/filesystem>
 #include <functional>
@@ -19,7 +24,7 @@ class ReaderBootstrapView: public View
 {
     std::unique_ptr<ReaderBootstrapViewState> state;
 
-    void load_reader();
+    void show_reader(std::shared_ptr<DocReader> reader);
 
 public:
     ReaderBootstrapView(
@@ -28,7 +33,10 @@ public:
         TokenViewStyling &token_view_styling,
         ViewStack &view_stack,
         StateStore &state_store,
-        std::function<void(std::function<void()>)> async
+        DocReaderCache &reader_cache,
+        ImageDiskCache *image_disk_cache,
+        MemoryBudget *memory_budget,
+        TaskQueue &task_queue
     );
     virtual ~ReaderBootstrapView();
 
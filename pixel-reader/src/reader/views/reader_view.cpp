@@ -4,12 +4,14 @@
 #include "./token_view/token_view.h"
 #include "./token_view/token_view_styling.h"
 
+#include "reader/config.h"
 #include "reader/system_styling.h"
 #include "reader/view_stack.h"
 
 #include "doc_api/doc_reader.h"
 #include "sys/keymap.h"
 #include "sys/screen.h"
+#include "util/memory_budget.h"
 #include "util/sdl_font_cache.h"
 
 #include <iostream>
@@ -29,8 +31,10 @@ struct ReaderViewState
     ViewStack &view_stack;
 
     std::unique_ptr<TokenView> token_view;
+
+    MemoryBudget::Registration reader_cache_budget;
     
-    ReaderViewState(std::experimental::filesystem::path path, DocAddr seek_address, std::shared_ptr<DocReader> reader, SystemStyling &sys_styling, TokenViewStyling &token_view_styling, uint32_t token_view_styling_sub_id, ViewStack &view_stack)
+    ReaderViewState(std::experimental::filesystem::path path, DocAddr seek_address, std::shared_ptr<DocReader> reader, SystemStyling &sys_styling, TokenViewStyling &token_view_styling, uint32_t token_view_styling_sub_id, ViewStack &view_stack, DocReaderCache *layout_cache, ImageDiskCache *image_disk_cache, MemoryBudget *memory_budget)
         : filename(path.filename()),
           reader(reader),
           sys_styling(sys_styling),
@@ -41,9 +45,23 @@ struct ReaderViewState
               reader,
               seek_address,
               sys_styling,
-              token_view_styling
+              token_view_styling,
+              layout_cache,
+              image_disk_cache,
+              memory_budget
           ))
     {
+        if (memory_budget)
+        {
+            reader_cache_budget = memory_budget->add({
+                "book text",
+                MemoryPriority::High,
+                0,
+                BOOK_CACHE_MAX_BYTES,
+                [reader]() { return reader->cache_size_bytes(); },
+                [reader](uint64_t budget_bytes) { reader->set_cache_budget(budget_bytes); }
+            });
+        }
     }
 
     ~ReaderViewState()
@@ -117,7 +135,10 @@ ReaderView::ReaderView(
     DocAddr seek_address,
     SystemStyling &sys_styling,
     TokenViewStyling &token_view_styling,
-    ViewStack &view_stack
+    ViewStack &view_stack,
+    DocReaderCache *layout_cache,
+    ImageDiskCache *image_disk_cache,
+    MemoryBudget *memory_budget
 ) : state(std::make_unique<ReaderViewState>(
         path,
         seek_address,
@@ -127,7 +148,10 @@ ReaderView::ReaderView(
         token_view_styling.subscribe_to_changes([this]() {
             update_token_view_title(get_current_address(*state));
         }),
-        view_stack
+        view_stack,
+        layout_cache,
+        image_disk_cache,
+        memory_budget
     ))
 {
     update_token_view_title(seek_address);
@@ -177,6 +201,11 @@ bool ReaderView::render(SDL_Surface *dest_surface, bool force_render)
     return state->token_view->render(dest_surface, force_render);
 }
 
+std::vector<SDL_Rect> ReaderView::get_dirty_rects() const
+{
+    return state->token_view->get_dirty_rects();
+}
+
 bool ReaderView::is_done()
 {
     return state->is_done;
@@ -210,6 +239,11 @@ void ReaderView::on_keyheld(SDLKey key, uint32_t hold_time_ms)
     state->token_view->on_keyheld(key, hold_time_ms);
 }
 
+bool ReaderView::on_idle()
+{
+    return state->token_view->on_idle();
+}
+
 void ReaderView::set_on_change_address(std::function<void(DocAddr)> callback)
 {
     state->on_change_address = callback;
@@ -9,6 +9,9 @@
 #include <string>
 
 struct DocReader;
+struct DocReaderCache;
+class ImageDiskCache;
+class MemoryBudget;
 struct ReaderViewState;
 struct SystemStyling;
 struct TokenViewStyling;
@@ -27,17 +30,22 @@ public:
         DocAddr seek_address,
         SystemStyling &sys_styling,
         TokenViewStyling &token_view_styling,
-        ViewStack &view_stack
+        ViewStack &view_stack,
+        DocReaderCache *layout_cache = nullptr,
+        ImageDiskCache *image_disk_cache = nullptr,
+        MemoryBudget *memory_budget = nullptr
     );
     ReaderView(const ReaderView &) = delete;
     ReaderView &operator=(const ReaderView &) = delete;
     virtual ~ReaderView();
 
     bool render(SDL_Surface *dest_surface, bool force_render) override;
+    std::vector<SDL_Rect> get_dirty_rects() const override;
     bool is_done() override;
 
     void on_keypress(SDLKey key) override;
     void on_keyheld(SDLKey key, uint32_t hold_time_ms) override;
+    bool on_idle() override;
 
     void set_on_change_address(std::function<void(DocAddr)> callback);
 
@@ -92,9 +92,9 @@ bool SettingsView::render(SDL_Surface *dest_surface, bool force_render)
 
         auto progress_label = render_text("Progress:", style_label);
         auto progress_value = render_text(
-            token_view_styling.get_progress_reporting() == ProgressReporting::CHAPTER_PERCENT ?
-            "Chapter %" :
-            "Book %",
+            get_progress_reporting_display_name(
+                token_view_styling.get_progress_reporting()
+            ),
             line_selected == 4 ? style_hl : style_normal
         );
 
@@ -0,0 +1,223 @@
+#include "./background_image_decoder.h"
+
+#include "util/sdl_utils.h"
+
+#include <SDL/SDL_video.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+
+// Rows [y, y + h) of surface, in its format
+surface_unique_ptr copy_rows(SDL_Surface *surface, uint32_t y, uint32_t h)
+{
+    if (y >= static_cast<uint32_t>(surface->h))
+    {
+        return nullptr;
+    }
+    h = std::min(h, surface->h - y);
+
+    auto rows = create_surface_in_format(SDL_SWSURFACE, surface->w, h, surface->format);
+    if (!rows || (SDL_MUSTLOCK(surface) && SDL_LockSurface(surface) != 0))
+    {
+        return nullptr;
+    }
+
+    const uint32_t row_bytes = surface->w * surface->format->BytesPerPixel;
+    for (uint32_t i = 0; i < h; ++i)
+    {
+        std::memcpy(
+            static_cast<uint8_t *>(rows->pixels) + i * rows->pitch,
+            static_cast<const uint8_t *>(surface->pixels) + (y + i) * surface->pitch,
+            row_bytes
+        );
+    }
+
+    if (SDL_MUSTLOCK(surface))
+    {
+        SDL_UnlockSurface(surface);
+    }
+    return rows;
+}
+
+} // namespace
+
+BackgroundImageDecoder::BackgroundImageDecoder(ImageDiskCache *disk_cache) : disk_cache(disk_cache)
+{
+    worker = std::thread(&BackgroundImageDecoder::run_worker, this);
+}
+
+BackgroundImageDecoder::~BackgroundImageDecoder()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop_requested = true;
+    }
+    job_cv.notify_all();
+    worker.join();
+}
+
+void BackgroundImageDecoder::queue_job(Job job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        queued_jobs.erase(std::remove_if(queued_jobs.begin(), queued_jobs.end(), [&](const Job &queued) {
+            return queued.key == job.key;
+        }), queued_jobs.end());
+
+        if (queued_jobs.size() >= MAX_QUEUED_IMAGE_DECODES)
+        {
+            queued_jobs.erase(queued_jobs.begin());
+        }
+
+        queued_jobs.push_back(std::move(job));
+    }
+    job_cv.notify_all();
+}
+
+void BackgroundImageDecoder::request(std::string key, ResourceBuffer data, std::string img_format, uint32_t max_width, const SDL_PixelFormat *format, std::string disk_key)
+{
+    queue_job({std::move(key), {}, std::move(data), std::move(img_format), max_width, *format, 0, 0, std::move(disk_key), false});
+}
+
+void BackgroundImageDecoder::request_cached(std::string key, std::string disk_key, const SDL_PixelFormat *format)
+{
+    queue_job({std::move(key), {}, {}, {}, 0, *format, 0, 0, std::move(disk_key), true});
+}
+
+void BackgroundImageDecoder::request_strip(std::string key, std::string image_key, ResourceBuffer data, std::string img_format, uint32_t max_width, const SDL_PixelFormat *format, uint32_t y, uint32_t h)
+{
+    queue_job({std::move(key), std::move(image_key), std::move(data), std::move(img_format), max_width, *format, y, h, {}, false});
+}
+
+bool BackgroundImageDecoder::is_pending(const std::string &key) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return (
+        active_key == key ||
+        std::any_of(queued_jobs.begin(), queued_jobs.end(), [&](const Job &job) {
+            return job.key == key;
+        }) ||
+        std::any_of(results.begin(), results.end(), [&](const DecodedImage &image) {
+            return image.key == key;
+        })
+    );
+}
+
+bool BackgroundImageDecoder::has_results() const
+{
+    return results_ready;
+}
+
+std::vector<DecodedImage> BackgroundImageDecoder::take_results()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    results_ready = false;
+
+    std::vector<DecodedImage> taken;
+    taken.swap(results);
+    return taken;
+}
+
+void BackgroundImageDecoder::run_worker()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        job_cv.wait(lock, [&]() {
+            return stop_requested || !queued_jobs.empty();
+        });
+        if (stop_requested)
+        {
+            break;
+        }
+
+        auto next = next_job();
+        Job job = std::move(*next);
+        queued_jobs.erase(next);
+        active_key = job.key;
+        lock.unlock();
+
+        surface_unique_ptr surface;
+        if (!job.image_key.empty())
+        {
+            surface = decode_strip(job);
+        }
+        else if (job.from_disk_cache)
+        {
+            surface = disk_cache ? disk_cache->load(job.disk_key, &job.format) : nullptr;
+        }
+        else
+        {
+            surface = decode_image_to_fit(
+                job.data.data(),
+                job.data.size(),
+                job.img_format,
+                job.max_width,
+                &job.format
+            );
+            if (surface && disk_cache && !job.disk_key.empty())
+            {
+                disk_cache->store(job.disk_key, surface.get());
+            }
+        }
+
+        lock.lock();
+        results.push_back({std::move(job.key), std::move(job.image_key), std::move(surface)});
+        results_ready = true;
+        active_key = std::experimental::nullopt;
+    }
+}
+
+// Newest first, except strips of the same image go top down, so each
+// continues from the last
+std::vector<BackgroundImageDecoder::Job>::iterator BackgroundImageDecoder::next_job()
+{
+    auto next = std::prev(queued_jobs.end());
+    if (!next->image_key.empty())
+    {
+        for (auto it = queued_jobs.begin(); it != queued_jobs.end(); ++it)
+        {
+            if (it->image_key == next->image_key && it->strip_y < next->strip_y)
+            {
+                next = it;
+            }
+        }
+    }
+    return next;
+}
+
+surface_unique_ptr BackgroundImageDecoder::decode_strip(Job &job)
+{
+    bool can_continue = (
+        strip_decoder &&
+        strip_image_key == job.image_key &&
+        strip_decoder->is_open() &&
+        strip_decoder->next_row() <= job.strip_y
+    );
+    if (!can_continue)
+    {
+        // Start again from the top
+        strip_decoder = nullptr;
+        strip_image_key = job.image_key;
+        strip_data = std::move(job.data);
+        strip_decoder = std::make_unique<ImageStripDecoder>(strip_data.data(), strip_data.size(), job.max_width);
+    }
+
+    if (strip_decoder->is_open())
+    {
+        return strip_decoder->decode_rows(job.strip_y, job.strip_h, &job.format);
+    }
+
+    // Formats that can't be decoded in strips are decoded whole, for the rows
+    // wanted
+    auto image = decode_image_to_fit(strip_data.data(), strip_data.size(), job.img_format, job.max_width, &job.format);
+    if (!image)
+    {
+        return nullptr;
+    }
+    return copy_rows(image.get(), job.strip_y, job.strip_h);
+}
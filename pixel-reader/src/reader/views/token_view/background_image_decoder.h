@@ -0,0 +1,100 @@
+#ifndef BACKGROUND_IMAGE_DECODER_H_
+#define BACKGROUND_IMAGE_DECODER_H_
+
+#include "doc_api/resource_buffer.h"
+#include "util/image_decode.h"
+#include "util/image_disk_cache.h"
+#include "util/sdl_pointer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <experimental/optional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Requests beyond this drop the oldest
+#define MAX_QUEUED_IMAGE_DECODES 8
+
+struct DecodedImage
+{
+    std::string key;
+    // Image a strip is of, empty for whole images
+    std::string image_key;
+    // nullptr if the image couldn't be decoded
+    surface_unique_ptr surface;
+};
+
+// Decode images on a background thread, scaled to fit a width as they're
+// decoded (see decode_image_to_fit). The most recent request is decoded
+// first, as it's likely the one the reader is waiting on. Strips of an
+// image are decoded top down, each continuing from the last. With a disk
+// cache, whole images can be stored once decoded, and loaded from it after.
+class BackgroundImageDecoder
+{
+    struct Job
+    {
+        std::string key;
+        std::string image_key;
+        ResourceBuffer data;
+        std::string img_format;
+        uint32_t max_width;
+        SDL_PixelFormat format;
+        uint32_t strip_y;
+        uint32_t strip_h;
+        // Disk cache entry to load the image from, or store it to once decoded
+        std::string disk_key;
+        bool from_disk_cache;
+    };
+
+    ImageDiskCache *disk_cache;
+
+    mutable std::mutex mutex;
+    std::condition_variable job_cv;
+    std::vector<Job> queued_jobs;  // newest at the back
+    std::experimental::optional<std::string> active_key;
+    std::vector<DecodedImage> results;
+
+    std::atomic<bool> results_ready {false};
+    bool stop_requested = false;
+    std::thread worker;
+
+    // Worker thread only: the image strips were last decoded from
+    std::string strip_image_key;
+    ResourceBuffer strip_data;
+    std::unique_ptr<ImageStripDecoder> strip_decoder;
+
+    void queue_job(Job job);
+    void run_worker();
+    std::vector<Job>::iterator next_job();
+    surface_unique_ptr decode_strip(Job &job);
+
+public:
+    BackgroundImageDecoder(ImageDiskCache *disk_cache = nullptr);
+    BackgroundImageDecoder(const BackgroundImageDecoder &) = delete;
+    BackgroundImageDecoder &operator=(const BackgroundImageDecoder &) = delete;
+
+    // Waits for any image being decoded
+    virtual ~BackgroundImageDecoder();
+
+    // Decode image data to fit max_width, in format. Stored in the disk cache
+    // under disk_key if given.
+    void request(std::string key, ResourceBuffer data, std::string img_format, uint32_t max_width, const SDL_PixelFormat *format, std::string disk_key = {});
+    // Load an image stored in the disk cache, in format. Fails if it's gone.
+    void request_cached(std::string key, std::string disk_key, const SDL_PixelFormat *format);
+    // Decode rows [y, y + h) of image_key scaled as above. Data is only read
+    // if the image isn't already being decoded from above these rows.
+    void request_strip(std::string key, std::string image_key, ResourceBuffer data, std::string img_format, uint32_t max_width, const SDL_PixelFormat *format, uint32_t y, uint32_t h);
+    // Requested, and not yet taken from results
+    bool is_pending(const std::string &key) const;
+
+    // True if take_results would return anything. Cheap enough to poll.
+    bool has_results() const;
+    // Move out all images decoded so far
+    std::vector<DecodedImage> take_results();
+};
+
+#endif
@@ -1,11 +1,20 @@
 #include "./display_line.h"
 
+#include <atomic>
+
+namespace
+{
+
+std::atomic<uint64_t> next_display_line_id(1);
+
+} // namespace
+
 DisplayLine::DisplayLine(DocAddr address, Type type)
-    : address(address), type(type)
+    : address(address), type(type), id(next_display_line_id++)
 {
 }
 
-TextLine::TextLine(DocAddr addr, const std::string& text, bool centered)
+TextLine::TextLine(DocAddr addr, std::string_view text, bool centered)
     : DisplayLine{addr, DisplayLine::Type::Text}
     , text{text}
     , centered{centered}
@@ -31,3 +40,52 @@ ImageRefLine::ImageRefLine(DocAddr addr, uint32_t offset)
     , offset{offset}
 {
 }
+
+////////////////////////
+
+void DisplayLinePool::Releaser::operator()(DisplayLine *line) const
+{
+    switch (line->type)
+    {
+        case DisplayLine::Type::Text:
+            pool->text_lines.release(static_cast<TextLine *>(line));
+            break;
+        case DisplayLine::Type::Image:
+            pool->image_lines.release(static_cast<ImageLine *>(line));
+            break;
+        case DisplayLine::Type::ImageRef:
+            pool->image_ref_lines.release(static_cast<ImageRefLine *>(line));
+            break;
+    }
+}
+
+DisplayLinePool::Ptr DisplayLinePool::text_line(DocAddr addr, std::string_view text, bool centered)
+{
+    TextLine *line = text_lines.acquire();
+    *line = TextLine(addr, text, centered);
+    return Ptr(line, Releaser{this});
+}
+
+DisplayLinePool::Ptr DisplayLinePool::image_line(
+    DocAddr addr,
+    const std::experimental::filesystem::path& image_path,
+    uint32_t num_lines,
+    uint32_t width,
+    uint32_t height
+)
+{
+    ImageLine *line = image_lines.acquire();
+    line->DisplayLine::operator=(DisplayLine(addr, DisplayLine::Type::Image));
+    line->image_path = image_path;  // reuses the path's storage
+    line->num_lines = num_lines;
+    line->width = width;
+    line->height = height;
+    return Ptr(line, Releaser{this});
+}
+
+DisplayLinePool::Ptr DisplayLinePool::image_ref_line(DocAddr addr, uint32_t offset)
+{
+    ImageRefLine *line = image_ref_lines.acquire();
+    *line = ImageRefLine(addr, offset);
+    return Ptr(line, Releaser{this});
+}
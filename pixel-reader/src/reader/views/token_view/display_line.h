@@ -2,8 +2,12 @@
 #define DISPLAY_LINE_H_
 
 #include "doc_api/doc_addr.h"
+#include "util/object_pool.h"
+
+#include <cstdint>
 #include <experimental/filesystem>
-#include <string>
+#include <memory>
+#include <string_view>
 
 struct DisplayLine
 {
@@ -16,18 +20,19 @@ struct DisplayLine
 
     DocAddr address;
     Type type;
+    // Unique to this line for the life of the program
+    uint64_t id;
 
     DisplayLine(DocAddr address, Type type);
-    virtual ~DisplayLine() = default;
 };
 
 struct TextLine: public DisplayLine
 {
-    std::string text;
+    // Slice of text owned by whoever made the line
+    std::string_view text;
     bool centered;
 
-    TextLine(DocAddr addr, const std::string& text, bool centered = false);
-    virtual ~TextLine() = default;
+    TextLine(DocAddr addr = 0, std::string_view text = {}, bool centered = false);
 };
 
 struct ImageLine: public DisplayLine
@@ -37,13 +42,12 @@ struct ImageLine: public DisplayLine
     uint32_t width, height;
 
     ImageLine(
-        DocAddr addr,
-        const std::experimental::filesystem::path& image_path,
-        uint32_t num_lines,
-        uint32_t width,
-        uint32_t height
+        DocAddr addr = 0,
+        const std::experimental::filesystem::path& image_path = {},
+        uint32_t num_lines = 0,
+        uint32_t width = 0,
+        uint32_t height = 0
     );
-    virtual ~ImageLine() = default;
 };
 
 
@@ -52,7 +56,33 @@ struct ImageRefLine: public DisplayLine
 {
     uint32_t offset;
 
-    ImageRefLine(DocAddr addr, uint32_t offset);
-    virtual ~ImageRefLine() = default;
+    ImageRefLine(DocAddr addr = 0, uint32_t offset = 0);
+};
+
+// Lines of each type, allocated from pools rather than one heap object each
+class DisplayLinePool
+{
+    ObjectPool<TextLine> text_lines;
+    ObjectPool<ImageLine> image_lines;
+    ObjectPool<ImageRefLine> image_ref_lines;
+
+public:
+    struct Releaser
+    {
+        DisplayLinePool *pool = nullptr;
+        void operator()(DisplayLine *line) const;
+    };
+    using Ptr = std::unique_ptr<DisplayLine, Releaser>;
+
+    Ptr text_line(DocAddr addr, std::string_view text, bool centered = false);
+    Ptr image_line(
+        DocAddr addr,
+        const std::experimental::filesystem::path& image_path,
+        uint32_t num_lines,
+        uint32_t width,
+        uint32_t height
+    );
+    Ptr image_ref_line(DocAddr addr, uint32_t offset);
 };
+
 #endif
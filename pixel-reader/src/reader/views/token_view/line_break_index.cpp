@@ -0,0 +1,447 @@
+#include "./line_break_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Bump whenever the encoding, or how tokens are laid out into lines, change
+#define LINE_BREAK_FORMAT_VERSION 2
+
+namespace
+{
+
+constexpr char LINE_BREAK_MAGIC[4] = {'P', 'R', 'L', 'B'};
+
+// magic, version, chunk index, checksum
+constexpr uint32_t HEADER_SIZE = sizeof(LINE_BREAK_MAGIC) + 2 * sizeof(uint32_t) + sizeof(uint64_t);
+
+// FNV-1a
+uint64_t checksum(const char *data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+template <typename T>
+void write_value(std::string &out, T value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+class Reader
+{
+    const char *pos;
+    const char *end;
+
+public:
+    Reader(const char *data, size_t size) : pos(data), end(data + size) {}
+
+    template <typename T>
+    bool read_value(T &value)
+    {
+        if (static_cast<size_t>(end - pos) < sizeof(value))
+        {
+            return false;
+        }
+        std::memcpy(&value, pos, sizeof(value));
+        pos += sizeof(value);
+        return true;
+    }
+
+    bool at_end() const
+    {
+        return pos == end;
+    }
+};
+
+const std::string CHUNK_KEY_PREFIX = "line_breaks_";
+
+std::string chunk_cache_key_prefix(const std::string &layout_id)
+{
+    return CHUNK_KEY_PREFIX + layout_id + "_";
+}
+
+std::string chunk_cache_key(const std::string &layout_id, uint32_t chunk)
+{
+    return chunk_cache_key_prefix(layout_id) + std::to_string(chunk);
+}
+
+bool starts_with(const std::string &str, const std::string &prefix)
+{
+    return str.compare(0, prefix.size(), prefix) == 0;
+}
+
+} // namespace
+
+LineBreakIndex::LineBreakIndex(DocReaderCache *cache, std::string book_id, std::string layout_id)
+    : cache(cache),
+      book_id(std::move(book_id)),
+      layout_id(std::move(layout_id)),
+      loaded(!cache)
+{
+    if (cache)
+    {
+        remove_other_layouts();
+    }
+}
+
+LineBreakIndex::~LineBreakIndex()
+{
+    save();
+}
+
+uint32_t LineBreakIndex::token_hash(const DocToken &token)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    auto add_byte = [&hash](uint8_t byte) {
+        hash ^= byte;
+        hash *= 16777619u;
+    };
+
+    add_byte(static_cast<uint8_t>(token.type));
+    add_byte(static_cast<uint8_t>(token.nest_level));
+    for (char c : token.text)
+    {
+        add_byte(static_cast<uint8_t>(c));
+    }
+    return hash;
+}
+
+const LineBreakIndex::TokenEntry *LineBreakIndex::find(DocAddr address, uint32_t hash) const
+{
+    auto it = std::lower_bound(
+        tokens.begin(),
+        tokens.end(),
+        address,
+        [](const TokenEntry &entry, DocAddr address) { return entry.address < address; }
+    );
+    for (; it != tokens.end() && it->address == address; ++it)
+    {
+        if (it->hash == hash)
+        {
+            return &*it;
+        }
+    }
+    return nullptr;
+}
+
+void LineBreakIndex::add(DocAddr address, uint32_t hash, uint32_t num_lines)
+{
+    tokens.push_back({address, hash, total_lines, static_cast<uint32_t>(breaks.size())});
+    total_lines += num_lines;
+}
+
+void LineBreakIndex::add_text(DocAddr address, uint32_t hash, const std::vector<LineBreak> &line_breaks)
+{
+    add(address, hash, line_breaks.size());
+
+    uint32_t pos = 0;
+    for (const auto &line_break : line_breaks)
+    {
+        uint32_t skipped = line_break.offset - pos;
+        breaks.push_back(line_break.length << 1 | (skipped ? 1 : 0));
+        pos = line_break.offset + line_break.length;
+    }
+}
+
+void LineBreakIndex::add_image(DocAddr address, uint32_t hash, uint32_t num_lines)
+{
+    add(address, hash, num_lines);
+}
+
+void LineBreakIndex::set_complete()
+{
+    complete = true;
+}
+
+bool LineBreakIndex::is_complete() const
+{
+    return complete;
+}
+
+uint32_t LineBreakIndex::num_tokens() const
+{
+    return tokens.size();
+}
+
+std::experimental::optional<DocAddr> LineBreakIndex::last_address() const
+{
+    if (tokens.empty())
+    {
+        return std::experimental::nullopt;
+    }
+    return tokens.back().address;
+}
+
+uint32_t LineBreakIndex::num_tokens_at_last_address() const
+{
+    uint32_t count = 0;
+    for (auto it = tokens.rbegin(); it != tokens.rend() && it->address == tokens.back().address; ++it)
+    {
+        ++count;
+    }
+    return count;
+}
+
+uint32_t LineBreakIndex::num_lines() const
+{
+    return total_lines;
+}
+
+bool LineBreakIndex::get_line_breaks(DocAddr address, uint32_t hash, uint32_t text_size, std::vector<LineBreak> &out) const
+{
+    const TokenEntry *entry = find(address, hash);
+    if (!entry)
+    {
+        return false;
+    }
+
+    const TokenEntry *next = entry + 1;
+    uint32_t end_break = next < tokens.data() + tokens.size() ? next->first_break : breaks.size();
+    if (end_break == entry->first_break)
+    {
+        // Not text
+        return false;
+    }
+
+    out.clear();
+    uint32_t pos = 0;
+    for (uint32_t i = entry->first_break; i < end_break; ++i)
+    {
+        pos += breaks[i] & 1;
+        uint32_t length = breaks[i] >> 1;
+        out.push_back({pos, length});
+        pos += length;
+    }
+
+    // Wrapping runs to the end of the text, less any trailing break char
+    if (pos > text_size || pos + 1 < text_size)
+    {
+        out.clear();
+        return false;
+    }
+    return true;
+}
+
+std::experimental::optional<uint32_t> LineBreakIndex::first_line(DocAddr address, uint32_t hash) const
+{
+    const TokenEntry *entry = find(address, hash);
+    if (!entry)
+    {
+        return std::experimental::nullopt;
+    }
+    return entry->first_line;
+}
+
+////////////////////////
+
+// Only one layout is kept per book, so changing font doesn't leave chunks of
+// every layout tried behind
+void LineBreakIndex::remove_other_layouts()
+{
+    const std::string keep_prefix = chunk_cache_key_prefix(layout_id);
+    for (const auto &key : cache->blob_keys(book_id))
+    {
+        if (starts_with(key, CHUNK_KEY_PREFIX) && !starts_with(key, keep_prefix))
+        {
+            cache->remove_blob(book_id, key);
+        }
+    }
+}
+
+std::string LineBreakIndex::encode_chunk(uint32_t chunk) const
+{
+    uint32_t first_token = chunk * LINE_BREAK_CHUNK_TOKENS;
+    uint32_t end_token = std::min<uint32_t>(first_token + LINE_BREAK_CHUNK_TOKENS, tokens.size());
+
+    std::string out(HEADER_SIZE, '\0');
+
+    write_value<uint8_t>(out, complete && end_token == tokens.size());
+    write_value<uint32_t>(out, end_token - first_token);
+    for (uint32_t i = first_token; i < end_token; ++i)
+    {
+        const auto &entry = tokens[i];
+        uint32_t end_line = i + 1 < tokens.size() ? tokens[i + 1].first_line : total_lines;
+        uint32_t end_break = i + 1 < tokens.size() ? tokens[i + 1].first_break : breaks.size();
+
+        write_value<DocAddr>(out, entry.address);
+        write_value<uint32_t>(out, entry.hash);
+        write_value<uint32_t>(out, end_line - entry.first_line);
+        write_value<uint32_t>(out, end_break - entry.first_break);
+        out.append(
+            reinterpret_cast<const char *>(breaks.data() + entry.first_break),
+            (end_break - entry.first_break) * sizeof(uint16_t)
+        );
+    }
+
+    // Fill in header now that the body is known
+    char *header = &out[0];
+    std::memcpy(header, LINE_BREAK_MAGIC, sizeof(LINE_BREAK_MAGIC));
+    header += sizeof(LINE_BREAK_MAGIC);
+
+    uint32_t version = LINE_BREAK_FORMAT_VERSION;
+    std::memcpy(header, &version, sizeof(version));
+    header += sizeof(version);
+
+    std::memcpy(header, &chunk, sizeof(chunk));
+    header += sizeof(chunk);
+
+    uint64_t body_checksum = checksum(out.data() + HEADER_SIZE, out.size() - HEADER_SIZE);
+    std::memcpy(header, &body_checksum, sizeof(body_checksum));
+
+    return out;
+}
+
+// Append tokens of chunk, which must follow those already loaded
+bool LineBreakIndex::try_decode_chunk(const std::string &encoded, uint32_t chunk)
+{
+    Reader header(encoded.data(), encoded.size());
+
+    char magic[sizeof(LINE_BREAK_MAGIC)];
+    uint32_t version;
+    uint32_t encoded_chunk;
+    uint64_t body_checksum;
+    if (!header.read_value(magic) ||
+        !header.read_value(version) ||
+        !header.read_value(encoded_chunk) ||
+        !header.read_value(body_checksum))
+    {
+        return false;
+    }
+
+    if (std::memcmp(magic, LINE_BREAK_MAGIC, sizeof(magic)) != 0 ||
+        version != LINE_BREAK_FORMAT_VERSION ||
+        encoded_chunk != chunk ||
+        tokens.size() != chunk * LINE_BREAK_CHUNK_TOKENS)
+    {
+        return false;
+    }
+
+    if (checksum(encoded.data() + HEADER_SIZE, encoded.size() - HEADER_SIZE) != body_checksum)
+    {
+        std::cerr << "Line break cache checksum mismatch for chunk " << chunk << std::endl;
+        return false;
+    }
+
+    Reader reader(encoded.data() + HEADER_SIZE, encoded.size() - HEADER_SIZE);
+
+    uint8_t is_complete;
+    uint32_t token_count;
+    if (!reader.read_value(is_complete) ||
+        !reader.read_value(token_count) ||
+        token_count > LINE_BREAK_CHUNK_TOKENS)
+    {
+        return false;
+    }
+
+    // Decode fully before adding, so a bad chunk leaves the index as it was
+    std::vector<TokenEntry> chunk_tokens;
+    std::vector<uint16_t> chunk_breaks;
+    uint32_t chunk_lines = 0;
+    DocAddr prev_address = tokens.empty() ? 0 : tokens.back().address;
+    for (uint32_t i = 0; i < token_count; ++i)
+    {
+        TokenEntry entry;
+        uint32_t num_lines;
+        uint32_t num_breaks;
+        if (!reader.read_value(entry.address) ||
+            !reader.read_value(entry.hash) ||
+            !reader.read_value(num_lines) ||
+            !reader.read_value(num_breaks) ||
+            entry.address < prev_address ||
+            num_lines == 0 ||
+            (num_breaks != 0 && num_breaks != num_lines))
+        {
+            return false;
+        }
+
+        entry.first_line = total_lines + chunk_lines;
+        entry.first_break = breaks.size() + chunk_breaks.size();
+        for (uint32_t j = 0; j < num_breaks; ++j)
+        {
+            uint16_t line_break;
+            if (!reader.read_value(line_break))
+            {
+                return false;
+            }
+            chunk_breaks.push_back(line_break);
+        }
+
+        chunk_tokens.push_back(entry);
+        chunk_lines += num_lines;
+        prev_address = entry.address;
+    }
+
+    if (!reader.at_end())
+    {
+        return false;
+    }
+
+    tokens.insert(tokens.end(), chunk_tokens.begin(), chunk_tokens.end());
+    breaks.insert(breaks.end(), chunk_breaks.begin(), chunk_breaks.end());
+    total_lines += chunk_lines;
+    complete = is_complete;
+    return true;
+}
+
+void LineBreakIndex::load_next_chunk()
+{
+    if (loaded)
+    {
+        return;
+    }
+
+    uint32_t chunk = tokens.size() / LINE_BREAK_CHUNK_TOKENS;
+    auto encoded = cache->read_blob(book_id, chunk_cache_key(layout_id, chunk));
+
+    // Stop at a partial chunk, or resume after the last good one
+    if (!encoded ||
+        !try_decode_chunk(*encoded, chunk) ||
+        complete ||
+        tokens.size() % LINE_BREAK_CHUNK_TOKENS != 0)
+    {
+        loaded = true;
+        saved_tokens = tokens.size();
+        saved_complete = complete;
+    }
+}
+
+void LineBreakIndex::load()
+{
+    while (!loaded)
+    {
+        load_next_chunk();
+    }
+}
+
+bool LineBreakIndex::is_loaded() const
+{
+    return loaded;
+}
+
+void LineBreakIndex::save()
+{
+    if (!cache || !loaded || (saved_tokens == tokens.size() && saved_complete == complete))
+    {
+        return;
+    }
+
+    // Rewrite the partial chunk last saved, through the last chunk. Completion
+    // is marked in the last chunk, which may be one already saved.
+    uint32_t last_chunk = tokens.empty() ? 0 : (tokens.size() - 1) / LINE_BREAK_CHUNK_TOKENS;
+    uint32_t first_chunk = std::min<uint32_t>(saved_tokens / LINE_BREAK_CHUNK_TOKENS, last_chunk);
+
+    for (uint32_t chunk = first_chunk; chunk <= last_chunk; ++chunk)
+    {
+        cache->write_blob(book_id, chunk_cache_key(layout_id, chunk), encode_chunk(chunk));
+    }
+
+    saved_tokens = tokens.size();
+    saved_complete = complete;
+}
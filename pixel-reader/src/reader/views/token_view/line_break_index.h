@@ -0,0 +1,100 @@
+#ifndef LINE_BREAK_INDEX_H_
+#define LINE_BREAK_INDEX_H_
+
+#include "doc_api/doc_reader.h"
+
+#include <cstdint>
+#include <experimental/optional>
+#include <string>
+#include <vector>
+
+// Tokens per persisted chunk
+#define LINE_BREAK_CHUNK_TOKENS 1024
+
+// How each token of a book was laid out into display lines, for one layout
+// (font, size, line width). Tokens are added in book order, and persisted to
+// a DocReaderCache in chunks so a later session can skip wrapping, or resume
+// adding where the last one stopped. Persisted chunks are loaded a chunk at a
+// time, so a large book doesn't hold up opening it or changing font. Chunks
+// of other layouts of the book are removed.
+class LineBreakIndex
+{
+public:
+    // Line of wrapped text
+    struct LineBreak
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+private:
+    struct TokenEntry
+    {
+        DocAddr address;
+        uint32_t hash;
+        uint32_t first_line;
+        uint32_t first_break;  // text tokens have a break per line, images none
+    };
+
+    DocReaderCache *cache;
+    const std::string book_id;
+    const std::string layout_id;
+
+    std::vector<TokenEntry> tokens;
+    // Per line of text tokens: length << 1, low bit set if a break char was skipped before it
+    std::vector<uint16_t> breaks;
+    uint32_t total_lines = 0;
+    bool complete = false;
+    bool loaded = false;
+
+    uint32_t saved_tokens = 0;
+    bool saved_complete = false;
+
+    void remove_other_layouts();
+    const TokenEntry *find(DocAddr address, uint32_t hash) const;
+    void add(DocAddr address, uint32_t hash, uint32_t num_lines);
+    std::string encode_chunk(uint32_t chunk) const;
+    bool try_decode_chunk(const std::string &encoded, uint32_t chunk);
+
+public:
+    // cache may be null, in which case nothing is persisted
+    LineBreakIndex(DocReaderCache *cache, std::string book_id, std::string layout_id);
+    LineBreakIndex(const LineBreakIndex &) = delete;
+    LineBreakIndex &operator=(const LineBreakIndex &) = delete;
+    // Saves tokens added since the last save
+    virtual ~LineBreakIndex();
+
+    // Identifies a token among others at the same address
+    static uint32_t token_hash(const DocToken &token);
+
+    // Load the next persisted chunk. Tokens may only be added once loaded.
+    void load_next_chunk();
+    // Load all persisted chunks
+    void load();
+    bool is_loaded() const;
+
+    // Add the next token of the book
+    void add_text(DocAddr address, uint32_t hash, const std::vector<LineBreak> &line_breaks);
+    void add_image(DocAddr address, uint32_t hash, uint32_t num_lines);
+    // All tokens of the book have been added
+    void set_complete();
+    // Persist tokens added since the last save
+    void save();
+
+    bool is_complete() const;
+    uint32_t num_tokens() const;
+    // Address of the last token added, if any
+    std::experimental::optional<DocAddr> last_address() const;
+    // Number of tokens at the end sharing the last address
+    uint32_t num_tokens_at_last_address() const;
+    // Lines of all tokens added so far
+    uint32_t num_lines() const;
+
+    // Line breaks of a text token that wrapped to text_size bytes. False if
+    // the token hasn't been added, or doesn't match.
+    bool get_line_breaks(DocAddr address, uint32_t hash, uint32_t text_size, std::vector<LineBreak> &out) const;
+    // Line number of the token's first line, counting from the book start
+    std::experimental::optional<uint32_t> first_line(DocAddr address, uint32_t hash) const;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#include "./line_surface_cache.h"
+
+#include "util/sdl_utils.h"
+
+namespace
+{
+
+uint32_t surface_size_bytes(const SDL_Surface *surface)
+{
+    return surface->pitch * surface->h;
+}
+
+} // namespace
+
+SDL_Surface *LineSurfaceCache::get_line(const TextLine &line, GlyphAtlas &atlas, const SDL_PixelFormat *format)
+{
+    if (cache.has(line.id))
+    {
+        return cache[line.id].get();
+    }
+
+    // Line text is a slice, the atlas wants it terminated
+    text.assign(line.text);
+
+    int width = text.empty() ? 0 : atlas.text_width(text.c_str());
+    if (width <= 0)
+    {
+        return nullptr;
+    }
+
+    surface_unique_ptr surface = create_surface_in_format(SDL_SWSURFACE, width, atlas.text_height(), format);
+    if (!surface)
+    {
+        return nullptr;
+    }
+    atlas.render(text.c_str(), surface.get(), 0, 0);
+
+    uint32_t surface_size = surface_size_bytes(surface.get());
+    while (cache.size() && total_size_bytes + surface_size > LINE_SURFACE_CACHE_SIZE_BYTES)
+    {
+        total_size_bytes -= surface_size_bytes(
+            cache.back_value().get()
+        );
+        cache.pop();
+    }
+
+    SDL_Surface *line_surface = surface.get();
+    cache.put(line.id, std::move(surface));
+    total_size_bytes += surface_size;
+
+    return line_surface;
+}
+
+void LineSurfaceCache::clear()
+{
+    cache.clear();
+    total_size_bytes = 0;
+}
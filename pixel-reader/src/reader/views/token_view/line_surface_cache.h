@@ -0,0 +1,30 @@
+#ifndef LINE_SURFACE_CACHE_H_
+#define LINE_SURFACE_CACHE_H_
+
+#include "./display_line.h"
+
+#include "util/lru_cache.h"
+#include "util/sdl_glyph_atlas.h"
+#include "util/sdl_pointer.h"
+
+#include <string>
+
+#define LINE_SURFACE_CACHE_SIZE_BYTES (4 * 1024 * 1024)
+
+// Rendered text lines by line id, so lines that stay on screen between
+// renders are blitted rather than drawn again. Must be cleared when the font
+// or colors used to draw lines change.
+class LineSurfaceCache
+{
+    LRUCache<uint64_t, surface_unique_ptr> cache;
+    uint32_t total_size_bytes = 0;
+    std::string text;
+
+public:
+    // Surface with the line's text, drawn with atlas if not cached. nullptr
+    // if there is nothing to draw.
+    SDL_Surface *get_line(const TextLine &line, GlyphAtlas &atlas, const SDL_PixelFormat *format);
+    void clear();
+};
+
+#endif
@@ -3,11 +3,9 @@
 #include "doc_api/token_addressing.h"
 #include "reader/text_wrap.h"
 #include "sys/screen.h"
-#include "util/sdl_utils.h"
 #include "util/str_utils.h"
 
-#include "extern/rotozoom/SDL_rotozoom.h"
-
+#include <algorithm>
 #include <experimental/filesystem>
 #include <iostream>
 
@@ -16,119 +14,248 @@ namespace
 
 const std::string BULLET = "•";
 
-uint32_t get_line_for_address(const IndexedDequeue<std::unique_ptr<DisplayLine>> &lines, DocAddr address)
+template <typename BufferedLine>
+uint32_t get_line_for_address(const IndexedDequeue<BufferedLine> &lines, DocAddr address)
 {
-    int best_line = lines.start_index();
-    for (int i = lines.start_index(); i < lines.end_index(); ++i)
+    // Binary search for the first line at or past the address
+    int lo = lines.start_index();
+    int hi = lines.end_index();
+    while (lo < hi)
     {
-        const auto &line = lines[i];
-        if (line && line->address <= address)
+        int mid = lo + (hi - lo) / 2;
+        const auto &line = lines[mid].line;
+        if (line && line->address < address)
         {
-            best_line = i;
-            if (line->address == address)
-            {
-                break;
-            }
+            lo = mid + 1;
         }
         else
         {
-            break;
+            hi = mid;
         }
     }
 
-    return best_line;
+    // Prefer the first line at the address, otherwise the last line before it
+    if (lo < lines.end_index() && lines[lo].line && lines[lo].line->address == address)
+    {
+        return lo;
+    }
+    return lo > lines.start_index() ? lo - 1 : lines.start_index();
 }
 
-float scale_to_fit_width(int w)
+// Text to wrap for a non-image token. Assigned to text, to reuse its storage.
+void get_token_text(const DocToken &token, std::string &text, uint32_t &extra_text_width)
 {
-    if (w > SCREEN_WIDTH)
+    extra_text_width = 0;
+
+    if (token.type == TokenType::Text || token.type == TokenType::Header)
     {
-        return SCREEN_WIDTH / static_cast<float>(w);
+        text.assign(token.text);
+        return;
     }
-    return 1;
+    else if (token.type == TokenType::ListItem)
+    {
+        int nest_level = token.nest_level;
+        text.assign((nest_level > 1 ? nest_level - 1 : 0) * 2, ' ');
+        text += BULLET;
+        text += ' ';
+        extra_text_width = get_address_width(std::string_view(text));
+        text += token.text;
+        return;
+    }
+
+    throw std::runtime_error("Unknown token type");
+}
+
+// Image type for SDL_image, from its path
+std::string image_format(const std::experimental::filesystem::path &path)
+{
+    std::string ext = path.extension().string();
+    return ext.empty() ? ext : ext.substr(1);
+}
+
+// Too tall to keep whole, see get_image_strip
+bool is_striped(ImageSize size)
+{
+    return size.h > IMAGE_STRIP_MIN_SCREENS * SCREEN_HEIGHT;
 }
 
 } // namespace
 
-std::vector<std::unique_ptr<DisplayLine>> TokenLineScroller::image_to_display_lines(const ImageDocToken &token)
+// Size of image once scaled to fit the screen, from its header if possible,
+// otherwise by decoding it now. With decode, the data loaded for the header
+// is also decoded in the background, unless the image is decoded in strips.
+std::experimental::optional<ImageSize> TokenLineScroller::get_image_size(const std::experimental::filesystem::path &path, bool decode)
+{
+    const std::string key = path.string();
+    auto it = image_sizes.find(key);
+    if (it != image_sizes.end())
+    {
+        return it->second;
+    }
+    if (failed_images.count(key))
+    {
+        return std::experimental::nullopt;
+    }
+
+    // Stored by an earlier session, already scaled
+    auto cached_size = image_disk_cache ? image_disk_cache->get_size(disk_cache_key(path)) : std::experimental::nullopt;
+    if (cached_size)
+    {
+        image_sizes[key] = *cached_size;
+        disk_cached_images.insert(key);
+        if (decode && !image_cache.get_image(key))
+        {
+            start_cached_decode(path);
+        }
+        return image_sizes[key];
+    }
+
+    ResourceBuffer data = reader->load_resource(path);
+    if (data.empty())
+    {
+        std::cerr << "Failed to read image data: " << path << std::endl;
+        failed_images.insert(key);
+        return std::experimental::nullopt;
+    }
+
+    auto size = probe_image_size(data.data(), data.size());
+    if (size)
+    {
+        image_sizes[key] = fit_image_to_width(*size, SCREEN_WIDTH);
+        if (decode && !is_striped(image_sizes[key]) && !image_cache.get_image(key))
+        {
+            start_decode(path, std::move(data));
+        }
+        return image_sizes[key];
+    }
+
+    auto image = decode_image_to_fit(data.data(), data.size(), image_format(path), SCREEN_WIDTH, get_render_surface_format());
+    if (!image || !image->h)
+    {
+        std::cerr << "Failed to load image: " << path << std::endl;
+        failed_images.insert(key);
+        return std::experimental::nullopt;
+    }
+
+    image_sizes[key] = {static_cast<uint32_t>(image->w), static_cast<uint32_t>(image->h)};
+    if (image_disk_cache && !is_striped(image_sizes[key]))
+    {
+        image_disk_cache->store(disk_cache_key(path), image.get());
+        disk_cached_images.insert(key);
+    }
+    image_cache.put_image(key, std::move(image));
+    return image_sizes[key];
+}
+
+std::string TokenLineScroller::disk_cache_key(const std::experimental::filesystem::path &path) const
 {
-    SDL_Surface *image = load_scaled_image(token.path);
+    return ImageDiskCache::image_key(reader->get_id(), path.string(), SCREEN_WIDTH, get_render_surface_format());
+}
 
-    std::vector<std::unique_ptr<DisplayLine>> lines;
-    if (image && image->h)
+BackgroundImageDecoder &TokenLineScroller::get_image_decoder()
+{
+    if (!image_decoder)
     {
-        int num_lines = (image->h + line_height_pixels - 1) / line_height_pixels;
-        lines.emplace_back(std::make_unique<ImageLine>(token.address, token.path, num_lines, image->w, image->h));
+        image_decoder = std::make_unique<BackgroundImageDecoder>(image_disk_cache);
+    }
+    return *image_decoder;
+}
+
+// Decode from data, to be stored in the disk cache if there is one
+void TokenLineScroller::start_decode(const std::experimental::filesystem::path &path, ResourceBuffer data)
+{
+    get_image_decoder().request(
+        path.string(),
+        std::move(data),
+        image_format(path),
+        SCREEN_WIDTH,
+        get_render_surface_format(),
+        image_disk_cache ? disk_cache_key(path) : std::string()
+    );
+}
+
+void TokenLineScroller::start_cached_decode(const std::experimental::filesystem::path &path)
+{
+    get_image_decoder().request_cached(path.string(), disk_cache_key(path), get_render_surface_format());
+}
+
+// Fills rendered_lines, and rendered_text if any lines have text. Space for
+// the image is kept whether or not it's been decoded.
+void TokenLineScroller::image_to_display_lines(const DocToken &token, bool decode)
+{
+    rendered_lines.clear();
+    rendered_text = nullptr;
+
+    std::experimental::filesystem::path path(std::string(token.text));
+    auto size = get_image_size(path, decode);
+
+    if (size)
+    {
+        int num_lines = (size->h + line_height_pixels - 1) / line_height_pixels;
+        rendered_lines.push_back(line_pool.image_line(token.address, path, num_lines, size->w, size->h));
         for (int i = 1; i < num_lines; ++i)
         {
-            lines.emplace_back(std::make_unique<ImageRefLine>(token.address, i));
+            rendered_lines.push_back(line_pool.image_ref_line(token.address, i));
         }
     }
     else
     {
         // Fallback for error loading image
-        lines.emplace_back(std::make_unique<TextLine>(token.address, ""));
-        lines.emplace_back(std::make_unique<TextLine>(token.address, "[Image " + token.path.string() + "]"));
-        lines.emplace_back(std::make_unique<TextLine>(token.address, ""));
+        rendered_text = text_pool.acquire_ptr();
+        rendered_text->assign("[Image ");
+        *rendered_text += path.string();
+        *rendered_text += ']';
+
+        rendered_lines.push_back(line_pool.text_line(token.address, {}));
+        rendered_lines.push_back(line_pool.text_line(token.address, *rendered_text));
+        rendered_lines.push_back(line_pool.text_line(token.address, {}));
     }
-    return lines;
 }
 
-
-std::vector<std::unique_ptr<DisplayLine>> TokenLineScroller::render_display_lines(const DocToken &token)
+// Fills rendered_lines with the token's lines, which are slices of rendered_text
+void TokenLineScroller::render_display_lines(const DocToken &token, uint32_t token_hash)
 {
     if (token.type == TokenType::Image)
     {
-        return image_to_display_lines(static_cast<const ImageDocToken &>(token));
+        image_to_display_lines(token, true);
+        return;
     }
-    else
-    {
-        std::string text;
-        uint32_t extra_text_width = 0;
 
-        if (token.type == TokenType::Text)
-        {
-            text = static_cast<const TextDocToken &>(token).text;
-        }
-        else if (token.type == TokenType::ListItem)
-        {
-            const ListItemDocToken &list_token = static_cast<const ListItemDocToken &>(token);
-            int nest_level = list_token.nest_level;
-            std::string prefix = std::string(
-                (nest_level > 1 ? nest_level - 1 : 0) * 2,
-                ' '
-            ) + BULLET + " ";
-            text = prefix + list_token.text;
-            extra_text_width = get_address_width(prefix);
-        }
-        else if (token.type == TokenType::Header)
-        {
-            text = static_cast<const HeaderDocToken &>(token).text;
-        }
-        else
-        {
-            throw std::runtime_error("Unknown token type");
-        }
+    rendered_lines.clear();
+    rendered_text = text_pool.acquire_ptr();
 
-        DocAddr address = token.address;
-        std::vector<std::unique_ptr<DisplayLine>> lines;
-        wrap_lines(text.c_str(), line_fits, [type=token.type, &lines, &address, extra_text_width](const char *str, uint32_t len) {
-            std::string line_text(str, len);
-            bool centered = type == TokenType::Header;
+    uint32_t extra_text_width;
+    get_token_text(token, *rendered_text, extra_text_width);
+    wrap_token_text(token, token_hash, *rendered_text);
 
-            lines.push_back(
-                std::make_unique<TextLine>(address, line_text, centered)
-            );
+    const std::string_view text = *rendered_text;
+    DocAddr address = token.address;
+    bool centered = token.type == TokenType::Header;
+    for (const auto &line_break : line_breaks)
+    {
+        std::string_view line_text = text.substr(line_break.offset, line_break.length);
+        rendered_lines.push_back(line_pool.text_line(address, line_text, centered));
 
-            address += get_address_width(line_text);
-            if (lines.size() == 1)
-            {
-                address -= extra_text_width;
-            }
-        });
+        address += get_address_width(line_text);
+        if (rendered_lines.size() == 1)
+        {
+            address -= extra_text_width;
+        }
+    }
+}
 
-        return lines;
+// Fill line_breaks for text, from the index if it has them
+void TokenLineScroller::wrap_token_text(const DocToken &token, uint32_t token_hash, const std::string &text)
+{
+    if (line_break_index && line_break_index->get_line_breaks(token.address, token_hash, text.size(), line_breaks))
+    {
+        return;
     }
+
+    line_breaks.clear();
+    wrap_lines(text.c_str(), line_fitter, [this, &text](const char *str, uint32_t len) {
+        line_breaks.push_back({static_cast<uint32_t>(str - text.c_str()), len});
+    });
 }
 
 void TokenLineScroller::get_more_lines_forward(uint32_t num_lines)
@@ -142,9 +269,15 @@ void TokenLineScroller::get_more_lines_forward(uint32_t num_lines)
             break;
         }
 
-        for (auto &line : render_display_lines(*token))
+        uint32_t token_hash = LineBreakIndex::token_hash(*token);
+        render_display_lines(*token, token_hash);
+
+        // Text goes to the first line added, the rest get nullptr
+        bool starts_token = true;
+        for (auto &line : rendered_lines)
         {
-            lines_buf.append(std::move(line));
+            lines_buf.append({std::move(line), std::move(rendered_text), starts_token, token_hash});
+            starts_token = false;
             if (num_lines > 0)
             {
                 --num_lines;
@@ -164,10 +297,13 @@ void TokenLineScroller::get_more_lines_backward(uint32_t num_lines)
             break;
         }
 
-        std::vector<std::unique_ptr<DisplayLine>> lines = render_display_lines(*token);
-        for (auto it = lines.rbegin(); it != lines.rend(); ++it)
+        uint32_t token_hash = LineBreakIndex::token_hash(*token);
+        render_display_lines(*token, token_hash);
+
+        // Text goes to the first line added, the rest get nullptr
+        for (auto it = rendered_lines.rbegin(); it != rendered_lines.rend(); ++it)
         {
-            lines_buf.prepend(std::move(*it));
+            lines_buf.prepend({std::move(*it), std::move(rendered_text), it + 1 == rendered_lines.rend(), token_hash});
             if (num_lines > 0)
             {
                 --num_lines;
@@ -198,15 +334,44 @@ void TokenLineScroller::initialize_buffer_at(DocAddr address)
 TokenLineScroller::TokenLineScroller(
     const std::shared_ptr<DocReader> reader,
     DocAddr address,
-    std::function<bool(const char *, uint32_t)> line_fits,
-    uint32_t line_height_pixels
+    LineFitter &line_fitter,
+    uint32_t line_height_pixels,
+    uint32_t window_lines,
+    LineBreakIndex *line_break_index,
+    ImageDiskCache *image_disk_cache,
+    MemoryBudget *memory_budget
 ) : reader(reader),
     forward_it(nullptr),
     backward_it(nullptr),
-    line_fits(line_fits),
-    line_height_pixels(line_height_pixels)
+    line_fitter(line_fitter),
+    line_height_pixels(line_height_pixels),
+    window_lines(window_lines),
+    budget_window_lines(window_lines),
+    image_disk_cache(image_disk_cache),
+    line_break_index(line_break_index)
 {
     initialize_buffer_at(address);
+
+    if (memory_budget)
+    {
+        // Text to show comes before images, which can be decoded again
+        line_buffer_budget = memory_budget->add({
+            "lines",
+            MemoryPriority::High,
+            0,
+            LINE_BUFFER_MAX_BYTES,
+            [this]() { return line_buffer_size_bytes(); },
+            [this](uint64_t size_bytes) { set_line_buffer_budget(size_bytes); }
+        });
+        image_cache_budget = memory_budget->add({
+            "images",
+            MemoryPriority::Normal,
+            IMAGE_CACHE_MIN_BYTES,
+            IMAGE_CACHE_SIZE_BYTES,
+            [this]() { return image_cache.size_bytes(); },
+            [this](uint64_t size_bytes) { image_cache.set_budget(size_bytes); }
+        });
+    }
 }
 
 void TokenLineScroller::materialize_line(int line_num)
@@ -224,6 +389,94 @@ void TokenLineScroller::materialize_line(int line_num)
     }
 }
 
+// Drop tokens whose lines are all outside the window, stepping the iterators
+// over them so they're read again if scrolled back to. Every token renders to
+// at least one line, and to the same lines each time, so line numbers and the
+// known first and end lines stay valid.
+void TokenLineScroller::trim_buffer()
+{
+    const int window_first = current_line - static_cast<int>(budget_window_lines);
+    const int window_last = current_line + static_cast<int>(budget_window_lines);
+
+    while (lines_buf.size())
+    {
+        int token_end = lines_buf.start_index() + 1;
+        while (token_end < lines_buf.end_index() && !lines_buf[token_end].starts_token)
+        {
+            ++token_end;
+        }
+        if (token_end > window_first)
+        {
+            break;
+        }
+
+        while (lines_buf.start_index() < token_end)
+        {
+            lines_buf.pop_front();
+        }
+        backward_it->read(1);
+    }
+
+    while (lines_buf.size())
+    {
+        int token_start = lines_buf.end_index() - 1;
+        while (token_start > lines_buf.start_index() && !lines_buf[token_start].starts_token)
+        {
+            --token_start;
+        }
+        if (token_start <= window_last)
+        {
+            break;
+        }
+
+        while (lines_buf.end_index() > token_start)
+        {
+            lines_buf.pop_back();
+        }
+        forward_it->read(-1);
+    }
+}
+
+// Buffered lines and the text they're slices of, including text released to
+// the pool, which keeps its capacity for reuse
+uint64_t TokenLineScroller::line_buffer_size_bytes()
+{
+    uint64_t size_bytes = static_cast<uint64_t>(lines_buf.size()) * (sizeof(BufferedLine) + sizeof(TextLine));
+    for (int i = lines_buf.start_index(); i < lines_buf.end_index(); ++i)
+    {
+        if (lines_buf[i].token_text)
+        {
+            size_bytes += lines_buf[i].token_text->capacity();
+        }
+    }
+    text_pool.for_each_free([&size_bytes](const std::string &text) {
+        size_bytes += text.capacity();
+    });
+    return size_bytes;
+}
+
+// Narrow the window to lines that fit, going by the lines buffered now, and
+// free text kept for reuse
+void TokenLineScroller::set_line_buffer_budget(uint64_t size_bytes)
+{
+    const uint64_t used_bytes = line_buffer_size_bytes();
+    uint64_t fit_lines = window_lines;
+    if (lines_buf.size() && used_bytes > size_bytes)
+    {
+        const uint64_t line_bytes = std::max<uint64_t>(used_bytes / lines_buf.size(), 1);
+        fit_lines = size_bytes / line_bytes / 2;
+    }
+    budget_window_lines = std::max<uint64_t>(std::min<uint64_t>(fit_lines, window_lines), std::min<uint32_t>(LINE_WINDOW_MIN_LINES, window_lines));
+
+    if (used_bytes > size_bytes)
+    {
+        trim_buffer();
+        text_pool.for_each_free([](std::string &text) {
+            std::string().swap(text);
+        });
+    }
+}
+
 const DisplayLine *TokenLineScroller::get_line_relative(int offset)
 {
     int line = current_line + offset;
@@ -233,7 +486,7 @@ const DisplayLine *TokenLineScroller::get_line_relative(int offset)
     {
         return nullptr;
     }
-    return lines_buf[line].get();
+    return lines_buf[line].line.get();
 }
 
 int TokenLineScroller::get_line_number() const
@@ -245,6 +498,7 @@ void TokenLineScroller::seek_lines_relative(int offset)
 {
     current_line += offset;
     materialize_line(current_line);
+    trim_buffer();
 }
 
 void TokenLineScroller::seek_to_address(DocAddr address)
@@ -278,52 +532,249 @@ std::experimental::optional<int> TokenLineScroller::end_line_number() const
     return global_end_line;
 }
 
-SDL_Surface *TokenLineScroller::load_scaled_image(const std::experimental::filesystem::path &path)
+uint32_t TokenLineScroller::num_buffered_lines() const
+{
+    return lines_buf.size();
+}
+
+void TokenLineScroller::set_line_break_index(LineBreakIndex *index)
+{
+    line_break_index = index;
+    layout_it = nullptr;
+}
+
+bool TokenLineScroller::lay_out_more(uint32_t max_tokens)
 {
+    if (!line_break_index || line_break_index->is_complete())
     {
-        SDL_Surface *image = image_cache.get_image(path);
-        if (image)
+        return false;
+    }
+
+    if (!line_break_index->is_loaded())
+    {
+        // Carry on from what's been persisted
+        line_break_index->load_next_chunk();
+        return true;
+    }
+
+    if (!layout_it)
+    {
+        // Resume after the last token added. Seeking lands before the first
+        // token at an address, so step over those already added.
+        auto last_address = line_break_index->last_address();
+        layout_it = reader->get_iter(last_address ? *last_address : 0);
+        if (last_address)
         {
-            return image;
+            for (uint32_t i = line_break_index->num_tokens_at_last_address(); i > 0; --i)
+            {
+                layout_it->read(1);
+            }
         }
     }
 
-    auto img_data = reader->load_resource(path);
-    if (img_data.empty())
+    for (uint32_t i = 0; i < max_tokens; ++i)
     {
-        std::cerr << "Failed to read image data: " << path << std::endl;
-        return nullptr;
+        const DocToken *token = layout_it->read(1);
+        if (!token)
+        {
+            line_break_index->set_complete();
+            line_break_index->save();
+            layout_it = nullptr;
+            return false;
+        }
+
+        uint32_t token_hash = LineBreakIndex::token_hash(*token);
+        if (token->type == TokenType::Image)
+        {
+            image_to_display_lines(*token, false);
+            line_break_index->add_image(token->address, token_hash, rendered_lines.size());
+            rendered_lines.clear();
+            rendered_text = nullptr;
+        }
+        else
+        {
+            uint32_t extra_text_width;
+            get_token_text(*token, layout_text, extra_text_width);
+            wrap_token_text(*token, token_hash, layout_text);
+            line_break_index->add_text(token->address, token_hash, line_breaks);
+        }
+
+        if (line_break_index->num_tokens() % LINE_BREAK_CHUNK_TOKENS == 0)
+        {
+            line_break_index->save();
+        }
+    }
+
+    return true;
+}
+
+std::experimental::optional<uint32_t> TokenLineScroller::get_global_line_number() const
+{
+    if (!line_break_index || !line_break_index->is_complete() || current_line < lines_buf.start_index() || current_line >= lines_buf.end_index())
+    {
+        return std::experimental::nullopt;
     }
 
-    std::string file_ext;
-    try
+    // Buffer holds whole tokens, so the current token's first line is in it
+    int token_start = current_line;
+    while (token_start > lines_buf.start_index() && !lines_buf[token_start].starts_token)
+    {
+        --token_start;
+    }
+
+    const BufferedLine &first = lines_buf[token_start];
+    auto token_first_line = line_break_index->first_line(first.line->address, first.token_hash);
+    if (!token_first_line)
+    {
+        return std::experimental::nullopt;
+    }
+    return *token_first_line + (current_line - token_start);
+}
+
+SDL_Surface *TokenLineScroller::get_scaled_image(const std::experimental::filesystem::path &path)
+{
+    const std::string key = path.string();
+    SDL_Surface *image = image_cache.get_image(key);
+    if (image || failed_images.count(key) || (image_decoder && image_decoder->is_pending(key)))
     {
-        file_ext = path.extension().string().substr(1);
+        return image;
     }
-    catch (const std::out_of_range &)
+
+    // Dropped from the cache, or from the decode queue
+    if (disk_cached_images.count(key))
     {
+        start_cached_decode(path);
         return nullptr;
     }
 
-    auto img_surface = load_surface_from_ptr(
-        img_data.data(),
-        img_data.size(),
-        file_ext.c_str(),
-        get_render_surface_format()
-    );
-    if (!img_surface)
+    ResourceBuffer data = reader->load_resource(path);
+    if (data.empty())
     {
-        std::cerr << "Failed to load image: " << path << std::endl;
+        std::cerr << "Failed to read image data: " << path << std::endl;
+        failed_images.insert(key);
         return nullptr;
     }
+    start_decode(path, std::move(data));
+    return nullptr;
+}
 
-    float scale = scale_to_fit_width(img_surface->w);
-    image_cache.put_image(
-        path,
-        scale != 1 ? 
-            surface_unique_ptr { zoomSurface(img_surface.get(), scale, scale, 1) } :
-            std::move(img_surface)
+void TokenLineScroller::start_strip_decode(const std::experimental::filesystem::path &path, const std::string &strip_key, uint32_t y, uint32_t h)
+{
+    const std::string key = path.string();
+    if (!strip_source || strip_source_key != key)
+    {
+        ResourceBuffer data = reader->load_resource(path);
+        if (data.empty())
+        {
+            std::cerr << "Failed to read image data: " << path << std::endl;
+            failed_images.insert(key);
+            return;
+        }
+        strip_source = std::make_shared<const ResourceBuffer>(std::move(data));
+        strip_source_key = key;
+    }
+
+    get_image_decoder().request_strip(
+        strip_key,
+        key,
+        ResourceBuffer(strip_source, strip_source->data(), strip_source->size()),
+        image_format(path),
+        SCREEN_WIDTH,
+        get_render_surface_format(),
+        y,
+        h
     );
+}
+
+ImageStrip TokenLineScroller::get_image_strip(const std::experimental::filesystem::path &path, uint32_t y, bool keep)
+{
+    const std::string key = path.string();
+    auto size = image_sizes.find(key);
+    SDL_Surface *whole_image = image_cache.get_image(key);
+    if (size == image_sizes.end() || whole_image || !is_striped(size->second))
+    {
+        SDL_Surface *image = whole_image ? whole_image : get_scaled_image(path);
+        uint32_t h = image ? image->h : (size != image_sizes.end() ? size->second.h : 0);
+        return {image, 0, h};
+    }
+
+    const uint32_t strip_y = y - y % SCREEN_HEIGHT;
+    const uint32_t strip_h = std::min<uint32_t>(SCREEN_HEIGHT, size->second.h - strip_y);
+    const std::string strip_key = key + "#" + std::to_string(strip_y);
+
+    ImageStrip strip = {nullptr, strip_y, strip_h};
+    auto it = image_strips.find(strip_key);
+    if (it != image_strips.end())
+    {
+        strip.surface = it->second.get();
+    }
+
+    if (keep && !failed_images.count(key))
+    {
+        keeping_strips.insert(strip_key);
+        if (!strip.surface && !(image_decoder && image_decoder->is_pending(strip_key)))
+        {
+            start_strip_decode(path, strip_key, strip_y, strip_h);
+        }
+    }
+    return strip;
+}
+
+void TokenLineScroller::release_image_strips()
+{
+    kept_strips.swap(keeping_strips);
+    keeping_strips.clear();
 
-    return image_cache.get_image(path);
+    for (auto it = image_strips.begin(); it != image_strips.end();)
+    {
+        if (kept_strips.count(it->first))
+        {
+            ++it;
+        }
+        else
+        {
+            it = image_strips.erase(it);
+        }
+    }
+
+    if (kept_strips.empty())
+    {
+        strip_source = nullptr;
+    }
+}
+
+bool TokenLineScroller::take_decoded_images()
+{
+    if (!image_decoder || !image_decoder->has_results())
+    {
+        return false;
+    }
+
+    for (auto &decoded : image_decoder->take_results())
+    {
+        if (!decoded.surface && decoded.image_key.empty() && disk_cached_images.erase(decoded.key))
+        {
+            // Gone from the disk cache, decode it from the book instead
+            get_scaled_image(decoded.key);
+        }
+        else if (!decoded.surface)
+        {
+            const std::string &image_key = decoded.image_key.empty() ? decoded.key : decoded.image_key;
+            std::cerr << "Failed to load image: " << image_key << std::endl;
+            failed_images.insert(image_key);
+        }
+        else if (decoded.image_key.empty())
+        {
+            if (image_disk_cache)
+            {
+                disk_cached_images.insert(decoded.key);
+            }
+            image_cache.put_image(decoded.key, std::move(decoded.surface));
+        }
+        else if (kept_strips.count(decoded.key) || keeping_strips.count(decoded.key))
+        {
+            image_strips[decoded.key] = std::move(decoded.surface);
+        }
+    }
+    return true;
 }
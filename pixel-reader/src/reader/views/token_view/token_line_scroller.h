@@ -1,50 +1,153 @@
 #ifndef TOKEN_LINE_SCROLLER_H_
 #define TOKEN_LINE_SCROLLER_H_
 
+#include "./background_image_decoder.h"
 #include "./display_line.h"
+#include "./line_break_index.h"
 
 #include "doc_api/doc_addr.h"
 #include "doc_api/doc_reader.h"
+#include "reader/text_wrap.h"
+#include "util/image_decode.h"
+#include "util/image_disk_cache.h"
 #include "util/indexed_dequeue.h"
+#include "util/memory_budget.h"
+#include "util/object_pool.h"
 #include "util/sdl_image_cache.h"
 #include "util/sdl_pointer.h"
 
-#include <functional>
 #include <experimental/optional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Lines kept either side of the current line
+#define LINE_WINDOW_LINES 256
+// Fewest lines kept either side when short of memory
+#define LINE_WINDOW_MIN_LINES 64
+
+// Shares asked of a memory budget. Images get at least a screen or two.
+#define LINE_BUFFER_MAX_BYTES  (2 * 1024 * 1024)
+#define IMAGE_CACHE_MIN_BYTES  (2 * 1024 * 1024)
+
+// Images taller than this many screens are decoded, and kept, in strips a
+// screen high
+#define IMAGE_STRIP_MIN_SCREENS 3
+
+// Rows [y, y + h) of an image scaled to fit the screen. Surface is nullptr
+// while they're decoded, or if they can't be.
+struct ImageStrip
+{
+    SDL_Surface *surface;
+    uint32_t y;
+    uint32_t h;
+};
 
 // Lazy renders tokens into lines of text, and provides access to the lines
-// through an infinite-scroll type interface.
+// through an infinite-scroll type interface. Only lines near the current line
+// are kept, others are rendered again when needed.
 class TokenLineScroller
 {
+    using TextPtr = ObjectPool<std::string>::Ptr;
+
+    struct BufferedLine
+    {
+        DisplayLinePool::Ptr line;
+        // Text the token's lines are slices of, held by one of them
+        TextPtr token_text;
+        bool starts_token = false;  // first line rendered from its token
+        uint32_t token_hash = 0;
+    };
+
     const std::shared_ptr<DocReader> reader;
     std::shared_ptr<TokenIter> forward_it;
     std::shared_ptr<TokenIter> backward_it;
-    std::function<bool(const char *, uint32_t)> line_fits;
+    LineFitter &line_fitter;
 
     std::experimental::optional<int> global_first_line;
     std::experimental::optional<int> global_end_line;
 
     uint32_t line_height_pixels;
+    uint32_t window_lines;
+    // Narrower than window_lines while the memory budget is short
+    uint32_t budget_window_lines;
     int current_line = 0;
 
-    IndexedDequeue<std::unique_ptr<DisplayLine>> lines_buf;
+    // Pools outlive the lines and text taken from them
+    DisplayLinePool line_pool;
+    ObjectPool<std::string> text_pool;
+
+    // Whole tokens' worth of lines, between backward_it and forward_it
+    IndexedDequeue<BufferedLine> lines_buf;
+
+    // Images scaled to fit the screen. Sizes are known from image headers
+    // before the images are decoded, in the background.
     SDLImageCache image_cache;
+    std::unordered_map<std::string, ImageSize> image_sizes;
+    std::unordered_set<std::string> failed_images;
+    std::unique_ptr<BackgroundImageDecoder> image_decoder;
+
+    // Optional, to keep scaled images across sessions. Images found in it, or
+    // decoded to be stored in it, are loaded from it rather than the book.
+    ImageDiskCache *image_disk_cache = nullptr;
+    std::unordered_set<std::string> disk_cached_images;
+
+    // Strips of images too tall to keep whole, only those kept since the
+    // release_image_strips before last
+    std::unordered_map<std::string, surface_unique_ptr> image_strips;
+    std::unordered_set<std::string> kept_strips;
+    std::unordered_set<std::string> keeping_strips;
+    // Data of the image strips were last requested from, shared with decodes
+    std::string strip_source_key;
+    std::shared_ptr<const ResourceBuffer> strip_source;
 
-    std::vector<std::unique_ptr<DisplayLine>> image_to_display_lines(const ImageDocToken &token);
-    std::vector<std::unique_ptr<DisplayLine>> render_display_lines(const DocToken &token);
+    // Optional, to reuse line breaks from an earlier layout
+    LineBreakIndex *line_break_index = nullptr;
+    // Next token to add to the index
+    std::shared_ptr<TokenIter> layout_it;
+    std::vector<LineBreakIndex::LineBreak> line_breaks;
+    std::string layout_text;
+
+    // Lines of the last token rendered, and the text they're slices of
+    std::vector<DisplayLinePool::Ptr> rendered_lines;
+    TextPtr rendered_text;
+
+    // Last, so unregistered before what they measure is destroyed
+    MemoryBudget::Registration image_cache_budget;
+    MemoryBudget::Registration line_buffer_budget;
+
+    std::experimental::optional<ImageSize> get_image_size(const std::experimental::filesystem::path &path, bool decode);
+    std::string disk_cache_key(const std::experimental::filesystem::path &path) const;
+    BackgroundImageDecoder &get_image_decoder();
+    void start_decode(const std::experimental::filesystem::path &path, ResourceBuffer data);
+    void start_cached_decode(const std::experimental::filesystem::path &path);
+    void start_strip_decode(const std::experimental::filesystem::path &path, const std::string &strip_key, uint32_t y, uint32_t h);
+    SDL_Surface *get_scaled_image(const std::experimental::filesystem::path &path);
+    void image_to_display_lines(const DocToken &token, bool decode);
+    void render_display_lines(const DocToken &token, uint32_t token_hash);
+    void wrap_token_text(const DocToken &token, uint32_t token_hash, const std::string &text);
 
     void get_more_lines_forward(uint32_t num);
     void get_more_lines_backward(uint32_t num);
     void clear_buffer();
     void initialize_buffer_at(DocAddr address);
     void materialize_line(int line_num);
+    void trim_buffer();
+    uint64_t line_buffer_size_bytes();
+    void set_line_buffer_budget(uint64_t size_bytes);
 
 public:
     TokenLineScroller(
         const std::shared_ptr<DocReader> reader,
         DocAddr address,
-        std::function<bool(const char *, uint32_t)> line_fits,
-        uint32_t line_height_pixels
+        LineFitter &line_fitter,
+        uint32_t line_height_pixels,
+        uint32_t window_lines = LINE_WINDOW_LINES,
+        LineBreakIndex *line_break_index = nullptr,
+        ImageDiskCache *image_disk_cache = nullptr,
+        MemoryBudget *memory_budget = nullptr
     );
 
     const DisplayLine *get_line_relative(int offset);
@@ -56,8 +159,28 @@ public:
 
     std::experimental::optional<int> first_line_number() const;
     std::experimental::optional<int> end_line_number() const;
+    uint32_t num_buffered_lines() const;
+
+    // Use index for line breaks of tokens it has, and add to it through
+    // lay_out_more. Must outlive the scroller, or be replaced.
+    void set_line_break_index(LineBreakIndex *index);
+    // Add up to max_tokens more tokens to the line break index, after loading
+    // what was persisted. False once the whole book has been laid out.
+    bool lay_out_more(uint32_t max_tokens);
+    // Current line counting from the start of the book, if the line break
+    // index is complete.
+    std::experimental::optional<uint32_t> get_global_line_number() const;
 
-    SDL_Surface *load_scaled_image(const std::experimental::filesystem::path &path);
+    // Part of image covering row y, of the image scaled to fit the screen.
+    // Images over IMAGE_STRIP_MIN_SCREENS tall come in strips, others whole.
+    // With keep, a strip is decoded if it isn't already, and stays decoded
+    // through the next release_image_strips. Without, it's only given if
+    // already decoded.
+    ImageStrip get_image_strip(const std::experimental::filesystem::path &path, uint32_t y, bool keep);
+    // Free strips not kept since the last call
+    void release_image_strips();
+    // Take in images decoded since last called. True if there were any.
+    bool take_decoded_images();
 };
 
 #endif
@@ -1,34 +1,28 @@
 #include "./token_view.h"
 
+#include "./line_break_index.h"
+#include "./line_surface_cache.h"
 #include "./token_line_scroller.h"
 #include "./token_view_styling.h"
+#include "./ttf_line_fitter.h"
 
 #include "doc_api/doc_reader.h"
 #include "reader/system_styling.h"
 #include "reader/shoulder_keymap.h"
 #include "sys/keymap.h"
 #include "sys/screen.h"
+#include "util/sdl_glyph_atlas.h"
+#include "util/sdl_pointer.h"
 #include "util/sdl_utils.h"
 #include "util/throttled.h"
+#include "util/timer.h"
 
-#include <stdexcept>
-namespace {
-
-bool line_fits_on_screen(TTF_Font *font, int avail_width, const char *s, uint32_t len)
-{
-    int w = avail_width, h;
-
-    char *mut_s = (char*)s;
-    char replaced = mut_s[len];
-    mut_s[len] = 0;
-
-    TTF_SizeUTF8(font, mut_s, &w, &h);
-    mut_s[len] = replaced;
-
-    return w <= avail_width;
-}
+#include "extern/hash-library/md5.h"
 
-}  // namespace
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
 
 struct TokenViewState
 {
@@ -38,13 +32,43 @@ struct TokenViewState
     const uint32_t token_view_styling_sub_id;
 
     TTF_Font *current_font = nullptr;
+    GlyphAtlas main_text_atlas;
+    GlyphAtlas secondary_text_atlas;
+    LineSurfaceCache line_surfaces;
 
     const int line_padding = 4;
     int line_height;
 
+    TTFLineFitter line_fitter;
+    DocReaderCache *layout_cache;
+    const std::string book_id;
+    // Line breaks for the current layout, also counts lines for page numbers
+    std::unique_ptr<LineBreakIndex> line_break_index;
     TokenLineScroller line_scroller;
 
     bool needs_render = true;
+    bool needs_title_render = false;
+
+    // Font changed since lines were wrapped
+    bool needs_reflow = false;
+    // Where to reflow from. Kept across font changes until scrolled, so
+    // cycling through sizes doesn't drift back a line start each time.
+    std::experimental::optional<DocAddr> layout_anchor;
+
+    // Top line when last rendered, if the screen can be scrolled from there
+    std::experimental::optional<int> rendered_line;
+    SDL_Surface *rendered_surface = nullptr;
+    // Areas changed by the last render, empty if all of it
+    std::vector<SDL_Rect> dirty_rects;
+
+    // Neighboring pages drawn while idle, without the title bar
+    struct PrerenderedPage
+    {
+        int line;
+        surface_unique_ptr surface;
+        bool is_complete;  // see draw_lines
+    };
+    std::vector<PrerenderedPage> prerendered_pages;
 
     std::string title;
     int title_progress_percent = 0;
@@ -54,6 +78,68 @@ struct TokenViewState
     Throttled line_scroll_throttle;
     Throttled page_scroll_throttle;
 
+    int line_avail_width() const
+    {
+        return SCREEN_WIDTH - line_padding * 2;
+    }
+
+    // Identifies what line breaks depend on
+    std::string layout_id() const
+    {
+        MD5 md5;
+        return md5(
+            sys_styling.get_font_name() + ":" +
+            std::to_string(sys_styling.get_font_size()) + ":" +
+            std::to_string(line_avail_width()) + ":" +
+            std::to_string(line_height)
+        );
+    }
+
+    std::unique_ptr<LineBreakIndex> make_line_break_index() const
+    {
+        return std::make_unique<LineBreakIndex>(layout_cache, book_id, layout_id());
+    }
+
+    // Re-wrap lines for the current font, if changed. Only lines near the
+    // anchor are wrapped now, the rest as scrolled to or while idle.
+    bool reflow_if_needed()
+    {
+        if (!needs_reflow)
+        {
+            return false;
+        }
+        needs_reflow = false;
+
+        line_scroller.set_line_break_index(nullptr);
+        line_break_index = make_line_break_index();
+        line_scroller.set_line_break_index(line_break_index.get());
+
+        if (layout_anchor)
+        {
+            line_scroller.seek_to_address(*layout_anchor);
+        }
+        else
+        {
+            line_scroller.reset_buffer();
+        }
+        return true;
+    }
+
+    void reset_atlases()
+    {
+        const auto &theme = sys_styling.get_loaded_color_theme();
+        main_text_atlas = GlyphAtlas(current_font, theme.main_text, theme.background);
+        secondary_text_atlas = GlyphAtlas(current_font, theme.secondary_text, theme.background);
+        line_surfaces.clear();
+    }
+
+    // Forget what was rendered, for when lines or their look change
+    void invalidate_rendered()
+    {
+        rendered_line = std::experimental::nullopt;
+        prerendered_pages.clear();
+    }
+
     int num_display_lines() const
     {
         return SCREEN_HEIGHT / line_height;
@@ -80,36 +166,58 @@ struct TokenViewState
         return SCREEN_HEIGHT - line_height - excess_pxl_y() / 2;
     }
 
-    TokenViewState(std::shared_ptr<DocReader> reader, DocAddr address, SystemStyling &sys_styling, TokenViewStyling &token_view_styling)
+    TokenViewState(std::shared_ptr<DocReader> reader, DocAddr address, SystemStyling &sys_styling, TokenViewStyling &token_view_styling, DocReaderCache *layout_cache, ImageDiskCache *image_disk_cache, MemoryBudget *memory_budget)
         : sys_styling(sys_styling),
           token_view_styling(token_view_styling),
           sys_styling_sub_id(sys_styling.subscribe_to_changes([this](SystemStyling::ChangeId change_id) {
               if (change_id == SystemStyling::ChangeId::FONT_SIZE || change_id == SystemStyling::ChangeId::FONT_NAME)
               {
+                  if (!layout_anchor)
+                  {
+                      const DisplayLine *line = line_scroller.get_line_relative(0);
+                      if (line)
+                      {
+                          layout_anchor = line->address;
+                      }
+                  }
+
                   current_font = this->sys_styling.get_loaded_font();
+                  line_fitter = TTFLineFitter(current_font, line_avail_width());
                   line_height = detect_line_height(current_font) + line_padding;
                   line_scroller.set_line_height_pixels(line_height);
-                  line_scroller.reset_buffer();  // need to re-wrap lines if font-size changed
+
+                  // Re-wrap when next needed, so changes in a row only re-wrap once
+                  line_scroller.set_line_break_index(nullptr);
+                  needs_reflow = true;
+              }
+              if (change_id != SystemStyling::ChangeId::SHOULDER_KEYMAP)
+              {
+                  reset_atlases();
+                  invalidate_rendered();
               }
               needs_render = true;
           })),
           token_view_styling_sub_id(token_view_styling.subscribe_to_changes([this]() {
+              invalidate_rendered();
               needs_render = true;
           })),
           current_font(sys_styling.get_loaded_font()),
+          main_text_atlas(current_font, sys_styling.get_loaded_color_theme().main_text, sys_styling.get_loaded_color_theme().background),
+          secondary_text_atlas(current_font, sys_styling.get_loaded_color_theme().secondary_text, sys_styling.get_loaded_color_theme().background),
           line_height(detect_line_height(sys_styling.get_font_name(), sys_styling.get_font_size()) + line_padding),
+          line_fitter(current_font, line_avail_width()),
+          layout_cache(layout_cache),
+          book_id(reader->get_id()),
+          line_break_index(make_line_break_index()),
           line_scroller(
               reader,
               address,
-              [this](const char *s, uint32_t len) {
-                  return line_fits_on_screen(
-                      current_font,
-                      SCREEN_WIDTH - line_padding * 2,
-                      s,
-                      len
-                  );
-              },
-              line_height
+              line_fitter,
+              line_height,
+              LINE_WINDOW_LINES,
+              line_break_index.get(),
+              image_disk_cache,
+              memory_budget
           ),
           line_scroll_throttle(250, 50),
           page_scroll_throttle(750, 150)
@@ -123,8 +231,8 @@ struct TokenViewState
     }
 };
 
-TokenView::TokenView(std::shared_ptr<DocReader> reader, DocAddr address, SystemStyling &sys_styling, TokenViewStyling &token_view_styling)
-    : state(std::make_unique<TokenViewState>(reader, address, sys_styling, token_view_styling))
+TokenView::TokenView(std::shared_ptr<DocReader> reader, DocAddr address, SystemStyling &sys_styling, TokenViewStyling &token_view_styling, DocReaderCache *layout_cache, ImageDiskCache *image_disk_cache, MemoryBudget *memory_budget)
+    : state(std::make_unique<TokenViewState>(reader, address, sys_styling, token_view_styling, layout_cache, image_disk_cache, memory_budget))
 {
 }
 
@@ -132,53 +240,38 @@ TokenView::~TokenView()
 {
 }
 
-bool TokenView::render(SDL_Surface *dest_surface, bool force_render)
+// Draw display lines [first_line, end_line) of the page starting top_line
+// lines from the current one, over a cleared background. False if part of an
+// image is missing, or is a strip only kept while on screen, so what's drawn
+// can't be reused later.
+static bool draw_lines(TokenViewState &state, SDL_Surface *dest_surface, int top_line, int first_line, int end_line)
 {
-    if (!state->needs_render && !force_render)
-    {
-        return false;
-    }
-    state->needs_render = false;
+    const int line_height = state.line_height;
+    const int line_padding = state.line_padding;
+    Sint16 line_y = state.excess_pxl_y() / 2 + first_line * line_height;
 
-    scroll(0);  // Will adjust scroll position if necessary for end of book
-
-    TTF_Font *font = state->current_font;
-    const auto &theme = state->sys_styling.get_loaded_color_theme();
-    const int line_height = state->line_height;
-    const int line_padding = state->line_padding;
+    // Strips of tall images are decoded and kept for the current page only
+    const bool is_current_page = top_line == 0;
+    bool is_complete = true;
 
-    // Clear screen
+    for (int i = first_line; i < end_line; ++i)
     {
-        SDL_Rect rect = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
-        const auto &bgcolor = theme.background;
-
-        SDL_FillRect(
-            dest_surface,
-            &rect,
-            SDL_MapRGB(dest_surface->format, bgcolor.r, bgcolor.g, bgcolor.b)
-        );
-    }
-
-    int num_text_display_lines = state->num_text_display_lines();
-    const Uint16 padding_y = state->excess_pxl_y() / 2;
-    Sint16 line_y = padding_y;
-
-    for (int i = 0; i < num_text_display_lines; ++i)
-    {
-        const DisplayLine *line = state->line_scroller.get_line_relative(i);
+        const DisplayLine *line = state.line_scroller.get_line_relative(top_line + i);
         if (line)
         {
             if (line->type == DisplayLine::Type::Text)
             {
                 const auto *text_line = static_cast<const TextLine *>(line);
-                const char *s = text_line->text.c_str();
-                auto surface = surface_unique_ptr { TTF_RenderUTF8_Shaded(font, s, theme.main_text, theme.background) };
-                SDL_Rect dest_rect = {
-                    static_cast<Sint16>(line_padding + (text_line->centered ? (SCREEN_WIDTH - 2 * line_padding - surface->w) /2 : 0)),
-                    static_cast<Sint16>(line_y + line_padding / 2),
-                    0, 0
-                };
-                SDL_BlitSurface(surface.get(), nullptr, dest_surface, &dest_rect);
+                SDL_Surface *surface = state.line_surfaces.get_line(*text_line, state.main_text_atlas, dest_surface->format);
+                if (surface)
+                {
+                    SDL_Rect dest_rect = {
+                        static_cast<Sint16>(line_padding + (text_line->centered ? (SCREEN_WIDTH - 2 * line_padding - surface->w) /2 : 0)),
+                        static_cast<Sint16>(line_y + line_padding / 2),
+                        0, 0
+                    };
+                    SDL_BlitSurface(surface, nullptr, dest_surface, &dest_rect);
+                }
             }
             else if (line->type == DisplayLine::Type::Image || (line->type == DisplayLine::Type::ImageRef && i == 0))
             {
@@ -188,7 +281,7 @@ bool TokenView::render(SDL_Surface *dest_surface, bool force_render)
                 if (line->type == DisplayLine::Type::ImageRef)
                 {
                     line_offset = static_cast<const ImageRefLine *>(line)->offset;
-                    const DisplayLine *ref_line = state->line_scroller.get_line_relative(i - line_offset);
+                    const DisplayLine *ref_line = state.line_scroller.get_line_relative(top_line + i - line_offset);
                     if (ref_line)
                     {
                         if (ref_line->type != DisplayLine::Type::Image)
@@ -205,38 +298,65 @@ bool TokenView::render(SDL_Surface *dest_surface, bool force_render)
 
                 if (image_line)
                 {
-                    auto *surface = state->line_scroller.load_scaled_image(image_line->image_path);
-
                     // Amount of line height not used by image
                     uint32_t img_excess_y = image_line->num_lines * line_height - image_line->height;
                     // Y coordinate of image in screen space
                     int screen_start_y = line_y + img_excess_y / 2 - line_height * line_offset;
 
                     // Crop off-screen part of image. Allow to extend to edge of screen.
-                    Sint16 src_y = std::max(-screen_start_y, 0);
-                    Sint16 dst_y = std::max(screen_start_y, 0);
+                    int src_y = std::max(-screen_start_y, 0);
+                    int dst_y = std::max(screen_start_y, 0);
 
-                    if (surface && src_y < (Sint16)image_line->height)
+                    if (src_y < (int)image_line->height)
                     {
-                        Uint16 width = image_line->width;
-                        Uint16 height = image_line->height - src_y;
+                        int width = image_line->width;
+                        int height = image_line->height - src_y;
 
                         // Crop bottom
-                        auto dst_y_bottom = dst_y + height;
-                        Uint16 y_limit = state->line_pxl_limit_y();
-                        if (dst_y_bottom > y_limit)
+                        int y_limit = state.line_pxl_limit_y();
+                        height = std::min(height, y_limit - dst_y);
+
+                        // Tall images come in strips, draw from each the rows on screen
+                        uint32_t y = src_y;
+                        const uint32_t end_y = src_y + std::max(height, 0);
+                        while (y < end_y)
                         {
-                            height -= dst_y_bottom - y_limit;
+                            ImageStrip strip = state.line_scroller.get_image_strip(image_line->image_path, y, is_current_page);
+                            const uint32_t strip_end_y = std::min(end_y, strip.y + strip.h);
+                            if (strip_end_y <= y)
+                            {
+                                is_complete = false;
+                                break;
+                            }
+
+                            if (strip.surface)
+                            {
+                                SDL_Rect src_rect = {
+                                    0,
+                                    static_cast<Sint16>(y - strip.y),
+                                    static_cast<Uint16>(width),
+                                    static_cast<Uint16>(strip_end_y - y)
+                                };
+                                SDL_Rect dest_rect = {
+                                    static_cast<Sint16>((SCREEN_WIDTH - width) / 2),
+                                    static_cast<Sint16>(dst_y + (y - src_y)),
+                                    0,
+                                    0
+                                };
+                                SDL_BlitSurface(strip.surface, &src_rect, dest_surface, &dest_rect);
+                            }
+                            if (!strip.surface || strip.h < image_line->height)
+                            {
+                                is_complete = false;
+                            }
+                            y = strip_end_y;
                         }
 
-                        SDL_Rect src_rect = {0, src_y, width, height};
-                        SDL_Rect dest_rect = {
-                            static_cast<Sint16>((SCREEN_WIDTH - width) / 2),
-                            dst_y,
-                            0,
-                            0
-                        };
-                        SDL_BlitSurface(surface, &src_rect, dest_surface, &dest_rect);
+                        // Decode the strip after those on screen ahead of scrolling to it
+                        if (is_current_page && end_y < image_line->height)
+                        {
+                            state.line_scroller.get_image_strip(image_line->image_path, end_y, true);
+                        }
                     }
                 }
             }
@@ -249,47 +369,244 @@ bool TokenView::render(SDL_Surface *dest_surface, bool force_render)
         line_y += line_height;
     }
 
-    if (state->token_view_styling.get_show_title_bar())
+    return is_complete;
+}
+
+static SDL_Rect title_bar_rect(const TokenViewState &state)
+{
+    // Placed after all text lines, even for a short book
+    return {
+        0,
+        static_cast<Sint16>(state.excess_pxl_y() / 2 + state.num_text_display_lines() * state.line_height),
+        SCREEN_WIDTH,
+        static_cast<Uint16>(state.line_height)
+    };
+}
+
+static void draw_title_bar(TokenViewState &state, SDL_Surface *dest_surface)
+{
+    const int line_height = state.line_height;
+    const int line_padding = state.line_padding;
+
+    SDL_Rect bar_rect = title_bar_rect(state);
+    const auto &bgcolor = state.sys_styling.get_loaded_color_theme().background;
+    SDL_FillRect(
+        dest_surface,
+        &bar_rect,
+        SDL_MapRGB(dest_surface->format, bgcolor.r, bgcolor.g, bgcolor.b)
+    );
+
+    const int text_y = bar_rect.y + line_padding / 2;
+    SDL_Rect title_crop_rect = {
+        static_cast<Sint16>(line_padding),
+        static_cast<Sint16>(text_y),
+        0,
+        static_cast<Uint16>(line_height)
+    };
+
+    // Progress, page numbers once the whole book is laid out
+    {
+        char progress_str[32];
+        auto global_line = state.line_scroller.get_global_line_number();
+        if (state.token_view_styling.get_progress_reporting() == ProgressReporting::PAGE_NUMBER && global_line)
+        {
+            const uint32_t page_lines = state.num_text_display_lines();
+            const uint32_t num_pages = (state.line_break_index->num_lines() + page_lines - 1) / page_lines;
+            const uint32_t page = *global_line / page_lines + 1;
+            snprintf(progress_str, sizeof(progress_str), " %u / %u", page, std::max(page, num_pages));
+        }
+        else
+        {
+            snprintf(progress_str, sizeof(progress_str), " %d%%", state.title_progress_percent);
+        }
+
+        int progress_width = state.secondary_text_atlas.text_width(progress_str);
+        state.secondary_text_atlas.render(progress_str, dest_surface, SCREEN_WIDTH - progress_width - line_padding, text_y);
+        title_crop_rect.w = SCREEN_WIDTH - line_padding * 2 - progress_width;
+    }
+
+    // Toc item
+    if (state.title.size() > 0)
     {
-        // Recompute for short book case
-        line_y = padding_y + num_text_display_lines * line_height;
-        SDL_Rect title_crop_rect = {0, 0, 0, (Uint16)line_height};
+        SDL_SetClipRect(dest_surface, &title_crop_rect);
+        state.secondary_text_atlas.render(state.title.c_str(), dest_surface, line_padding, text_y);
+        SDL_SetClipRect(dest_surface, nullptr);
+    }
+}
 
-        // Progress
+// Clear the screen and draw the page starting top_line lines from the current
+// one, as a full render does before the title bar. False if it can't be
+// reused, as with draw_lines.
+static bool draw_page(TokenViewState &state, SDL_Surface *dest_surface, int top_line)
+{
+    SDL_Rect rect = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
+    const auto &bgcolor = state.sys_styling.get_loaded_color_theme().background;
+
+    SDL_FillRect(
+        dest_surface,
+        &rect,
+        SDL_MapRGB(dest_surface->format, bgcolor.r, bgcolor.g, bgcolor.b)
+    );
+
+    return draw_lines(state, dest_surface, top_line, 0, state.num_text_display_lines());
+}
+
+static bool draw_prerendered_page(TokenViewState &state, SDL_Surface *dest_surface, int line_number)
+{
+    for (const auto &page : state.prerendered_pages)
+    {
+        if (page.line == line_number && page.is_complete)
         {
-            char percent_str[32];
-            snprintf(percent_str, sizeof(percent_str), " %d%%", state->title_progress_percent);
+            SDL_BlitSurface(page.surface.get(), nullptr, dest_surface, nullptr);
+            return true;
+        }
+    }
+    return false;
+}
 
-            SDL_Surface *page_surface = TTF_RenderUTF8_Shaded(font, percent_str, theme.secondary_text, theme.background);
+static bool has_visible_images(TokenViewState &state)
+{
+    for (int i = 0; i < state.num_text_display_lines(); ++i)
+    {
+        const DisplayLine *line = state.line_scroller.get_line_relative(i);
+        if (!line)
+        {
+            break;
+        }
+        if (line->type != DisplayLine::Type::Text)
+        {
+            return true;
+        }
+    }
+    return false;
+}
 
-            SDL_Rect dest_rect = {
-                static_cast<Sint16>(SCREEN_WIDTH - page_surface->w - line_padding),
-                static_cast<Sint16>(line_y + line_padding / 2),
-                0, 0
-            };
-            title_crop_rect.w = SCREEN_WIDTH - line_padding * 2 - page_surface->w;
+// Scroll what was last rendered by num_lines, moving the pixels of lines
+// still on screen and drawing only those scrolled into view. Returns false if
+// the screen needs to be drawn in full instead.
+static bool render_scrolled(TokenViewState &state, SDL_Surface *dest_surface, int num_lines)
+{
+    const int num_text_lines = state.num_text_display_lines();
+    if (std::abs(num_lines) >= num_text_lines || has_visible_images(state))
+    {
+        return false;
+    }
+
+    const int line_height = state.line_height;
+    const int text_y = state.excess_pxl_y() / 2;
+    const int num_kept_lines = num_text_lines - std::abs(num_lines);
 
-            SDL_BlitSurface(page_surface, nullptr, dest_surface, &dest_rect);
-            SDL_FreeSurface(page_surface);
+    if (num_kept_lines > 0 && num_lines != 0)
+    {
+        if (SDL_MUSTLOCK(dest_surface) && SDL_LockSurface(dest_surface) != 0)
+        {
+            return false;
         }
 
-        // Toc item
-        if (state->title.size() > 0)
+        // Whole rows, so lines are contiguous
+        Uint8 *text_pixels = static_cast<Uint8 *>(dest_surface->pixels) + text_y * dest_surface->pitch;
+        const int line_bytes = line_height * dest_surface->pitch;
+        if (num_lines > 0)
         {
-            SDL_Rect dest_rect = {
-                static_cast<Sint16>(line_padding),
-                static_cast<Sint16>(line_y + line_padding / 2),
-                0, 0
-            };
-            SDL_Surface *surface = TTF_RenderUTF8_Shaded(font, state->title.c_str(), theme.secondary_text, theme.background);
-            SDL_BlitSurface(surface, &title_crop_rect, dest_surface, &dest_rect);
-            SDL_FreeSurface(surface);
+            memmove(text_pixels, text_pixels + num_lines * line_bytes, num_kept_lines * line_bytes);
         }
+        else
+        {
+            memmove(text_pixels - num_lines * line_bytes, text_pixels, num_kept_lines * line_bytes);
+        }
+
+        if (SDL_MUSTLOCK(dest_surface))
+        {
+            SDL_UnlockSurface(dest_surface);
+        }
+    }
+
+    int first_new_line = num_lines > 0 ? num_kept_lines : 0;
+    int end_new_line = num_lines > 0 ? num_text_lines : -num_lines;
+
+    SDL_Rect new_lines_rect = {
+        0,
+        static_cast<Sint16>(text_y + first_new_line * line_height),
+        SCREEN_WIDTH,
+        static_cast<Uint16>((end_new_line - first_new_line) * line_height)
+    };
+    const auto &bgcolor = state.sys_styling.get_loaded_color_theme().background;
+    SDL_FillRect(
+        dest_surface,
+        &new_lines_rect,
+        SDL_MapRGB(dest_surface->format, bgcolor.r, bgcolor.g, bgcolor.b)
+    );
+    draw_lines(state, dest_surface, 0, first_new_line, end_new_line);
+
+    if (num_lines != 0)
+    {
+        state.dirty_rects.push_back({
+            0,
+            static_cast<Sint16>(text_y),
+            SCREEN_WIDTH,
+            static_cast<Uint16>(num_text_lines * line_height)
+        });
     }
 
     return true;
 }
 
+bool TokenView::render(SDL_Surface *dest_surface, bool force_render)
+{
+    scroll(0);  // Will adjust scroll position if necessary for end of book
+
+    if (!state->needs_render && !state->needs_title_render && !force_render)
+    {
+        return false;
+    }
+
+    state->dirty_rects.clear();
+    if (dest_surface != state->rendered_surface)
+    {
+        // Prerendered in the format of the last surface
+        state->prerendered_pages.clear();
+    }
+
+    const bool show_title_bar = state->token_view_styling.get_show_title_bar();
+    const int line_number = state->line_scroller.get_line_number();
+
+    bool can_scroll = (
+        !force_render &&
+        state->rendered_line &&
+        state->rendered_surface == dest_surface
+    );
+    if (!can_scroll || !render_scrolled(*state, dest_surface, line_number - *state->rendered_line))
+    {
+        if (!draw_prerendered_page(*state, dest_surface, line_number))
+        {
+            draw_page(*state, dest_surface, 0);
+            state->line_scroller.release_image_strips();
+        }
+    }
+    else if (show_title_bar)
+    {
+        state->dirty_rects.push_back(title_bar_rect(*state));
+    }
+
+    if (show_title_bar)
+    {
+        draw_title_bar(*state, dest_surface);
+    }
+
+    // Images can extend past their lines, so screens with them aren't scrolled
+    state->rendered_line = has_visible_images(*state) ? std::experimental::nullopt : std::experimental::make_optional(line_number);
+    state->rendered_surface = dest_surface;
+    state->needs_render = false;
+    state->needs_title_render = false;
+
+    return true;
+}
+
+std::vector<SDL_Rect> TokenView::get_dirty_rects() const
+{
+    return state->dirty_rects;
+}
+
 // Adjust scroll amount to avoid going beyond start or end of book.
 static int get_bounded_scroll_amount(TokenLineScroller &line_scroller, int num_display_lines, int num_lines)
 {
@@ -325,6 +642,8 @@ static int get_bounded_scroll_amount(TokenLineScroller &line_scroller, int num_d
 
 void TokenView::scroll(int num_lines)
 {
+    state->reflow_if_needed();
+
     num_lines = get_bounded_scroll_amount(
         state->line_scroller,
         state->num_text_display_lines(),
@@ -333,6 +652,7 @@ void TokenView::scroll(int num_lines)
     if (num_lines != 0)
     {
         state->needs_render = true;
+        state->layout_anchor = std::experimental::nullopt;
         state->line_scroller.seek_lines_relative(num_lines);
         if (state->on_scroll)
         {
@@ -341,6 +661,106 @@ void TokenView::scroll(int num_lines)
     }
 }
 
+// Draw the pages a page turn would go to ahead of time, next page first. Only
+// draws one page per call, true if it did.
+static bool prerender_next_page(TokenViewState &state)
+{
+    if (!state.rendered_surface)
+    {
+        return false;
+    }
+
+    const int page_lines = state.num_text_display_lines();
+    const int line_number = state.line_scroller.get_line_number();
+    const SDL_PixelFormat *format = state.rendered_surface->format;
+    const uint32_t page_size_bytes = SCREEN_WIDTH * SCREEN_HEIGHT * format->BytesPerPixel;
+    const uint32_t max_pages = std::min<uint32_t>(2, PRERENDERED_PAGES_SIZE_BYTES / page_size_bytes);
+
+    std::vector<int> wanted_lines;
+    for (int direction : {1, -1})
+    {
+        if (wanted_lines.size() >= max_pages)
+        {
+            break;
+        }
+
+        // Lays out the lines of the page if not already
+        int num_lines = get_bounded_scroll_amount(state.line_scroller, page_lines, direction * page_lines);
+        if (num_lines != 0)
+        {
+            wanted_lines.push_back(line_number + num_lines);
+        }
+    }
+
+    // Drop pages no longer a page turn away, keeping a surface to draw into
+    surface_unique_ptr surface;
+    auto &pages = state.prerendered_pages;
+    for (auto it = pages.begin(); it != pages.end();)
+    {
+        if (std::find(wanted_lines.begin(), wanted_lines.end(), it->line) == wanted_lines.end())
+        {
+            if (!surface)
+            {
+                surface = std::move(it->surface);
+            }
+            it = pages.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    for (int line : wanted_lines)
+    {
+        bool is_rendered = std::any_of(pages.begin(), pages.end(), [line](const auto &page) { return page.line == line; });
+        if (is_rendered)
+        {
+            continue;
+        }
+
+        if (!surface)
+        {
+            surface = create_surface_in_format(SDL_SWSURFACE, SCREEN_WIDTH, SCREEN_HEIGHT, format);
+            if (!surface)
+            {
+                return false;
+            }
+        }
+
+        bool is_complete = draw_page(state, surface.get(), line - line_number);
+        pages.push_back({line, std::move(surface), is_complete});
+        return true;
+    }
+
+    return false;
+}
+
+// Once pages are prerendered, lay out more of the book for page numbers
+bool TokenView::on_idle()
+{
+    state->reflow_if_needed();
+
+    if (state->line_scroller.take_decoded_images())
+    {
+        // Pages may have been drawn without them
+        state->prerendered_pages.clear();
+        state->needs_render = true;
+        return true;
+    }
+
+    if (prerender_next_page(*state))
+    {
+        return false;
+    }
+
+    Timer timer;
+    while (state->line_scroller.lay_out_more(LAYOUT_IDLE_TOKENS_PER_STEP) && timer.elapsed_ms() < LAYOUT_IDLE_TIME_MS)
+    {
+    }
+    return false;
+}
+
 void TokenView::on_keypress(SDLKey key)
 {
     switch (key) {
@@ -420,6 +840,11 @@ bool TokenView::is_done()
 
 DocAddr TokenView::get_address() const
 {
+    if (state->layout_anchor)
+    {
+        return *state->layout_anchor;
+    }
+
     const DisplayLine *line = state->line_scroller.get_line_relative(0);
     if (line)
     {
@@ -430,7 +855,15 @@ DocAddr TokenView::get_address() const
 
 void TokenView::seek_to_address(DocAddr address)
 {
-    state->line_scroller.seek_to_address(address);
+    // Seeks as part of any pending reflow
+    state->layout_anchor = address;
+    if (!state->reflow_if_needed())
+    {
+        state->line_scroller.seek_to_address(address);
+    }
+    state->layout_anchor = std::experimental::nullopt;
+
+    state->invalidate_rendered();
     state->needs_render = true;
 }
 
@@ -439,7 +872,10 @@ void TokenView::set_title(const std::string &title)
     if (title != state->title)
     {
         state->title = title;
-        state->needs_render = true;
+        if (state->token_view_styling.get_show_title_bar())
+        {
+            state->needs_title_render = true;
+        }
     }
 }
 
@@ -448,7 +884,10 @@ void TokenView::set_title_progress(int percent)
     if (percent != state->title_progress_percent)
     {
         state->title_progress_percent = percent;
-        state->needs_render = true;
+        if (state->token_view_styling.get_show_title_bar())
+        {
+            state->needs_title_render = true;
+        }
     }
 }
 
@@ -9,6 +9,15 @@
 #include <string>
 #include <vector>
 
+#define PRERENDERED_PAGES_SIZE_BYTES (3 * 1024 * 1024)
+// Time spent laying out the book for page numbers per idle call
+#define LAYOUT_IDLE_TIME_MS 8
+#define LAYOUT_IDLE_TOKENS_PER_STEP 8
+
+struct DocReaderCache;
+class ImageDiskCache;
+class MemoryBudget;
+
 struct DocReader;
 struct SystemStyling;
 struct TokenViewState;
@@ -25,14 +34,19 @@ public:
         std::shared_ptr<DocReader> reader,
         DocAddr address,
         SystemStyling &sys_styling,
-        TokenViewStyling &token_view_styling
+        TokenViewStyling &token_view_styling,
+        DocReaderCache *layout_cache = nullptr,
+        ImageDiskCache *image_disk_cache = nullptr,
+        MemoryBudget *memory_budget = nullptr
     );
     virtual ~TokenView();
 
     bool render(SDL_Surface *dest_surface, bool force_render) override;
+    std::vector<SDL_Rect> get_dirty_rects() const override;
     bool is_done() override;
     void on_keypress(SDLKey key) override;
     void on_keyheld(SDLKey key, uint32_t held_time_ms) override;
+    bool on_idle() override;
 
     DocAddr get_address() const;
     void seek_to_address(DocAddr address);
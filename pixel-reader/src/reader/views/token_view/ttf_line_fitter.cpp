@@ -0,0 +1,77 @@
+#include "./ttf_line_fitter.h"
+
+#include <algorithm>
+
+TTFLineFitter::TTFLineFitter(TTF_Font *font, int max_width)
+    : font(font),
+      glyphs(&cached_glyphs(font)),
+      max_width(max_width)
+{
+}
+
+void TTFLineFitter::start_line(const char *start)
+{
+    line_start = start;
+    measured_len = 0;
+    x = 0;
+    minx = 0;
+    maxx = 0;
+    prev_index = 0;
+    use_sdl_sizing = false;
+}
+
+// Mirrors the loop in SDL_ttf's TTF_SizeUNICODE, for unstyled text
+void TTFLineFitter::measure_to(uint32_t len)
+{
+    while (measured_len < len)
+    {
+        uint16_t ch = 0;
+        uint32_t char_len = decode_ttf_char(line_start + measured_len, len - measured_len, ch);
+        const GlyphMetrics *glyph = char_len ? glyphs->glyph(ch) : nullptr;
+        if (!glyph)
+        {
+            use_sdl_sizing = true;
+            return;
+        }
+
+        x += glyphs->kerning(prev_index, glyph->index);
+        minx = std::min(minx, x + glyph->minx);
+        maxx = std::max(maxx, x + std::max(glyph->advance, glyph->maxx));
+        x += glyph->advance;
+        prev_index = glyph->index;
+
+        measured_len += char_len;
+    }
+}
+
+int TTFLineFitter::width(uint32_t len)
+{
+    if (len < measured_len)
+    {
+        start_line(line_start);
+    }
+
+    if (!use_sdl_sizing)
+    {
+        measure_to(len);
+    }
+
+    if (use_sdl_sizing)
+    {
+        sdl_buffer.assign(line_start, len);
+        int w, h;
+        if (TTF_SizeUTF8(font, sdl_buffer.c_str(), &w, &h) != 0)
+        {
+            return -1;
+        }
+        return w;
+    }
+
+    return maxx - minx;
+}
+
+bool TTFLineFitter::fits(uint32_t len)
+{
+    // Text that can't be sized is let through
+    return width(len) <= max_width;
+}
@@ -0,0 +1,45 @@
+#ifndef TTF_LINE_FITTER_H_
+#define TTF_LINE_FITTER_H_
+
+#include "reader/text_wrap.h"
+#include "util/sdl_glyph_cache.h"
+
+#include <SDL/SDL_ttf.h>
+
+#include <string>
+
+// Fits lines to a pixel width, measuring them as TTF_SizeUTF8 would. Widths
+// are accumulated from cached glyph metrics as a line is extended, so finding
+// a break takes one pass over the line rather than sizing every candidate.
+class TTFLineFitter : public LineFitter
+{
+    TTF_Font *font;
+    GlyphCache *glyphs;
+    int max_width;
+
+    const char *line_start = nullptr;
+    uint32_t measured_len = 0;
+
+    // State of SDL_ttf's sizing loop after the measured chars
+    int x = 0;
+    int minx = 0;
+    int maxx = 0;
+    int prev_index = 0;
+
+    // Set once the line has chars whose sizing isn't reproduced here
+    bool use_sdl_sizing = false;
+    std::string sdl_buffer;
+
+    void measure_to(uint32_t len);
+
+public:
+    TTFLineFitter(TTF_Font *font, int max_width);
+
+    void start_line(const char *line_start) override;
+    bool fits(uint32_t len) override;
+
+    // Width of the first len chars from the line start. -1 if the text can't be sized.
+    int width(uint32_t len);
+};
+
+#endif
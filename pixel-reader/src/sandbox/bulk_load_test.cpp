@@ -40,7 +40,7 @@ void bulk_load_test(std::string dir_path)
 {
     if (std::experimental::filesystem::exists(dir_path) && std::experimental::filesystem::is_directory(dir_path))
     {
-        StateStore store("store");
+        StateStore store("store", READER_CACHE_BLOB_SIZE_BYTES);
         SSDocReaderCache cache(store);
 
         Stats stats;
@@ -11,7 +11,7 @@ Line::Line(std::string text, DocAddr address)
 }
 
 std::vector<Line> cli_render_tokens(
-    const std::vector<const DocToken *> &tokens,
+    const TokenTable &tokens,
     uint32_t max_column_width
 )
 {
@@ -41,29 +41,29 @@ std::vector<Line> cli_render_tokens(
         });
     };
 
-    for (const auto *token : tokens) {
-        DocAddr address = token->address;
-        switch (token->type) {
+    for (uint32_t i = 0; i < tokens.size(); ++i) {
+        DocToken token = tokens[i];
+        DocAddr address = token.address;
+        switch (token.type) {
             case TokenType::Text:
-                wrap_text(address, static_cast<const TextDocToken *>(token)->text);
+                wrap_text(address, std::string(token.text));
                 break;
             case TokenType::Header:
-                wrap_text(address, static_cast<const HeaderDocToken *>(token)->text, true);
+                wrap_text(address, std::string(token.text), true);
                 break;
             case TokenType::ListItem:
                 {
-                    const auto *list_token = static_cast<const ListItemDocToken *>(token);
                     std::string prefix = std::string(
-                        (list_token->nest_level > 1 ? list_token->nest_level - 1 : 0) * 2,
+                        (token.nest_level > 1 ? token.nest_level - 1 : 0) * 2,
                         ' '
                     ) + BULLET + " ";
                     uint32_t extra_text_width = get_address_width(prefix);
 
-                    wrap_text(address, prefix + static_cast<const ListItemDocToken *>(token)->text, false, extra_text_width);
+                    wrap_text(address, prefix + std::string(token.text), false, extra_text_width);
                 }
                 break;
             case TokenType::Image:
-                wrap_text(address, "[Image " + static_cast<const ImageDocToken *>(token)->path.string() + "]");
+                wrap_text(address, "[Image " + std::string(token.text) + "]");
                 break;
             default:
                 break;
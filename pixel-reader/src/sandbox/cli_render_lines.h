@@ -1,7 +1,7 @@
 #ifndef CLI_WRAP_LINES_H_
 #define CLI_WRAP_LINES_H_
 
-#include "doc_api/doc_token.h"
+#include "doc_api/token_table.h"
 #include <string>
 #include <vector>
 
@@ -15,7 +15,7 @@ struct Line
 
 // Text-only rendering of tokens.
 std::vector<Line> cli_render_tokens(
-    const std::vector<const DocToken *> &tokens,
+    const TokenTable &tokens,
     uint32_t max_column_width
 );
 
@@ -19,7 +19,7 @@ void display_epub(std::string path)
     }
 
     // Read entire book
-    std::vector<const DocToken*> tokens;
+    TokenTable tokens;
     {
         auto it = epub.get_iter();
         const DocToken *token = nullptr;
@@ -27,13 +27,13 @@ void display_epub(std::string path)
         {
             if (token->type == TokenType::Image)
             {
-                const auto *image_token = static_cast<const ImageDocToken*>(token);
-                if (!epub.load_resource(image_token->path).size())
+                std::string image_path(token->text);
+                if (!epub.load_resource(image_path).size())
                 {
-                    std::cerr << "Unable to load image: " << image_token->path << std::endl;
+                    std::cerr << "Unable to load image: " << image_path << std::endl;
                 }
             }
-            tokens.push_back(token);
+            tokens.push_back(*token);
         }
     }
 
@@ -49,9 +49,9 @@ void display_epub(std::string path)
         if (get_text_number(toc_addr) > 0)
         {
             bool found_matching_addr = false;
-            for (const auto &token : tokens)
+            for (uint32_t j = 0; j < tokens.size(); ++j)
             {
-                if (toc_addr == token->address)
+                if (toc_addr == tokens.address(j))
                 {
                     found_matching_addr = true;
                     break;
@@ -12,16 +12,11 @@ void display_xhtml(std::string path)
     std::stringstream buffer;
     buffer << fp.rdbuf();
 
-    std::vector<std::unique_ptr<DocToken>> tokens;
+    TokenTable tokens;
     std::unordered_map<std::string, DocAddr> ids;
     parse_xhtml_tokens(buffer.str().c_str(), path, 0, tokens, ids);
 
-    auto token_ptrs = std::vector<const DocToken*>();
-    for (auto &token : tokens)
-    {
-        token_ptrs.push_back(token.get());
-    }
-    std::vector<Line> display_lines = cli_render_tokens(token_ptrs, 80);
+    std::vector<Line> display_lines = cli_render_tokens(tokens, 80);
 
     std::cout << path << std::endl;
     for (const auto &line: display_lines)
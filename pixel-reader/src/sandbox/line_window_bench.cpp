@@ -0,0 +1,137 @@
+#include "filetypes/open_doc.h"
+#include "reader/config.h"
+#include "reader/views/token_view/token_line_scroller.h"
+#include "reader/views/token_view/ttf_line_fitter.h"
+#include "sys/screen.h"
+#include "util/sdl_font_cache.h"
+#include "util/sdl_utils.h"
+
+#include <SDL/SDL.h>
+#include <SDL/SDL_ttf.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <unistd.h>
+
+namespace
+{
+
+// Heap use of the whole program, counted by the operator new below
+std::atomic<uint64_t> num_allocations(0);
+std::atomic<uint64_t> allocated_bytes(0);
+
+} // namespace
+
+void *operator new(std::size_t size)
+{
+    ++num_allocations;
+    allocated_bytes += size;
+    if (void *ptr = std::malloc(size ? size : 1))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace
+{
+
+constexpr int PAGE_LINES = 20;
+constexpr uint32_t REPORT_EVERY_PAGES = 500;
+constexpr uint32_t UNBOUNDED_WINDOW_LINES = 1 << 30;
+
+uint64_t resident_kb()
+{
+    std::ifstream fp("/proc/self/statm");
+    uint64_t size_pages = 0, resident_pages = 0;
+    fp >> size_pages >> resident_pages;
+    return resident_pages * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+// Page through the book from start to end, reporting buffered lines and
+// process memory along the way, and heap allocations per page turn.
+void read_book(const std::string &path, TTF_Font *font, uint32_t window_lines)
+{
+    auto reader = create_doc_reader(path);
+    if (!reader || !reader->open())
+    {
+        std::cerr << "Unable to open " << path << std::endl;
+        return;
+    }
+
+    TTFLineFitter line_fitter(font, SCREEN_WIDTH - 8);
+    TokenLineScroller scroller(reader, 0, line_fitter, detect_line_height(font), window_lines);
+
+    uint32_t max_buffered_lines = 0;
+    uint32_t pages = 0;
+    const uint64_t start_allocations = num_allocations;
+    const uint64_t start_bytes = allocated_bytes;
+    while (scroller.get_line_relative(PAGE_LINES))
+    {
+        scroller.seek_lines_relative(PAGE_LINES);
+        max_buffered_lines = std::max(max_buffered_lines, scroller.num_buffered_lines());
+
+        if (++pages % REPORT_EVERY_PAGES == 0)
+        {
+            std::cerr << "  Line " << scroller.get_line_number()
+                << ", buffered lines: " << scroller.num_buffered_lines()
+                << ", resident KB: " << resident_kb() << std::endl;
+        }
+    }
+
+    std::cerr << "  Read " << scroller.get_line_number() << " lines"
+        << ", max buffered lines: " << max_buffered_lines
+        << ", resident KB: " << resident_kb() << std::endl;
+
+    // Each line paged past was materialized once
+    const uint64_t allocations = num_allocations - start_allocations;
+    const uint64_t bytes = allocated_bytes - start_bytes;
+    std::cerr << "  Allocations/page: " << allocations / std::max<uint32_t>(pages, 1)
+        << ", bytes allocated/page: " << bytes / std::max<uint32_t>(pages, 1)
+        << ", bytes allocated/line: " << bytes / std::max(scroller.get_line_number(), 1) << std::endl;
+}
+
+} // namespace
+
+// Read a book end to end through TokenLineScroller, with the default line
+// window and with one that keeps every line, to compare memory use and
+// allocations.
+void line_window_bench(std::string font_path, std::string path)
+{
+    TTF_Init();
+
+    TTF_Font *font = cached_load_font(font_path, DEFAULT_FONT_SIZE, FontLoadErrorOpt::NoThrow);
+    if (!font)
+    {
+        std::cerr << "Unable to load " << font_path << std::endl;
+        return;
+    }
+
+    // For images
+    SDL_Surface *surface = SDL_CreateRGBSurface(SDL_SWSURFACE, 1, 1, 32, 0, 0, 0, 0);
+    set_render_surface_format(surface->format);
+
+    std::cerr << "Window of " << LINE_WINDOW_LINES << " lines each side" << std::endl;
+    read_book(path, font, LINE_WINDOW_LINES);
+
+    std::cerr << "Unbounded window" << std::endl;
+    read_book(path, font, UNBOUNDED_WINDOW_LINES);
+
+    SDL_FreeSurface(surface);
+    TTF_Quit();
+}
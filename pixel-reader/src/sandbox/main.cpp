@@ -15,9 +15,18 @@ void ls(std::string path)
 void display_epub(std::string path);
 void display_xhtml(std::string path);
 void bulk_load_test(std::string path);
+void token_cache_bench(std::string path);
+void seek_bench(uint32_t num_lines);
+void text_scan_bench(std::string path);
+void wrap_bench(std::string font_path, std::string path);
+void scroll_bench(std::string font_path, std::string path);
+void line_window_bench(std::string font_path, std::string path);
+void resample_bench();
 
 int main(int argc, char** argv)
 {
+    xmlInitParser();
+
     if (argc >= 2)
     {
         std::string mode = argv[1];
@@ -37,6 +46,34 @@ int main(int argc, char** argv)
         {
             bulk_load_test(argv[2]);
         }
+        else if (mode == "token_cache" && argc > 2)
+        {
+            token_cache_bench(argv[2]);
+        }
+        else if (mode == "seek" && argc > 2)
+        {
+            seek_bench(std::stoul(argv[2]));
+        }
+        else if (mode == "text_scan" && argc > 2)
+        {
+            text_scan_bench(argv[2]);
+        }
+        else if (mode == "wrap" && argc > 3)
+        {
+            wrap_bench(argv[2], argv[3]);
+        }
+        else if (mode == "scroll" && argc > 3)
+        {
+            scroll_bench(argv[2], argv[3]);
+        }
+        else if (mode == "line_window" && argc > 3)
+        {
+            line_window_bench(argv[2], argv[3]);
+        }
+        else if (mode == "resample")
+        {
+            resample_bench();
+        }
         else
         {
             std::cerr << "Invalid args" << std::endl;
@@ -0,0 +1,196 @@
+#include "util/image_resample.h"
+#include "util/sdl_utils.h"
+
+#include "extern/rotozoom/SDL_rotozoom.h"
+
+#include <SDL/SDL_video.h>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t NUM_ROUNDS = 10;
+
+uint32_t elapsed_us(Clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+double mpixels_per_sec(uint64_t pixels, uint32_t us)
+{
+    return us ? static_cast<double>(pixels) / us : 0;
+}
+
+struct Case
+{
+    const char *name;
+    uint32_t src_w;
+    uint32_t src_h;
+    uint32_t dst_w;
+    uint32_t dst_h;
+};
+
+// Noise over a gradient, so neither path sees runs of equal pixels
+surface_unique_ptr make_source(uint32_t w, uint32_t h, int bpp)
+{
+    surface_unique_ptr surface {
+        bpp == 16 ?
+            SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 16, 0xf800, 0x07e0, 0x001f, 0) :
+            SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000)
+    };
+    std::mt19937 rng(1234);
+    for (uint32_t y = 0; y < h; ++y)
+    {
+        uint8_t *row = static_cast<uint8_t *>(surface->pixels) + y * surface->pitch;
+        for (uint32_t i = 0; i < w * surface->format->BytesPerPixel; ++i)
+        {
+            row[i] = (i + y + rng() % 32) & 0xff;
+        }
+    }
+    return surface;
+}
+
+// As image loading zoomed, back to the source format
+surface_unique_ptr zoom(SDL_Surface *src, uint32_t dst_w)
+{
+    double scale = dst_w / static_cast<double>(src->w);
+    return convert_surface_to_format(surface_unique_ptr { zoomSurface(src, scale, scale, 1) }, src->format);
+}
+
+void bench_case(const Case &c, int bpp)
+{
+    auto src = make_source(c.src_w, c.src_h, bpp);
+    const uint64_t total_pixels = static_cast<uint64_t>(c.src_w) * c.src_h * NUM_ROUNDS;
+
+    auto start = Clock::now();
+    for (uint32_t i = 0; i < NUM_ROUNDS; ++i)
+    {
+        zoom(src.get(), c.dst_w);
+    }
+    uint32_t zoom_us = elapsed_us(start);
+
+    start = Clock::now();
+    for (uint32_t i = 0; i < NUM_ROUNDS; ++i)
+    {
+        resample_surface(src.get(), c.dst_w, c.dst_h);
+    }
+    uint32_t resample_us = elapsed_us(start);
+
+    std::cerr << c.name << " " << bpp << " bit, "
+              << c.src_w << "x" << c.src_h << " to " << c.dst_w << "x" << c.dst_h << std::endl;
+    std::cerr << "  zoomSurface source MP/s: " << mpixels_per_sec(total_pixels, zoom_us) << std::endl;
+    std::cerr << "  resample source MP/s: " << mpixels_per_sec(total_pixels, resample_us) << std::endl;
+}
+
+// Kernels against their scalar versions, a row of width pixels at a time
+void bench_kernels(uint32_t width)
+{
+    std::mt19937 rng(1234);
+    std::vector<uint8_t> row(width * 4);
+    for (auto &b : row)
+    {
+        b = rng();
+    }
+    const uint64_t total_pixels = static_cast<uint64_t>(width) * NUM_ROUNDS * 100;
+
+    // Uneven blocks of 2 and 3 pixels
+    std::vector<uint32_t> block_widths;
+    for (uint32_t x = 0; x + 3 <= width; x += 5)
+    {
+        block_widths.insert(block_widths.end(), {2, 3});
+    }
+    std::vector<uint32_t> block_sums(block_widths.size() * 4);
+
+    auto start = Clock::now();
+    for (uint32_t i = 0; i < NUM_ROUNDS * 100; ++i)
+    {
+        sum_pixel_blocks_scalar(row.data(), block_widths.data(), block_widths.size(), block_sums.data());
+    }
+    uint32_t blocks_scalar_us = elapsed_us(start);
+
+    start = Clock::now();
+    for (uint32_t i = 0; i < NUM_ROUNDS * 100; ++i)
+    {
+        sum_pixel_blocks(row.data(), block_widths.data(), block_widths.size(), block_sums.data());
+    }
+    uint32_t blocks_us = elapsed_us(start);
+
+    std::vector<uint16_t> run_sums(width / 2 * 4);
+    start = Clock::now();
+    for (uint32_t i = 0; i < NUM_ROUNDS * 100; ++i)
+    {
+        std::fill(run_sums.begin(), run_sums.end(), 0);
+        sum_pixel_runs_scalar(row.data(), 2, width / 2, run_sums.data());
+    }
+    uint32_t runs_scalar_us = elapsed_us(start);
+
+    start = Clock::now();
+    for (uint32_t i = 0; i < NUM_ROUNDS * 100; ++i)
+    {
+        std::fill(run_sums.begin(), run_sums.end(), 0);
+        sum_pixel_runs(row.data(), 2, width / 2, run_sums.data());
+    }
+    uint32_t runs_us = elapsed_us(start);
+
+    // 1.5x reduction
+    const uint32_t out_width = width * 2 / 3;
+    std::vector<uint32_t> x0(out_width);
+    std::vector<uint8_t> weight(out_width);
+    for (uint32_t x = 0; x < out_width; ++x)
+    {
+        x0[x] = x * 3 / 2;
+        weight[x] = (x & 1) ? 128 : 0;
+    }
+    std::vector<uint16_t> interpolated(out_width * 4);
+
+    start = Clock::now();
+    for (uint32_t i = 0; i < NUM_ROUNDS * 100; ++i)
+    {
+        interpolate_row_scalar(row.data(), width, x0.data(), weight.data(), out_width, interpolated.data());
+    }
+    uint32_t interpolate_scalar_us = elapsed_us(start);
+
+    start = Clock::now();
+    for (uint32_t i = 0; i < NUM_ROUNDS * 100; ++i)
+    {
+        interpolate_row(row.data(), width, x0.data(), weight.data(), out_width, interpolated.data());
+    }
+    uint32_t interpolate_us = elapsed_us(start);
+
+    std::cerr << "Kernels, " << width << " pixel rows, source MP/s" << std::endl;
+    std::cerr << "  sum_pixel_blocks scalar: " << mpixels_per_sec(total_pixels, blocks_scalar_us) << std::endl;
+    std::cerr << "  sum_pixel_blocks: " << mpixels_per_sec(total_pixels, blocks_us) << std::endl;
+    std::cerr << "  sum_pixel_runs scalar: " << mpixels_per_sec(total_pixels, runs_scalar_us) << std::endl;
+    std::cerr << "  sum_pixel_runs: " << mpixels_per_sec(total_pixels, runs_us) << std::endl;
+    std::cerr << "  interpolate_row scalar: " << mpixels_per_sec(total_pixels, interpolate_scalar_us) << std::endl;
+    std::cerr << "  interpolate_row: " << mpixels_per_sec(total_pixels, interpolate_us) << std::endl;
+}
+
+} // namespace
+
+// Compare throughput of resampling against zoomSurface, on synthetic images
+// in the formats the reader draws in, and of the resampling kernels against
+// their scalar versions.
+void resample_bench()
+{
+    const std::vector<Case> cases = {
+        {"Integer 2x", 1280, 1600, 640, 800},
+        {"Area", 1200, 1600, 320, 427},
+        {"Bilinear", 480, 640, 320, 427},
+    };
+    for (int bpp : {32, 16})
+    {
+        for (const auto &c : cases)
+        {
+            bench_case(c, bpp);
+        }
+    }
+
+    bench_kernels(1280);
+}
@@ -0,0 +1,189 @@
+#include "filetypes/open_doc.h"
+#include "reader/config.h"
+#include "reader/system_styling.h"
+#include "reader/views/token_view/token_view.h"
+#include "reader/views/token_view/token_view_styling.h"
+#include "sys/keymap.h"
+#include "sys/screen.h"
+#include "util/sdl_pointer.h"
+#include "util/sdl_utils.h"
+
+#include <SDL/SDL.h>
+#include <SDL/SDL_ttf.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t NUM_FRAMES = 300;
+
+struct ScrollStats
+{
+    uint64_t render_us = 0;
+    uint64_t present_us = 0;
+    uint64_t presented_bytes = 0;
+};
+
+// Press key once per frame, e.g. to scroll down a line as when holding down,
+// and present each frame as the reader does. With full_render, every frame is
+// redrawn and presented in full, as before incremental rendering. With idle,
+// the view gets an idle step before each key press, as between page turns.
+// If screen is video, frames are rendered straight into it and flipped.
+ScrollStats time_scrolling(
+    const std::string &path,
+    SystemStyling &sys_styling,
+    TokenViewStyling &token_view_styling,
+    SDL_Surface *screen,
+    SDL_Surface *video,
+    SDLKey key,
+    bool full_render,
+    bool idle
+)
+{
+    ScrollStats stats;
+
+    auto reader = create_doc_reader(path);
+    if (!reader || !reader->open())
+    {
+        std::cerr << "Unable to open " << path << std::endl;
+        return stats;
+    }
+
+    TokenView token_view(reader, 0, sys_styling, token_view_styling);
+    token_view.render(screen, true);
+
+    const uint32_t screen_bytes = screen->pitch * screen->h;
+    for (uint32_t i = 0; i < NUM_FRAMES; ++i)
+    {
+        if (idle)
+        {
+            token_view.on_idle();
+        }
+        token_view.on_keypress(key);
+
+        auto start = Clock::now();
+        bool rendered = token_view.render(screen, full_render);
+        auto rendered_time = Clock::now();
+        if (!rendered)
+        {
+            break;
+        }
+
+        std::vector<SDL_Rect> dirty_rects;
+        if (!full_render)
+        {
+            dirty_rects = token_view.get_dirty_rects();
+        }
+
+        if (screen == video)
+        {
+            SDL_Flip(video);
+        }
+        else if (dirty_rects.empty())
+        {
+            SDL_BlitSurface(screen, NULL, video, NULL);
+            SDL_Flip(video);
+            stats.presented_bytes += screen_bytes;
+        }
+        else
+        {
+            for (const auto &rect : dirty_rects)
+            {
+                SDL_Rect src_rect = rect;
+                SDL_Rect dest_rect = rect;
+                SDL_BlitSurface(screen, &src_rect, video, &dest_rect);
+                stats.presented_bytes += rect.w * rect.h * screen->format->BytesPerPixel;
+            }
+            SDL_UpdateRects(video, dirty_rects.size(), dirty_rects.data());
+        }
+
+        stats.render_us += std::chrono::duration_cast<std::chrono::microseconds>(rendered_time - start).count();
+        stats.present_us += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - rendered_time).count();
+    }
+
+    return stats;
+}
+
+void print_stats(const std::string &name, const ScrollStats &stats)
+{
+    std::cerr << name << std::endl;
+    std::cerr << "  Render us/frame: " << stats.render_us / NUM_FRAMES << std::endl;
+    std::cerr << "  Present us/frame: " << stats.present_us / NUM_FRAMES << std::endl;
+    std::cerr << "  Presented KB/frame: " << stats.presented_bytes / NUM_FRAMES / 1024 << std::endl;
+}
+
+// Page turns on a display of bpp, rendering offscreen in 32 bit, offscreen in
+// the display's format, and straight into the display.
+void compare_render_formats(
+    const std::string &path,
+    SystemStyling &sys_styling,
+    TokenViewStyling &token_view_styling,
+    int bpp
+)
+{
+    SDL_Surface *video = SDL_SetVideoMode(SCREEN_WIDTH, SCREEN_HEIGHT, bpp, SDL_SWSURFACE);
+    if (!video)
+    {
+        std::cerr << "Unable to set " << bpp << " bit video mode" << std::endl;
+        return;
+    }
+    const std::string prefix = std::to_string(video->format->BitsPerPixel) + " bit display, ";
+
+    {
+        surface_unique_ptr screen { SDL_CreateRGBSurface(SDL_SWSURFACE, SCREEN_WIDTH, SCREEN_HEIGHT, 32, 0, 0, 0, 0) };
+        set_render_surface_format(screen->format);
+        print_stats(prefix + "32 bit offscreen", time_scrolling(path, sys_styling, token_view_styling, screen.get(), video, SW_BTN_RIGHT, false, false));
+    }
+    {
+        surface_unique_ptr screen = create_surface_in_format(SDL_SWSURFACE, SCREEN_WIDTH, SCREEN_HEIGHT, video->format);
+        set_render_surface_format(screen->format);
+        print_stats(prefix + "display format offscreen", time_scrolling(path, sys_styling, token_view_styling, screen.get(), video, SW_BTN_RIGHT, false, false));
+    }
+    set_render_surface_format(video->format);
+    print_stats(prefix + "render into display", time_scrolling(path, sys_styling, token_view_styling, video, video, SW_BTN_RIGHT, true, false));
+}
+
+} // namespace
+
+// Compare per frame cost of held key scrolling with full and incremental
+// rendering, of page turns with and without prerendering while idle, and of
+// page turns with each way of matching the render format to 16 and 32 bit
+// displays. Runs on SDL's dummy video driver unless another is set.
+void scroll_bench(std::string font_path, std::string path)
+{
+    setenv("SDL_VIDEODRIVER", "dummy", 0);
+
+    SDL_Init(SDL_INIT_VIDEO);
+    TTF_Init();
+
+    SDL_Surface *video = SDL_SetVideoMode(SCREEN_WIDTH, SCREEN_HEIGHT, 32, SDL_SWSURFACE);
+    SDL_Surface *screen = SDL_CreateRGBSurface(SDL_SWSURFACE, SCREEN_WIDTH, SCREEN_HEIGHT, 32, 0, 0, 0, 0);
+    set_render_surface_format(screen->format);
+
+    {
+        SystemStyling sys_styling(font_path, DEFAULT_FONT_SIZE, DEFAULT_COLOR_THEME, DEFAULT_SHOULDER_KEYMAP);
+        TokenViewStyling token_view_styling(true, DEFAULT_PROGRESS_REPORTING);
+
+        print_stats("Line scroll, full render", time_scrolling(path, sys_styling, token_view_styling, screen, video, SW_BTN_DOWN, true, false));
+        print_stats("Line scroll, incremental render", time_scrolling(path, sys_styling, token_view_styling, screen, video, SW_BTN_DOWN, false, false));
+        print_stats("Page turn", time_scrolling(path, sys_styling, token_view_styling, screen, video, SW_BTN_RIGHT, false, false));
+        print_stats("Page turn, prerendered while idle", time_scrolling(path, sys_styling, token_view_styling, screen, video, SW_BTN_RIGHT, false, true));
+
+        // Sets new video modes, so last
+        SDL_FreeSurface(screen);
+        for (int bpp : {16, 32})
+        {
+            compare_render_formats(path, sys_styling, token_view_styling, bpp);
+        }
+    }
+
+    TTF_Quit();
+    SDL_Quit();
+}
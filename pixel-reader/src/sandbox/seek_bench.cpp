@@ -0,0 +1,117 @@
+#include "doc_api/token_addressing.h"
+#include "doc_api/token_table.h"
+#include "filetypes/txt/txt_reader.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t NUM_SEEKS = 1000;
+
+uint32_t elapsed_us(Clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+// Seek as done before binary search, for comparison
+uint32_t linear_seek_index(const TokenTable &tokens, DocAddr address)
+{
+    uint32_t index = 0;
+    for (uint32_t i = 0; i < tokens.size(); ++i)
+    {
+        DocAddr other_address = tokens.address(i);
+        if (other_address <= address)
+        {
+            index = i;
+            if (other_address == address)
+            {
+                break;
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+    return index;
+}
+
+} // namespace
+
+// Time random seeks over a synthetic document of num_lines lines, through a
+// token table directly and end to end through a txt file.
+void seek_bench(uint32_t num_lines)
+{
+    std::mt19937 rng(1234);
+
+    const std::string line = "The quick brown fox jumps over the lazy dog.";
+    const uint32_t line_width = get_address_width(line);
+    TokenTable tokens;
+    DocAddr address = 0;
+    for (uint32_t i = 0; i < num_lines; ++i)
+    {
+        // Empty tokens give duplicate addresses, as with paragraph breaks
+        tokens.push_back(TokenType::Text, address, "");
+        tokens.push_back(TokenType::Text, address, line);
+        address += line_width;
+    }
+    std::uniform_int_distribution<DocAddr> addr_dist(0, address);
+
+    std::vector<DocAddr> seek_addrs;
+    for (uint32_t i = 0; i < NUM_SEEKS; ++i)
+    {
+        seek_addrs.push_back(addr_dist(rng));
+    }
+
+    uint64_t check = 0;
+    auto start = Clock::now();
+    for (DocAddr seek_addr : seek_addrs)
+    {
+        check += linear_seek_index(tokens, seek_addr);
+    }
+    uint32_t linear_us = elapsed_us(start);
+
+    start = Clock::now();
+    for (DocAddr seek_addr : seek_addrs)
+    {
+        check -= tokens.seek_index(seek_addr);
+    }
+    uint32_t binary_us = elapsed_us(start);
+
+    if (check != 0)
+    {
+        std::cerr << "Linear and binary seek results differ" << std::endl;
+    }
+
+    // End to end through a txt file
+    const std::string txt_path = "seek_bench.txt";
+    {
+        std::ofstream fp(txt_path);
+        for (uint32_t i = 0; i < num_lines; ++i)
+        {
+            fp << line << "\n";
+        }
+    }
+
+    TxtReader reader(txt_path);
+    reader.open();
+
+    start = Clock::now();
+    for (DocAddr seek_addr : seek_addrs)
+    {
+        reader.get_iter(seek_addr)->read(1);
+    }
+    uint32_t txt_us = elapsed_us(start);
+
+    std::cerr << "Tokens: " << tokens.size() << ", seeks: " << NUM_SEEKS << std::endl;
+    std::cerr << "Linear seek us: " << linear_us << std::endl;
+    std::cerr << "Binary seek us: " << binary_us << std::endl;
+    std::cerr << "Txt get_iter us: " << txt_us << std::endl;
+}
@@ -0,0 +1,91 @@
+#include "util/text_scan.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t NUM_ROUNDS = 20;
+
+uint32_t elapsed_us(Clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+double mb_per_sec(uint64_t bytes, uint32_t us)
+{
+    return us ? static_cast<double>(bytes) / us : 0;
+}
+
+} // namespace
+
+// Compare throughput of the text scanning kernels against their scalar
+// versions, over the contents of a file (e.g. an extracted xhtml chapter).
+void text_scan_bench(std::string path)
+{
+    std::string text;
+    {
+        std::ifstream fp(path, std::ios::binary);
+        if (!fp)
+        {
+            std::cerr << "Unable to open " << path << std::endl;
+            return;
+        }
+        std::stringstream buffer;
+        buffer << fp.rdbuf();
+        text = buffer.str();
+    }
+    uint64_t total_bytes = static_cast<uint64_t>(text.size()) * NUM_ROUNDS;
+
+    uint64_t scalar_count = 0;
+    auto start = Clock::now();
+    for (uint32_t i = 0; i < NUM_ROUNDS; ++i)
+    {
+        scalar_count += count_non_whitespace_chars_scalar(text.data(), text.size());
+    }
+    uint32_t scalar_count_us = elapsed_us(start);
+
+    uint64_t count = 0;
+    start = Clock::now();
+    for (uint32_t i = 0; i < NUM_ROUNDS; ++i)
+    {
+        count += count_non_whitespace_chars(text.data(), text.size());
+    }
+    uint32_t count_us = elapsed_us(start);
+
+    std::string out(text.size(), '\0');
+    uint64_t scalar_size = 0;
+    start = Clock::now();
+    for (uint32_t i = 0; i < NUM_ROUNDS; ++i)
+    {
+        bool last_was_whitespace = false;
+        scalar_size += collapse_whitespace_scalar(text.data(), text.size(), &out[0], last_was_whitespace);
+    }
+    uint32_t scalar_collapse_us = elapsed_us(start);
+
+    uint64_t size = 0;
+    start = Clock::now();
+    for (uint32_t i = 0; i < NUM_ROUNDS; ++i)
+    {
+        bool last_was_whitespace = false;
+        size += collapse_whitespace(text.data(), text.size(), &out[0], last_was_whitespace);
+    }
+    uint32_t collapse_us = elapsed_us(start);
+
+    if (count != scalar_count || size != scalar_size)
+    {
+        std::cerr << "Kernel and scalar results differ" << std::endl;
+    }
+
+    std::cerr << "Bytes: " << text.size() << ", rounds: " << NUM_ROUNDS << std::endl;
+    std::cerr << "Count scalar MB/s: " << mb_per_sec(total_bytes, scalar_count_us) << std::endl;
+    std::cerr << "Count MB/s: " << mb_per_sec(total_bytes, count_us) << std::endl;
+    std::cerr << "Collapse scalar MB/s: " << mb_per_sec(total_bytes, scalar_collapse_us) << std::endl;
+    std::cerr << "Collapse MB/s: " << mb_per_sec(total_bytes, collapse_us) << std::endl;
+}
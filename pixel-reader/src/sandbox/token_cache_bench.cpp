@@ -0,0 +1,107 @@
+#include "filetypes/epub/epub_token_cache.h"
+#include "filetypes/epub/xhtml_parser.h"
+#include "filetypes/epub/zip_xhtml_source.h"
+#include "reader/config.h"
+#include "reader/ss_doc_reader_cache.h"
+#include "reader/state_store.h"
+#include "util/zip_archive.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+uint32_t elapsed_us(Clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+bool is_xhtml(const std::string &name)
+{
+    for (const char *ext : {".xhtml", ".html", ".htm"})
+    {
+        std::string suffix(ext);
+        if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+// Compare parsing each xhtml document in an epub from scratch against
+// loading its tokens from the persistent token cache.
+void token_cache_bench(std::string path)
+{
+    ZipArchive zip(path);
+    if (!zip.open())
+    {
+        std::cerr << "Unable to open " << path << std::endl;
+        return;
+    }
+
+    StateStore store("store", READER_CACHE_BLOB_SIZE_BYTES);
+    SSDocReaderCache cache(store);
+    const std::string book_id = "token_cache_bench";
+
+    uint64_t total_parse_us = 0;
+    uint64_t total_load_us = 0;
+    uint32_t spine_index = 0;
+
+    std::cerr << "document, tokens, cache bytes, parse us, load us" << std::endl;
+
+    for (const auto &name : zip.entry_names())
+    {
+        if (!is_xhtml(name))
+        {
+            continue;
+        }
+
+        // Cold: inflate and parse
+        auto start = Clock::now();
+        TokenTable tokens;
+        std::unordered_map<std::string, DocAddr> ids;
+        {
+            auto source = open_zip_xhtml_source(zip, name);
+            if (source)
+            {
+                parse_xhtml_tokens(std::move(source), name, spine_index, tokens, ids);
+            }
+        }
+        uint32_t parse_us = elapsed_us(start);
+
+        auto key = spine_tokens_cache_key(spine_index);
+        auto encoded = encode_spine_tokens(spine_index, tokens, ids);
+        cache.write_blob(book_id, key, encoded);
+
+        // Warm: read from cache and decode
+        start = Clock::now();
+        TokenTable cached_tokens;
+        std::unordered_map<std::string, DocAddr> cached_ids;
+        {
+            auto blob = cache.read_blob(book_id, key);
+            if (!blob || !try_decode_spine_tokens(*blob, spine_index, cached_tokens, cached_ids))
+            {
+                std::cerr << "Unable to load cached tokens for " << name << std::endl;
+            }
+        }
+        uint32_t load_us = elapsed_us(start);
+
+        std::cerr << name << ", " << tokens.size() << ", " << encoded.size() << ", " << parse_us << ", " << load_us << std::endl;
+
+        total_parse_us += parse_us;
+        total_load_us += load_us;
+        ++spine_index;
+    }
+
+    std::cerr << std::endl;
+    std::cerr << "Total documents: " << spine_index << std::endl;
+    std::cerr << "Total parse us: " << total_parse_us << std::endl;
+    std::cerr << "Total load us: " << total_load_us << std::endl;
+}
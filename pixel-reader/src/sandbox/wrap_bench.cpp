@@ -0,0 +1,103 @@
+#include "reader/text_wrap.h"
+#include "reader/views/token_view/ttf_line_fitter.h"
+#include "util/sdl_font_cache.h"
+
+#include <SDL/SDL_ttf.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int LINE_WIDTH = 640 - 8;
+constexpr uint32_t FONT_SIZES[] = {16, 20, 24, 28, 32};
+
+uint32_t elapsed_us(Clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+// Line fitting as done before the glyph cache, sizing every candidate from scratch
+bool sdl_line_fits(TTF_Font *font, const char *s, uint32_t len)
+{
+    std::string line(s, len);
+    int w = LINE_WIDTH, h;
+    TTF_SizeUTF8(font, line.c_str(), &w, &h);
+    return w <= LINE_WIDTH;
+}
+
+} // namespace
+
+// Time wrapping each line of a text file to the screen width at several font
+// sizes, sizing with SDL_ttf directly and with cached glyph metrics.
+void wrap_bench(std::string font_path, std::string path)
+{
+    std::vector<std::string> paragraphs;
+    {
+        std::ifstream fp(path);
+        if (!fp)
+        {
+            std::cerr << "Unable to open " << path << std::endl;
+            return;
+        }
+        std::string line;
+        while (std::getline(fp, line))
+        {
+            paragraphs.push_back(line);
+        }
+    }
+
+    TTF_Init();
+
+    for (uint32_t font_size : FONT_SIZES)
+    {
+        TTF_Font *font = cached_load_font(font_path, font_size, FontLoadErrorOpt::NoThrow);
+        if (!font)
+        {
+            std::cerr << "Unable to load " << font_path << std::endl;
+            break;
+        }
+
+        std::vector<uint32_t> sdl_breaks;
+        auto start = Clock::now();
+        for (const auto &paragraph : paragraphs)
+        {
+            wrap_lines(
+                paragraph.c_str(),
+                [font](const char *s, uint32_t len) { return sdl_line_fits(font, s, len); },
+                [&sdl_breaks](const char *, uint32_t len) { sdl_breaks.push_back(len); }
+            );
+        }
+        uint32_t sdl_us = elapsed_us(start);
+
+        std::vector<uint32_t> breaks;
+        TTFLineFitter line_fitter(font, LINE_WIDTH);
+        start = Clock::now();
+        for (const auto &paragraph : paragraphs)
+        {
+            wrap_lines(
+                paragraph.c_str(),
+                line_fitter,
+                [&breaks](const char *, uint32_t len) { breaks.push_back(len); }
+            );
+        }
+        uint32_t cached_us = elapsed_us(start);
+
+        if (breaks != sdl_breaks)
+        {
+            std::cerr << "Line breaks differ at size " << font_size << std::endl;
+        }
+
+        std::cerr << "Size " << font_size << ", lines: " << breaks.size() << std::endl;
+        std::cerr << "  TTF_SizeUTF8 us: " << sdl_us << std::endl;
+        std::cerr << "  Glyph cache us: " << cached_us << std::endl;
+    }
+
+    TTF_Quit();
+}
@@ -0,0 +1,660 @@
+#include "./image_decode.h"
+#include "./image_resample.h"
+#include "./sdl_utils.h"
+
+#include "extern/rotozoom/SDL_rotozoom.h"
+
+#include <SDL/SDL_video.h>
+#include <jpeglib.h>
+#include <png.h>
+
+#include <cmath>
+#include <csetjmp>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+
+uint32_t read_be16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+uint32_t read_be32(const uint8_t *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+uint32_t read_le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+uint32_t read_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+const uint8_t PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+bool is_png(const uint8_t *data, uint32_t size)
+{
+    return size >= sizeof(PNG_SIGNATURE) && std::memcmp(data, PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) == 0;
+}
+
+bool is_jpeg(const uint8_t *data, uint32_t size)
+{
+    return size >= 3 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff;
+}
+
+std::experimental::optional<ImageSize> probe_png(const uint8_t *data, uint32_t size)
+{
+    // Signature, then IHDR chunk: length, type, width, height
+    if (size < 24 || std::memcmp(data + 12, "IHDR", 4) != 0)
+    {
+        return std::experimental::nullopt;
+    }
+    return ImageSize{read_be32(data + 16), read_be32(data + 20)};
+}
+
+std::experimental::optional<ImageSize> probe_jpeg(const uint8_t *data, uint32_t size)
+{
+    uint32_t pos = 2;
+    while (pos + 4 <= size)
+    {
+        if (data[pos] != 0xff)
+        {
+            return std::experimental::nullopt;
+        }
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xff)
+        {
+            // Fill byte
+            ++pos;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7))
+        {
+            // No length
+            pos += 2;
+            continue;
+        }
+
+        uint32_t length = read_be16(data + pos + 2);
+        bool is_sof = marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc;
+        if (is_sof)
+        {
+            // Length, precision, height, width
+            if (pos + 9 > size)
+            {
+                return std::experimental::nullopt;
+            }
+            return ImageSize{read_be16(data + pos + 7), read_be16(data + pos + 5)};
+        }
+        if (marker == 0xd9 || marker == 0xda || length < 2)
+        {
+            // End of image, or start of scan, before a frame header
+            return std::experimental::nullopt;
+        }
+        pos += 2 + length;
+    }
+    return std::experimental::nullopt;
+}
+
+std::experimental::optional<ImageSize> probe_gif(const uint8_t *data, uint32_t size)
+{
+    if (size < 10 || (std::memcmp(data, "GIF87a", 6) != 0 && std::memcmp(data, "GIF89a", 6) != 0))
+    {
+        return std::experimental::nullopt;
+    }
+    return ImageSize{read_le16(data + 6), read_le16(data + 8)};
+}
+
+std::experimental::optional<ImageSize> probe_bmp(const uint8_t *data, uint32_t size)
+{
+    if (size < 26 || data[0] != 'B' || data[1] != 'M')
+    {
+        return std::experimental::nullopt;
+    }
+
+    uint32_t header_size = read_le32(data + 14);
+    if (header_size == 12)
+    {
+        // OS/2 core header
+        return ImageSize{read_le16(data + 18), read_le16(data + 20)};
+    }
+
+    // Height is negative for top down images
+    int32_t height = static_cast<int32_t>(read_le32(data + 22));
+    return ImageSize{read_le32(data + 18), static_cast<uint32_t>(height < 0 ? -height : height)};
+}
+
+// 8 bit RGBA in memory order, as with rotozoom, on little endian
+surface_unique_ptr create_rgba_surface(ImageSize size)
+{
+    return surface_unique_ptr {
+        SDL_CreateRGBSurface(SDL_SWSURFACE, size.w, size.h, 32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000)
+    };
+}
+
+// Feeds an image's rows, decoded to 8 bit RGBA, to a RowDownscaler. Errors
+// are reported by returning false, after which the source can't be used.
+class RowSource
+{
+public:
+    virtual ~RowSource() = default;
+
+    // Start decoding, at least as large as target
+    virtual bool open(const uint8_t *data, uint32_t size, ImageSize target) = 0;
+    // Size of the rows given, once open
+    virtual ImageSize size() const = 0;
+    // Add rows until the scaler's next row is end_row, or it's done
+    virtual bool read_rows(RowDownscaler &scaler, uint32_t end_row) = 0;
+};
+
+////////////////////////
+// JPEG
+
+struct JpegErrorManager
+{
+    jpeg_error_mgr mgr;
+    jmp_buf jump;
+};
+
+void jpeg_error_exit(j_common_ptr cinfo)
+{
+    char message[JMSG_LENGTH_MAX];
+    cinfo->err->format_message(cinfo, message);
+    std::cerr << "JPEG decode failed: " << message << std::endl;
+
+    longjmp(reinterpret_cast<JpegErrorManager *>(cinfo->err)->jump, 1);
+}
+
+void jpeg_output_message(j_common_ptr)
+{
+    // Warnings aren't worth reporting
+}
+
+// Largest scale down the codec can do while decoding, that still leaves the
+// image at least as large as target
+int jpeg_scale_denom(const jpeg_decompress_struct &cinfo, ImageSize target)
+{
+    for (int denom = 8; denom > 1; denom /= 2)
+    {
+        if ((cinfo.image_width + denom - 1) / denom >= target.w &&
+            (cinfo.image_height + denom - 1) / denom >= target.h)
+        {
+            return denom;
+        }
+    }
+    return 1;
+}
+
+class JpegSource : public RowSource
+{
+    jpeg_decompress_struct cinfo;
+    JpegErrorManager error;
+    bool created = false;
+
+    std::vector<uint8_t> scanline;
+    std::vector<uint8_t> rgba_row;
+
+public:
+    ~JpegSource() override
+    {
+        if (created)
+        {
+            jpeg_destroy_decompress(&cinfo);
+        }
+    }
+
+    bool open(const uint8_t *data, uint32_t size, ImageSize target) override
+    {
+        cinfo.err = jpeg_std_error(&error.mgr);
+        error.mgr.error_exit = jpeg_error_exit;
+        error.mgr.output_message = jpeg_output_message;
+        if (setjmp(error.jump))
+        {
+            return false;
+        }
+
+        jpeg_create_decompress(&cinfo);
+        created = true;
+        jpeg_mem_src(&cinfo, const_cast<uint8_t *>(data), size);
+        jpeg_read_header(&cinfo, TRUE);
+
+        if (cinfo.num_components != 1 && cinfo.num_components != 3)
+        {
+            // e.g. CMYK, which can't be output as RGB
+            return false;
+        }
+
+        cinfo.out_color_space = cinfo.num_components == 1 ? JCS_GRAYSCALE : JCS_RGB;
+        cinfo.scale_num = 1;
+        cinfo.scale_denom = jpeg_scale_denom(cinfo, target);
+        jpeg_start_decompress(&cinfo);
+
+        if (cinfo.output_width < target.w || cinfo.output_height < target.h)
+        {
+            // Header disagrees with what decoding gives
+            return false;
+        }
+
+        scanline.resize(cinfo.output_width * cinfo.output_components);
+        rgba_row.resize(cinfo.output_width * 4);
+        return true;
+    }
+
+    ImageSize size() const override
+    {
+        return {cinfo.output_width, cinfo.output_height};
+    }
+
+    bool read_rows(RowDownscaler &scaler, uint32_t end_row) override
+    {
+        if (setjmp(error.jump))
+        {
+            return false;
+        }
+
+        const uint32_t width = cinfo.output_width;
+        const uint32_t components = cinfo.output_components;
+        while (!scaler.done() && scaler.next_row() < end_row)
+        {
+            JSAMPROW row = scanline.data();
+            jpeg_read_scanlines(&cinfo, &row, 1);
+
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                const uint8_t *src = &scanline[x * components];
+                uint8_t *dst = &rgba_row[x * 4];
+                dst[0] = src[0];
+                dst[1] = src[components == 1 ? 0 : 1];
+                dst[2] = src[components == 1 ? 0 : 2];
+                dst[3] = 0xff;
+            }
+            scaler.add_row(rgba_row.data());
+        }
+        return true;
+    }
+};
+
+////////////////////////
+// PNG
+
+struct PngMemory
+{
+    const uint8_t *data;
+    uint32_t size;
+    uint32_t pos;
+};
+
+void png_read_from_memory(png_structp png, png_bytep out, png_size_t count)
+{
+    auto *source = static_cast<PngMemory *>(png_get_io_ptr(png));
+    if (count > source->size - source->pos)
+    {
+        png_error(png, "Read past end of data");
+    }
+    std::memcpy(out, source->data + source->pos, count);
+    source->pos += count;
+}
+
+void png_report_error(png_structp png, png_const_charp message)
+{
+    std::cerr << "PNG decode failed: " << message << std::endl;
+    png_longjmp(png, 1);
+}
+
+void png_report_warning(png_structp, png_const_charp)
+{
+}
+
+class PngSource : public RowSource
+{
+    png_structp png = nullptr;
+    png_infop info = nullptr;
+    PngMemory memory {nullptr, 0, 0};
+
+    std::vector<uint8_t> row;
+
+public:
+    ~PngSource() override
+    {
+        if (png)
+        {
+            png_destroy_read_struct(&png, info ? &info : nullptr, nullptr);
+        }
+    }
+
+    bool open(const uint8_t *data, uint32_t size, ImageSize target) override
+    {
+        png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, png_report_error, png_report_warning);
+        if (!png)
+        {
+            return false;
+        }
+        info = png_create_info_struct(png);
+        if (!info)
+        {
+            return false;
+        }
+        if (setjmp(png_jmpbuf(png)))
+        {
+            return false;
+        }
+
+        memory = {data, size, 0};
+        png_set_read_fn(png, &memory, png_read_from_memory);
+        png_read_info(png, info);
+
+        if (png_get_image_width(png, info) < target.w ||
+            png_get_image_height(png, info) < target.h ||
+            png_get_interlace_type(png, info) != PNG_INTERLACE_NONE)
+        {
+            // Interlaced images need every row at once
+            return false;
+        }
+
+        // Whatever the source, read as 8 bit RGBA
+        png_set_expand(png);
+        png_set_strip_16(png);
+        png_set_gray_to_rgb(png);
+        png_set_filler(png, 0xff, PNG_FILLER_AFTER);
+        png_read_update_info(png, info);
+
+        row.resize(png_get_image_width(png, info) * 4);
+        return true;
+    }
+
+    ImageSize size() const override
+    {
+        return {png_get_image_width(png, info), png_get_image_height(png, info)};
+    }
+
+    bool read_rows(RowDownscaler &scaler, uint32_t end_row) override
+    {
+        if (setjmp(png_jmpbuf(png)))
+        {
+            return false;
+        }
+
+        while (!scaler.done() && scaler.next_row() < end_row)
+        {
+            png_read_row(png, row.data(), nullptr);
+            scaler.add_row(row.data());
+        }
+        return true;
+    }
+};
+
+////////////////////////
+
+// Decode in full, then scale
+surface_unique_ptr decode_and_zoom(const char *data, uint32_t size, const std::string &img_format, uint32_t max_width, SDL_PixelFormat *format)
+{
+    auto surface = load_surface_from_ptr(data, size, img_format, format);
+    if (!surface || surface->w <= 0)
+    {
+        return nullptr;
+    }
+
+    ImageSize scaled = fit_image_to_width({static_cast<uint32_t>(surface->w), static_cast<uint32_t>(surface->h)}, max_width);
+    if (scaled.w == static_cast<uint32_t>(surface->w))
+    {
+        return surface;
+    }
+
+    auto resampled = resample_surface(surface.get(), scaled.w, scaled.h);
+    if (resampled)
+    {
+        return resampled;
+    }
+
+    // Zoomed surfaces come back 32 bit, convert so drawing doesn't have to
+    float scale = max_width / static_cast<float>(surface->w);
+    return convert_surface_to_format(
+        surface_unique_ptr { zoomSurface(surface.get(), scale, scale, 1) },
+        format
+    );
+}
+
+} // namespace
+
+std::experimental::optional<ImageSize> probe_image_size(const char *data, uint32_t size)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+
+    std::experimental::optional<ImageSize> image_size;
+    if (is_png(bytes, size))
+    {
+        image_size = probe_png(bytes, size);
+    }
+    else if (is_jpeg(bytes, size))
+    {
+        image_size = probe_jpeg(bytes, size);
+    }
+    else if (size >= 2 && bytes[0] == 'G')
+    {
+        image_size = probe_gif(bytes, size);
+    }
+    else if (size >= 2 && bytes[0] == 'B')
+    {
+        image_size = probe_bmp(bytes, size);
+    }
+
+    if (image_size && (image_size->w == 0 || image_size->h == 0))
+    {
+        return std::experimental::nullopt;
+    }
+    return image_size;
+}
+
+ImageSize fit_image_to_width(ImageSize size, uint32_t max_width)
+{
+    if (size.w <= max_width)
+    {
+        return size;
+    }
+
+    // Rounded as zoomSurface does
+    float scale = max_width / static_cast<float>(size.w);
+    return {
+        std::max<uint32_t>(std::floor(size.w * static_cast<double>(scale) + 0.5), 1),
+        std::max<uint32_t>(std::floor(size.h * static_cast<double>(scale) + 0.5), 1)
+    };
+}
+
+surface_unique_ptr decode_image_to_fit(
+    const char *data,
+    uint32_t size,
+    const std::string &img_format,
+    uint32_t max_width,
+    SDL_PixelFormat *format
+)
+{
+    ImageStripDecoder decoder(data, size, max_width);
+    if (decoder.is_open())
+    {
+        auto surface = decoder.decode_rows(0, decoder.size().h, format);
+        if (surface)
+        {
+            return surface;
+        }
+    }
+    return decode_and_zoom(data, size, img_format, max_width, format);
+}
+
+////////////////////////
+
+struct ImageStripDecoder::State
+{
+    std::unique_ptr<RowSource> source;
+    std::experimental::optional<RowDownscaler> scaler;
+    ImageSize size {0, 0};
+};
+
+ImageStripDecoder::ImageStripDecoder(const char *data, uint32_t size, uint32_t max_width)
+    : state(std::make_unique<State>())
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+    auto image_size = probe_image_size(data, size);
+    if (!image_size)
+    {
+        return;
+    }
+
+    if (is_png(bytes, size))
+    {
+        state->source = std::make_unique<PngSource>();
+    }
+    else if (is_jpeg(bytes, size))
+    {
+        state->source = std::make_unique<JpegSource>();
+    }
+
+    ImageSize target = fit_image_to_width(*image_size, max_width);
+    if (!state->source || !state->source->open(bytes, size, target))
+    {
+        state->source = nullptr;
+        return;
+    }
+
+    ImageSize source_size = state->source->size();
+    state->scaler.emplace(source_size.w, source_size.h, target.w, target.h, nullptr, 0);
+    state->size = target;
+}
+
+ImageStripDecoder::~ImageStripDecoder()
+{
+}
+
+bool ImageStripDecoder::is_open() const
+{
+    return state->source != nullptr;
+}
+
+ImageSize ImageStripDecoder::size() const
+{
+    return state->size;
+}
+
+uint32_t ImageStripDecoder::next_row() const
+{
+    return state->scaler ? state->scaler->next_row() : 0;
+}
+
+surface_unique_ptr ImageStripDecoder::decode_rows(uint32_t y, uint32_t h, SDL_PixelFormat *format)
+{
+    if (!is_open() || y < next_row() || y >= state->size.h)
+    {
+        return nullptr;
+    }
+    h = std::min(h, state->size.h - y);
+
+    surface_unique_ptr surface = create_rgba_surface({state->size.w, h});
+    if (!surface)
+    {
+        return nullptr;
+    }
+
+    auto &scaler = *state->scaler;
+    scaler.set_output(static_cast<uint8_t *>(surface->pixels), surface->pitch, y, h);
+    bool ok = state->source->read_rows(scaler, y + h);
+    scaler.set_output(nullptr, 0, 0, 0);
+
+    if (!ok)
+    {
+        state->source = nullptr;
+        return nullptr;
+    }
+    return convert_surface_to_format(std::move(surface), format);
+}
+
+////////////////////////
+
+RowDownscaler::RowDownscaler(uint32_t src_w, uint32_t src_h, uint32_t dst_w, uint32_t dst_h, uint8_t *dst, uint32_t dst_pitch)
+    : src_w(src_w),
+      src_h(src_h),
+      dst_w(std::min(dst_w, src_w)),
+      dst_h(std::min(dst_h, src_h)),
+      dst(dst),
+      dst_pitch(dst_pitch),
+      out_num_rows(this->dst_h),
+      src_columns(this->dst_w),
+      sums(this->dst_w * 4)
+{
+    for (uint32_t x = 0; x < src_w; ++x)
+    {
+        ++src_columns[static_cast<uint64_t>(x) * this->dst_w / src_w];
+    }
+}
+
+uint32_t RowDownscaler::dst_row(uint32_t y) const
+{
+    return static_cast<uint64_t>(y) * dst_h / src_h;
+}
+
+bool RowDownscaler::is_output(uint32_t y) const
+{
+    return y >= out_first_row && y - out_first_row < out_num_rows;
+}
+
+void RowDownscaler::write_row(uint32_t y)
+{
+    uint8_t *out = dst + (y - out_first_row) * dst_pitch;
+    for (uint32_t x = 0; x < dst_w; ++x)
+    {
+        uint32_t count = src_columns[x] * src_rows;
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            uint32_t &sum = sums[x * 4 + c];
+            out[x * 4 + c] = (sum + count / 2) / count;
+            sum = 0;
+        }
+    }
+    src_rows = 0;
+}
+
+void RowDownscaler::set_output(uint8_t *dst, uint32_t dst_pitch, uint32_t first_row, uint32_t num_rows)
+{
+    this->dst = dst;
+    this->dst_pitch = dst_pitch;
+    out_first_row = first_row;
+    out_num_rows = num_rows;
+}
+
+void RowDownscaler::add_row(const uint8_t *row)
+{
+    if (done())
+    {
+        return;
+    }
+
+    const uint32_t y = dst_row(src_y);
+    const bool is_wanted = is_output(y);
+    if (is_wanted)
+    {
+        // Each destination column's source columns are consecutive
+        sum_pixel_blocks(row, src_columns.data(), dst_w, sums.data());
+        ++src_rows;
+    }
+    ++src_y;
+
+    // Write out once the next row belongs to another destination row
+    if (is_wanted && (src_y == src_h || dst_row(src_y) != y))
+    {
+        write_row(y);
+    }
+}
+
+uint32_t RowDownscaler::next_row() const
+{
+    return done() ? dst_h : dst_row(src_y);
+}
+
+bool RowDownscaler::done() const
+{
+    return src_y == src_h;
+}
@@ -0,0 +1,101 @@
+#ifndef IMAGE_DECODE_H_
+#define IMAGE_DECODE_H_
+
+#include "./sdl_pointer.h"
+
+#include <cstdint>
+#include <experimental/optional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct ImageSize
+{
+    uint32_t w;
+    uint32_t h;
+};
+
+// Dimensions from the image's header, without decoding it. Knows PNG, JPEG,
+// GIF and BMP.
+std::experimental::optional<ImageSize> probe_image_size(const char *data, uint32_t size);
+
+// Size of an image once scaled down to fit max_width, as decode_image_to_fit
+// makes it
+ImageSize fit_image_to_width(ImageSize size, uint32_t max_width);
+
+// Decode image scaled down to fit max_width, in format. PNG and JPEG are
+// scaled as they're decoded, so a large image never exists at full size.
+// Others are decoded in full, then zoomed. Safe to call from any thread.
+surface_unique_ptr decode_image_to_fit(
+    const char *data,
+    uint32_t size,
+    const std::string &img_format,
+    uint32_t max_width,
+    SDL_PixelFormat *format
+);
+
+// Decodes a PNG or JPEG scaled down to fit max_width a strip of rows at a
+// time, from the top. Only the decoder's state is kept between strips, so an
+// image of any height takes the memory of a strip. Data must outlive it.
+class ImageStripDecoder
+{
+    struct State;
+    std::unique_ptr<State> state;
+
+public:
+    ImageStripDecoder(const char *data, uint32_t size, uint32_t max_width);
+    ImageStripDecoder(const ImageStripDecoder &) = delete;
+    ImageStripDecoder &operator=(const ImageStripDecoder &) = delete;
+    ~ImageStripDecoder();
+
+    // False for other formats, interlaced PNGs, or after an error
+    bool is_open() const;
+    // Scaled size
+    ImageSize size() const;
+    // First row not yet decoded. Rows can't be decoded again.
+    uint32_t next_row() const;
+
+    // Rows [y, y + h) of the scaled image, cut short at the bottom, in
+    // format. Rows between next_row() and y are decoded and dropped.
+    surface_unique_ptr decode_rows(uint32_t y, uint32_t h, SDL_PixelFormat *format);
+};
+
+// Box filter fed rows of 8 bit RGBA pixels one at a time, each destination
+// pixel the average of the block of source pixels it covers. Only scales
+// down, or not at all.
+class RowDownscaler
+{
+    const uint32_t src_w;
+    const uint32_t src_h;
+    const uint32_t dst_w;
+    const uint32_t dst_h;
+    uint8_t *dst;
+    uint32_t dst_pitch;
+    uint32_t out_first_row = 0;         // destination row written at dst
+    uint32_t out_num_rows;
+
+    std::vector<uint32_t> src_columns;  // source columns per destination column
+    std::vector<uint32_t> sums;         // per destination channel, over the rows added
+    uint32_t src_y = 0;
+    uint32_t src_rows = 0;              // source rows in sums
+
+    uint32_t dst_row(uint32_t y) const;
+    bool is_output(uint32_t y) const;
+    void write_row(uint32_t y);
+
+public:
+    // Destination rows of dst_w RGBA pixels are written dst_pitch bytes apart
+    RowDownscaler(uint32_t src_w, uint32_t src_h, uint32_t dst_w, uint32_t dst_h, uint8_t *dst, uint32_t dst_pitch);
+
+    // Write only destination rows [first_row, first_row + num_rows), the
+    // first at dst. Source rows for the others are skipped.
+    void set_output(uint8_t *dst, uint32_t dst_pitch, uint32_t first_row, uint32_t num_rows);
+
+    void add_row(const uint8_t *row);
+    // Destination row the next source row goes to
+    uint32_t next_row() const;
+    // All source rows added
+    bool done() const;
+};
+
+#endif
@@ -0,0 +1,324 @@
+#include "./image_disk_cache.h"
+
+#include "./sdl_utils.h"
+
+#include <fcntl.h>
+#include <SDL/SDL_video.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// Bump whenever the entry format, or how images are scaled, change
+#define IMAGE_DISK_CACHE_VERSION 1
+
+namespace
+{
+
+constexpr char ENTRY_MAGIC[4] = {'P', 'R', 'I', 'C'};
+
+// Followed by the key, then h rows of pitch bytes
+struct EntryHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t key_size;
+    uint32_t w;
+    uint32_t h;
+    uint32_t pitch;
+    uint32_t bits_per_pixel;
+    uint32_t masks[4];
+};
+
+// FNV-1a
+uint64_t key_hash(const std::string &key)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : key)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool has_masks(const EntryHeader &header, const SDL_PixelFormat *format)
+{
+    return (
+        header.bits_per_pixel == format->BitsPerPixel &&
+        header.masks[0] == format->Rmask &&
+        header.masks[1] == format->Gmask &&
+        header.masks[2] == format->Bmask &&
+        header.masks[3] == format->Amask
+    );
+}
+
+// Opens the entry for key, leaving in at its pixels. Entries for another key,
+// or whose size doesn't match their header, are treated as missing.
+std::experimental::optional<EntryHeader> open_entry(const std::experimental::filesystem::path &path, const std::string &key, std::ifstream &in)
+{
+    in.open(path, std::ios::binary | std::ios::ate);
+    if (!in)
+    {
+        return std::experimental::nullopt;
+    }
+    const uint64_t file_size = in.tellg();
+    in.seekg(0);
+
+    EntryHeader header;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC)) != 0 ||
+        header.version != IMAGE_DISK_CACHE_VERSION ||
+        header.key_size != key.size())
+    {
+        return std::experimental::nullopt;
+    }
+
+    std::string entry_key(header.key_size, '\0');
+    if (!in.read(&entry_key[0], entry_key.size()) || entry_key != key)
+    {
+        return std::experimental::nullopt;
+    }
+
+    const uint32_t row_bytes = header.w * ((header.bits_per_pixel + 7) / 8);
+    if (!header.w || !header.h || header.pitch < row_bytes ||
+        file_size != sizeof(header) + header.key_size + static_cast<uint64_t>(header.pitch) * header.h)
+    {
+        return std::experimental::nullopt;
+    }
+
+    return header;
+}
+
+// Last use is marked in both access and modify times, as FAT only keeps the
+// date of access
+time_t last_used(const struct stat &st)
+{
+    return std::max(st.st_atime, st.st_mtime);
+}
+
+void mark_used(const std::experimental::filesystem::path &path)
+{
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+}
+
+} // namespace
+
+ImageDiskCache::ImageDiskCache(std::experimental::filesystem::path dir, uint64_t max_bytes)
+    : dir(std::move(dir)),
+      max_bytes(max_bytes)
+{
+}
+
+std::string ImageDiskCache::image_key(const std::string &book_id, const std::string &path, uint32_t max_width, const SDL_PixelFormat *format)
+{
+    return (
+        book_id + '\n' +
+        path + '\n' +
+        std::to_string(max_width) + '\n' +
+        std::to_string(format->BitsPerPixel) + ' ' +
+        std::to_string(format->Rmask) + ' ' +
+        std::to_string(format->Gmask) + ' ' +
+        std::to_string(format->Bmask) + ' ' +
+        std::to_string(format->Amask)
+    );
+}
+
+std::experimental::filesystem::path ImageDiskCache::entry_path(const std::string &key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.img", static_cast<unsigned long long>(key_hash(key)));
+    return dir / name;
+}
+
+std::experimental::optional<ImageSize> ImageDiskCache::get_size(const std::string &key) const
+{
+    std::ifstream in;
+    auto header = open_entry(entry_path(key), key, in);
+    if (!header)
+    {
+        return std::experimental::nullopt;
+    }
+    return ImageSize{header->w, header->h};
+}
+
+surface_unique_ptr ImageDiskCache::load(const std::string &key, const SDL_PixelFormat *format)
+{
+    const auto path = entry_path(key);
+    std::ifstream in;
+    auto header = open_entry(path, key, in);
+    if (!header || !has_masks(*header, format) || format->palette)
+    {
+        return nullptr;
+    }
+
+    auto surface = create_surface_in_format(SDL_SWSURFACE, header->w, header->h, format);
+    if (!surface)
+    {
+        return nullptr;
+    }
+
+    char *pixels = static_cast<char *>(surface->pixels);
+    if (surface->pitch == header->pitch)
+    {
+        // Single read of all rows
+        if (!in.read(pixels, static_cast<uint64_t>(header->pitch) * header->h))
+        {
+            return nullptr;
+        }
+    }
+    else
+    {
+        const uint32_t row_bytes = header->w * format->BytesPerPixel;
+        for (uint32_t y = 0; y < header->h; ++y)
+        {
+            if (!in.read(pixels + y * surface->pitch, row_bytes) || !in.ignore(header->pitch - row_bytes))
+            {
+                return nullptr;
+            }
+        }
+    }
+
+    mark_used(path);
+    return surface;
+}
+
+void ImageDiskCache::store(const std::string &key, SDL_Surface *surface)
+{
+    const SDL_PixelFormat *format = surface->format;
+    if (format->palette)
+    {
+        return;
+    }
+
+    EntryHeader header;
+    std::memcpy(header.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC));
+    header.version = IMAGE_DISK_CACHE_VERSION;
+    header.key_size = key.size();
+    header.w = surface->w;
+    header.h = surface->h;
+    header.pitch = surface->pitch;
+    header.bits_per_pixel = format->BitsPerPixel;
+    header.masks[0] = format->Rmask;
+    header.masks[1] = format->Gmask;
+    header.masks[2] = format->Bmask;
+    header.masks[3] = format->Amask;
+
+    const uint64_t pixel_bytes = static_cast<uint64_t>(header.pitch) * header.h;
+    const uint64_t entry_bytes = sizeof(header) + key.size() + pixel_bytes;
+    if (entry_bytes > max_bytes)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const auto path = entry_path(key);
+    auto tmp_path = path;
+    tmp_path += ".tmp";
+
+    std::error_code ec;
+    std::experimental::filesystem::create_directories(dir, ec);
+    uint64_t replaced_bytes = std::experimental::filesystem::file_size(path, ec);
+    if (ec)
+    {
+        replaced_bytes = 0;
+    }
+
+    if (SDL_MUSTLOCK(surface) && SDL_LockSurface(surface) != 0)
+    {
+        return;
+    }
+
+    // Write then rename, so readers never see a partial entry
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(key.data(), key.size());
+        out.write(static_cast<const char *>(surface->pixels), pixel_bytes);
+        if (SDL_MUSTLOCK(surface))
+        {
+            SDL_UnlockSurface(surface);
+        }
+
+        out.close();
+        if (!out)
+        {
+            std::cerr << "Unable to write " << tmp_path << std::endl;
+            std::experimental::filesystem::remove(tmp_path, ec);
+            return;
+        }
+    }
+    std::experimental::filesystem::rename(tmp_path, path, ec);
+    if (ec)
+    {
+        std::cerr << "Unable to write " << path << ": " << ec.message() << std::endl;
+        return;
+    }
+
+    if (total_bytes)
+    {
+        *total_bytes = *total_bytes - std::min(*total_bytes, replaced_bytes) + entry_bytes;
+    }
+    if (!total_bytes || *total_bytes > max_bytes)
+    {
+        evict(path);
+    }
+}
+
+// Counts entries, then while over max_bytes removes those least recently used.
+// Trims to three quarters of max_bytes, so a full cache isn't scanned on every
+// store. Called with mutex held.
+void ImageDiskCache::evict(const std::experimental::filesystem::path &keep_path)
+{
+    struct Entry
+    {
+        time_t last_used;
+        uint64_t size;
+        std::experimental::filesystem::path path;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+
+    std::error_code ec;
+    for (const auto &dir_entry : std::experimental::filesystem::directory_iterator(dir, ec))
+    {
+        struct stat st;
+        if (stat(dir_entry.path().c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            continue;
+        }
+        total += st.st_size;
+        if (dir_entry.path() != keep_path)
+        {
+            entries.push_back({last_used(st), static_cast<uint64_t>(st.st_size), dir_entry.path()});
+        }
+    }
+
+    if (total > max_bytes)
+    {
+        std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+            return a.last_used < b.last_used;
+        });
+
+        const uint64_t target_bytes = max_bytes / 4 * 3;
+        for (const auto &entry : entries)
+        {
+            if (total <= target_bytes)
+            {
+                break;
+            }
+            if (std::experimental::filesystem::remove(entry.path, ec))
+            {
+                total -= entry.size;
+            }
+        }
+    }
+
+    total_bytes = total;
+}
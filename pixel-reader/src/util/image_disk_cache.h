@@ -0,0 +1,45 @@
+#ifndef IMAGE_DISK_CACHE_H_
+#define IMAGE_DISK_CACHE_H_
+
+#include "./image_decode.h"
+#include "./sdl_pointer.h"
+
+#include <cstdint>
+#include <experimental/filesystem>
+#include <experimental/optional>
+#include <mutex>
+#include <string>
+
+// Images already scaled and in the render format, stored uncompressed in a
+// file each so they load with a single read instead of being decoded again.
+// Entries least recently used are removed to keep under max_bytes. Safe to
+// use from any thread.
+class ImageDiskCache
+{
+    const std::experimental::filesystem::path dir;
+    const uint64_t max_bytes;
+
+    std::mutex mutex;
+    // Size of all entries, once counted
+    std::experimental::optional<uint64_t> total_bytes;
+
+    std::experimental::filesystem::path entry_path(const std::string &key) const;
+    void evict(const std::experimental::filesystem::path &keep_path);
+
+public:
+    ImageDiskCache(std::experimental::filesystem::path dir, uint64_t max_bytes);
+    ImageDiskCache(const ImageDiskCache &) = delete;
+    ImageDiskCache &operator=(const ImageDiskCache &) = delete;
+
+    // Key for everything the scaled pixels depend on
+    static std::string image_key(const std::string &book_id, const std::string &path, uint32_t max_width, const SDL_PixelFormat *format);
+
+    // Size of the stored image, from the entry's header
+    std::experimental::optional<ImageSize> get_size(const std::string &key) const;
+    // Stored image, or nullptr if missing or not in format. Marks it used.
+    surface_unique_ptr load(const std::string &key, const SDL_PixelFormat *format);
+    // Replaces any image stored for key
+    void store(const std::string &key, SDL_Surface *surface);
+};
+
+#endif
@@ -0,0 +1,556 @@
+#include "./image_resample.h"
+
+#include "./image_decode.h"
+#include "./sdl_utils.h"
+
+#include <SDL/SDL_video.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+// Largest block the equal block path averages, so sums fit 16 bits
+#define MAX_RUN_BLOCK_PIXELS 256
+
+namespace
+{
+
+// Rounded division by multiplying by the reciprocal, exact for values under
+// 2^16 and counts up to 256
+constexpr uint32_t RECIPROCAL_SHIFT = 24;
+
+uint32_t reciprocal(uint32_t count)
+{
+    return ((1u << RECIPROCAL_SHIFT) + count - 1) / count;
+}
+
+} // namespace
+
+void sum_pixel_blocks_scalar(const uint8_t *row, const uint32_t *block_widths, uint32_t num_blocks, uint32_t *sums)
+{
+    for (uint32_t b = 0; b < num_blocks; ++b)
+    {
+        uint32_t *sum = sums + b * 4;
+        for (uint32_t i = 0; i < block_widths[b]; ++i, row += 4)
+        {
+            sum[0] += row[0];
+            sum[1] += row[1];
+            sum[2] += row[2];
+            sum[3] += row[3];
+        }
+    }
+}
+
+void sum_pixel_runs_scalar(const uint8_t *row, uint32_t run_width, uint32_t num_runs, uint16_t *sums)
+{
+    for (uint32_t r = 0; r < num_runs; ++r)
+    {
+        uint16_t *sum = sums + r * 4;
+        for (uint32_t i = 0; i < run_width; ++i, row += 4)
+        {
+            sum[0] += row[0];
+            sum[1] += row[1];
+            sum[2] += row[2];
+            sum[3] += row[3];
+        }
+    }
+}
+
+void divide_sums_scalar(const uint16_t *sums, uint32_t num_values, uint32_t count, uint8_t *out)
+{
+    const uint64_t recip = reciprocal(count);
+    for (uint32_t i = 0; i < num_values; ++i)
+    {
+        out[i] = ((sums[i] + count / 2) * recip) >> RECIPROCAL_SHIFT;
+    }
+}
+
+void interpolate_row_scalar(const uint8_t *row, uint32_t row_width, const uint32_t *x0, const uint8_t *weight, uint32_t out_width, uint16_t *out)
+{
+    for (uint32_t x = 0; x < out_width; ++x, out += 4)
+    {
+        const uint8_t *p0 = row + x0[x] * 4;
+        const uint8_t *p1 = x0[x] + 1 < row_width ? p0 + 4 : p0;
+        const uint32_t w1 = weight[x];
+        const uint32_t w0 = 256 - w1;
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            out[c] = p0[c] * w0 + p1[c] * w1;
+        }
+    }
+}
+
+void blend_rows_scalar(const uint16_t *top, const uint16_t *bottom, uint32_t num_values, uint8_t weight, uint8_t *out)
+{
+    const uint32_t w1 = weight;
+    const uint32_t w0 = 256 - w1;
+    for (uint32_t i = 0; i < num_values; ++i)
+    {
+        out[i] = (top[i] * w0 + bottom[i] * w1 + (1u << 15)) >> 16;
+    }
+}
+
+void unpack_rgb565_row_scalar(const uint16_t *in, uint32_t width, uint8_t *out)
+{
+    for (uint32_t x = 0; x < width; ++x, out += 4)
+    {
+        const uint32_t r = in[x] >> 11;
+        const uint32_t g = (in[x] >> 5) & 0x3f;
+        const uint32_t b = in[x] & 0x1f;
+        out[0] = (r << 3) | (r >> 2);
+        out[1] = (g << 2) | (g >> 4);
+        out[2] = (b << 3) | (b >> 2);
+        out[3] = 0xff;
+    }
+}
+
+void pack_rgb565_row_scalar(const uint8_t *in, uint32_t width, uint16_t *out)
+{
+    for (uint32_t x = 0; x < width; ++x, in += 4)
+    {
+        out[x] = ((in[0] >> 3) << 11) | ((in[1] >> 2) << 5) | (in[2] >> 3);
+    }
+}
+
+#ifdef __ARM_NEON
+
+namespace
+{
+
+inline uint8x8_t load_pixel(const uint8_t *p)
+{
+    uint32_t pixel;
+    std::memcpy(&pixel, p, sizeof(pixel));
+    return vreinterpret_u8_u32(vdup_n_u32(pixel));
+}
+
+} // namespace
+
+void sum_pixel_blocks(const uint8_t *row, const uint32_t *block_widths, uint32_t num_blocks, uint32_t *sums)
+{
+    for (uint32_t b = 0; b < num_blocks; ++b)
+    {
+        uint32x4_t sum = vld1q_u32(sums + b * 4);
+        uint32_t remaining = block_widths[b];
+        while (remaining >= 2)
+        {
+            // Pixels are added in pairs, up to 256 to a 16 bit lane before spilling
+            const uint32_t pairs = std::min(remaining / 2, 256u);
+            uint16x8_t pair_sums = vdupq_n_u16(0);
+            for (uint32_t i = 0; i < pairs; ++i, row += 8)
+            {
+                pair_sums = vaddw_u8(pair_sums, vld1_u8(row));
+            }
+            sum = vaddw_u16(sum, vget_low_u16(pair_sums));
+            sum = vaddw_u16(sum, vget_high_u16(pair_sums));
+            remaining -= pairs * 2;
+        }
+        if (remaining)
+        {
+            sum = vaddw_u16(sum, vget_low_u16(vmovl_u8(load_pixel(row))));
+            row += 4;
+        }
+        vst1q_u32(sums + b * 4, sum);
+    }
+}
+
+// Rows of 32 bit pixels are 4 byte aligned, so load as such to deinterleave
+// pixels
+void sum_pixel_runs(const uint8_t *row, uint32_t run_width, uint32_t num_runs, uint16_t *sums)
+{
+    uint32_t r = 0;
+    if (run_width == 1)
+    {
+        for (; r + 4 <= num_runs; r += 4, row += 16)
+        {
+            uint8x16_t pixels = vld1q_u8(row);
+            vst1q_u16(sums + r * 4, vaddw_u8(vld1q_u16(sums + r * 4), vget_low_u8(pixels)));
+            vst1q_u16(sums + r * 4 + 8, vaddw_u8(vld1q_u16(sums + r * 4 + 8), vget_high_u8(pixels)));
+        }
+    }
+    else if (run_width == 2)
+    {
+        for (; r + 4 <= num_runs; r += 4, row += 32)
+        {
+            uint32x4x2_t pixels = vld2q_u32(reinterpret_cast<const uint32_t *>(row));
+            uint8x16_t even = vreinterpretq_u8_u32(pixels.val[0]);
+            uint8x16_t odd = vreinterpretq_u8_u32(pixels.val[1]);
+            vst1q_u16(sums + r * 4, vaddq_u16(vld1q_u16(sums + r * 4), vaddl_u8(vget_low_u8(even), vget_low_u8(odd))));
+            vst1q_u16(sums + r * 4 + 8, vaddq_u16(vld1q_u16(sums + r * 4 + 8), vaddl_u8(vget_high_u8(even), vget_high_u8(odd))));
+        }
+    }
+    else if (run_width == 4)
+    {
+        for (; r + 4 <= num_runs; r += 4, row += 64)
+        {
+            uint32x4x4_t pixels = vld4q_u32(reinterpret_cast<const uint32_t *>(row));
+            uint8x16_t p0 = vreinterpretq_u8_u32(pixels.val[0]);
+            uint8x16_t p1 = vreinterpretq_u8_u32(pixels.val[1]);
+            uint8x16_t p2 = vreinterpretq_u8_u32(pixels.val[2]);
+            uint8x16_t p3 = vreinterpretq_u8_u32(pixels.val[3]);
+            uint16x8_t low = vaddq_u16(vaddl_u8(vget_low_u8(p0), vget_low_u8(p1)), vaddl_u8(vget_low_u8(p2), vget_low_u8(p3)));
+            uint16x8_t high = vaddq_u16(vaddl_u8(vget_high_u8(p0), vget_high_u8(p1)), vaddl_u8(vget_high_u8(p2), vget_high_u8(p3)));
+            vst1q_u16(sums + r * 4, vaddq_u16(vld1q_u16(sums + r * 4), low));
+            vst1q_u16(sums + r * 4 + 8, vaddq_u16(vld1q_u16(sums + r * 4 + 8), high));
+        }
+    }
+    else
+    {
+        // Pairs of pixels, folded together once the run's summed. Runs sum
+        // within 16 bits, so the halves do too.
+        for (; r < num_runs; ++r)
+        {
+            uint16x8_t pair_sums = vdupq_n_u16(0);
+            uint32_t i = 0;
+            for (; i + 2 <= run_width; i += 2, row += 8)
+            {
+                pair_sums = vaddw_u8(pair_sums, vld1_u8(row));
+            }
+            if (i < run_width)
+            {
+                pair_sums = vaddw_u8(pair_sums, vreinterpret_u8_u64(vshl_n_u64(vreinterpret_u64_u8(load_pixel(row)), 32)));
+                row += 4;
+            }
+            uint16x4_t run_sum = vadd_u16(vget_low_u16(pair_sums), vget_high_u16(pair_sums));
+            vst1_u16(sums + r * 4, vadd_u16(vld1_u16(sums + r * 4), run_sum));
+        }
+    }
+
+    sum_pixel_runs_scalar(row, run_width, num_runs - r, sums + r * 4);
+}
+
+void divide_sums(const uint16_t *sums, uint32_t num_values, uint32_t count, uint8_t *out)
+{
+    const uint32x2_t recip = vdup_n_u32(reciprocal(count));
+    const uint32x4_t half = vdupq_n_u32(count / 2);
+
+    uint32_t i = 0;
+    for (; i + 8 <= num_values; i += 8)
+    {
+        uint16x8_t values = vld1q_u16(sums + i);
+        uint32x4_t low = vaddw_u16(half, vget_low_u16(values));
+        uint32x4_t high = vaddw_u16(half, vget_high_u16(values));
+        uint32x4_t low_quotient = vcombine_u32(
+            vshrn_n_u64(vmull_u32(vget_low_u32(low), recip), RECIPROCAL_SHIFT),
+            vshrn_n_u64(vmull_u32(vget_high_u32(low), recip), RECIPROCAL_SHIFT)
+        );
+        uint32x4_t high_quotient = vcombine_u32(
+            vshrn_n_u64(vmull_u32(vget_low_u32(high), recip), RECIPROCAL_SHIFT),
+            vshrn_n_u64(vmull_u32(vget_high_u32(high), recip), RECIPROCAL_SHIFT)
+        );
+        vst1_u8(out + i, vmovn_u16(vcombine_u16(vmovn_u32(low_quotient), vmovn_u32(high_quotient))));
+    }
+
+    divide_sums_scalar(sums + i, num_values - i, count, out + i);
+}
+
+void interpolate_row(const uint8_t *row, uint32_t row_width, const uint32_t *x0, const uint8_t *weight, uint32_t out_width, uint16_t *out)
+{
+    // Both pixels come from one load, and are weighted in one multiply
+    uint32_t x = 0;
+    for (; x < out_width && x0[x] + 1 < row_width; ++x)
+    {
+        uint16x8_t pixels = vmovl_u8(vld1_u8(row + x0[x] * 4));
+        uint16x8_t weights = vcombine_u16(vdup_n_u16(256 - weight[x]), vdup_n_u16(weight[x]));
+        uint16x8_t weighted = vmulq_u16(pixels, weights);
+        vst1_u16(out + x * 4, vadd_u16(vget_low_u16(weighted), vget_high_u16(weighted)));
+    }
+
+    // Positions only increase, so the rest are at the last pixel
+    interpolate_row_scalar(row, row_width, x0 + x, weight + x, out_width - x, out + x * 4);
+}
+
+void blend_rows(const uint16_t *top, const uint16_t *bottom, uint32_t num_values, uint8_t weight, uint8_t *out)
+{
+    const uint16x4_t w0 = vdup_n_u16(256 - weight);
+    const uint16x4_t w1 = vdup_n_u16(weight);
+
+    uint32_t i = 0;
+    for (; i + 8 <= num_values; i += 8)
+    {
+        uint16x8_t t = vld1q_u16(top + i);
+        uint16x8_t b = vld1q_u16(bottom + i);
+        uint32x4_t low = vmlal_u16(vmull_u16(vget_low_u16(t), w0), vget_low_u16(b), w1);
+        uint32x4_t high = vmlal_u16(vmull_u16(vget_high_u16(t), w0), vget_high_u16(b), w1);
+        vst1_u8(out + i, vmovn_u16(vcombine_u16(vrshrn_n_u32(low, 16), vrshrn_n_u32(high, 16))));
+    }
+
+    blend_rows_scalar(top + i, bottom + i, num_values - i, weight, out + i);
+}
+
+void unpack_rgb565_row(const uint16_t *in, uint32_t width, uint8_t *out)
+{
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        uint16x8_t pixels = vld1q_u16(in + x);
+        uint8x8_t r = vshrn_n_u16(pixels, 8);
+        uint8x8_t g = vshrn_n_u16(pixels, 3);
+        uint8x8_t b = vmovn_u16(vshlq_n_u16(pixels, 3));
+
+        uint8x8x4_t channels;
+        channels.val[0] = vorr_u8(vand_u8(r, vdup_n_u8(0xf8)), vshr_n_u8(r, 5));
+        channels.val[1] = vorr_u8(vand_u8(g, vdup_n_u8(0xfc)), vshr_n_u8(g, 6));
+        channels.val[2] = vorr_u8(b, vshr_n_u8(b, 5));
+        channels.val[3] = vdup_n_u8(0xff);
+        vst4_u8(out + x * 4, channels);
+    }
+
+    unpack_rgb565_row_scalar(in + x, width - x, out + x * 4);
+}
+
+void pack_rgb565_row(const uint8_t *in, uint32_t width, uint16_t *out)
+{
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        uint8x8x4_t channels = vld4_u8(in + x * 4);
+        uint16x8_t r = vshll_n_u8(vand_u8(channels.val[0], vdup_n_u8(0xf8)), 8);
+        uint16x8_t g = vshll_n_u8(vand_u8(channels.val[1], vdup_n_u8(0xfc)), 3);
+        uint16x8_t b = vmovl_u8(vshr_n_u8(channels.val[2], 3));
+        vst1q_u16(out + x, vorrq_u16(vorrq_u16(r, g), b));
+    }
+
+    pack_rgb565_row_scalar(in + x * 4, width - x, out + x);
+}
+
+#else
+
+void sum_pixel_blocks(const uint8_t *row, const uint32_t *block_widths, uint32_t num_blocks, uint32_t *sums)
+{
+    sum_pixel_blocks_scalar(row, block_widths, num_blocks, sums);
+}
+
+void sum_pixel_runs(const uint8_t *row, uint32_t run_width, uint32_t num_runs, uint16_t *sums)
+{
+    sum_pixel_runs_scalar(row, run_width, num_runs, sums);
+}
+
+void divide_sums(const uint16_t *sums, uint32_t num_values, uint32_t count, uint8_t *out)
+{
+    divide_sums_scalar(sums, num_values, count, out);
+}
+
+void interpolate_row(const uint8_t *row, uint32_t row_width, const uint32_t *x0, const uint8_t *weight, uint32_t out_width, uint16_t *out)
+{
+    interpolate_row_scalar(row, row_width, x0, weight, out_width, out);
+}
+
+void blend_rows(const uint16_t *top, const uint16_t *bottom, uint32_t num_values, uint8_t weight, uint8_t *out)
+{
+    blend_rows_scalar(top, bottom, num_values, weight, out);
+}
+
+void unpack_rgb565_row(const uint16_t *in, uint32_t width, uint8_t *out)
+{
+    unpack_rgb565_row_scalar(in, width, out);
+}
+
+void pack_rgb565_row(const uint8_t *in, uint32_t width, uint16_t *out)
+{
+    pack_rgb565_row_scalar(in, width, out);
+}
+
+#endif
+
+////////////////////////
+
+namespace
+{
+
+bool is_rgb565(const SDL_PixelFormat *format)
+{
+    return (
+        format->BitsPerPixel == 16 &&
+        format->Rmask == 0xf800 &&
+        format->Gmask == 0x07e0 &&
+        format->Bmask == 0x001f
+    );
+}
+
+// Source rows as 8 bit, 4 channel pixels. An unpacked row lasts until the next
+// is asked for.
+class SourceRows
+{
+    const SDL_Surface *surface;
+    const bool unpack;
+    std::vector<uint8_t> unpacked;
+
+public:
+    SourceRows(const SDL_Surface *surface)
+        : surface(surface),
+          unpack(surface->format->BytesPerPixel == 2),
+          unpacked(unpack ? surface->w * 4 : 0)
+    {
+    }
+
+    const uint8_t *row(uint32_t y)
+    {
+        const uint8_t *pixels = static_cast<const uint8_t *>(surface->pixels) + y * surface->pitch;
+        if (!unpack)
+        {
+            return pixels;
+        }
+        unpack_rgb565_row(reinterpret_cast<const uint16_t *>(pixels), surface->w, unpacked.data());
+        return unpacked.data();
+    }
+};
+
+// Destination rows, written as 8 bit, 4 channel pixels then packed if need be
+class DestRows
+{
+    SDL_Surface *surface;
+    const bool pack;
+    std::vector<uint8_t> unpacked;
+
+public:
+    DestRows(SDL_Surface *surface)
+        : surface(surface),
+          pack(surface->format->BytesPerPixel == 2),
+          unpacked(pack ? surface->w * 4 : 0)
+    {
+    }
+
+    uint8_t *row(uint32_t y)
+    {
+        return pack ? unpacked.data() : static_cast<uint8_t *>(surface->pixels) + y * surface->pitch;
+    }
+
+    void finish_row(uint32_t y)
+    {
+        if (pack)
+        {
+            uint16_t *pixels = reinterpret_cast<uint16_t *>(static_cast<uint8_t *>(surface->pixels) + y * surface->pitch);
+            pack_rgb565_row(unpacked.data(), surface->w, pixels);
+        }
+    }
+};
+
+void resample_equal_blocks(SourceRows &source, uint32_t block_w, uint32_t block_h, DestRows &dest, uint32_t w, uint32_t h)
+{
+    std::vector<uint16_t> sums(w * 4);
+    for (uint32_t y = 0; y < h; ++y)
+    {
+        std::fill(sums.begin(), sums.end(), 0);
+        for (uint32_t i = 0; i < block_h; ++i)
+        {
+            sum_pixel_runs(source.row(y * block_h + i), block_w, w, sums.data());
+        }
+        divide_sums(sums.data(), w * 4, block_w * block_h, dest.row(y));
+        dest.finish_row(y);
+    }
+}
+
+void resample_area(SourceRows &source, uint32_t src_w, uint32_t src_h, DestRows &dest, uint32_t w, uint32_t h)
+{
+    RowDownscaler scaler(src_w, src_h, w, h, nullptr, 0);
+    uint32_t y = scaler.next_row();
+    scaler.set_output(dest.row(y), 0, y, 1);
+
+    for (uint32_t src_y = 0; src_y < src_h; ++src_y)
+    {
+        scaler.add_row(source.row(src_y));
+        if (scaler.next_row() != y)
+        {
+            dest.finish_row(y);
+            y = scaler.next_row();
+            if (y < h)
+            {
+                scaler.set_output(dest.row(y), 0, y, 1);
+            }
+        }
+    }
+}
+
+// Source pixel before the centre of each destination pixel, and how far
+// towards the next one it is, in 256ths
+void map_positions(uint32_t src_size, uint32_t dst_size, std::vector<uint32_t> &first, std::vector<uint8_t> &weight)
+{
+    first.resize(dst_size);
+    weight.resize(dst_size);
+
+    const int64_t max_pos = static_cast<int64_t>(src_size - 1) * 256;
+    for (uint32_t i = 0; i < dst_size; ++i)
+    {
+        int64_t pos = (static_cast<int64_t>(2 * i + 1) * src_size * 256) / (2 * dst_size) - 128;
+        pos = std::max<int64_t>(0, std::min(pos, max_pos));
+        first[i] = pos >> 8;
+        weight[i] = pos & 0xff;
+    }
+}
+
+void resample_bilinear(SourceRows &source, uint32_t src_w, uint32_t src_h, DestRows &dest, uint32_t w, uint32_t h)
+{
+    std::vector<uint32_t> x0, y0;
+    std::vector<uint8_t> x_weight, y_weight;
+    map_positions(src_w, w, x0, x_weight);
+    map_positions(src_h, h, y0, y_weight);
+
+    // Consecutive source rows, interpolated across, go to alternate slots
+    std::vector<uint16_t> rows[2] = {std::vector<uint16_t>(w * 4), std::vector<uint16_t>(w * 4)};
+    int64_t row_y[2] = {-1, -1};
+    auto interpolated_row = [&](uint32_t src_y) {
+        const uint32_t slot = src_y & 1;
+        if (row_y[slot] != src_y)
+        {
+            interpolate_row(source.row(src_y), src_w, x0.data(), x_weight.data(), w, rows[slot].data());
+            row_y[slot] = src_y;
+        }
+        return rows[slot].data();
+    };
+
+    for (uint32_t y = 0; y < h; ++y)
+    {
+        const uint16_t *top = interpolated_row(y0[y]);
+        const uint16_t *bottom = interpolated_row(std::min(y0[y] + 1, src_h - 1));
+        blend_rows(top, bottom, w * 4, y_weight[y], dest.row(y));
+        dest.finish_row(y);
+    }
+}
+
+} // namespace
+
+surface_unique_ptr resample_surface(SDL_Surface *src, uint32_t w, uint32_t h)
+{
+    const SDL_PixelFormat *format = src->format;
+    if (!w || !h || src->w <= 0 || src->h <= 0 || (format->BytesPerPixel != 4 && !is_rgb565(format)))
+    {
+        return nullptr;
+    }
+
+    auto dst = create_surface_in_format(SDL_SWSURFACE, w, h, format);
+    if (!dst || (SDL_MUSTLOCK(src) && SDL_LockSurface(src) != 0))
+    {
+        return nullptr;
+    }
+
+    SourceRows source(src);
+    DestRows dest(dst.get());
+    const uint32_t src_w = src->w;
+    const uint32_t src_h = src->h;
+    const uint32_t block_w = src_w / w;
+    const uint32_t block_h = src_h / h;
+
+    if (src_w % w == 0 && src_h % h == 0 && block_w * block_h <= MAX_RUN_BLOCK_PIXELS)
+    {
+        resample_equal_blocks(source, block_w, block_h, dest, w, h);
+    }
+    else if (w <= src_w && h <= src_h && (w * 2 <= src_w || h * 2 <= src_h))
+    {
+        resample_area(source, src_w, src_h, dest, w, h);
+    }
+    else
+    {
+        resample_bilinear(source, src_w, src_h, dest, w, h);
+    }
+
+    if (SDL_MUSTLOCK(src))
+    {
+        SDL_UnlockSurface(src);
+    }
+    return dst;
+}
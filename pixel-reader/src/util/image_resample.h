@@ -0,0 +1,54 @@
+#ifndef IMAGE_RESAMPLE_H_
+#define IMAGE_RESAMPLE_H_
+
+#include "./sdl_pointer.h"
+
+#include <cstdint>
+
+// Scale a 32 bit or RGB565 surface to w x h, in the same format.
+// - Exact reductions, to blocks of up to 256 pixels, average equal blocks.
+// - Other reductions of half or more in either direction average the uneven
+//   block each pixel covers (see RowDownscaler).
+// - Anything else, smaller reductions and enlargements, is bilinear.
+// Nullptr for other formats.
+surface_unique_ptr resample_surface(SDL_Surface *src, uint32_t w, uint32_t h);
+
+// Kernels over rows of 8 bit, 4 channel pixels, using NEON where available.
+// Channels are treated alike, so any 32 bit channel order works. Each has a
+// scalar reference implementation, which the vector version must match
+// exactly.
+
+// Add the sum of each block of pixels along row, block_widths[i] wide, to
+// sums[i * 4 + channel]
+void sum_pixel_blocks(const uint8_t *row, const uint32_t *block_widths, uint32_t num_blocks, uint32_t *sums);
+void sum_pixel_blocks_scalar(const uint8_t *row, const uint32_t *block_widths, uint32_t num_blocks, uint32_t *sums);
+
+// Add the sum of each run of run_width pixels along row to sums, as above.
+// Sums must stay within 16 bits.
+void sum_pixel_runs(const uint8_t *row, uint32_t run_width, uint32_t num_runs, uint16_t *sums);
+void sum_pixel_runs_scalar(const uint8_t *row, uint32_t run_width, uint32_t num_runs, uint16_t *sums);
+
+// out[i] = sums[i] / count, rounded, for count up to 256 and sums up to
+// count * 255
+void divide_sums(const uint16_t *sums, uint32_t num_values, uint32_t count, uint8_t *out);
+void divide_sums_scalar(const uint16_t *sums, uint32_t num_values, uint32_t count, uint8_t *out);
+
+// Pixel x of out interpolates pixels x0[x] and x0[x] + 1 of row (the last
+// pixel alone at the end), by weight[x] / 256 towards the second. Values are
+// scaled by 256.
+void interpolate_row(const uint8_t *row, uint32_t row_width, const uint32_t *x0, const uint8_t *weight, uint32_t out_width, uint16_t *out);
+void interpolate_row_scalar(const uint8_t *row, uint32_t row_width, const uint32_t *x0, const uint8_t *weight, uint32_t out_width, uint16_t *out);
+
+// Interpolate between rows from interpolate_row by weight / 256 towards
+// bottom, back to 8 bits
+void blend_rows(const uint16_t *top, const uint16_t *bottom, uint32_t num_values, uint8_t weight, uint8_t *out);
+void blend_rows_scalar(const uint16_t *top, const uint16_t *bottom, uint32_t num_values, uint8_t weight, uint8_t *out);
+
+// RGB565 to and from pixels of 8 bit R, G, B, and opaque alpha. Packing
+// drops the low bits, so unpacked values pack back as they were.
+void unpack_rgb565_row(const uint16_t *in, uint32_t width, uint8_t *out);
+void unpack_rgb565_row_scalar(const uint16_t *in, uint32_t width, uint8_t *out);
+void pack_rgb565_row(const uint8_t *in, uint32_t width, uint16_t *out);
+void pack_rgb565_row_scalar(const uint8_t *in, uint32_t width, uint16_t *out);
+
+#endif
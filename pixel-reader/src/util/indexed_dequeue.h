@@ -1,17 +1,44 @@
 #ifndef INDEXED_DEQUEUE_H_
 #define INDEXED_DEQUEUE_H_
 
-#include <memory>
+#include <algorithm>
+#include <cstdint>
 #include <stdexcept>
-#include <unordered_map>
+#include <vector>
 
+// Dequeue with stable indexes, which may go negative when prepending. Items
+// are kept contiguously in a ring buffer that grows as needed.
 template <typename T>
 class IndexedDequeue
 {
-    std::unordered_map<int, T> items;
+    static constexpr uint32_t MIN_CAPACITY = 16;
+
+    std::vector<T> items;
+    uint32_t head = 0;  // position of _start_index in items
     int _start_index = 0;
     int _end_index = 0;
 
+    uint32_t position(int index) const
+    {
+        return (head + static_cast<uint32_t>(index - _start_index)) % items.size();
+    }
+
+    void reserve_one()
+    {
+        if (size() < items.size())
+        {
+            return;
+        }
+
+        std::vector<T> grown(std::max<uint32_t>(items.size() * 2, MIN_CAPACITY));
+        for (int i = _start_index; i < _end_index; ++i)
+        {
+            grown[i - _start_index] = std::move(items[position(i)]);
+        }
+        items = std::move(grown);
+        head = 0;
+    }
+
 public:
 
     // First index
@@ -31,14 +58,24 @@ public:
         return _end_index - _start_index;
     }
 
+    // Number of items that fit before growing
+    uint32_t capacity() const
+    {
+        return items.size();
+    }
+
     const T &operator[](int index) const
     {
-        auto it = items.find(index);
-        if (it == items.end())
+        if (index < _start_index || index >= _end_index)
         {
             throw std::out_of_range("Invalid item index");
         }
-        return it->second;
+        return items[position(index)];
+    }
+
+    const T &front() const
+    {
+        return (*this)[_start_index];
     }
 
     const T &back() const
@@ -48,17 +85,48 @@ public:
 
     void prepend(T item)
     {
-        items.emplace(--_start_index, std::move(item));
+        reserve_one();
+        head = (head + items.size() - 1) % items.size();
+        items[head] = std::move(item);
+        --_start_index;
     }
 
     void append(T item)
     {
-        items.emplace(_end_index++, std::move(item));
+        reserve_one();
+        items[position(_end_index)] = std::move(item);
+        ++_end_index;
+    }
+
+    void pop_front()
+    {
+        if (size() == 0)
+        {
+            throw std::out_of_range("Pop from empty dequeue");
+        }
+        items[head] = T();
+        head = (head + 1) % items.size();
+        ++_start_index;
     }
 
+    void pop_back()
+    {
+        if (size() == 0)
+        {
+            throw std::out_of_range("Pop from empty dequeue");
+        }
+        items[position(_end_index - 1)] = T();
+        --_end_index;
+    }
+
+    // Remove all items, keeping capacity
     void clear()
     {
-        items.clear();
+        for (auto &item : items)
+        {
+            item = T();
+        }
+        head = 0;
         _start_index = 0;
         _end_index = 0;
     }
@@ -73,6 +73,13 @@ public:
     {
         erase_key(back_key());
     }
+
+    void clear()
+    {
+        order.clear();
+        order_iterators.clear();
+        values.clear();
+    }
 };
 
 #endif
@@ -0,0 +1,210 @@
+#include "./memory_budget.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+MemoryBudget::Registration::Registration(MemoryBudget *budget, uint32_t id)
+    : budget(budget),
+      id(id)
+{
+}
+
+MemoryBudget::Registration::Registration(Registration &&other)
+    : budget(other.budget),
+      id(other.id)
+{
+    other.budget = nullptr;
+}
+
+MemoryBudget::Registration &MemoryBudget::Registration::operator=(Registration &&other)
+{
+    if (this != &other)
+    {
+        if (budget)
+        {
+            budget->remove(id);
+        }
+        budget = other.budget;
+        id = other.id;
+        other.budget = nullptr;
+    }
+    return *this;
+}
+
+MemoryBudget::Registration::~Registration()
+{
+    if (budget)
+    {
+        budget->remove(id);
+    }
+}
+
+MemoryBudget::MemoryBudget(uint64_t total_bytes, uint64_t reserve_bytes, AvailableReader read_available)
+    : total_bytes(total_bytes),
+      reserve_bytes(reserve_bytes),
+      read_available(std::move(read_available)),
+      limit_bytes(total_bytes)
+{
+}
+
+MemoryBudget::Registration MemoryBudget::add(Consumer consumer)
+{
+    uint32_t id = next_id++;
+    entries.push_back({id, std::move(consumer), std::experimental::nullopt});
+    distribute();
+    return Registration(this, id);
+}
+
+// Budget freed is shared out at the next update, rather than while the
+// consumer's owner is being torn down
+void MemoryBudget::remove(uint32_t id)
+{
+    entries.erase(
+        std::remove_if(entries.begin(), entries.end(), [id](const Entry &entry) {
+            return entry.id == id;
+        }),
+        entries.end()
+    );
+}
+
+void MemoryBudget::update()
+{
+    uint64_t limit = total_bytes;
+
+    auto available = read_available ? read_available() : std::experimental::nullopt;
+    if (available)
+    {
+        // What the caches hold could be had back, so counts as available
+        uint64_t headroom = used_bytes() + *available;
+        limit = std::min(limit, headroom > reserve_bytes ? headroom - reserve_bytes : 0);
+    }
+
+    if ((limit < total_bytes) != (limit_bytes < total_bytes))
+    {
+        if (limit < total_bytes)
+        {
+            std::cerr << "Low memory, cache budget cut to " << limit / 1024 << " KB" << std::endl;
+        }
+        else
+        {
+            std::cerr << "Cache budget restored to " << limit / 1024 << " KB" << std::endl;
+        }
+    }
+    limit_bytes = limit;
+
+    distribute();
+}
+
+// Caches that can't shrink keep what they hold. The rest each get their
+// minimum, highest priority first, then up to their maximum in the same order.
+void MemoryBudget::distribute()
+{
+    uint64_t remaining = limit_bytes;
+    std::vector<Entry *> shrinkable;
+    for (auto &entry : entries)
+    {
+        if (entry.consumer.set_budget)
+        {
+            shrinkable.push_back(&entry);
+        }
+        else if (entry.consumer.size_bytes)
+        {
+            remaining -= std::min(remaining, entry.consumer.size_bytes());
+        }
+    }
+
+    std::stable_sort(shrinkable.begin(), shrinkable.end(), [](const Entry *a, const Entry *b) {
+        return a->consumer.priority > b->consumer.priority;
+    });
+
+    std::vector<uint64_t> grants(shrinkable.size());
+    for (uint32_t i = 0; i < shrinkable.size(); ++i)
+    {
+        grants[i] = std::min({shrinkable[i]->consumer.min_bytes, shrinkable[i]->consumer.max_bytes, remaining});
+        remaining -= grants[i];
+    }
+    for (uint32_t i = 0; i < shrinkable.size(); ++i)
+    {
+        uint64_t extra = std::min(shrinkable[i]->consumer.max_bytes - grants[i], remaining);
+        grants[i] += extra;
+        remaining -= extra;
+    }
+
+    for (uint32_t i = 0; i < shrinkable.size(); ++i)
+    {
+        Entry &entry = *shrinkable[i];
+        if (!entry.budget_bytes || *entry.budget_bytes != grants[i])
+        {
+            entry.budget_bytes = grants[i];
+            entry.consumer.set_budget(grants[i]);
+        }
+    }
+}
+
+uint64_t MemoryBudget::current_budget_bytes() const
+{
+    return limit_bytes;
+}
+
+uint64_t MemoryBudget::used_bytes() const
+{
+    uint64_t used = 0;
+    for (const auto &entry : entries)
+    {
+        if (entry.consumer.size_bytes)
+        {
+            used += entry.consumer.size_bytes();
+        }
+    }
+    return used;
+}
+
+std::experimental::optional<uint64_t> parse_mem_available(const std::string &meminfo)
+{
+    std::experimental::optional<uint64_t> available;
+    uint64_t estimate = 0;
+    uint32_t num_estimate_fields = 0;
+
+    std::istringstream lines(meminfo);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        std::istringstream fields(line);
+        std::string name;
+        uint64_t kb;
+        if (!(fields >> name >> kb))
+        {
+            continue;
+        }
+
+        if (name == "MemAvailable:")
+        {
+            available = kb * 1024;
+        }
+        else if (name == "MemFree:" || name == "Buffers:" || name == "Cached:")
+        {
+            estimate += kb * 1024;
+            ++num_estimate_fields;
+        }
+    }
+
+    if (!available && num_estimate_fields == 3)
+    {
+        available = estimate;
+    }
+    return available;
+}
+
+std::experimental::optional<uint64_t> read_mem_available()
+{
+    std::ifstream in("/proc/meminfo");
+    if (!in)
+    {
+        return std::experimental::nullopt;
+    }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    return parse_mem_available(buffer.str());
+}
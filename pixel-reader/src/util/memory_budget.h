@@ -0,0 +1,98 @@
+#ifndef MEMORY_BUDGET_H_
+#define MEMORY_BUDGET_H_
+
+#include <cstdint>
+#include <experimental/optional>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Higher priority caches are given their share of the budget first, and so
+// are the last to shrink
+enum class MemoryPriority
+{
+    Low,
+    Normal,
+    High,
+};
+
+// Shares a total memory budget between the caches registered with it. The
+// total is cut to what's left of available memory, less a reserve, so caches
+// shrink when something else (frontend, emulator) needs the memory. Not
+// thread safe, update from the main loop.
+class MemoryBudget
+{
+public:
+    struct Consumer
+    {
+        std::string name;
+        MemoryPriority priority;
+        // Given before any cache gets more, if the budget allows
+        uint64_t min_bytes;
+        // Never given more
+        uint64_t max_bytes;
+        // Bytes the cache holds
+        std::function<uint64_t()> size_bytes;
+        // Told its budget on registering and whenever it changes, and should
+        // shrink to it. Empty for caches that can't shrink; what they hold is
+        // taken off the budget for the others.
+        std::function<void(uint64_t)> set_budget;
+    };
+
+    // Unregisters the consumer when destroyed
+    class Registration
+    {
+        MemoryBudget *budget = nullptr;
+        uint32_t id = 0;
+
+    public:
+        Registration() = default;
+        Registration(MemoryBudget *budget, uint32_t id);
+        Registration(Registration &&other);
+        Registration &operator=(Registration &&other);
+        ~Registration();
+    };
+
+    // Available memory in bytes, or nullopt if unknown
+    using AvailableReader = std::function<std::experimental::optional<uint64_t>()>;
+
+    MemoryBudget(uint64_t total_bytes, uint64_t reserve_bytes, AvailableReader read_available);
+    MemoryBudget(const MemoryBudget &) = delete;
+    MemoryBudget &operator=(const MemoryBudget &) = delete;
+
+    Registration add(Consumer consumer);
+
+    // Read available memory and share out the budget again
+    void update();
+
+    // Budget shared out at the last update, after memory pressure
+    uint64_t current_budget_bytes() const;
+    // Bytes held by all consumers
+    uint64_t used_bytes() const;
+
+private:
+    struct Entry
+    {
+        uint32_t id;
+        Consumer consumer;
+        std::experimental::optional<uint64_t> budget_bytes;
+    };
+
+    const uint64_t total_bytes;
+    const uint64_t reserve_bytes;
+    const AvailableReader read_available;
+
+    std::vector<Entry> entries;
+    uint32_t next_id = 1;
+    uint64_t limit_bytes;
+
+    void remove(uint32_t id);
+    void distribute();
+};
+
+// MemAvailable from the contents of /proc/meminfo, in bytes. Older kernels
+// without it estimate from free memory and page cache.
+std::experimental::optional<uint64_t> parse_mem_available(const std::string &meminfo);
+std::experimental::optional<uint64_t> read_mem_available();
+
+#endif
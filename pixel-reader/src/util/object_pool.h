@@ -0,0 +1,88 @@
+#ifndef OBJECT_POOL_H_
+#define OBJECT_POOL_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Hands out objects allocated in blocks, and takes them back for reuse rather
+// than freeing them. Reused objects are as they were released, so callers
+// reset them, and keep whatever memory they hold (e.g. a string's capacity).
+// The pool must outlive the objects it hands out.
+template <typename T>
+class ObjectPool
+{
+    static constexpr uint32_t BLOCK_SIZE = 64;
+
+    std::vector<std::unique_ptr<T[]>> blocks;
+    std::vector<T *> free_objects;
+
+public:
+    struct Releaser
+    {
+        ObjectPool *pool = nullptr;
+
+        void operator()(T *obj) const
+        {
+            pool->release(obj);
+        }
+    };
+    using Ptr = std::unique_ptr<T, Releaser>;
+
+    ObjectPool() = default;
+    ObjectPool(const ObjectPool &) = delete;
+    ObjectPool &operator=(const ObjectPool &) = delete;
+
+    T *acquire()
+    {
+        if (free_objects.empty())
+        {
+            blocks.emplace_back(new T[BLOCK_SIZE]);
+            T *block = blocks.back().get();
+            // So releasing never allocates
+            free_objects.reserve(capacity());
+            for (uint32_t i = BLOCK_SIZE; i > 0; --i)
+            {
+                free_objects.push_back(block + i - 1);
+            }
+        }
+
+        T *obj = free_objects.back();
+        free_objects.pop_back();
+        return obj;
+    }
+
+    void release(T *obj)
+    {
+        free_objects.push_back(obj);
+    }
+
+    // Object returned to the pool when the pointer is reset
+    Ptr acquire_ptr()
+    {
+        return Ptr(acquire(), Releaser{this});
+    }
+
+    // Objects allocated, in use or free
+    uint32_t capacity() const
+    {
+        return blocks.size() * BLOCK_SIZE;
+    }
+
+    uint32_t num_free() const
+    {
+        return free_objects.size();
+    }
+
+    // Visit objects not in use, e.g. to drop memory they hold
+    template <typename F>
+    void for_each_free(F f)
+    {
+        for (T *obj : free_objects)
+        {
+            f(*obj);
+        }
+    }
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include "./sdl_font_cache.h"
 #include "./sdl_pointer.h"
 
+#include <experimental/filesystem>
 #include <iostream>
 #include <unordered_map>
 
@@ -35,3 +36,21 @@ TTF_Font *cached_load_font(const std::string &font_path, uint32_t size, FontLoad
 
     return it->second.get();
 }
+
+uint64_t cached_fonts_size_bytes()
+{
+    uint64_t size_bytes = 0;
+    for (const auto &size_lookup : font_cache)
+    {
+        for (const auto &entry : size_lookup.second)
+        {
+            std::error_code ec;
+            uint64_t file_size = std::experimental::filesystem::file_size(entry.first, ec);
+            if (entry.second && !ec)
+            {
+                size_bytes += file_size;
+            }
+        }
+    }
+    return size_bytes;
+}
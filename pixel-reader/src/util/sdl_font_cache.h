@@ -12,4 +12,8 @@ enum class FontLoadErrorOpt
 
 TTF_Font *cached_load_font(const std::string &font_path, uint32_t size, FontLoadErrorOpt opt = FontLoadErrorOpt::ThrowOnError);
 
+// Rough memory held by loaded fonts, taking each as the size of its file.
+// Fonts are never unloaded, so this only grows.
+uint64_t cached_fonts_size_bytes();
+
 #endif
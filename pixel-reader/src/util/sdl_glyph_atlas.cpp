@@ -0,0 +1,256 @@
+#include "./sdl_glyph_atlas.h"
+#include "./sdl_utils.h"
+
+#include <algorithm>
+
+namespace
+{
+
+constexpr int ATLAS_PAGE_SIZE = 256;
+
+} // namespace
+
+GlyphAtlas::GlyphAtlas(TTF_Font *font, SDL_Color fg, SDL_Color bg, uint32_t max_size_bytes)
+    : font(font),
+      glyphs(&cached_glyphs(font)),
+      fg(fg),
+      bg(bg),
+      font_height(TTF_FontHeight(font)),
+      font_ascent(TTF_FontAscent(font)),
+      max_size_bytes(max_size_bytes)
+{
+}
+
+// Position glyphs as SDL_ttf's TTF_RenderUNICODE_Shaded does, for unstyled text
+bool GlyphAtlas::layout(const char *text)
+{
+    line.clear();
+
+    int x = 0;
+    int minx = 0;
+    int maxx = 0;
+    int prev_index = 0;
+
+    const char *pos = text;
+    while (*pos)
+    {
+        uint16_t ch = 0;
+        uint32_t char_len = decode_ttf_char(pos, 3, ch);
+        const GlyphMetrics *glyph = char_len ? glyphs->glyph(ch) : nullptr;
+        if (!glyph)
+        {
+            return false;
+        }
+
+        x += glyphs->kerning(prev_index, glyph->index);
+        minx = std::min(minx, x + glyph->minx);
+        maxx = std::max(maxx, x + std::max(glyph->advance, glyph->maxx));
+        line.push_back({ch, x, glyph});
+        x += glyph->advance;
+        prev_index = glyph->index;
+
+        pos += char_len;
+    }
+
+    line_width = maxx - minx;
+    return true;
+}
+
+void GlyphAtlas::clear()
+{
+    pages.clear();
+    shelf_x = 0;
+    shelf_y = 0;
+    shelf_h = 0;
+
+    ascii_loaded.fill(false);
+    atlas_glyphs.clear();
+}
+
+bool GlyphAtlas::has_format(const SDL_PixelFormat *format) const
+{
+    if (pages.empty())
+    {
+        return true;
+    }
+
+    return same_pixel_format(pages[0]->format, format);
+}
+
+// Find space for a w x h glyph at the shelf position, starting a new page if
+// needed. Drops every page when that would go over the size limit.
+bool GlyphAtlas::reserve(int w, int h, const SDL_PixelFormat *format)
+{
+    if (!pages.empty() && shelf_x + w > ATLAS_PAGE_SIZE)
+    {
+        shelf_x = 0;
+        shelf_y += shelf_h;
+        shelf_h = 0;
+    }
+
+    if (pages.empty() || shelf_y + h > ATLAS_PAGE_SIZE)
+    {
+        uint32_t page_size_bytes = ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE * format->BytesPerPixel;
+        if ((pages.size() + 1) * page_size_bytes > max_size_bytes)
+        {
+            clear();
+        }
+
+        surface_unique_ptr page = create_surface_in_format(SDL_SWSURFACE, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, format);
+        if (!page)
+        {
+            return false;
+        }
+
+        // Background is skipped when drawing, so overlapping glyphs don't clip each other
+        Uint32 bg_color = SDL_MapRGB(page->format, bg.r, bg.g, bg.b);
+        SDL_FillRect(page.get(), nullptr, bg_color);
+        SDL_SetColorKey(page.get(), SDL_SRCCOLORKEY, bg_color);
+
+        pages.push_back(std::move(page));
+        shelf_x = 0;
+        shelf_y = 0;
+        shelf_h = 0;
+    }
+
+    shelf_h = std::max(shelf_h, h);
+    return true;
+}
+
+GlyphAtlas::AtlasGlyph GlyphAtlas::load_glyph(uint16_t ch, const GlyphMetrics &metrics, const SDL_PixelFormat *format)
+{
+    AtlasGlyph glyph;
+
+    surface_unique_ptr rendered { TTF_RenderGlyph_Shaded(font, ch, fg, bg) };
+    if (!rendered)
+    {
+        return glyph;
+    }
+
+    // Crop to the part SDL_ttf draws within a line
+    int offset_y = font_ascent - metrics.maxy;
+    int src_y = std::max(-offset_y, 0);
+    int w = std::min(rendered->w, metrics.maxx - metrics.minx);
+    int h = std::min(rendered->h, font_height - offset_y) - src_y;
+    if (w <= 0 || h <= 0 || w > ATLAS_PAGE_SIZE || h > ATLAS_PAGE_SIZE)
+    {
+        return glyph;
+    }
+
+    if (!reserve(w, h, format))
+    {
+        return glyph;
+    }
+
+    SDL_Rect src_rect = {0, static_cast<Sint16>(src_y), static_cast<Uint16>(w), static_cast<Uint16>(h)};
+    SDL_Rect dest_rect = {static_cast<Sint16>(shelf_x), static_cast<Sint16>(shelf_y), 0, 0};
+    SDL_BlitSurface(rendered.get(), &src_rect, pages.back().get(), &dest_rect);
+
+    glyph.page = pages.size() - 1;
+    glyph.src_rect = {static_cast<Sint16>(shelf_x), static_cast<Sint16>(shelf_y), static_cast<Uint16>(w), static_cast<Uint16>(h)};
+    glyph.offset_y = offset_y + src_y;
+
+    shelf_x += w;
+
+    return glyph;
+}
+
+const GlyphAtlas::AtlasGlyph &GlyphAtlas::atlas_glyph(uint16_t ch, const GlyphMetrics &metrics, const SDL_PixelFormat *format)
+{
+    if (ch < ascii_glyphs.size())
+    {
+        if (!ascii_loaded[ch])
+        {
+            ascii_glyphs[ch] = load_glyph(ch, metrics, format);
+            ascii_loaded[ch] = true;
+        }
+        return ascii_glyphs[ch];
+    }
+
+    auto it = atlas_glyphs.find(ch);
+    if (it == atlas_glyphs.end())
+    {
+        // Loading may drop pages and the glyphs in them, so look up again after
+        AtlasGlyph glyph = load_glyph(ch, metrics, format);
+        it = atlas_glyphs.emplace(ch, glyph).first;
+    }
+    return it->second;
+}
+
+int GlyphAtlas::text_width(const char *text)
+{
+    if (layout(text))
+    {
+        return line_width;
+    }
+
+    int w = 0, h;
+    TTF_SizeUTF8(font, text, &w, &h);
+    return w;
+}
+
+int GlyphAtlas::text_height() const
+{
+    return font_height;
+}
+
+void GlyphAtlas::render(const char *text, SDL_Surface *dest, int x, int y)
+{
+    if (!layout(text))
+    {
+        surface_unique_ptr surface { TTF_RenderUTF8_Shaded(font, text, fg, bg) };
+        if (surface)
+        {
+            SDL_Rect dest_rect = {static_cast<Sint16>(x), static_cast<Sint16>(y), 0, 0};
+            SDL_BlitSurface(surface.get(), nullptr, dest, &dest_rect);
+        }
+        return;
+    }
+
+    if (line_width <= 0)
+    {
+        return;
+    }
+
+    if (!has_format(dest->format))
+    {
+        clear();
+    }
+
+    // Background of the whole line, as with a shaded line surface
+    SDL_Rect line_rect = {
+        static_cast<Sint16>(x),
+        static_cast<Sint16>(y),
+        static_cast<Uint16>(line_width),
+        static_cast<Uint16>(font_height)
+    };
+    SDL_FillRect(dest, &line_rect, SDL_MapRGB(dest->format, bg.r, bg.g, bg.b));
+
+    for (const auto &placed : line)
+    {
+        const AtlasGlyph &glyph = atlas_glyph(placed.ch, *placed.metrics, dest->format);
+        if (glyph.page < 0)
+        {
+            continue;
+        }
+
+        SDL_Rect src_rect = glyph.src_rect;
+        int glyph_x = x + placed.x + placed.metrics->minx;
+
+        // Keep within the line
+        if (glyph_x < x)
+        {
+            int crop = x - glyph_x;
+            if (crop >= src_rect.w)
+            {
+                continue;
+            }
+            src_rect.x += crop;
+            src_rect.w -= crop;
+            glyph_x = x;
+        }
+
+        SDL_Rect dest_rect = {static_cast<Sint16>(glyph_x), static_cast<Sint16>(y + glyph.offset_y), 0, 0};
+        SDL_BlitSurface(pages[glyph.page].get(), &src_rect, dest, &dest_rect);
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef SDL_GLYPH_ATLAS_H_
+#define SDL_GLYPH_ATLAS_H_
+
+#include "./sdl_glyph_cache.h"
+#include "./sdl_pointer.h"
+
+#include <SDL/SDL_ttf.h>
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#define GLYPH_ATLAS_SIZE_BYTES (1024 * 1024)
+
+// Draws text as blitting the output of TTF_RenderUTF8_Shaded would, from
+// glyphs rasterized once into pages in the destination's pixel format. Pages
+// are dropped and refilled once max_size_bytes is reached. Text with chars
+// that can't be laid out from cached metrics goes through SDL_ttf.
+class GlyphAtlas
+{
+    // Location of a glyph's pixels within a page
+    struct AtlasGlyph
+    {
+        int page = -1;      // -1 if the glyph has no pixels
+        SDL_Rect src_rect = {0, 0, 0, 0};
+        int offset_y = 0;   // from top of line
+    };
+
+    struct PlacedGlyph
+    {
+        uint16_t ch;
+        int x;
+        const GlyphMetrics *metrics;
+    };
+
+    TTF_Font *font;
+    GlyphCache *glyphs;
+    SDL_Color fg;
+    SDL_Color bg;
+    int font_height;
+    int font_ascent;
+    uint32_t max_size_bytes;
+
+    std::vector<surface_unique_ptr> pages;
+    // Shelf packing position within the last page
+    int shelf_x = 0;
+    int shelf_y = 0;
+    int shelf_h = 0;
+
+    std::array<AtlasGlyph, 128> ascii_glyphs;
+    std::array<bool, 128> ascii_loaded {};
+    std::unordered_map<uint16_t, AtlasGlyph> atlas_glyphs;
+
+    std::vector<PlacedGlyph> line;
+    int line_width = 0;
+
+    bool layout(const char *text);
+    void clear();
+    bool has_format(const SDL_PixelFormat *format) const;
+    bool reserve(int w, int h, const SDL_PixelFormat *format);
+    AtlasGlyph load_glyph(uint16_t ch, const GlyphMetrics &metrics, const SDL_PixelFormat *format);
+    const AtlasGlyph &atlas_glyph(uint16_t ch, const GlyphMetrics &metrics, const SDL_PixelFormat *format);
+
+public:
+    GlyphAtlas(TTF_Font *font, SDL_Color fg, SDL_Color bg, uint32_t max_size_bytes = GLYPH_ATLAS_SIZE_BYTES);
+
+    // Size of text as rendered
+    int text_width(const char *text);
+    int text_height() const;
+    // Draw text with its top left at x, y. Respects the clip rect of dest.
+    void render(const char *text, SDL_Surface *dest, int x, int y);
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "./sdl_glyph_cache.h"
+
+#include <memory>
+
+uint32_t decode_ttf_char(const char *str, uint32_t max_len, uint16_t &ch_out)
+{
+    const unsigned char *s = reinterpret_cast<const unsigned char *>(str);
+    unsigned char c = s[0];
+    if (c < 0x80)
+    {
+        ch_out = c;
+        return c ? 1 : 0;
+    }
+
+    uint32_t len;
+    uint16_t ch;
+    if (c >= 0xC2 && c < 0xE0)
+    {
+        len = 2;
+        ch = c & 0x1F;
+    }
+    else if (c >= 0xE0 && c < 0xF0)
+    {
+        len = 3;
+        ch = c & 0x0F;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (len > max_len)
+    {
+        return 0;
+    }
+    for (uint32_t i = 1; i < len; ++i)
+    {
+        if ((s[i] & 0xC0) != 0x80)
+        {
+            return 0;
+        }
+        ch = (ch << 6) | (s[i] & 0x3F);
+    }
+
+    if ((len == 3 && ch < 0x800) || ch == 0xFEFF || ch == 0xFFFE)
+    {
+        return 0;
+    }
+
+    ch_out = ch;
+    return len;
+}
+
+GlyphCache::GlyphCache(TTF_Font *font)
+    : font(font),
+      use_kerning(TTF_GetFontKerning(font) != 0)
+{
+}
+
+bool GlyphCache::load_glyph(uint16_t ch, GlyphMetrics &metrics_out) const
+{
+    int miny;
+    if (TTF_GlyphMetrics(font, ch, &metrics_out.minx, &metrics_out.maxx, &miny, &metrics_out.maxy, &metrics_out.advance) != 0)
+    {
+        return false;
+    }
+    metrics_out.index = TTF_GlyphIsProvided(font, ch);
+    return true;
+}
+
+const GlyphMetrics *GlyphCache::glyph(uint16_t ch)
+{
+    if (ch < ascii_glyphs.size())
+    {
+        if (!ascii_loaded[ch])
+        {
+            if (!load_glyph(ch, ascii_glyphs[ch]))
+            {
+                return nullptr;
+            }
+            ascii_loaded[ch] = true;
+        }
+        return &ascii_glyphs[ch];
+    }
+
+    auto it = glyphs.find(ch);
+    if (it == glyphs.end())
+    {
+        GlyphMetrics metrics;
+        if (!load_glyph(ch, metrics))
+        {
+            return nullptr;
+        }
+        it = glyphs.emplace(ch, metrics).first;
+    }
+    return &it->second;
+}
+
+int GlyphCache::kerning(int prev_index, int index)
+{
+    if (!use_kerning || !prev_index || !index)
+    {
+        return 0;
+    }
+
+    uint64_t key = (static_cast<uint64_t>(prev_index) << 32) | static_cast<uint32_t>(index);
+    auto it = kerning_pairs.find(key);
+    if (it == kerning_pairs.end())
+    {
+        it = kerning_pairs.emplace(key, TTF_GetFontKerningSize(font, prev_index, index)).first;
+    }
+    return it->second;
+}
+
+GlyphCache &cached_glyphs(TTF_Font *font)
+{
+    static std::unordered_map<TTF_Font *, std::unique_ptr<GlyphCache>> glyph_caches;
+
+    auto &cache = glyph_caches[font];
+    if (!cache)
+    {
+        cache = std::make_unique<GlyphCache>(font);
+    }
+    return *cache;
+}
@@ -0,0 +1,53 @@
+#ifndef SDL_GLYPH_CACHE_H_
+#define SDL_GLYPH_CACHE_H_
+
+#include <SDL/SDL_ttf.h>
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+
+// Glyph metrics used by SDL_ttf to size text
+struct GlyphMetrics
+{
+    int minx;
+    int maxx;
+    int maxy;
+    int advance;
+    int index;      // glyph index in font, 0 if not provided
+};
+
+// Decode a character as SDL_ttf does. Only well formed sequences of
+// characters from the basic multilingual plane are handled, since SDL_ttf
+// truncates other characters, and treats byte order marks as directives.
+// Returns the sequence length, or 0 if not handled.
+uint32_t decode_ttf_char(const char *s, uint32_t max_len, uint16_t &ch_out);
+
+// Metrics and kerning of glyphs in a loaded font (a font at one size), kept
+// so text can be measured without asking SDL_ttf to size every string.
+class GlyphCache
+{
+    TTF_Font *font;
+    bool use_kerning;
+
+    std::array<GlyphMetrics, 128> ascii_glyphs;
+    std::array<bool, 128> ascii_loaded {};
+    std::unordered_map<uint16_t, GlyphMetrics> glyphs;
+    std::unordered_map<uint64_t, int> kerning_pairs;
+
+    bool load_glyph(uint16_t ch, GlyphMetrics &metrics_out) const;
+
+public:
+    GlyphCache(TTF_Font *font);
+
+    // Metrics of character, or nullptr if SDL_ttf can't provide them
+    const GlyphMetrics *glyph(uint16_t ch);
+    // Offset applied between glyphs, by index
+    int kerning(int prev_index, int index);
+};
+
+// Shared cache for font. Fonts from cached_load_font live for the whole
+// program, so their glyph caches do too.
+GlyphCache &cached_glyphs(TTF_Font *font);
+
+#endif
@@ -1,5 +1,7 @@
 #include "./sdl_image_cache.h"
 
+#include <algorithm>
+
 namespace
 {
 
@@ -10,17 +12,22 @@ uint32_t surface_size_bytes(const SDL_Surface *surface)
 
 } // namespace
 
-void SDLImageCache::put_image(const std::string &key, surface_unique_ptr image)
+void SDLImageCache::evict_to(uint64_t size_bytes)
 {
-    uint32_t surface_size = surface_size_bytes(image.get());
-
-    while (cache.size() && total_size_bytes + surface_size > IMAGE_CACHE_SIZE_BYTES)
+    while (cache.size() && total_size_bytes > size_bytes)
     {
         total_size_bytes -= surface_size_bytes(
             cache.back_value().get()
         );
         cache.pop();
     }
+}
+
+void SDLImageCache::put_image(const std::string &key, surface_unique_ptr image)
+{
+    uint32_t surface_size = surface_size_bytes(image.get());
+
+    evict_to(budget_bytes - std::min<uint64_t>(budget_bytes, surface_size));
 
     cache.put(key, std::move(image));
     total_size_bytes += surface_size;
@@ -34,3 +41,14 @@ SDL_Surface *SDLImageCache::get_image(const std::string &key)
     }
     return cache[key].get();
 }
+
+void SDLImageCache::set_budget(uint64_t size_bytes)
+{
+    budget_bytes = size_bytes;
+    evict_to(budget_bytes);
+}
+
+uint64_t SDLImageCache::size_bytes() const
+{
+    return total_size_bytes;
+}
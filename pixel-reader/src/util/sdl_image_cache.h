@@ -6,16 +6,25 @@
 
 #include <string>
 
+// Budget until told otherwise
 #define IMAGE_CACHE_SIZE_BYTES (64 * 1024 * 1024)
 
 class SDLImageCache
 {
     LRUCache<std::string, surface_unique_ptr> cache;
-    uint32_t total_size_bytes = 0;
+    uint64_t total_size_bytes = 0;
+    uint64_t budget_bytes = IMAGE_CACHE_SIZE_BYTES;
+
+    void evict_to(uint64_t size_bytes);
 
 public:
     void put_image(const std::string &key, surface_unique_ptr image);
     SDL_Surface *get_image(const std::string &key);
+
+    // Drops images least recently used to fit. Surfaces got from the cache
+    // may be freed.
+    void set_budget(uint64_t size_bytes);
+    uint64_t size_bytes() const;
 };
 
 #endif
@@ -39,5 +39,41 @@ surface_unique_ptr load_surface_from_ptr(const char *data, uint32_t size, const
         return nullptr;
     }
 
-    return surface_unique_ptr { SDL_ConvertSurface(loaded_surface.get(), surface_format, 0) };
+    return convert_surface_to_format(std::move(loaded_surface), surface_format);
+}
+
+bool same_pixel_format(const SDL_PixelFormat *a, const SDL_PixelFormat *b)
+{
+    return (
+        a->BitsPerPixel == b->BitsPerPixel &&
+        a->Rmask == b->Rmask &&
+        a->Gmask == b->Gmask &&
+        a->Bmask == b->Bmask &&
+        a->Amask == b->Amask
+    );
+}
+
+surface_unique_ptr create_surface_in_format(Uint32 flags, int w, int h, const SDL_PixelFormat *format)
+{
+    return surface_unique_ptr {
+        SDL_CreateRGBSurface(
+            flags,
+            w,
+            h,
+            format->BitsPerPixel,
+            format->Rmask,
+            format->Gmask,
+            format->Bmask,
+            format->Amask
+        )
+    };
+}
+
+surface_unique_ptr convert_surface_to_format(surface_unique_ptr surface, SDL_PixelFormat *format)
+{
+    if (!surface || (!surface->format->palette && same_pixel_format(surface->format, format)))
+    {
+        return surface;
+    }
+    return surface_unique_ptr { SDL_ConvertSurface(surface.get(), format, 0) };
 }
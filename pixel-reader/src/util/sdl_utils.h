@@ -10,4 +10,10 @@ int detect_line_height(const std::string &font, uint32_t size);
 
 surface_unique_ptr load_surface_from_ptr(const char *data, uint32_t size, const std::string &img_format, SDL_PixelFormat *surface_format);
 
+// Surfaces in the same format as the one they're blitted to are copied without per-pixel conversion
+bool same_pixel_format(const SDL_PixelFormat *a, const SDL_PixelFormat *b);
+surface_unique_ptr create_surface_in_format(Uint32 flags, int w, int h, const SDL_PixelFormat *format);
+// Returns surface as is if already in format
+surface_unique_ptr convert_surface_to_format(surface_unique_ptr surface, SDL_PixelFormat *format);
+
 #endif
@@ -47,3 +47,59 @@ std::string encode_uint_vector(const std::vector<uint32_t> &numbers)
 
     return ss.str();
 }
+
+bool try_decode_optional_uint_vector(const std::string &encoded, std::vector<std::experimental::optional<uint32_t>> &out)
+{
+    if (encoded.empty())
+    {
+        return true;
+    }
+
+    std::string::size_type pos = 0;
+    while (true)
+    {
+        auto end_pos = encoded.find(',', pos);
+        std::string next_str = encoded.substr(pos, end_pos == std::string::npos ? std::string::npos : end_pos - pos);
+        if (next_str.empty())
+        {
+            out.emplace_back();
+        }
+        else
+        {
+            auto int_opt = try_decode_uint(next_str);
+            if (!int_opt)
+            {
+                return false;
+            }
+            out.emplace_back(*int_opt);
+        }
+
+        if (end_pos == std::string::npos)
+        {
+            break;
+        }
+        pos = end_pos + 1;
+    }
+
+    return true;
+}
+
+std::string encode_optional_uint_vector(const std::vector<std::experimental::optional<uint32_t>> &numbers)
+{
+    std::ostringstream ss;
+
+    uint32_t n = numbers.size();
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        if (numbers[i])
+        {
+            ss << *numbers[i];
+        }
+        if (i < n - 1)
+        {
+            ss << ',';
+        }
+    }
+
+    return ss.str();
+}
@@ -10,4 +10,8 @@ std::experimental::optional<uint32_t> try_decode_uint(const std::string &str);
 bool try_decode_uint_vector(std::string encoded, std::vector<uint32_t> &out);
 std::string encode_uint_vector(const std::vector<uint32_t> &numbers);
 
+// Like uint vector, but missing values are encoded as empty fields (e.g. "1,,3")
+bool try_decode_optional_uint_vector(const std::string &encoded, std::vector<std::experimental::optional<uint32_t>> &out);
+std::string encode_optional_uint_vector(const std::vector<std::experimental::optional<uint32_t>> &numbers);
+
 #endif
@@ -1,28 +1,147 @@
 #include "./task_queue.h"
 
-TaskQueue::TaskQueue()
+#include <algorithm>
+
+CancelToken::CancelToken() : cancelled(std::make_shared<std::atomic<bool>>(false))
+{
+}
+
+void CancelToken::cancel() const
 {
+    *cancelled = true;
+}
+
+bool CancelToken::is_cancelled() const
+{
+    return *cancelled;
+}
+
+TaskQueue::TaskQueue() : TaskQueue(std::max(1u, std::thread::hardware_concurrency()))
+{
+}
+
+TaskQueue::TaskQueue(uint32_t num_workers)
+{
+    for (uint32_t i = 0; i < std::max(1u, num_workers); ++i)
+    {
+        workers.emplace_back(&TaskQueue::run_worker, this);
+    }
 }
 
 TaskQueue::~TaskQueue()
 {
-    drain();
+    shutdown();
+}
+
+void TaskQueue::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop_requested = true;
+    }
+    job_cv.notify_all();
+    for (auto &worker : workers)
+    {
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+    }
+}
+
+CancelToken TaskQueue::submit(work_func work, task_func on_complete, TaskPriority priority)
+{
+    CancelToken token;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued_jobs.push_back({std::move(work), std::move(on_complete), priority, next_seq++, token});
+    }
+    job_cv.notify_one();
+    return token;
 }
 
-void TaskQueue::submit(task_func task)
+void TaskQueue::post(task_func task)
 {
-    queue.push(task);
+    std::lock_guard<std::mutex> lock(mutex);
+    completions.push_back({std::move(task), CancelToken()});
 }
 
 bool TaskQueue::drain()
 {
     bool ran_task = false;
-    while (!queue.empty())
+    while (true)
     {
-        queue.front()();
-        queue.pop();
-        ran_task = true;
+        std::vector<Completion> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.swap(completions);
+        }
+        if (ready.empty())
+        {
+            break;
+        }
+
+        for (auto &completion : ready)
+        {
+            if (!completion.token.is_cancelled())
+            {
+                completion.func();
+                ran_task = true;
+            }
+        }
     }
 
     return ran_task;
 }
+
+uint32_t TaskQueue::num_workers() const
+{
+    return workers.size();
+}
+
+void TaskQueue::run_worker()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        job_cv.wait(lock, [&]() {
+            return stop_requested || !queued_jobs.empty();
+        });
+        if (stop_requested)
+        {
+            break;
+        }
+
+        auto next = next_job();
+        Job job = std::move(*next);
+        queued_jobs.erase(next);
+
+        if (!job.token.is_cancelled())
+        {
+            lock.unlock();
+            job.work(job.token);
+            // Captures are freed here rather than under the lock
+            job.work = nullptr;
+            lock.lock();
+        }
+
+        // Even if cancelled, so what the completion captured is freed on the
+        // drain thread
+        if (job.on_complete)
+        {
+            completions.push_back({std::move(job.on_complete), job.token});
+        }
+    }
+}
+
+// Highest priority, oldest first
+std::vector<TaskQueue::Job>::iterator TaskQueue::next_job()
+{
+    return std::min_element(queued_jobs.begin(), queued_jobs.end(), [](const Job &a, const Job &b) {
+        if (a.priority != b.priority)
+        {
+            return a.priority > b.priority;
+        }
+        return a.seq < b.seq;
+    });
+}
@@ -1,24 +1,97 @@
 #ifndef TASK_QUEUE_H_
 #define TASK_QUEUE_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
-#include <queue>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum class TaskPriority
+{
+    Low,
+    Normal,
+    High,
+};
+
+// Shared by a task and whoever started it. Cancelling skips the task if it
+// hasn't started, and its completion if it hasn't run. Long running work can
+// poll it to stop early.
+class CancelToken
+{
+    std::shared_ptr<std::atomic<bool>> cancelled;
+
+public:
+    CancelToken();
+
+    void cancel() const;
+    bool is_cancelled() const;
+};
 
 using task_func = typename std::function<void()>;
+using work_func = typename std::function<void(const CancelToken &)>;
 
+// Runs work on a pool of worker threads, and completions on the thread that
+// calls drain (the main loop). Completions can touch UI state without locks;
+// work should only touch what it owns or what's thread safe.
 class TaskQueue
 {
-    std::queue<task_func> queue;
+    struct Job
+    {
+        work_func work;
+        task_func on_complete;
+        TaskPriority priority;
+        uint64_t seq;
+        CancelToken token;
+    };
 
-public:
+    struct Completion
+    {
+        task_func func;
+        CancelToken token;
+    };
 
+    std::mutex mutex;
+    std::condition_variable job_cv;
+    std::vector<Job> queued_jobs;
+    std::vector<Completion> completions;
+    uint64_t next_seq = 0;
+    bool stop_requested = false;
+
+    std::vector<std::thread> workers;
+
+    void run_worker();
+    std::vector<Job>::iterator next_job();
+
+public:
+    // One worker per core
     TaskQueue();
-    virtual ~TaskQueue();
+    TaskQueue(uint32_t num_workers);
+    TaskQueue(const TaskQueue &) = delete;
+    TaskQueue &operator=(const TaskQueue &) = delete;
+
+    // Waits for running work. Queued work and completions are dropped.
+    ~TaskQueue();
 
-    void submit(task_func task);
-    
+    // Wait for running work and stop the workers. Work queued or submitted
+    // after is never run. Completions still run in drain.
+    void shutdown();
+
+    // Run work on a worker, highest priority first, then in order submitted.
+    // Once done, on_complete runs in drain unless cancelled.
+    CancelToken submit(work_func work, task_func on_complete = {}, TaskPriority priority = TaskPriority::Normal);
+
+    // Run task in drain. Can be called from any thread.
+    void post(task_func task);
+
+    // Run completions and posted tasks, including any they post.
     // Return true if ran tasks
     bool drain();
+
+    uint32_t num_workers() const;
 };
 
 #endif
@@ -0,0 +1,268 @@
+#include "../image_decode.h"
+
+#include <SDL/SDL_video.h>
+#include <gtest/gtest.h>
+#include <png.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static std::string bytes(std::initializer_list<int> values)
+{
+    std::string out;
+    for (int value : values)
+    {
+        out += static_cast<char>(value);
+    }
+    return out;
+}
+
+// RGBA PNG with a different value in each row and column
+static std::string encode_png(uint32_t w, uint32_t h)
+{
+    char *buffer = nullptr;
+    size_t size = 0;
+    FILE *file = open_memstream(&buffer, &size);
+
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info = png_create_info_struct(png);
+    png_init_io(png, file);
+    png_set_IHDR(png, info, w, h, 8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+
+    std::vector<uint8_t> row(w * 4);
+    for (uint32_t y = 0; y < h; ++y)
+    {
+        for (uint32_t x = 0; x < w; ++x)
+        {
+            row[x * 4] = x;
+            row[x * 4 + 1] = y;
+            row[x * 4 + 2] = x + y;
+            row[x * 4 + 3] = 0xff;
+        }
+        png_write_row(png, row.data());
+    }
+    png_write_end(png, nullptr);
+    png_destroy_write_struct(&png, &info);
+    fclose(file);
+
+    std::string data(buffer, size);
+    free(buffer);
+    return data;
+}
+
+static uint32_t pixel_at(const SDL_Surface *surface, uint32_t x, uint32_t y)
+{
+    return *reinterpret_cast<const uint32_t *>(static_cast<const uint8_t *>(surface->pixels) + y * surface->pitch + x * 4);
+}
+
+static void expect_size(const std::string &data, uint32_t w, uint32_t h)
+{
+    auto size = probe_image_size(data.data(), data.size());
+    ASSERT_TRUE(size);
+    EXPECT_EQ(w, size->w);
+    EXPECT_EQ(h, size->h);
+}
+
+TEST(IMAGE_DECODE, probe_png)
+{
+    std::string png = bytes({
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n',
+        0, 0, 0, 13, 'I', 'H', 'D', 'R',
+        0, 0, 0x0f, 0xa0,  // 4000
+        0, 0, 0x0b, 0xb8,  // 3000
+        8, 6, 0, 0, 0
+    });
+    expect_size(png, 4000, 3000);
+
+    // Truncated
+    std::string truncated = png.substr(0, 20);
+    EXPECT_FALSE(probe_image_size(truncated.data(), truncated.size()));
+}
+
+TEST(IMAGE_DECODE, probe_jpeg)
+{
+    std::string jpeg = bytes({
+        0xff, 0xd8,
+        // APP0, skipped
+        0xff, 0xe0, 0, 6, 'J', 'F', 'I', 'F',
+        // Fill bytes before a marker
+        0xff, 0xff,
+        // DHT, which is in the SOF range but isn't one
+        0xff, 0xc4, 0, 3, 0,
+        // Progressive SOF
+        0xff, 0xc2, 0, 11, 8,
+        0x02, 0x58,  // height 600
+        0x03, 0x20,  // width 800
+        3
+    });
+    expect_size(jpeg, 800, 600);
+
+    // Scan before any frame header
+    std::string no_frame = bytes({0xff, 0xd8, 0xff, 0xda, 0, 2, 0, 0, 0, 0});
+    EXPECT_FALSE(probe_image_size(no_frame.data(), no_frame.size()));
+
+    // Runs out before the frame header
+    std::string truncated = jpeg.substr(0, 23);
+    EXPECT_FALSE(probe_image_size(truncated.data(), truncated.size()));
+}
+
+TEST(IMAGE_DECODE, probe_gif_bmp)
+{
+    expect_size(bytes({'G', 'I', 'F', '8', '9', 'a', 0x40, 0x01, 0xf0, 0x00}), 320, 240);
+
+    std::string bmp(26, '\0');
+    bmp[0] = 'B';
+    bmp[1] = 'M';
+    bmp[14] = 40;    // info header size
+    bmp[18] = 100;   // width
+    bmp[22] = -50;   // height, negative for top down
+    for (int i = 23; i < 26; ++i)
+    {
+        bmp[i] = static_cast<char>(0xff);
+    }
+    expect_size(bmp, 100, 50);
+}
+
+TEST(IMAGE_DECODE, probe_unknown)
+{
+    std::string svg = "<svg xmlns=\"http://www.w3.org/2000/svg\"/>";
+    EXPECT_FALSE(probe_image_size(svg.data(), svg.size()));
+    EXPECT_FALSE(probe_image_size(nullptr, 0));
+
+    std::string empty_gif = bytes({'G', 'I', 'F', '8', '7', 'a', 0, 0, 0, 0});
+    EXPECT_FALSE(probe_image_size(empty_gif.data(), empty_gif.size()));
+}
+
+TEST(IMAGE_DECODE, fit_to_width)
+{
+    ImageSize small = fit_image_to_width({200, 100}, 320);
+    EXPECT_EQ(200, small.w);
+    EXPECT_EQ(100, small.h);
+
+    ImageSize large = fit_image_to_width({4000, 3000}, 320);
+    EXPECT_EQ(320, large.w);
+    EXPECT_EQ(240, large.h);
+
+    ImageSize thin = fit_image_to_width({4000, 1}, 320);
+    EXPECT_EQ(320, thin.w);
+    EXPECT_EQ(1, thin.h);
+}
+
+TEST(IMAGE_DECODE, downscale_averages_blocks)
+{
+    // 4x2 source, a value per pixel in every channel
+    const uint8_t values[2][4] = {
+        {0, 10, 100, 200},
+        {20, 30, 50, 0},
+    };
+
+    std::vector<uint8_t> dst(2 * 4, 0xee);
+    RowDownscaler scaler(4, 2, 2, 1, dst.data(), 2 * 4);
+    for (const auto &row_values : values)
+    {
+        std::vector<uint8_t> row;
+        for (uint8_t value : row_values)
+        {
+            row.insert(row.end(), 4, value);
+        }
+        EXPECT_FALSE(scaler.done());
+        scaler.add_row(row.data());
+    }
+    EXPECT_TRUE(scaler.done());
+
+    // Rounded averages of each 2x2 block
+    EXPECT_EQ(std::vector<uint8_t>({15, 15, 15, 15, 88, 88, 88, 88}), dst);
+}
+
+TEST(IMAGE_DECODE, downscale_uneven)
+{
+    // 3x3 to 2x2: blocks of 1 and 2 source pixels each way
+    std::vector<uint8_t> dst(2 * 4 * 2);
+    RowDownscaler scaler(3, 3, 2, 2, dst.data(), 2 * 4);
+    for (uint8_t y = 0; y < 3; ++y)
+    {
+        std::vector<uint8_t> row;
+        for (uint8_t x = 0; x < 3; ++x)
+        {
+            uint8_t value = (y * 3 + x) * 10;
+            row.insert(row.end(), {value, value, value, 255});
+        }
+        scaler.add_row(row.data());
+    }
+
+    // Top left averages the first 2x2, bottom right is the last pixel alone
+    EXPECT_EQ(20, dst[0]);
+    EXPECT_EQ(35, dst[4]);
+    EXPECT_EQ(65, dst[8]);
+    EXPECT_EQ(80, dst[12]);
+    EXPECT_EQ(255, dst[15]);
+}
+
+TEST(IMAGE_DECODE, downscale_same_size)
+{
+    std::vector<uint8_t> src = {1, 2, 3, 4, 5, 6, 7, 8};
+    std::vector<uint8_t> dst(8);
+    RowDownscaler scaler(2, 1, 2, 1, dst.data(), 8);
+    scaler.add_row(src.data());
+    EXPECT_EQ(src, dst);
+}
+
+TEST(IMAGE_DECODE, downscale_output_window)
+{
+    // 1x6 to 1x3, keeping only the middle row
+    std::vector<uint8_t> dst(4, 0xee);
+    RowDownscaler scaler(1, 6, 1, 3, nullptr, 0);
+    scaler.set_output(dst.data(), 4, 1, 1);
+
+    for (uint8_t y = 0; y < 6; ++y)
+    {
+        EXPECT_EQ(y / 2u, scaler.next_row());
+        std::vector<uint8_t> row(4, y * 10);
+        scaler.add_row(row.data());
+    }
+    EXPECT_TRUE(scaler.done());
+    EXPECT_EQ(3u, scaler.next_row());
+
+    EXPECT_EQ(std::vector<uint8_t>({25, 25, 25, 25}), dst);
+}
+
+TEST(IMAGE_DECODE, strips_match_whole_image)
+{
+    std::string png = encode_png(200, 100);
+    surface_unique_ptr format_surface {
+        SDL_CreateRGBSurface(SDL_SWSURFACE, 1, 1, 32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000)
+    };
+    SDL_PixelFormat *format = format_surface->format;
+
+    ImageStripDecoder whole_decoder(png.data(), png.size(), 100);
+    ASSERT_TRUE(whole_decoder.is_open());
+    EXPECT_EQ(100u, whole_decoder.size().w);
+    EXPECT_EQ(50u, whole_decoder.size().h);
+    auto whole = whole_decoder.decode_rows(0, 50, format);
+    ASSERT_TRUE(whole);
+
+    // Skip the first rows, then strips, the last cut short
+    ImageStripDecoder strip_decoder(png.data(), png.size(), 100);
+    uint32_t y = 5;
+    while (y < 50)
+    {
+        auto strip = strip_decoder.decode_rows(y, 20, format);
+        ASSERT_TRUE(strip);
+        ASSERT_EQ(std::min(20u, 50 - y), static_cast<uint32_t>(strip->h));
+        for (int strip_y = 0; strip_y < strip->h; ++strip_y)
+        {
+            for (uint32_t x = 0; x < 100; ++x)
+            {
+                ASSERT_EQ(pixel_at(whole.get(), x, y + strip_y), pixel_at(strip.get(), x, strip_y));
+            }
+        }
+        y += strip->h;
+    }
+    EXPECT_EQ(50u, strip_decoder.next_row());
+
+    // Rows already passed can't be decoded
+    EXPECT_FALSE(strip_decoder.decode_rows(10, 10, format));
+}
@@ -0,0 +1,174 @@
+#include "../image_disk_cache.h"
+#include "./test_files.h"
+
+#include <fcntl.h>
+#include <SDL/SDL_video.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+
+#include <cstring>
+#include <set>
+
+namespace
+{
+
+std::set<std::experimental::filesystem::path> entry_paths(const std::experimental::filesystem::path &dir)
+{
+    std::set<std::experimental::filesystem::path> paths;
+    for (const auto &entry : std::experimental::filesystem::directory_iterator(dir))
+    {
+        paths.insert(entry.path());
+    }
+    return paths;
+}
+
+// w x h RGBA, each pixel a different value
+surface_unique_ptr make_image(int w, int h, uint32_t seed)
+{
+    surface_unique_ptr surface {
+        SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000)
+    };
+    for (int y = 0; y < h; ++y)
+    {
+        uint32_t *row = reinterpret_cast<uint32_t *>(static_cast<uint8_t *>(surface->pixels) + y * surface->pitch);
+        for (int x = 0; x < w; ++x)
+        {
+            row[x] = seed + y * w + x;
+        }
+    }
+    return surface;
+}
+
+bool same_pixels(const SDL_Surface *a, const SDL_Surface *b)
+{
+    if (a->w != b->w || a->h != b->h)
+    {
+        return false;
+    }
+    for (int y = 0; y < a->h; ++y)
+    {
+        if (std::memcmp(
+            static_cast<const uint8_t *>(a->pixels) + y * a->pitch,
+            static_cast<const uint8_t *>(b->pixels) + y * b->pitch,
+            a->w * a->format->BytesPerPixel) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void set_used_time(const std::experimental::filesystem::path &path, time_t time)
+{
+    struct timespec times[2] = {{time, 0}, {time, 0}};
+    utimensat(AT_FDCWD, path.c_str(), times, 0);
+}
+
+} // namespace
+
+TEST(IMAGE_DISK_CACHE, store_load)
+{
+    TempDir dir("image_disk_cache");
+    ASSERT_FALSE(dir.path.empty());
+
+    ImageDiskCache cache(dir.path, 1024 * 1024);
+    auto image = make_image(5, 3, 100);
+    const std::string key = ImageDiskCache::image_key("book", "images/a.png", 320, image->format);
+
+    EXPECT_FALSE(cache.get_size(key));
+    EXPECT_FALSE(cache.load(key, image->format));
+
+    cache.store(key, image.get());
+
+    auto size = cache.get_size(key);
+    ASSERT_TRUE(size);
+    EXPECT_EQ(5u, size->w);
+    EXPECT_EQ(3u, size->h);
+
+    auto loaded = cache.load(key, image->format);
+    ASSERT_TRUE(loaded);
+    EXPECT_TRUE(same_pixels(image.get(), loaded.get()));
+}
+
+TEST(IMAGE_DISK_CACHE, keys_differ)
+{
+    TempDir dir("image_disk_cache");
+    ASSERT_FALSE(dir.path.empty());
+
+    auto image = make_image(2, 2, 0);
+    const SDL_PixelFormat *format = image->format;
+    const std::string key = ImageDiskCache::image_key("book", "a.png", 320, format);
+
+    EXPECT_NE(key, ImageDiskCache::image_key("other_book", "a.png", 320, format));
+    EXPECT_NE(key, ImageDiskCache::image_key("book", "b.png", 320, format));
+    EXPECT_NE(key, ImageDiskCache::image_key("book", "a.png", 640, format));
+
+    surface_unique_ptr rgb565 {SDL_CreateRGBSurface(SDL_SWSURFACE, 1, 1, 16, 0xf800, 0x07e0, 0x001f, 0)};
+    EXPECT_NE(key, ImageDiskCache::image_key("book", "a.png", 320, rgb565->format));
+
+    // Stored in one format, not loaded in another
+    ImageDiskCache cache(dir.path, 1024 * 1024);
+    cache.store(key, image.get());
+    EXPECT_FALSE(cache.load(key, rgb565->format));
+    EXPECT_TRUE(cache.load(key, image->format));
+}
+
+TEST(IMAGE_DISK_CACHE, ignores_bad_entries)
+{
+    TempDir dir("image_disk_cache");
+    ASSERT_FALSE(dir.path.empty());
+
+    ImageDiskCache cache(dir.path, 1024 * 1024);
+    auto image = make_image(4, 4, 0);
+    const std::string key = ImageDiskCache::image_key("book", "a.png", 320, image->format);
+    cache.store(key, image.get());
+
+    auto paths = entry_paths(dir.path);
+    ASSERT_EQ(1u, paths.size());
+    std::experimental::filesystem::resize_file(*paths.begin(), std::experimental::filesystem::file_size(*paths.begin()) - 1);
+
+    EXPECT_FALSE(cache.get_size(key));
+    EXPECT_FALSE(cache.load(key, image->format));
+}
+
+TEST(IMAGE_DISK_CACHE, evicts_least_recently_used)
+{
+    TempDir dir("image_disk_cache");
+    ASSERT_FALSE(dir.path.empty());
+
+    // Room for two 16x16 entries, not three
+    ImageDiskCache cache(dir.path, 3000);
+    auto image = make_image(16, 16, 0);
+    const std::string key_a = ImageDiskCache::image_key("book", "a.png", 320, image->format);
+    const std::string key_b = ImageDiskCache::image_key("book", "b.png", 320, image->format);
+    const std::string key_c = ImageDiskCache::image_key("book", "c.png", 320, image->format);
+
+    cache.store(key_a, image.get());
+    const auto path_a = *entry_paths(dir.path).begin();
+    set_used_time(path_a, 1000);
+
+    cache.store(key_b, image.get());
+    for (const auto &path : entry_paths(dir.path))
+    {
+        if (path != path_a)
+        {
+            set_used_time(path, 2000);
+        }
+    }
+
+    // Use a, leaving b least recently used
+    ASSERT_TRUE(cache.load(key_a, image->format));
+
+    cache.store(key_c, image.get());
+    EXPECT_TRUE(cache.get_size(key_a));
+    EXPECT_FALSE(cache.get_size(key_b));
+    EXPECT_TRUE(cache.get_size(key_c));
+    EXPECT_EQ(2u, entry_paths(dir.path).size());
+
+    // Too big to store at all
+    auto large = make_image(64, 64, 0);
+    const std::string key_large = ImageDiskCache::image_key("book", "large.png", 320, large->format);
+    cache.store(key_large, large.get());
+    EXPECT_FALSE(cache.get_size(key_large));
+    EXPECT_TRUE(cache.get_size(key_a));
+}
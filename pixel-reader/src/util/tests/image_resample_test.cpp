@@ -0,0 +1,379 @@
+#include "../image_resample.h"
+#include "../image_decode.h"
+
+#include <SDL/SDL_video.h>
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+std::vector<uint8_t> random_bytes(std::mt19937 &rng, uint32_t len)
+{
+    std::uniform_int_distribution<uint32_t> byte_dist(0, 255);
+    std::vector<uint8_t> bytes(len);
+    for (auto &b : bytes)
+    {
+        b = byte_dist(rng);
+    }
+    return bytes;
+}
+
+surface_unique_ptr make_rgba(int w, int h)
+{
+    return surface_unique_ptr {
+        SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000)
+    };
+}
+
+surface_unique_ptr make_rgb565(int w, int h)
+{
+    return surface_unique_ptr {
+        SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 16, 0xf800, 0x07e0, 0x001f, 0)
+    };
+}
+
+uint8_t *pixel_at(SDL_Surface *surface, int x, int y)
+{
+    return static_cast<uint8_t *>(surface->pixels) + y * surface->pitch + x * surface->format->BytesPerPixel;
+}
+
+void fill_random(SDL_Surface *surface, std::mt19937 &rng)
+{
+    for (int y = 0; y < surface->h; ++y)
+    {
+        auto bytes = random_bytes(rng, surface->w * surface->format->BytesPerPixel);
+        std::copy(bytes.begin(), bytes.end(), pixel_at(surface, 0, y));
+    }
+}
+
+// Each channel a different linear function of x and y
+void fill_gradient(SDL_Surface *surface)
+{
+    for (int y = 0; y < surface->h; ++y)
+    {
+        for (int x = 0; x < surface->w; ++x)
+        {
+            uint8_t *p = pixel_at(surface, x, y);
+            p[0] = x * 255 / std::max(surface->w - 1, 1);
+            p[1] = y * 255 / std::max(surface->h - 1, 1);
+            p[2] = 255 - p[0];
+            p[3] = 0xff;
+        }
+    }
+}
+
+} // namespace
+
+TEST(IMAGE_RESAMPLE, sum_pixel_blocks_matches_scalar)
+{
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<uint32_t> width_dist(0, 40);
+
+    for (uint32_t i = 0; i < 500; ++i)
+    {
+        std::vector<uint32_t> block_widths(1 + i % 17);
+        uint32_t row_width = 0;
+        for (auto &w : block_widths)
+        {
+            // Mostly narrow, sometimes past the 16 bit spill point
+            w = (i % 50 == 0) ? 600 : width_dist(rng);
+            row_width += w;
+        }
+        auto row = random_bytes(rng, row_width * 4);
+
+        std::vector<uint32_t> sums(block_widths.size() * 4, 7);
+        std::vector<uint32_t> expected(sums);
+        sum_pixel_blocks(row.data(), block_widths.data(), block_widths.size(), sums.data());
+        sum_pixel_blocks_scalar(row.data(), block_widths.data(), block_widths.size(), expected.data());
+        ASSERT_EQ(expected, sums) << "case " << i;
+    }
+}
+
+TEST(IMAGE_RESAMPLE, sum_pixel_runs_matches_scalar)
+{
+    std::mt19937 rng(1234);
+
+    for (uint32_t run_width : {1, 2, 3, 4, 5, 7, 8, 16})
+    {
+        for (uint32_t num_runs = 0; num_runs < 40; ++num_runs)
+        {
+            auto row = random_bytes(rng, run_width * num_runs * 4);
+            std::vector<uint16_t> sums(num_runs * 4, 3);
+            std::vector<uint16_t> expected(sums);
+            sum_pixel_runs(row.data(), run_width, num_runs, sums.data());
+            sum_pixel_runs_scalar(row.data(), run_width, num_runs, expected.data());
+            ASSERT_EQ(expected, sums) << run_width << " x " << num_runs;
+        }
+    }
+}
+
+TEST(IMAGE_RESAMPLE, divide_sums_exact)
+{
+    // Every count, every sum it can have
+    for (uint32_t count = 1; count <= 256; ++count)
+    {
+        std::vector<uint16_t> sums(count * 255 + 1);
+        for (uint32_t i = 0; i < sums.size(); ++i)
+        {
+            sums[i] = i;
+        }
+
+        std::vector<uint8_t> out(sums.size());
+        std::vector<uint8_t> out_scalar(sums.size());
+        divide_sums(sums.data(), sums.size(), count, out.data());
+        divide_sums_scalar(sums.data(), sums.size(), count, out_scalar.data());
+        for (uint32_t i = 0; i < sums.size(); ++i)
+        {
+            ASSERT_EQ((i + count / 2) / count, out_scalar[i]) << i << " / " << count;
+        }
+        ASSERT_EQ(out_scalar, out) << "count " << count;
+    }
+}
+
+TEST(IMAGE_RESAMPLE, interpolate_and_blend_match_scalar)
+{
+    std::mt19937 rng(1234);
+
+    for (uint32_t row_width = 1; row_width < 30; ++row_width)
+    {
+        const uint32_t out_width = row_width * 3 / 2 + 1;
+        auto row = random_bytes(rng, row_width * 4);
+
+        // Increasing positions, ending at the last pixel
+        std::vector<uint32_t> x0(out_width);
+        auto weight = random_bytes(rng, out_width);
+        for (uint32_t x = 0; x < out_width; ++x)
+        {
+            x0[x] = std::min(x * row_width / out_width, row_width - 1);
+        }
+        x0.back() = row_width - 1;
+
+        std::vector<uint16_t> top(out_width * 4);
+        std::vector<uint16_t> expected(out_width * 4);
+        interpolate_row(row.data(), row_width, x0.data(), weight.data(), out_width, top.data());
+        interpolate_row_scalar(row.data(), row_width, x0.data(), weight.data(), out_width, expected.data());
+        ASSERT_EQ(expected, top) << "width " << row_width;
+
+        std::vector<uint16_t> bottom(out_width * 4);
+        for (auto &v : bottom)
+        {
+            v = rng() % (255 * 256 + 1);
+        }
+        for (uint32_t w : {0, 1, 100, 128, 255})
+        {
+            std::vector<uint8_t> out(out_width * 4);
+            std::vector<uint8_t> out_scalar(out_width * 4);
+            blend_rows(top.data(), bottom.data(), top.size(), w, out.data());
+            blend_rows_scalar(top.data(), bottom.data(), top.size(), w, out_scalar.data());
+            ASSERT_EQ(out_scalar, out) << "width " << row_width << " weight " << w;
+        }
+    }
+}
+
+TEST(IMAGE_RESAMPLE, rgb565_round_trip)
+{
+    std::vector<uint16_t> pixels(0x10000);
+    for (uint32_t i = 0; i < pixels.size(); ++i)
+    {
+        pixels[i] = i;
+    }
+
+    std::vector<uint8_t> unpacked(pixels.size() * 4);
+    std::vector<uint8_t> unpacked_scalar(pixels.size() * 4);
+    unpack_rgb565_row(pixels.data(), pixels.size(), unpacked.data());
+    unpack_rgb565_row_scalar(pixels.data(), pixels.size(), unpacked_scalar.data());
+    ASSERT_EQ(unpacked_scalar, unpacked);
+
+    // Full range, opaque
+    EXPECT_EQ(std::vector<uint8_t>({0xff, 0xff, 0xff, 0xff}), std::vector<uint8_t>(unpacked.end() - 4, unpacked.end()));
+    EXPECT_EQ(std::vector<uint8_t>({0, 0, 0, 0xff}), std::vector<uint8_t>(unpacked.begin(), unpacked.begin() + 4));
+
+    std::vector<uint16_t> packed(pixels.size());
+    std::vector<uint16_t> packed_scalar(pixels.size());
+    pack_rgb565_row(unpacked.data(), pixels.size(), packed.data());
+    pack_rgb565_row_scalar(unpacked.data(), pixels.size(), packed_scalar.data());
+    EXPECT_EQ(pixels, packed_scalar);
+    EXPECT_EQ(pixels, packed);
+}
+
+TEST(IMAGE_RESAMPLE, equal_blocks_average)
+{
+    std::mt19937 rng(1234);
+
+    for (int block : {1, 2, 3, 4, 16})
+    {
+        auto src = make_rgba(5 * block, 3 * block);
+        fill_random(src.get(), rng);
+
+        auto dst = resample_surface(src.get(), 5, 3);
+        ASSERT_TRUE(dst);
+        ASSERT_EQ(5, dst->w);
+        ASSERT_EQ(3, dst->h);
+        EXPECT_EQ(src->format->Rmask, dst->format->Rmask);
+
+        for (int y = 0; y < 3; ++y)
+        {
+            for (int x = 0; x < 5; ++x)
+            {
+                for (int c = 0; c < 4; ++c)
+                {
+                    uint32_t sum = 0;
+                    for (int i = 0; i < block * block; ++i)
+                    {
+                        sum += pixel_at(src.get(), x * block + i % block, y * block + i / block)[c];
+                    }
+                    const uint32_t count = block * block;
+                    ASSERT_EQ((sum + count / 2) / count, pixel_at(dst.get(), x, y)[c])
+                        << "block " << block << " at " << x << ", " << y;
+                }
+            }
+        }
+    }
+}
+
+TEST(IMAGE_RESAMPLE, area_matches_downscaler)
+{
+    std::mt19937 rng(1234);
+
+    // Uneven reductions, and an exact one too large for equal blocks
+    const std::vector<std::vector<int>> sizes = {
+        {100, 37, 33, 17},
+        {640, 480, 300, 225},
+        {17, 200, 17, 9},
+        {400, 40, 20, 2},
+    };
+    for (const auto &size : sizes)
+    {
+        auto src = make_rgba(size[0], size[1]);
+        fill_random(src.get(), rng);
+
+        auto dst = resample_surface(src.get(), size[2], size[3]);
+        ASSERT_TRUE(dst);
+
+        std::vector<uint8_t> expected(size[2] * size[3] * 4);
+        RowDownscaler scaler(size[0], size[1], size[2], size[3], expected.data(), size[2] * 4);
+        for (int y = 0; y < size[1]; ++y)
+        {
+            scaler.add_row(pixel_at(src.get(), 0, y));
+        }
+
+        for (int y = 0; y < size[3]; ++y)
+        {
+            ASSERT_EQ(
+                std::vector<uint8_t>(expected.begin() + y * size[2] * 4, expected.begin() + (y + 1) * size[2] * 4),
+                std::vector<uint8_t>(pixel_at(dst.get(), 0, y), pixel_at(dst.get(), 0, y) + size[2] * 4)
+            ) << size[0] << "x" << size[1] << " row " << y;
+        }
+    }
+}
+
+TEST(IMAGE_RESAMPLE, bilinear)
+{
+    // Small reductions and enlargements
+    const std::vector<std::vector<int>> sizes = {
+        {30, 20, 20, 14},
+        {20, 14, 30, 20},
+        {7, 5, 64, 3},
+        {1, 1, 3, 2},
+    };
+    for (const auto &size : sizes)
+    {
+        // Constant stays constant
+        auto flat = make_rgba(size[0], size[1]);
+        for (int y = 0; y < size[1]; ++y)
+        {
+            for (int x = 0; x < size[0]; ++x)
+            {
+                uint8_t *p = pixel_at(flat.get(), x, y);
+                p[0] = 10;
+                p[1] = 128;
+                p[2] = 255;
+                p[3] = 77;
+            }
+        }
+        auto flat_dst = resample_surface(flat.get(), size[2], size[3]);
+        ASSERT_TRUE(flat_dst);
+        for (int y = 0; y < size[3]; ++y)
+        {
+            for (int x = 0; x < size[2]; ++x)
+            {
+                const uint8_t *p = pixel_at(flat_dst.get(), x, y);
+                ASSERT_EQ(std::vector<uint8_t>({10, 128, 255, 77}), std::vector<uint8_t>(p, p + 4));
+            }
+        }
+
+        // Gradients stay in order, within a level of the exact interpolation
+        auto src = make_rgba(size[0], size[1]);
+        fill_gradient(src.get());
+        auto dst = resample_surface(src.get(), size[2], size[3]);
+        ASSERT_TRUE(dst);
+        for (int y = 0; y < size[3]; ++y)
+        {
+            for (int x = 0; x < size[2]; ++x)
+            {
+                const double src_x = std::max(0.0, std::min((x + 0.5) * size[0] / size[2] - 0.5, size[0] - 1.0));
+                const int x0 = src_x;
+                const int x1 = std::min(x0 + 1, size[0] - 1);
+                const double exact = pixel_at(src.get(), x0, 0)[0] * (1 - (src_x - x0)) + pixel_at(src.get(), x1, 0)[0] * (src_x - x0);
+
+                const uint8_t *p = pixel_at(dst.get(), x, y);
+                EXPECT_NEAR(exact, p[0], 1.0) << size[0] << " to " << size[2] << " at " << x;
+                if (x > 0)
+                {
+                    EXPECT_GE(p[0], pixel_at(dst.get(), x - 1, y)[0]);
+                    EXPECT_LE(p[2], pixel_at(dst.get(), x - 1, y)[2]);
+                }
+                if (y > 0)
+                {
+                    EXPECT_GE(p[1], pixel_at(dst.get(), x, y - 1)[1]);
+                }
+            }
+        }
+    }
+}
+
+TEST(IMAGE_RESAMPLE, rgb565)
+{
+    std::mt19937 rng(1234);
+
+    for (const auto &size : std::vector<std::vector<int>>{{40, 20, 20, 10}, {45, 21, 20, 10}, {20, 10, 27, 13}})
+    {
+        auto src = make_rgb565(size[0], size[1]);
+        fill_random(src.get(), rng);
+
+        // Same as resampling the unpacked pixels, then packing
+        auto src_rgba = make_rgba(size[0], size[1]);
+        for (int y = 0; y < size[1]; ++y)
+        {
+            unpack_rgb565_row_scalar(reinterpret_cast<uint16_t *>(pixel_at(src.get(), 0, y)), size[0], pixel_at(src_rgba.get(), 0, y));
+        }
+
+        auto dst = resample_surface(src.get(), size[2], size[3]);
+        auto dst_rgba = resample_surface(src_rgba.get(), size[2], size[3]);
+        ASSERT_TRUE(dst);
+        ASSERT_TRUE(dst_rgba);
+        EXPECT_EQ(16, dst->format->BitsPerPixel);
+        EXPECT_EQ(0xf800u, dst->format->Rmask);
+
+        for (int y = 0; y < size[3]; ++y)
+        {
+            std::vector<uint16_t> expected(size[2]);
+            pack_rgb565_row_scalar(pixel_at(dst_rgba.get(), 0, y), size[2], expected.data());
+            const uint16_t *row = reinterpret_cast<uint16_t *>(pixel_at(dst.get(), 0, y));
+            ASSERT_EQ(expected, std::vector<uint16_t>(row, row + size[2])) << "row " << y;
+        }
+    }
+}
+
+TEST(IMAGE_RESAMPLE, unsupported_format)
+{
+    surface_unique_ptr rgb24 {SDL_CreateRGBSurface(SDL_SWSURFACE, 4, 4, 24, 0xff0000, 0x00ff00, 0x0000ff, 0)};
+    EXPECT_FALSE(resample_surface(rgb24.get(), 2, 2));
+
+    auto rgba = make_rgba(4, 4);
+    EXPECT_FALSE(resample_surface(rgba.get(), 0, 2));
+}
@@ -0,0 +1,126 @@
+#include "../indexed_dequeue.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+TEST(INDEXED_DEQUEUE, append_prepend)
+{
+    IndexedDequeue<int> items;
+    ASSERT_EQ(0, items.size());
+
+    items.append(0);
+    items.append(1);
+    items.prepend(-1);
+
+    ASSERT_EQ(-1, items.start_index());
+    ASSERT_EQ(2, items.end_index());
+    ASSERT_EQ(3, items.size());
+    ASSERT_EQ(-1, items[-1]);
+    ASSERT_EQ(0, items[0]);
+    ASSERT_EQ(1, items[1]);
+    ASSERT_EQ(-1, items.front());
+    ASSERT_EQ(1, items.back());
+}
+
+TEST(INDEXED_DEQUEUE, out_of_range)
+{
+    IndexedDequeue<int> items;
+    ASSERT_THROW(items[0], std::out_of_range);
+    ASSERT_THROW(items.pop_front(), std::out_of_range);
+    ASSERT_THROW(items.pop_back(), std::out_of_range);
+
+    items.append(0);
+    ASSERT_THROW(items[1], std::out_of_range);
+    ASSERT_THROW(items[-1], std::out_of_range);
+}
+
+TEST(INDEXED_DEQUEUE, pop_keeps_indexes)
+{
+    IndexedDequeue<int> items;
+    for (int i = 0; i < 5; ++i)
+    {
+        items.append(i);
+    }
+
+    items.pop_front();
+    items.pop_back();
+    ASSERT_EQ(1, items.start_index());
+    ASSERT_EQ(4, items.end_index());
+    ASSERT_EQ(1, items[1]);
+    ASSERT_EQ(3, items[3]);
+
+    items.prepend(0);
+    items.append(4);
+    for (int i = 0; i < 5; ++i)
+    {
+        ASSERT_EQ(i, items[i]);
+    }
+}
+
+TEST(INDEXED_DEQUEUE, grows_across_wraparound)
+{
+    IndexedDequeue<int> items;
+    for (int i = 0; i < 10; ++i)
+    {
+        items.append(i);
+    }
+    for (int i = 0; i < 8; ++i)
+    {
+        items.pop_front();
+    }
+    for (int i = 10; i < 100; ++i)
+    {
+        items.append(i);
+    }
+    for (int i = 7; i >= -20; --i)
+    {
+        items.prepend(i);
+    }
+
+    ASSERT_EQ(-20, items.start_index());
+    ASSERT_EQ(100, items.end_index());
+    for (int i = -20; i < 100; ++i)
+    {
+        ASSERT_EQ(i, items[i]);
+    }
+}
+
+TEST(INDEXED_DEQUEUE, sliding_window_keeps_capacity)
+{
+    IndexedDequeue<int> items;
+    for (int i = 0; i < 10; ++i)
+    {
+        items.append(i);
+    }
+    uint32_t capacity = items.capacity();
+
+    for (int i = 10; i < 1000; ++i)
+    {
+        items.append(i);
+        items.pop_front();
+        ASSERT_EQ(i, items.back());
+        ASSERT_EQ(i - 9, items.front());
+    }
+    ASSERT_EQ(capacity, items.capacity());
+}
+
+TEST(INDEXED_DEQUEUE, releases_removed_items)
+{
+    auto item = std::make_shared<int>(0);
+
+    IndexedDequeue<std::shared_ptr<int>> items;
+    items.append(item);
+    items.prepend(item);
+    ASSERT_EQ(3, item.use_count());
+
+    items.pop_front();
+    ASSERT_EQ(2, item.use_count());
+    items.pop_back();
+    ASSERT_EQ(1, item.use_count());
+
+    items.append(item);
+    items.clear();
+    ASSERT_EQ(1, item.use_count());
+    ASSERT_EQ(0, items.size());
+}
@@ -61,3 +61,17 @@ TEST(LRU_CACHE, replace)
     ASSERT_EQ(cache.size(), 1);
     ASSERT_EQ(cache["0"], 100);
 }
+
+TEST(LRU_CACHE, clear)
+{
+    lru_cache cache;
+    cache.put("0", 0);
+    cache.put("1", 1);
+    cache.clear();
+    ASSERT_EQ(cache.size(), 0);
+    ASSERT_FALSE(cache.has("0"));
+
+    cache.put("2", 2);
+    ASSERT_EQ(cache.size(), 1);
+    ASSERT_EQ(cache.back_key(), "2");
+}
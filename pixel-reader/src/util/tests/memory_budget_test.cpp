@@ -0,0 +1,181 @@
+#include "../memory_budget.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+namespace
+{
+
+constexpr uint64_t MB = 1024 * 1024;
+
+struct FakeCache
+{
+    uint64_t size_bytes = 0;
+    uint64_t budget_bytes = 0;
+    uint32_t num_budget_calls = 0;
+
+    MemoryBudget::Consumer consumer(MemoryPriority priority, uint64_t min_bytes, uint64_t max_bytes)
+    {
+        return {
+            "fake",
+            priority,
+            min_bytes,
+            max_bytes,
+            [this]() { return size_bytes; },
+            [this](uint64_t budget) {
+                budget_bytes = budget;
+                size_bytes = std::min(size_bytes, budget);
+                ++num_budget_calls;
+            }
+        };
+    }
+};
+
+} // namespace
+
+TEST(MEMORY_BUDGET, shares_by_priority)
+{
+    MemoryBudget budget(10 * MB, 0, {});
+
+    FakeCache low, normal, high;
+    auto low_reg = budget.add(low.consumer(MemoryPriority::Low, 1 * MB, 8 * MB));
+    auto normal_reg = budget.add(normal.consumer(MemoryPriority::Normal, 2 * MB, 8 * MB));
+    auto high_reg = budget.add(high.consumer(MemoryPriority::High, 1 * MB, 4 * MB));
+
+    // Minimums first, then the rest to the highest priority
+    ASSERT_EQ(4 * MB, high.budget_bytes);
+    ASSERT_EQ(5 * MB, normal.budget_bytes);
+    ASSERT_EQ(1 * MB, low.budget_bytes);
+}
+
+TEST(MEMORY_BUDGET, minimums_limited_by_total)
+{
+    MemoryBudget budget(3 * MB, 0, {});
+
+    FakeCache low, high;
+    auto low_reg = budget.add(low.consumer(MemoryPriority::Low, 2 * MB, 8 * MB));
+    auto high_reg = budget.add(high.consumer(MemoryPriority::High, 2 * MB, 8 * MB));
+
+    ASSERT_EQ(2 * MB, high.budget_bytes);
+    ASSERT_EQ(1 * MB, low.budget_bytes);
+}
+
+TEST(MEMORY_BUDGET, cut_under_pressure)
+{
+    uint64_t available = 100 * MB;
+    MemoryBudget budget(10 * MB, 4 * MB, [&available]() { return std::experimental::optional<uint64_t>(available); });
+
+    FakeCache cache;
+    cache.size_bytes = 6 * MB;
+    auto reg = budget.add(cache.consumer(MemoryPriority::Normal, 0, 10 * MB));
+    budget.update();
+    ASSERT_EQ(10 * MB, budget.current_budget_bytes());
+    ASSERT_EQ(10 * MB, cache.budget_bytes);
+
+    // What the cache holds counts as available
+    available = 1 * MB;
+    budget.update();
+    ASSERT_EQ(3 * MB, budget.current_budget_bytes());
+    ASSERT_EQ(3 * MB, cache.budget_bytes);
+    ASSERT_EQ(3 * MB, cache.size_bytes);
+
+    // Under the reserve
+    available = 0;
+    cache.size_bytes = 0;
+    budget.update();
+    ASSERT_EQ(0, cache.budget_bytes);
+
+    available = 100 * MB;
+    budget.update();
+    ASSERT_EQ(10 * MB, cache.budget_bytes);
+}
+
+TEST(MEMORY_BUDGET, unknown_available_uses_total)
+{
+    MemoryBudget budget(10 * MB, 4 * MB, []() { return std::experimental::optional<uint64_t>(); });
+
+    FakeCache cache;
+    auto reg = budget.add(cache.consumer(MemoryPriority::Normal, 0, 20 * MB));
+    budget.update();
+    ASSERT_EQ(10 * MB, cache.budget_bytes);
+}
+
+TEST(MEMORY_BUDGET, fixed_consumers_reduce_budget)
+{
+    MemoryBudget budget(10 * MB, 0, {});
+
+    uint64_t fixed_size = 3 * MB;
+    auto fixed_reg = budget.add({"fixed", MemoryPriority::High, 0, 0, [&fixed_size]() { return fixed_size; }, {}});
+
+    FakeCache cache;
+    auto reg = budget.add(cache.consumer(MemoryPriority::Low, 0, 10 * MB));
+    ASSERT_EQ(7 * MB, cache.budget_bytes);
+
+    fixed_size = 5 * MB;
+    budget.update();
+    ASSERT_EQ(5 * MB, cache.budget_bytes);
+    ASSERT_EQ(5 * MB, budget.used_bytes());
+}
+
+TEST(MEMORY_BUDGET, budget_only_set_on_change)
+{
+    MemoryBudget budget(10 * MB, 0, {});
+
+    FakeCache cache;
+    auto reg = budget.add(cache.consumer(MemoryPriority::Normal, 0, 4 * MB));
+    budget.update();
+    budget.update();
+    ASSERT_EQ(1, cache.num_budget_calls);
+}
+
+TEST(MEMORY_BUDGET, registration_removes_consumer)
+{
+    MemoryBudget budget(10 * MB, 0, {});
+
+    FakeCache first, second;
+    auto first_reg = budget.add(first.consumer(MemoryPriority::High, 0, 8 * MB));
+    {
+        auto second_reg = budget.add(second.consumer(MemoryPriority::Normal, 0, 8 * MB));
+        ASSERT_EQ(2 * MB, second.budget_bytes);
+
+        // Moved registration still removes once
+        MemoryBudget::Registration moved = std::move(first_reg);
+        first.size_bytes = 1 * MB;
+        ASSERT_EQ(1 * MB, budget.used_bytes());
+    }
+    ASSERT_EQ(0, budget.used_bytes());
+
+    FakeCache third;
+    auto third_reg = budget.add(third.consumer(MemoryPriority::Low, 0, 10 * MB));
+    ASSERT_EQ(10 * MB, third.budget_bytes);
+}
+
+TEST(MEMORY_BUDGET, parse_mem_available)
+{
+    ASSERT_EQ(
+        2048 * 1024,
+        parse_mem_available(
+            "MemTotal:         131072 kB\n"
+            "MemFree:            1024 kB\n"
+            "MemAvailable:       2048 kB\n"
+            "Buffers:             512 kB\n"
+            "Cached:             4096 kB\n"
+        ).value_or(0)
+    );
+
+    // Estimated without MemAvailable
+    ASSERT_EQ(
+        (1024 + 512 + 4096) * 1024,
+        parse_mem_available(
+            "MemTotal:         131072 kB\n"
+            "MemFree:            1024 kB\n"
+            "Buffers:             512 kB\n"
+            "Cached:             4096 kB\n"
+            "SwapCached:          256 kB\n"
+        ).value_or(0)
+    );
+
+    ASSERT_FALSE(parse_mem_available("MemTotal: 131072 kB\n"));
+    ASSERT_FALSE(parse_mem_available(""));
+}
@@ -0,0 +1,81 @@
+#include "../object_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+TEST(OBJECT_POOL, reuses_released)
+{
+    ObjectPool<int> pool;
+    int *a = pool.acquire();
+    int *b = pool.acquire();
+    ASSERT_NE(a, b);
+
+    pool.release(a);
+    ASSERT_EQ(a, pool.acquire());
+}
+
+TEST(OBJECT_POOL, grows_by_blocks)
+{
+    ObjectPool<int> pool;
+    std::set<int *> objs;
+    for (int i = 0; i < 1000; ++i)
+    {
+        int *obj = pool.acquire();
+        *obj = i;
+        objs.insert(obj);
+    }
+    ASSERT_EQ(1000, objs.size());
+    ASSERT_GE(pool.capacity(), 1000);
+    ASSERT_EQ(pool.capacity() - 1000, pool.num_free());
+
+    for (int *obj : objs)
+    {
+        pool.release(obj);
+    }
+    uint32_t capacity = pool.capacity();
+    for (int i = 0; i < 1000; ++i)
+    {
+        pool.acquire();
+    }
+    ASSERT_EQ(capacity, pool.capacity());
+}
+
+TEST(OBJECT_POOL, ptr_releases)
+{
+    ObjectPool<std::string> pool;
+    std::string *first;
+    {
+        auto str = pool.acquire_ptr();
+        str->assign(100, 'x');
+        first = str.get();
+    }
+    ASSERT_EQ(pool.capacity(), pool.num_free());
+
+    // Reused as released, storage and all
+    auto str = pool.acquire_ptr();
+    ASSERT_EQ(first, str.get());
+    ASSERT_GE(str->capacity(), 100);
+}
+
+TEST(OBJECT_POOL, for_each_free_visits_released)
+{
+    ObjectPool<std::string> pool;
+    std::string *a = pool.acquire();
+    std::string *b = pool.acquire();
+    a->assign(100, 'x');
+    b->assign(100, 'y');
+    pool.release(a);
+
+    std::set<std::string *> visited;
+    pool.for_each_free([&visited](std::string &str) {
+        visited.insert(&str);
+        std::string().swap(str);
+    });
+    ASSERT_EQ(pool.num_free(), visited.size());
+    ASSERT_EQ(1, visited.count(a));
+    ASSERT_EQ(0, visited.count(b));
+    ASSERT_EQ(100, b->size());
+}
@@ -57,3 +57,37 @@ TEST(ENCODE_UINT_VECTOR, encoding)
     ASSERT_EQ(encode_uint_vector(std::vector<uint32_t>{0}), "0");
     ASSERT_EQ(encode_uint_vector(std::vector<uint32_t>{0, 100, 200}), "0,100,200");
 }
+
+TEST(TRY_DECODE_OPTIONAL_UINT_VECTOR, missing_values)
+{
+    std::vector<std::experimental::optional<uint32_t>> array;
+    ASSERT_TRUE(try_decode_optional_uint_vector("100,,300,", array));
+    ASSERT_EQ(array.size(), 4);
+    ASSERT_EQ(*array[0], 100);
+    ASSERT_FALSE(array[1]);
+    ASSERT_EQ(*array[2], 300);
+    ASSERT_FALSE(array[3]);
+}
+
+TEST(TRY_DECODE_OPTIONAL_UINT_VECTOR, accepts_uint_vector_encoding)
+{
+    std::vector<std::experimental::optional<uint32_t>> array;
+    ASSERT_TRUE(try_decode_optional_uint_vector(encode_uint_vector({1, 2}), array));
+    ASSERT_EQ(array.size(), 2);
+    ASSERT_EQ(*array[0], 1);
+    ASSERT_EQ(*array[1], 2);
+}
+
+TEST(TRY_DECODE_OPTIONAL_UINT_VECTOR, invalid_number)
+{
+    std::vector<std::experimental::optional<uint32_t>> array;
+    ASSERT_FALSE(try_decode_optional_uint_vector("100,foo", array));
+}
+
+TEST(ENCODE_OPTIONAL_UINT_VECTOR, encoding)
+{
+    using opt_uint = std::experimental::optional<uint32_t>;
+    ASSERT_EQ(encode_optional_uint_vector({}), "");
+    ASSERT_EQ(encode_optional_uint_vector({opt_uint(0), opt_uint(), opt_uint(200)}), "0,,200");
+    ASSERT_EQ(encode_optional_uint_vector({opt_uint(), opt_uint()}), ",");
+}
@@ -0,0 +1,198 @@
+#include "../task_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// Drain until pred holds, or give up after a while
+template <typename F>
+bool drain_until(TaskQueue &queue, F pred)
+{
+    for (int i = 0; i < 2000 && !pred(); ++i)
+    {
+        queue.drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    queue.drain();
+    return pred();
+}
+
+} // namespace
+
+TEST(TASK_QUEUE, completes_on_drain_thread)
+{
+    TaskQueue queue(2);
+    ASSERT_EQ(2, queue.num_workers());
+
+    const auto main_id = std::this_thread::get_id();
+    std::thread::id work_id;
+    std::thread::id complete_id;
+    int result = 0;
+    bool done = false;
+
+    queue.submit(
+        [&](const CancelToken &) {
+            work_id = std::this_thread::get_id();
+            result = 42;
+        },
+        [&]() {
+            complete_id = std::this_thread::get_id();
+            done = true;
+        }
+    );
+
+    ASSERT_TRUE(drain_until(queue, [&]() { return done; }));
+    ASSERT_NE(main_id, work_id);
+    ASSERT_EQ(main_id, complete_id);
+    ASSERT_EQ(42, result);
+}
+
+TEST(TASK_QUEUE, runs_by_priority_then_order)
+{
+    TaskQueue queue(1);
+
+    // Hold the only worker while queueing
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    queue.submit([released](const CancelToken &) { released.wait(); });
+
+    std::vector<std::string> order;
+    auto record = [&order](std::string name) {
+        return [&order, name]() { order.push_back(name); };
+    };
+    auto nothing = [](const CancelToken &) {};
+    queue.submit(nothing, record("low"), TaskPriority::Low);
+    queue.submit(nothing, record("normal 1"));
+    queue.submit(nothing, record("high"), TaskPriority::High);
+    queue.submit(nothing, record("normal 2"));
+    release.set_value();
+
+    ASSERT_TRUE(drain_until(queue, [&]() { return order.size() == 4; }));
+    ASSERT_EQ((std::vector<std::string>{"high", "normal 1", "normal 2", "low"}), order);
+}
+
+TEST(TASK_QUEUE, cancel_skips_work_and_completion)
+{
+    TaskQueue queue(1);
+
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    queue.submit([released](const CancelToken &) { released.wait(); });
+
+    bool ran_work = false;
+    bool ran_completion = false;
+    auto token = queue.submit(
+        [&](const CancelToken &) { ran_work = true; },
+        [&]() { ran_completion = true; }
+    );
+    token.cancel();
+
+    bool last_done = false;
+    queue.submit([](const CancelToken &) {}, [&]() { last_done = true; });
+    release.set_value();
+
+    ASSERT_TRUE(drain_until(queue, [&]() { return last_done; }));
+    ASSERT_FALSE(ran_work);
+    ASSERT_FALSE(ran_completion);
+}
+
+TEST(TASK_QUEUE, cancel_after_work_skips_completion)
+{
+    TaskQueue queue(1);
+
+    std::promise<void> worked;
+    bool ran_completion = false;
+    auto token = queue.submit(
+        [&](const CancelToken &) { worked.set_value(); },
+        [&]() { ran_completion = true; }
+    );
+    worked.get_future().wait();
+    token.cancel();
+
+    bool last_done = false;
+    queue.submit([](const CancelToken &) {}, [&]() { last_done = true; });
+
+    ASSERT_TRUE(drain_until(queue, [&]() { return last_done; }));
+    ASSERT_FALSE(ran_completion);
+}
+
+TEST(TASK_QUEUE, work_sees_cancel)
+{
+    TaskQueue queue(1);
+
+    std::promise<void> started;
+    std::promise<bool> stopped;
+    auto token = queue.submit([&](const CancelToken &token) {
+        started.set_value();
+        while (!token.is_cancelled())
+        {
+            std::this_thread::yield();
+        }
+        stopped.set_value(true);
+    });
+    started.get_future().wait();
+    token.cancel();
+    ASSERT_TRUE(stopped.get_future().get());
+}
+
+TEST(TASK_QUEUE, post_runs_on_drain)
+{
+    TaskQueue queue(1);
+
+    std::vector<int> ran;
+    queue.post([&]() {
+        ran.push_back(1);
+        queue.post([&]() { ran.push_back(2); });
+    });
+    ASSERT_TRUE(ran.empty());
+
+    ASSERT_TRUE(queue.drain());
+    ASSERT_EQ((std::vector<int>{1, 2}), ran);
+    ASSERT_FALSE(queue.drain());
+}
+
+TEST(TASK_QUEUE, shutdown_waits_for_running_work)
+{
+    TaskQueue queue(1);
+
+    bool finished = false;
+    bool ran_queued = false;
+    std::promise<void> started;
+    queue.submit([&](const CancelToken &) {
+        started.set_value();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        finished = true;
+    });
+    queue.submit([&](const CancelToken &) { ran_queued = true; });
+    started.get_future().wait();
+
+    queue.shutdown();
+    ASSERT_TRUE(finished);
+    ASSERT_FALSE(ran_queued);
+
+    // Safe to call again, and from the destructor
+    queue.shutdown();
+}
+
+TEST(TASK_QUEUE, destroy_waits_for_running_work)
+{
+    bool finished = false;
+    {
+        TaskQueue queue(1);
+        std::promise<void> started;
+        queue.submit([&](const CancelToken &) {
+            started.set_value();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            finished = true;
+        });
+        started.get_future().wait();
+    }
+    ASSERT_TRUE(finished);
+}
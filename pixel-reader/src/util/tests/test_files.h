@@ -0,0 +1,123 @@
+#ifndef TEST_FILES_H_
+#define TEST_FILES_H_
+
+#include <experimental/filesystem>
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Removed with everything in it when done
+struct TempDir
+{
+    std::experimental::filesystem::path path;
+
+    TempDir(const std::string &prefix)
+    {
+        std::string pattern = (std::experimental::filesystem::temp_directory_path() / (prefix + "_XXXXXX")).string();
+        if (mkdtemp(&pattern[0]))
+        {
+            path = pattern;
+        }
+    }
+
+    ~TempDir()
+    {
+        if (!path.empty())
+        {
+            std::experimental::filesystem::remove_all(path);
+        }
+    }
+};
+
+inline std::experimental::filesystem::path write_file(const TempDir &dir, const std::string &name, const std::string &contents)
+{
+    auto path = dir.path / name;
+    std::ofstream out(path, std::ios::binary);
+    out << contents;
+    return path;
+}
+
+inline void put_u16(std::string &out, uint16_t v)
+{
+    out.push_back(v & 0xff);
+    out.push_back(v >> 8);
+}
+
+inline void put_u32(std::string &out, uint32_t v)
+{
+    put_u16(out, v & 0xffff);
+    put_u16(out, v >> 16);
+}
+
+struct StoredFile
+{
+    std::string name;
+    std::string data;
+    // Size recorded in the central directory, if not the data's
+    uint32_t recorded_size = 0;
+    // Extra field length recorded in the local header, with no extra data
+    uint16_t local_extra_len = 0;
+};
+
+// Zip of uncompressed entries. CRCs are left zero, as nothing here checks them.
+inline std::string make_stored_zip(const std::vector<StoredFile> &files)
+{
+    std::string out;
+    std::vector<uint32_t> offsets;
+    for (const auto &file : files)
+    {
+        offsets.push_back(out.size());
+        put_u32(out, 0x04034b50);
+        put_u16(out, 10);  // version needed
+        put_u16(out, 0);   // flags
+        put_u16(out, 0);   // stored
+        put_u32(out, 0);   // time, date
+        put_u32(out, 0);   // crc
+        put_u32(out, file.data.size());
+        put_u32(out, file.data.size());
+        put_u16(out, file.name.size());
+        put_u16(out, file.local_extra_len);
+        out += file.name;
+        out += file.data;
+    }
+
+    uint32_t cd_offset = out.size();
+    for (uint32_t i = 0; i < files.size(); ++i)
+    {
+        const auto &file = files[i];
+        uint32_t size = file.recorded_size ? file.recorded_size : file.data.size();
+        put_u32(out, 0x02014b50);
+        put_u16(out, 20);  // version made by
+        put_u16(out, 10);  // version needed
+        put_u16(out, 0);   // flags
+        put_u16(out, 0);   // stored
+        put_u32(out, 0);   // time, date
+        put_u32(out, 0);   // crc
+        put_u32(out, size);
+        put_u32(out, size);
+        put_u16(out, file.name.size());
+        put_u16(out, 0);   // extra
+        put_u16(out, 0);   // comment
+        put_u16(out, 0);   // disk
+        put_u16(out, 0);   // internal attributes
+        put_u32(out, 0);   // external attributes
+        put_u32(out, offsets[i]);
+        out += file.name;
+    }
+    uint32_t cd_size = out.size() - cd_offset;
+
+    put_u32(out, 0x06054b50);
+    put_u16(out, 0);
+    put_u16(out, 0);
+    put_u16(out, files.size());
+    put_u16(out, files.size());
+    put_u32(out, cd_size);
+    put_u32(out, cd_offset);
+    put_u16(out, 0);  // comment
+    return out;
+}
+
+#endif
@@ -0,0 +1,122 @@
+#include "../text_scan.h"
+#include "../str_utils.h"
+#include "../utf8.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+
+// Bytes likely to trip up a vector kernel: whitespace, multi-byte utf-8
+// sequences, stray continuation bytes and bytes with the high bit set
+static std::string random_text(std::mt19937 &rng, uint32_t len)
+{
+    static const std::vector<std::string> pieces = {
+        "a", "Z", " ", " ", "  ", "\t", "\r", "\n", "\xc3\xa9", "\xe2\x80\x94", "\xf0\x9f\x98\x80", "\x80", "\xbf", "\xff", "\x7f",
+    };
+    std::uniform_int_distribution<uint32_t> piece_dist(0, pieces.size() - 1);
+
+    std::string text;
+    while (text.size() < len)
+    {
+        text += pieces[piece_dist(rng)];
+    }
+    text.resize(len);
+    return text;
+}
+
+// Character stepping over a null terminated string, as addressing was first defined
+static uint32_t stepped_count(const std::string &text)
+{
+    uint32_t count = 0;
+    const char *str = text.c_str();
+    while (*str)
+    {
+        if (!is_whitespace(*str))
+        {
+            ++count;
+        }
+        str = utf8_step(str);
+    }
+    return count;
+}
+
+TEST(TEXT_SCAN, count_non_whitespace_chars_examples)
+{
+    EXPECT_EQ(count_non_whitespace_chars("", 0), 0);
+    EXPECT_EQ(count_non_whitespace_chars("a b", 3), 2);
+    EXPECT_EQ(count_non_whitespace_chars(" \t\r\n", 4), 0);
+    EXPECT_EQ(count_non_whitespace_chars("caf\xc3\xa9 au lait", 13), 10);
+    // Leading continuation byte is a character of its own
+    EXPECT_EQ(count_non_whitespace_chars("\x80\x80 a", 4), 2);
+}
+
+TEST(TEXT_SCAN, count_non_whitespace_chars_matches_scalar)
+{
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<uint32_t> len_dist(0, 300);
+
+    for (uint32_t i = 0; i < 2000; ++i)
+    {
+        // Long strings overflow the per-lane counters
+        uint32_t len = i % 100 == 0 ? 20000 : len_dist(rng);
+        std::string text = random_text(rng, len);
+
+        uint32_t expected = stepped_count(text);
+        ASSERT_EQ(count_non_whitespace_chars_scalar(text.data(), text.size()), expected) << i;
+        ASSERT_EQ(count_non_whitespace_chars(text.data(), text.size()), expected) << i;
+
+        // Unaligned starts
+        for (uint32_t offset = 1; offset < 4 && offset < text.size(); ++offset)
+        {
+            ASSERT_EQ(
+                count_non_whitespace_chars(text.data() + offset, text.size() - offset),
+                count_non_whitespace_chars_scalar(text.data() + offset, text.size() - offset)
+            ) << i << " " << offset;
+        }
+    }
+}
+
+TEST(TEXT_SCAN, collapse_whitespace_examples)
+{
+    char out[32];
+    bool last_was_whitespace = false;
+    EXPECT_EQ(std::string(out, collapse_whitespace("a \t\r\nb  ", 8, out, last_was_whitespace)), "a b ");
+    EXPECT_TRUE(last_was_whitespace);
+
+    // Run continues from the previous call
+    EXPECT_EQ(std::string(out, collapse_whitespace("  c", 3, out, last_was_whitespace)), "c");
+    EXPECT_FALSE(last_was_whitespace);
+}
+
+TEST(TEXT_SCAN, collapse_whitespace_matches_scalar)
+{
+    std::mt19937 rng(5678);
+    std::uniform_int_distribution<uint32_t> len_dist(0, 300);
+
+    for (uint32_t i = 0; i < 2000; ++i)
+    {
+        std::string text = random_text(rng, len_dist(rng));
+        std::uniform_int_distribution<uint32_t> split_dist(0, text.size());
+        uint32_t split = split_dist(rng);
+
+        // Split in two, to check state carried between calls
+        for (bool start_after_whitespace : {false, true})
+        {
+            std::string expected(text.size(), '\0');
+            bool expected_last = start_after_whitespace;
+            size_t expected_size = collapse_whitespace_scalar(text.data(), split, &expected[0], expected_last);
+            expected_size += collapse_whitespace_scalar(text.data() + split, text.size() - split, &expected[expected_size], expected_last);
+            expected.resize(expected_size);
+
+            std::string actual(text.size(), '\0');
+            bool actual_last = start_after_whitespace;
+            size_t actual_size = collapse_whitespace(text.data(), split, &actual[0], actual_last);
+            actual_size += collapse_whitespace(text.data() + split, text.size() - split, &actual[actual_size], actual_last);
+            actual.resize(actual_size);
+
+            ASSERT_EQ(actual, expected) << i;
+            ASSERT_EQ(actual_last, expected_last) << i;
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#include "../zip_archive.h"
+#include "./test_files.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+
+TEST(ZIP_ARCHIVE, maps_stored_entry)
+{
+    TempDir dir("zip_archive");
+    auto path = write_file(dir, "ok.zip", make_stored_zip({{"a.txt", "hello world"}, {"b.txt", "second"}}));
+
+    ZipArchive zip(path);
+    ASSERT_TRUE(zip.open());
+
+    auto mapped = zip.map_entry("b.txt");
+    ASSERT_TRUE(mapped);
+    ASSERT_EQ("second", std::string(mapped->data(), mapped->size()));
+}
+
+TEST(ZIP_ARCHIVE, entry_past_end_not_mapped)
+{
+    TempDir dir("zip_archive");
+    // Central directory claims more data than the file holds
+    auto path = write_file(dir, "truncated.zip", make_stored_zip({{"a.txt", "hello world", 1024 * 1024}}));
+
+    ZipArchive zip(path);
+    ASSERT_TRUE(zip.open());
+    ASSERT_FALSE(zip.map_entry("a.txt"));
+}
+
+TEST(ZIP_ARCHIVE, local_header_past_end_not_mapped)
+{
+    TempDir dir("zip_archive");
+    // Local header's extra field pushes the data past the end of the file
+    auto path = write_file(dir, "bad_extra.zip", make_stored_zip({{"a.txt", "hello world", 0, 0xffff}}));
+
+    ZipArchive zip(path);
+    ASSERT_TRUE(zip.open());
+    ASSERT_FALSE(zip.map_entry("a.txt"));
+}
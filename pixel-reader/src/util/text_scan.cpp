@@ -0,0 +1,165 @@
+#include "./text_scan.h"
+
+#include "./str_utils.h"
+
+#include <cstring>
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+uint32_t count_non_whitespace_chars_scalar(const char *str, size_t len)
+{
+    uint32_t count = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        // Continuation bytes are skipped over, except at the start
+        bool is_char_start = i == 0 || (str[i] & 0xC0) != 0x80;
+        if (is_char_start && !is_whitespace(str[i]))
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+size_t collapse_whitespace_scalar(const char *str, size_t len, char *out, bool &last_was_whitespace)
+{
+    char *out_start = out;
+    for (size_t i = 0; i < len; ++i)
+    {
+        char c = str[i];
+        if (is_whitespace(c))
+        {
+            if (!last_was_whitespace)
+            {
+                *out++ = ' ';
+                last_was_whitespace = true;
+            }
+        }
+        else
+        {
+            *out++ = c;
+            last_was_whitespace = false;
+        }
+    }
+    return out - out_start;
+}
+
+#ifdef __ARM_NEON
+
+namespace
+{
+
+constexpr size_t BLOCK_SIZE = 16;
+
+inline uint8x16_t whitespace_mask(uint8x16_t block)
+{
+    return vorrq_u8(
+        vorrq_u8(vceqq_u8(block, vdupq_n_u8(' ')), vceqq_u8(block, vdupq_n_u8('\t'))),
+        vorrq_u8(vceqq_u8(block, vdupq_n_u8('\r')), vceqq_u8(block, vdupq_n_u8('\n')))
+    );
+}
+
+inline bool any_set(uint8x16_t mask)
+{
+    uint8x8_t folded = vorr_u8(vget_low_u8(mask), vget_high_u8(mask));
+    return vget_lane_u64(vreinterpret_u64_u8(folded), 0) != 0;
+}
+
+inline uint32_t sum_lanes(uint8x16_t counts)
+{
+    uint64x2_t sums = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(counts)));
+    return vgetq_lane_u64(sums, 0) + vgetq_lane_u64(sums, 1);
+}
+
+} // namespace
+
+uint32_t count_non_whitespace_chars(const char *str, size_t len)
+{
+    if (len < BLOCK_SIZE)
+    {
+        return count_non_whitespace_chars_scalar(str, len);
+    }
+
+    // A leading continuation byte is counted, unlike any other
+    uint32_t count = (str[0] & 0xC0) == 0x80;
+
+    const uint8_t *s = reinterpret_cast<const uint8_t*>(str);
+    size_t i = 0;
+    while (len - i >= BLOCK_SIZE)
+    {
+        // Lanes count up to 255 before spilling
+        uint8x16_t counts = vdupq_n_u8(0);
+        for (uint32_t j = 0; j < 255 && len - i >= BLOCK_SIZE; ++j, i += BLOCK_SIZE)
+        {
+            uint8x16_t block = vld1q_u8(s + i);
+            uint8x16_t is_continuation = vceqq_u8(vandq_u8(block, vdupq_n_u8(0xC0)), vdupq_n_u8(0x80));
+            uint8x16_t skip = vorrq_u8(is_continuation, whitespace_mask(block));
+            // Mask lanes are 0 or 0xff, so adding the inverse counts down from 0
+            counts = vsubq_u8(counts, vmvnq_u8(skip));
+        }
+        count += sum_lanes(counts);
+    }
+
+    for (; i < len; ++i)
+    {
+        if ((s[i] & 0xC0) != 0x80 && !is_whitespace(s[i]))
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+size_t collapse_whitespace(const char *str, size_t len, char *out, bool &last_was_whitespace)
+{
+    const uint8_t *s = reinterpret_cast<const uint8_t*>(str);
+    char *out_start = out;
+
+    // Prose mostly has blocks with only single spaces, which are copied as is
+    size_t i = 0;
+    uint8x16_t prev_whitespace = vdupq_n_u8(last_was_whitespace ? 0xff : 0);
+    for (; len - i >= BLOCK_SIZE; i += BLOCK_SIZE)
+    {
+        uint8x16_t block = vld1q_u8(s + i);
+        uint8x16_t is_space = vceqq_u8(block, vdupq_n_u8(' '));
+        uint8x16_t whitespace = whitespace_mask(block);
+
+        // Whitespace preceded by whitespace, or other than ' ', is rewritten
+        uint8x16_t follows_whitespace = vextq_u8(prev_whitespace, whitespace, 15);
+        uint8x16_t rewritten = vorrq_u8(
+            vandq_u8(whitespace, follows_whitespace),
+            vbicq_u8(whitespace, is_space)
+        );
+
+        if (any_set(rewritten))
+        {
+            out += collapse_whitespace_scalar(str + i, BLOCK_SIZE, out, last_was_whitespace);
+        }
+        else
+        {
+            memcpy(out, str + i, BLOCK_SIZE);
+            out += BLOCK_SIZE;
+            last_was_whitespace = s[i + BLOCK_SIZE - 1] == ' ';
+        }
+        prev_whitespace = whitespace;
+    }
+
+    out += collapse_whitespace_scalar(str + i, len - i, out, last_was_whitespace);
+    return out - out_start;
+}
+
+#else
+
+uint32_t count_non_whitespace_chars(const char *str, size_t len)
+{
+    return count_non_whitespace_chars_scalar(str, len);
+}
+
+size_t collapse_whitespace(const char *str, size_t len, char *out, bool &last_was_whitespace)
+{
+    return collapse_whitespace_scalar(str, len, out, last_was_whitespace);
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef TEXT_SCAN_H_
+#define TEXT_SCAN_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Bulk versions of the per-character loops over document text, using NEON
+// where available. Each has a scalar reference implementation, which the
+// vector version must match exactly.
+
+// Number of utf-8 characters in str[0, len) that aren't whitespace, stepping
+// as utf8_step does. A leading continuation byte counts as a character.
+uint32_t count_non_whitespace_chars(const char *str, size_t len);
+uint32_t count_non_whitespace_chars_scalar(const char *str, size_t len);
+
+// Copy str[0, len) to out, converting whitespace to ' ' and collapsing runs of
+// it to a single char. last_was_whitespace carries state between calls, so a
+// run spanning calls is collapsed too. out must have room for len chars.
+// Returns number of chars written.
+size_t collapse_whitespace(const char *str, size_t len, char *out, bool &last_was_whitespace);
+size_t collapse_whitespace_scalar(const char *str, size_t len, char *out, bool &last_was_whitespace);
+
+#endif
@@ -0,0 +1,388 @@
+#include "./zip_archive.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zip.h>
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+
+constexpr uint32_t EOCD_SIGNATURE = 0x06054b50;
+constexpr uint32_t EOCD_SIZE = 22;
+constexpr uint32_t MAX_COMMENT_SIZE = 0xffff;
+constexpr uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+constexpr uint32_t CENTRAL_HEADER_SIZE = 46;
+constexpr uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+constexpr uint32_t LOCAL_HEADER_SIZE = 30;
+
+uint16_t read_u16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+uint32_t read_u32(const unsigned char *p)
+{
+    return read_u16(p) | (static_cast<uint32_t>(read_u16(p + 2)) << 16);
+}
+
+bool read_exact(int fd, void *buf, size_t size, off_t offset)
+{
+    return pread(fd, buf, size, offset) == static_cast<ssize_t>(size);
+}
+
+} // namespace
+
+ZipEntryReader::ZipEntryReader(zip_t *zip, uint64_t index)
+    : zip(zip), index(index)
+{
+}
+
+ZipEntryReader::~ZipEntryReader()
+{
+    if (file)
+    {
+        zip_fclose(file);
+    }
+}
+
+bool ZipEntryReader::rewind()
+{
+    if (file)
+    {
+        zip_fclose(file);
+    }
+
+    file = zip_fopen_index(zip, index, 0);
+    return file != nullptr;
+}
+
+int64_t ZipEntryReader::read(char *buf, uint64_t size)
+{
+    if (!file)
+    {
+        return -1;
+    }
+    return zip_fread(file, buf, size);
+}
+
+////////////////////////
+
+MappedZipEntry::MappedZipEntry(void *mapping, size_t mapping_size, const char *data, uint64_t size)
+    : mapping(mapping), mapping_size(mapping_size), _data(data), _size(size)
+{
+}
+
+MappedZipEntry::~MappedZipEntry()
+{
+    munmap(mapping, mapping_size);
+}
+
+const char *MappedZipEntry::data() const
+{
+    return _data;
+}
+
+uint64_t MappedZipEntry::size() const
+{
+    return _size;
+}
+
+////////////////////////
+
+ZipArchive::ZipArchive(std::experimental::filesystem::path path)
+    : path(std::move(path))
+{
+}
+
+ZipArchive::~ZipArchive()
+{
+    if (zip)
+    {
+        zip_close(zip);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+bool ZipArchive::open()
+{
+    if (zip)
+    {
+        return true;
+    }
+
+    int err = 0;
+    zip = zip_open(path.c_str(), ZIP_RDONLY, &err);
+    if (zip == nullptr)
+    {
+        std::cerr << "Failed to open zip " << path << " code: " << err << std::endl;
+        return false;
+    }
+
+    zip_int64_t num_entries = zip_get_num_entries(zip, 0);
+    name_to_index.reserve(std::max<zip_int64_t>(num_entries, 0));
+    for (zip_int64_t i = 0; i < num_entries; ++i)
+    {
+        const char *name = zip_get_name(zip, i, 0);
+        if (name)
+        {
+            name_to_index.emplace(name, i);
+        }
+    }
+
+    index_stored_entries();
+
+    return true;
+}
+
+// libzip doesn't expose where entry data lives in the file, so locate
+// uncompressed entries from the central directory for mapping. Anything
+// unexpected (e.g. zip64 archives) just leaves entries unmappable.
+void ZipArchive::index_stored_entries()
+{
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < EOCD_SIZE)
+    {
+        return;
+    }
+    file_size = st.st_size;
+
+    // Find end of central directory record, which may be followed by a comment
+    uint32_t tail_size = std::min<uint64_t>(file_size, EOCD_SIZE + MAX_COMMENT_SIZE);
+    std::vector<unsigned char> tail(tail_size);
+    if (!read_exact(fd, tail.data(), tail_size, file_size - tail_size))
+    {
+        return;
+    }
+
+    const unsigned char *eocd = nullptr;
+    for (int64_t i = tail_size - EOCD_SIZE; i >= 0; --i)
+    {
+        // Comment must run to the end of the file, in case it contains the signature
+        if (read_u32(&tail[i]) == EOCD_SIGNATURE && read_u16(&tail[i] + 20) == tail_size - i - EOCD_SIZE)
+        {
+            eocd = &tail[i];
+            break;
+        }
+    }
+    if (!eocd)
+    {
+        return;
+    }
+
+    uint16_t num_entries = read_u16(eocd + 10);
+    uint32_t cd_size = read_u32(eocd + 12);
+    uint32_t cd_offset = read_u32(eocd + 16);
+    if (num_entries == 0xffff || cd_size == 0xffffffff || cd_offset == 0xffffffff || cd_offset + static_cast<uint64_t>(cd_size) > file_size)
+    {
+        return;
+    }
+
+    std::vector<unsigned char> cd(cd_size);
+    if (!read_exact(fd, cd.data(), cd_size, cd_offset))
+    {
+        return;
+    }
+
+    uint32_t pos = 0;
+    for (uint32_t i = 0; i < num_entries && pos + CENTRAL_HEADER_SIZE <= cd_size; ++i)
+    {
+        const unsigned char *header = &cd[pos];
+        if (read_u32(header) != CENTRAL_HEADER_SIGNATURE)
+        {
+            break;
+        }
+
+        uint16_t flags = read_u16(header + 8);
+        uint16_t method = read_u16(header + 10);
+        uint32_t compressed_size = read_u32(header + 20);
+        uint32_t size = read_u32(header + 24);
+        uint16_t name_len = read_u16(header + 28);
+        uint16_t extra_len = read_u16(header + 30);
+        uint16_t comment_len = read_u16(header + 32);
+        uint32_t local_header_offset = read_u32(header + 42);
+
+        uint32_t next_pos = pos + CENTRAL_HEADER_SIZE + name_len + extra_len + comment_len;
+        if (next_pos > cd_size)
+        {
+            break;
+        }
+
+        bool is_encrypted = flags & 1;
+        if (
+            method == ZIP_CM_STORE &&
+            !is_encrypted &&
+            compressed_size == size &&
+            size != 0xffffffff &&
+            local_header_offset != 0xffffffff &&
+            local_header_offset + static_cast<uint64_t>(LOCAL_HEADER_SIZE) + size <= file_size
+        )
+        {
+            std::string name(reinterpret_cast<const char *>(header + CENTRAL_HEADER_SIZE), name_len);
+            if (name_to_index.count(name))
+            {
+                stored_entries[name] = {local_header_offset, size};
+            }
+        }
+
+        pos = next_pos;
+    }
+}
+
+bool ZipArchive::is_open() const
+{
+    return zip != nullptr;
+}
+
+std::experimental::optional<uint64_t> ZipArchive::entry_index(const std::string &name) const
+{
+    auto it = name_to_index.find(name);
+    if (it == name_to_index.end())
+    {
+        return std::experimental::nullopt;
+    }
+    return it->second;
+}
+
+std::vector<std::string> ZipArchive::entry_names() const
+{
+    std::vector<std::pair<uint64_t, std::string>> indexed_names(name_to_index.size());
+    std::transform(
+        name_to_index.begin(),
+        name_to_index.end(),
+        indexed_names.begin(),
+        [](const auto &name_index) { return std::make_pair(name_index.second, name_index.first); }
+    );
+    std::sort(indexed_names.begin(), indexed_names.end());
+
+    std::vector<std::string> names;
+    names.reserve(indexed_names.size());
+    for (auto &index_name : indexed_names)
+    {
+        names.push_back(std::move(index_name.second));
+    }
+    return names;
+}
+
+uint64_t ZipArchive::compressed_size(const std::string &name) const
+{
+    auto index = entry_index(name);
+    zip_stat_t stats;
+    if (!index || zip_stat_index(zip, *index, 0, &stats) != 0 || !(stats.valid & ZIP_STAT_COMP_SIZE))
+    {
+        return 0;
+    }
+    return stats.comp_size;
+}
+
+std::vector<char> ZipArchive::read(const std::string &name) const
+{
+    if (zip == nullptr)
+    {
+        throw std::runtime_error("Zip is not open");
+    }
+
+    auto index = entry_index(name);
+    zip_stat_t stats;
+    if (!index || zip_stat_index(zip, *index, 0, &stats) != 0 || !(stats.valid & ZIP_STAT_SIZE))
+    {
+        std::cerr << "Unable to get size of " << name << " in zip" << std::endl;
+        return {};
+    }
+
+    zip_uint64_t size = stats.size;
+    std::vector<char> buffer(size + 1);
+
+    ZipEntryReader reader(zip, *index);
+    if (!reader.rewind())
+    {
+        std::cerr << "Unable to open " << name << " in zip" << std::endl;
+        return {};
+    }
+
+    auto read_size = reader.read(buffer.data(), size);
+    if ((zip_uint64_t)read_size != size)
+    {
+        std::cerr << "Read unexpected number of bytes for " << name << " in zip"
+            << " expected " << size
+            << " got " << read_size
+            << std::endl;
+    }
+
+    return buffer;
+}
+
+std::unique_ptr<ZipEntryReader> ZipArchive::open_entry(const std::string &name) const
+{
+    auto index = entry_index(name);
+    if (!index)
+    {
+        std::cerr << "Unable to find " << name << " in zip" << std::endl;
+        return nullptr;
+    }
+
+    auto reader = std::make_unique<ZipEntryReader>(zip, *index);
+    if (!reader->rewind())
+    {
+        std::cerr << "Unable to open " << name << " in zip" << std::endl;
+        return nullptr;
+    }
+    return reader;
+}
+
+std::unique_ptr<MappedZipEntry> ZipArchive::map_entry(const std::string &name) const
+{
+    auto it = stored_entries.find(name);
+    if (it == stored_entries.end() || it->second.size == 0)
+    {
+        return nullptr;
+    }
+    const auto &entry = it->second;
+
+    // Data follows the local header, whose variable length fields may differ
+    // from the central directory's
+    unsigned char header[LOCAL_HEADER_SIZE];
+    if (!read_exact(fd, header, LOCAL_HEADER_SIZE, entry.local_header_offset) || read_u32(header) != LOCAL_HEADER_SIGNATURE)
+    {
+        return nullptr;
+    }
+    uint64_t data_offset = entry.local_header_offset + LOCAL_HEADER_SIZE + read_u16(header + 26) + read_u16(header + 28);
+
+    // Sizes come from the archive, and touching a mapping past the end of the
+    // file faults rather than reading short
+    if (data_offset + entry.size > file_size)
+    {
+        return nullptr;
+    }
+
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    uint64_t map_offset = data_offset - data_offset % page_size;
+    size_t map_size = data_offset - map_offset + entry.size;
+
+    void *mapping = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, map_offset);
+    if (mapping == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    return std::make_unique<MappedZipEntry>(
+        mapping,
+        map_size,
+        static_cast<const char *>(mapping) + (data_offset - map_offset),
+        entry.size
+    );
+}
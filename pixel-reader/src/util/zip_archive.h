@@ -0,0 +1,99 @@
+#ifndef ZIP_ARCHIVE_H_
+#define ZIP_ARCHIVE_H_
+
+#include <cstdint>
+#include <experimental/filesystem>
+#include <experimental/optional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef struct zip zip_t;
+typedef struct zip_file zip_file_t;
+
+// Sequential reader for the contents of a zip entry. Inflates as it goes,
+// without buffering the whole entry.
+class ZipEntryReader
+{
+    zip_t *zip;
+    uint64_t index;
+    zip_file_t *file = nullptr;
+
+public:
+    ZipEntryReader(zip_t *zip, uint64_t index);
+    ZipEntryReader(const ZipEntryReader &) = delete;
+    ZipEntryReader &operator=(const ZipEntryReader &) = delete;
+    ~ZipEntryReader();
+
+    // Restart from the beginning of the entry
+    bool rewind();
+    // Read up to size bytes. Returns bytes read, 0 at the end, or -1 on error.
+    int64_t read(char *buf, uint64_t size);
+};
+
+// Contents of an uncompressed zip entry, mapped straight from the archive file
+class MappedZipEntry
+{
+    void *mapping;
+    size_t mapping_size;
+    const char *_data;
+    uint64_t _size;
+
+public:
+    MappedZipEntry(void *mapping, size_t mapping_size, const char *data, uint64_t size);
+    MappedZipEntry(const MappedZipEntry &) = delete;
+    MappedZipEntry &operator=(const MappedZipEntry &) = delete;
+    ~MappedZipEntry();
+
+    const char *data() const;
+    uint64_t size() const;
+};
+
+// Read-only access to a zip archive. Entry names are indexed once on open, so
+// lookups don't go through libzip's name resolution. Like the underlying
+// libzip handle, an archive must only be used from one thread at a time.
+class ZipArchive
+{
+    // Location of an uncompressed entry, from the central directory
+    struct StoredEntry
+    {
+        uint64_t local_header_offset;
+        uint64_t size;
+    };
+
+    std::experimental::filesystem::path path;
+    zip_t *zip = nullptr;
+    int fd = -1;
+    uint64_t file_size = 0;
+
+    std::unordered_map<std::string, uint64_t> name_to_index;
+    std::unordered_map<std::string, StoredEntry> stored_entries;
+
+    void index_stored_entries();
+
+public:
+    ZipArchive(std::experimental::filesystem::path path);
+    ZipArchive(const ZipArchive &) = delete;
+    ZipArchive &operator=(const ZipArchive &) = delete;
+    ~ZipArchive();
+
+    bool open();
+    bool is_open() const;
+
+    std::experimental::optional<uint64_t> entry_index(const std::string &name) const;
+    // Names of all entries, in archive order
+    std::vector<std::string> entry_names() const;
+    // Compressed size of the entry, or 0 if unknown
+    uint64_t compressed_size(const std::string &name) const;
+
+    // Entry contents followed by a null terminator. Empty if the entry can't be read.
+    std::vector<char> read(const std::string &name) const;
+    // Stream entry contents. nullptr if the entry can't be opened.
+    std::unique_ptr<ZipEntryReader> open_entry(const std::string &name) const;
+    // Map contents of an uncompressed entry. nullptr if the entry is
+    // compressed, or can't be mapped.
+    std::unique_ptr<MappedZipEntry> map_entry(const std::string &name) const;
+};
+
+#endif